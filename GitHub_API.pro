@@ -1,4 +1,4 @@
-QT       += core gui network
+QT       += core gui network concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -10,15 +10,97 @@ CONFIG += c++1z
 
 SOURCES += \
     InfoBeamer_API_Types.cpp \
+    account.cpp \
+    apiclient.cpp \
+    arrowexport.cpp \
+    assetsync.cpp \
+    bulkoperation.cpp \
     device.cpp \
+    devicedetails.cpp \
+    deviceexport.cpp \
+    devicequery.cpp \
+    devicesearchdialog.cpp \
+    fanout.cpp \
+    fleetaggregates.cpp \
+    fleetdiff.cpp \
+    fleetpoller.cpp \
+    fleetsegment.cpp \
+    fleetstore.cpp \
+    githubcrawler.cpp \
+    githubeventsync.cpp \
+    githublookup.cpp \
+    jsonflatten.cpp \
+    jsonindex.cpp \
+    jsonparser.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    memoryaccounting.cpp \
+    relationindex.cpp \
+    searchindex.cpp \
+    startuptrace.cpp \
+    statusserver.cpp \
+    streamdecoder.cpp \
+    supervisor.cpp
 
 HEADERS += \
     InfoBeamerParams.hpp \
     InfoBeamer_API_Types.hpp \
+    account.hpp \
+    apiclient.hpp \
+    arrowexport.hpp \
+    assetsync.hpp \
+    bulkoperation.hpp \
     device.hpp \
-    mainwindow.h
+    devicedetails.hpp \
+    deviceexport.hpp \
+    devicequery.hpp \
+    devicesearchdialog.hpp \
+    fanout.hpp \
+    fleetaggregates.hpp \
+    fleetdiff.hpp \
+    fleetpoller.hpp \
+    fleetsegment.hpp \
+    fleetstore.hpp \
+    githubcrawler.hpp \
+    githubeventsync.hpp \
+    githublookup.hpp \
+    jsonflatten.hpp \
+    jsonindex.hpp \
+    jsonparser.hpp \
+    mainwindow.h \
+    memoryaccounting.hpp \
+    relationindex.hpp \
+    rcu.hpp \
+    searchindex.hpp \
+    startuptrace.hpp \
+    statusserver.hpp \
+    streamdecoder.hpp \
+    supervisor.hpp
+
+# Content-Encoding decoders: zlib is required, brotli and zstd are used when pkg-config finds them
+unix|mingw: LIBS += -lz
+else: LIBS += zlib.lib
+packagesExist(libbrotlidec) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libbrotlidec
+    DEFINES += IB_HAVE_BROTLI
+}
+packagesExist(libzstd) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libzstd
+    DEFINES += IB_HAVE_ZSTD
+}
+
+# Columnar fleet export (.arrow/.parquet) when Apache Arrow C++ is installed
+packagesExist(arrow) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += arrow
+    DEFINES += IB_HAVE_ARROW
+    packagesExist(parquet) {
+        PKGCONFIG += parquet
+        DEFINES += IB_HAVE_PARQUET
+    }
+}
 
 FORMS += \
     mainwindow.ui
@@ -0,0 +1,88 @@
+#include "account.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QSet>
+#include <QStandardPaths>
+
+#include "InfoBeamerParams.hpp"
+#include "jsonparser.hpp"
+
+namespace InfoBeamer {
+
+QByteArray Account::basicAuth(const QString &apiKey)
+{
+    // info-beamer takes the key as the password with an empty user name
+    return "Basic "+(":"+apiKey).toUtf8().toBase64();
+}
+
+const Account &Account::builtIn()
+{
+    static const Account account{"default", basicAuth(QString::fromStdString(API_KEY)), QString()};
+    return account;
+}
+
+static QString readKeyFile(const QString &file, const QDir &base)
+{
+    QFile f(QFileInfo(file).isRelative() ? base.filePath(file) : file);
+    if(!f.open(QIODevice::ReadOnly))
+        throw AccountException("cannot read key file "+f.fileName().toStdString(), IBErrCode::BAD_JSON);
+    return QString::fromUtf8(f.readAll()).trimmed();
+}
+
+std::vector<Account> Account::load(const QString &path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        throw AccountException("cannot read accounts file "+path.toStdString(), IBErrCode::BAD_JSON);
+
+    QJsonParseError err;
+    const QJsonObject json=JsonParser::fromJson(file.readAll(), &err).object();
+    if(err.error!=QJsonParseError::NoError)
+        throw AccountException(path.toStdString()+": "+err.errorString().toStdString(), IBErrCode::BAD_JSON);
+    if(!json["accounts"].isArray())
+        throw AccountException(path.toStdString()+": \"accounts\" is not an Array", IBErrCode::BAD_JSON);
+
+    const QDir base=QFileInfo(path).absoluteDir();
+    std::vector<Account> accounts;
+    QSet<QString> names;
+    for(const auto &v: json["accounts"].toArray())
+    {
+        const QJsonObject a=v.toObject();
+        const QString name=a["name"].toString();
+        if(name.isEmpty())
+            throw AccountException(path.toStdString()+": account without \"name\"", IBErrCode::BAD_JSON);
+        if(names.contains(name))
+            throw AccountException(path.toStdString()+": duplicate account "+name.toStdString(), IBErrCode::BAD_JSON);
+        names.insert(name);
+
+        QString key;
+        if(a.contains("api_key"))
+            key=a["api_key"].toString();
+        else if(a.contains("api_key_file"))
+            key=readKeyFile(a["api_key_file"].toString(), base);
+        else if(a.contains("api_key_env"))
+            key=qEnvironmentVariable(a["api_key_env"].toString().toLocal8Bit().constData());
+        if(key.isEmpty())
+            throw AccountException(path.toStdString()+": no API key for "+name.toStdString(), IBErrCode::BAD_JSON);
+
+        QString url=a["api_url"].toString();
+        if(!url.isEmpty() && !url.endsWith('/'))
+            url+='/';
+        accounts.push_back(Account{name, basicAuth(key), url});
+    }
+    return accounts;
+}
+
+QString Account::configPath()
+{
+    const QString env=qEnvironmentVariable("IB_ACCOUNTS");
+    if(!env.isEmpty())
+        return env;
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation)).filePath("accounts.json");
+}
+
+}
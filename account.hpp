@@ -0,0 +1,51 @@
+#ifndef ACCOUNT_HPP
+#define ACCOUNT_HPP
+
+#include <QByteArray>
+#include <QString>
+
+#include <vector>
+
+#include "InfoBeamer_API_Types.hpp"
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The Account struct
+ * One info-beamer account: a display name, its precomputed Basic auth header and optionally its own API base URL.
+ */
+struct Account
+{
+    QString    name;
+    QByteArray authHeader;   //! Value for the Authorization header
+    QString    apiUrl;       //! Empty for ApiClient::infoBeamerBase()
+
+    //! The "Basic ..." header value for \a apiKey
+    static QByteArray basicAuth(const QString &apiKey);
+
+    //! The single account compiled in through InfoBeamerParams.hpp
+    static const Account &builtIn();
+
+    /*!
+     * \brief load
+     * Reads an accounts file:
+     *
+     *   {"accounts": [{"name": "acme", "api_key": "..."},
+     *                 {"name": "globex", "api_key_file": "keys/globex"},
+     *                 {"name": "initech", "api_key_env": "INITECH_KEY", "api_url": "https://..."}]}
+     *
+     * The key is given inline, read from a file (relative paths are taken from the accounts file's directory, so a
+     * keyring directory with one key per file works) or taken from an environment variable.  Throws
+     * AccountException when the file is unreadable or an entry is incomplete.
+     */
+    static std::vector<Account> load(const QString &path);
+
+    //! IB_ACCOUNTS if set, else accounts.json in the application's config directory
+    static QString configPath();
+};
+
+typedef IBException<struct Account> AccountException;
+
+}
+
+#endif // ACCOUNT_HPP
@@ -0,0 +1,10 @@
+# The app together with the tools around it: qmake all.pro && make
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    app \
+    indexbench \
+    jsonbench \
+    mockserver
+
+app.file = GitHub_API.pro
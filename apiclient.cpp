@@ -0,0 +1,279 @@
+#include "apiclient.hpp"
+
+#include <QDebug>
+#include <QHttp2Configuration>
+#include <QSslCertificate>
+#include <QSettings>
+
+#include "InfoBeamerParams.hpp"
+#include "account.hpp"
+
+namespace InfoBeamer {
+
+static const char TICKET_GROUP[]="tls/sessionTickets";
+
+//! Large responses (device/list, asset/list) should not stall on flow control
+static const int H2_SESSION_WINDOW=16*1024*1024;
+static const int H2_STREAM_WINDOW=8*1024*1024;
+
+static const int TRANSFER_TIMEOUT_MS=30000;
+
+static const char GITHUB_API_URL[]="https://api.github.com/";
+static const char GITHUB_AVATAR_URL[]="https://avatars.githubusercontent.com/";
+
+ApiClient::ApiClient(QObject *parent)
+    : QObject(parent)
+    , _manager(new QNetworkAccessManager(this))
+{
+    _clock.start();
+    loadTickets();
+    connect(_manager, &QNetworkAccessManager::encrypted, this, &ApiClient::onEncrypted);
+    connect(_manager, &QNetworkAccessManager::finished, this, &ApiClient::onFinished);
+}
+
+ApiClient::~ApiClient()
+{
+}
+
+static QString baseFromEnv(const char *var, const QString &fallback)
+{
+    QString base=qEnvironmentVariable(var, fallback);
+    if(!base.endsWith('/'))
+        base+='/';
+    return base;
+}
+
+QString ApiClient::infoBeamerBase()
+{
+    static const QString base=baseFromEnv("IB_API_URL", API_URL);
+    return base;
+}
+
+QString ApiClient::gitHubBase()
+{
+    static const QString base=baseFromEnv("IB_GITHUB_URL", GITHUB_API_URL);
+    return base;
+}
+
+QList<QUrl> ApiClient::knownOrigins()
+{
+    QList<QUrl> origins;
+    for(const QString &base: {infoBeamerBase(), gitHubBase()})
+    {
+        const QUrl url(base);
+        origins.append(url.adjusted(QUrl::RemovePath | QUrl::RemoveQuery));
+    }
+    // Avatars come from a separate host, except when GitHub is served by something local
+    if(gitHubBase()==GITHUB_API_URL)
+        origins.append(QUrl(GITHUB_AVATAR_URL).adjusted(QUrl::RemovePath));
+    return origins;
+}
+
+QString ApiClient::originOf(const QUrl &url)
+{
+    const int port=url.port(url.scheme()=="https" ? 443 : 80);
+    return url.scheme()+"://"+url.host()+":"+QString::number(port);
+}
+
+//! Certificates from IB_CA_CERTS, read once
+static const QList<QSslCertificate> &extraCaCertificates()
+{
+    static const QList<QSslCertificate> certs=qEnvironmentVariableIsSet("IB_CA_CERTS")
+            ? QSslCertificate::fromPath(qEnvironmentVariable("IB_CA_CERTS"))
+            : QList<QSslCertificate>();
+    return certs;
+}
+
+QSslConfiguration ApiClient::sslConfigurationFor(const QString &host) const
+{
+    QSslConfiguration conf=QSslConfiguration::defaultConfiguration();
+    if(!extraCaCertificates().isEmpty())
+        conf.addCaCertificates(extraCaCertificates());
+    conf.setAllowedNextProtocols({QSslConfiguration::ALPNProtocolHTTP2, QSslConfiguration::NextProtocolHttp1_1});
+    // Session persistence is off by default; without it Qt never hands out the ticket
+    conf.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    const auto t=_tickets.constFind(host);
+    if(t!=_tickets.constEnd())
+        conf.setSessionTicket(t.value());
+    return conf;
+}
+
+QNetworkRequest ApiClient::request(const QUrl &url) const
+{
+    QNetworkRequest req(url);
+    req.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+    req.setAttribute(QNetworkRequest::RedirectPolicyAttribute, QNetworkRequest::NoLessSafeRedirectPolicy);
+    req.setTransferTimeout(TRANSFER_TIMEOUT_MS);
+    req.setRawHeader("Accept-Encoding", StreamDecoder::acceptEncoding());
+
+    QHttp2Configuration h2;
+    h2.setSessionReceiveWindowSize(H2_SESSION_WINDOW);
+    h2.setStreamReceiveWindowSize(H2_STREAM_WINDOW);
+    req.setHttp2Configuration(h2);
+
+    if(url.scheme()=="https")
+        req.setSslConfiguration(sslConfigurationFor(url.host()));
+    return req;
+}
+
+QNetworkRequest ApiClient::infoBeamerRequest(const QString &path) const
+{
+    return infoBeamerRequest(path, Account::builtIn());
+}
+
+QNetworkRequest ApiClient::infoBeamerRequest(const QString &path, const Account &account) const
+{
+    QNetworkRequest req=request(QUrl((account.apiUrl.isEmpty() ? infoBeamerBase() : account.apiUrl)+path));
+    req.setRawHeader("Authorization", account.authHeader);
+    return req;
+}
+
+QNetworkRequest ApiClient::gitHubRequest(const QString &path) const
+{
+    return request(QUrl(gitHubBase()+path));
+}
+
+QUrl ApiClient::gitHubAvatarGuess(const QString &login)
+{
+    if(gitHubBase()==GITHUB_API_URL)
+        return QUrl(GITHUB_AVATAR_URL+login);
+    return QUrl(gitHubBase()).resolved(QUrl("/avatars/"+login+".png"));
+}
+
+QNetworkReply *ApiClient::get(const QNetworkRequest &req)
+{
+    return track(_manager->get(req));
+}
+
+QNetworkReply *ApiClient::post(const QNetworkRequest &req, const QByteArray &body)
+{
+    QNetworkRequest r(req);
+    if(r.header(QNetworkRequest::ContentTypeHeader).isNull())
+        r.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+    return track(_manager->post(r, body));
+}
+
+QNetworkReply *ApiClient::track(QNetworkReply *reply)
+{
+    _started.insert(reply, _clock.elapsed());
+    _stats.requests++;
+    return reply;
+}
+
+bool ApiClient::read(QNetworkReply *reply, QByteArray &out)
+{
+    auto d=_decoders.find(reply);
+    const bool first=d==_decoders.end();
+    if(first)
+    {
+        const auto e=StreamDecoder::fromHeader(reply->rawHeader("Content-Encoding"));
+        if(e!=StreamDecoder::Encoding::Identity)
+            _stats.compressed++;
+        d=_decoders.emplace(reply, std::make_unique<StreamDecoder>(e)).first;
+        // A failed decoder stays until the reply is gone, so a later call cannot pass off the rest of the body
+        connect(reply, &QObject::destroyed, this, [this, reply]{_decoders.erase(reply);});
+    }
+    StreamDecoder &decoder=*d->second;
+    // Reported when it failed; an unsupported encoding fails right away and is reported below
+    if(decoder.failed() && !first)
+        return false;
+
+    const QByteArray chunk=reply->readAll();
+    const qsizetype before=out.size();
+    bool ok=decoder.feed(chunk, out);
+    _stats.wireBytes+=quint64(chunk.size());
+    _stats.decodedBytes+=quint64(out.size()-before);
+    if(ok && reply->isFinished() && reply->bytesAvailable()==0 && reply->error()==QNetworkReply::NoError)
+        ok=decoder.finish();
+
+    if(!ok)
+    {
+        qDebug() << __func__ << "cannot decode" << reply->rawHeader("Content-Encoding") << "body from" << reply->url();
+        _stats.decodeErrors++;
+        return false;
+    }
+    return true;
+}
+
+QString ApiClient::errorString(QNetworkReply *reply) const
+{
+    const auto d=_decoders.find(reply);
+    if(reply->error()==QNetworkReply::NoError && d!=_decoders.end() && d->second->failed())
+        return QString("corrupt or truncated %1 body").arg(QString::fromLatin1(reply->rawHeader("Content-Encoding")));
+    return reply->errorString();
+}
+
+void ApiClient::warmUp()
+{
+    for(const auto &origin: knownOrigins())
+    {
+        const QString host=origin.host();
+        if(origin.scheme()=="https")
+        {
+            _manager->connectToHostEncrypted(host, quint16(origin.port(443)), sslConfigurationFor(host));
+        }
+        else
+            _manager->connectToHost(host, quint16(origin.port(80)));
+        _stats.warmUps++;
+    }
+    emit statsChanged();
+}
+
+void ApiClient::onEncrypted(QNetworkReply *reply)
+{
+    // Warm-up connections are replies of the manager too, so each handshake is counted here once
+    _stats.handshakes++;
+    if(!reply->request().sslConfiguration().sessionTicket().isEmpty())
+        _stats.ticketsOffered++;
+}
+
+void ApiClient::onFinished(QNetworkReply *reply)
+{
+    const auto s=_started.find(reply);
+    if(s!=_started.end())
+    {
+        const qint64 latency=_clock.elapsed()-s.value();
+        _started.erase(s);
+        if(_stats.firstLatencyMs<0)
+            _stats.firstLatencyMs=latency;
+        else
+        {
+            _stats.totalLatencyMs+=latency;
+            _stats.timed++;
+        }
+    }
+    _stats.finished++;
+    if(reply->attribute(QNetworkRequest::Http2WasUsedAttribute).toBool())
+    {
+        _stats.http2++;
+        _http2Origins.insert(originOf(reply->url()));
+    }
+
+    const QString host=reply->url().host();
+    const QByteArray ticket=reply->sslConfiguration().sessionTicket();
+    if(!ticket.isEmpty() && _tickets.value(host)!=ticket)
+        saveTicket(host, ticket);
+
+    emit statsChanged();
+}
+
+void ApiClient::loadTickets()
+{
+    QSettings settings;
+    settings.beginGroup(TICKET_GROUP);
+    for(const auto &host: settings.childKeys())
+        _tickets.insert(host, settings.value(host).toByteArray());
+    settings.endGroup();
+}
+
+void ApiClient::saveTicket(const QString &host, const QByteArray &ticket)
+{
+    _tickets.insert(host, ticket);
+    QSettings settings;
+    settings.beginGroup(TICKET_GROUP);
+    settings.setValue(host, ticket);
+    settings.endGroup();
+    _stats.ticketsSaved++;
+}
+
+}
@@ -0,0 +1,160 @@
+#ifndef APICLIENT_HPP
+#define APICLIENT_HPP
+
+#include <QObject>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QSslConfiguration>
+#include <QList>
+#include <QSet>
+#include <QUrl>
+
+#include <memory>
+#include <unordered_map>
+
+#include "streamdecoder.hpp"
+
+namespace InfoBeamer {
+
+struct Account;
+
+/*!
+ * \brief The ApiClient class
+ * Owns the QNetworkAccessManager used for every info-beamer and GitHub call and builds requests with the same
+ * tuned attributes, so they all land on the same cached (HTTP/2 where the server offers it) connection.
+ *
+ * warmUp() pre-connects to the known hosts so the first click does not pay DNS, TCP and TLS setup.  TLS session
+ * tickets handed out by the servers are persisted in QSettings and offered again on the next start.  IB_CA_CERTS
+ * names a PEM file of extra certificates to trust, e.g. the self-signed one of the mock server's TLS mode.
+ *
+ * Compression is negotiated explicitly (see StreamDecoder::acceptEncoding()), which turns off Qt's own buffered
+ * decompression; callers pull response bytes through read(), which decodes them chunk by chunk as they arrive.
+ */
+class ApiClient : public QObject
+{
+    Q_OBJECT
+public:
+    /*!
+     * \brief The Stats struct
+     * Connection reuse figures.  Qt does not report reuse directly: every new TLS connection emits
+     * QNetworkAccessManager::encrypted(), so requests that did not trigger one rode on an existing connection.
+     */
+    struct Stats
+    {
+        quint64 requests=0;         //! Requests issued through get() and post()
+        quint64 finished=0;         //! Replies that completed, successfully or not
+        quint64 handshakes=0;       //! Full TLS handshakes for replies (new connections)
+        quint64 http2=0;            //! Replies that were served over HTTP/2
+        quint64 warmUps=0;          //! Pre-connects issued by warmUp()
+        quint64 ticketsOffered=0;   //! Handshakes started with a persisted session ticket
+        quint64 ticketsSaved=0;     //! New session tickets stored
+        qint64  firstLatencyMs=-1;  //! Latency of the first reply, -1 until it arrives
+        qint64  totalLatencyMs=0;   //! Sum over timed replies but the first
+        quint64 timed=0;            //! Replies in totalLatencyMs; warm-ups and foreign replies are not timed
+        quint64 wireBytes=0;        //! Response body bytes as received
+        quint64 decodedBytes=0;     //! Response body bytes after Content-Encoding was undone
+        quint64 compressed=0;       //! Replies that arrived with a Content-Encoding
+        quint64 decodeErrors=0;     //! Replies whose body could not be decoded
+
+        quint64 reused() const {return finished>handshakes ? finished-handshakes : 0;}
+        double steadyLatencyMs() const {return timed ? double(totalLatencyMs)/double(timed) : 0.0;}
+        double compressionRatio() const {return wireBytes ? double(decodedBytes)/double(wireBytes) : 1.0;}
+    };
+
+    explicit ApiClient(QObject *parent=nullptr);
+    ~ApiClient();
+
+    /*!
+     * \brief request
+     * Returns a request for \a url carrying the client's HTTP/2, redirect and TLS settings.
+     */
+    QNetworkRequest request(const QUrl &url) const;
+
+    /*!
+     * \brief infoBeamerRequest
+     * Like request(), for \a path relative to infoBeamerBase(), authenticated as Account::builtIn().
+     */
+    QNetworkRequest infoBeamerRequest(const QString &path) const;
+
+    //! Like infoBeamerRequest(), authenticated as \a account and against its own API URL if it has one
+    QNetworkRequest infoBeamerRequest(const QString &path, const Account &account) const;
+
+    //! Like request(), for \a path relative to gitHubBase()
+    QNetworkRequest gitHubRequest(const QString &path) const;
+
+    /*!
+     * \brief gitHubAvatarGuess
+     * Where the avatar of \a login can be fetched without knowing the profile: the avatar host serves avatars by login
+     * as well as by user id.  Against a local GitHub stand-in (IB_GITHUB_URL) it is /avatars/{login}.png there.
+     */
+    static QUrl gitHubAvatarGuess(const QString &login);
+
+    QNetworkReply *get(const QNetworkRequest &req);
+    //! Like get(); \a body is sent form encoded unless \a req sets a Content-Type
+    QNetworkReply *post(const QNetworkRequest &req, const QByteArray &body=QByteArray());
+
+    /*!
+     * \brief read
+     * Reads everything \a reply has buffered, decodes it according to its Content-Encoding and appends the result to
+     * \a out.  Meant to be called from the reply's readyRead and finished handlers; the finished handler must check
+     * the result.  Returns false if the body is corrupt, was cut off before the end of the compressed stream or uses
+     * an encoding that was not negotiated.  Once false, it stays false for \a reply.
+     */
+    bool read(QNetworkReply *reply, QByteArray &out);
+
+    //! The reply's error, or why read() rejected its body
+    QString errorString(QNetworkReply *reply) const;
+
+    /*!
+     * \brief warmUp
+     * Opens connections to knownOrigins() in the background.  Safe to call more than once.
+     */
+    void warmUp();
+
+    /*!
+     * \brief infoBeamerBase
+     * API_URL, unless IB_API_URL is set in the environment.  Together with IB_GITHUB_URL for gitHubBase() this points
+     * the client at another server, e.g. the mock server in mockserver/, without touching anything else on the
+     * request path.  Both always end with a '/'.
+     */
+    static QString infoBeamerBase();
+    static QString gitHubBase();
+
+    //! Scheme, host and port of every server the client talks to
+    static QList<QUrl> knownOrigins();
+
+    //! The server \a url points at has answered over HTTP/2; other origins, e.g. GitHub's, say nothing about it
+    bool speaksHttp2(const QUrl &url) const {return _http2Origins.contains(originOf(url));}
+
+    const Stats &stats() const {return _stats;}
+    QNetworkAccessManager *manager() const {return _manager;}
+
+signals:
+    void statsChanged();
+
+private slots:
+    void onEncrypted(QNetworkReply *reply);
+    void onFinished(QNetworkReply *reply);
+
+private:
+    static QString originOf(const QUrl &url);
+    QSslConfiguration sslConfigurationFor(const QString &host) const;
+    QNetworkReply *track(QNetworkReply *reply);
+    void loadTickets();
+    void saveTicket(const QString &host, const QByteArray &ticket);
+
+    QNetworkAccessManager          *_manager;
+    QHash<QString, QByteArray>      _tickets;   //! Session ticket per host
+    QSet<QString>                   _http2Origins;
+    QHash<QNetworkReply *, qint64>  _started;   //! Reply start times, ms on _clock
+    QElapsedTimer                   _clock;
+    std::unordered_map<QNetworkReply *, std::unique_ptr<StreamDecoder>> _decoders;  //! Until the reply is destroyed
+    Stats                           _stats;
+};
+
+}
+
+#endif // APICLIENT_HPP
@@ -0,0 +1,315 @@
+#include "arrowexport.hpp"
+
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QJsonObject>
+
+#ifdef IB_HAVE_ARROW
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+#ifdef IB_HAVE_PARQUET
+#include <parquet/arrow/writer.h>
+#endif
+#endif
+
+namespace InfoBeamer {
+
+#ifdef IB_HAVE_ARROW
+
+namespace {
+
+using arrow::Status;
+
+typedef arrow::StringDictionary32Builder DictBuilder;
+
+std::shared_ptr<arrow::DataType> utcSeconds()
+{
+    return arrow::timestamp(arrow::TimeUnit::SECOND, "UTC");
+}
+
+std::shared_ptr<arrow::ListBuilder> stringList(arrow::MemoryPool *pool)
+{
+    return std::make_shared<arrow::ListBuilder>(pool, std::make_shared<arrow::StringBuilder>(pool));
+}
+
+Status appendStrings(arrow::ListBuilder &b, const std::vector<std::string> &v)
+{
+    ARROW_RETURN_NOT_OK(b.Append());
+    auto *values=static_cast<arrow::StringBuilder *>(b.value_builder());
+    for(const auto &s: v)
+        ARROW_RETURN_NOT_OK(values->Append(s));
+    return Status::OK();
+}
+
+/*!
+ * \brief The StructColumn struct
+ * A StructBuilder together with its children, so rows can be appended field by field and null rows can null
+ * every child (which every Arrow version accepts).
+ */
+struct StructColumn
+{
+    std::vector<std::shared_ptr<arrow::ArrayBuilder>> children;
+    std::shared_ptr<arrow::StructBuilder>             builder;
+
+    StructColumn(arrow::MemoryPool *pool, const std::vector<std::string> &names,
+                 std::vector<std::shared_ptr<arrow::ArrayBuilder>> fields)
+        : children(std::move(fields))
+    {
+        arrow::FieldVector f;
+        for(size_t i=0; i<names.size(); i++)
+            f.push_back(arrow::field(names[i], children[i]->type()));
+        builder=std::make_shared<arrow::StructBuilder>(arrow::struct_(f), pool, children);
+    }
+
+    template<class B>
+    B &child(size_t i) {return static_cast<B &>(*children[i]);}
+
+    Status appendNull()
+    {
+        ARROW_RETURN_NOT_OK(builder->Append(false));
+        for(auto &c: children)
+            ARROW_RETURN_NOT_OK(c->AppendNull());
+        return Status::OK();
+    }
+};
+
+/*!
+ * \brief The FleetColumns class
+ * One builder per top level column of the fleet schema.
+ */
+class FleetColumns
+{
+public:
+    explicit FleetColumns(arrow::MemoryPool *pool)
+        : _id(pool), _description(pool), _location(pool), _serial(pool), _status(pool)
+        , _isOnline(pool), _isSynced(pool), _maintenance(stringList(pool))
+        , _run(pool, {"channel", "public_addr", "resolution", "restarted", "tag", "version", "pi_revision", "features"},
+               {std::make_shared<DictBuilder>(pool), std::make_shared<arrow::StringBuilder>(pool),
+                std::make_shared<arrow::StringBuilder>(pool), std::make_shared<arrow::TimestampBuilder>(utcSeconds(), pool),
+                std::make_shared<DictBuilder>(pool), std::make_shared<DictBuilder>(pool),
+                std::make_shared<arrow::StringBuilder>(pool), stringList(pool)})
+        , _userdata(pool), _reboot(pool)
+        , _geo(pool, {"lat", "lon", "source"},
+               {std::make_shared<arrow::DoubleBuilder>(pool), std::make_shared<arrow::DoubleBuilder>(pool),
+                std::make_shared<DictBuilder>(pool)})
+        , _setup(pool, {"id", "name", "updated"},
+                 {std::make_shared<arrow::Int64Builder>(pool), std::make_shared<arrow::StringBuilder>(pool),
+                  std::make_shared<arrow::TimestampBuilder>(utcSeconds(), pool)})
+        , _hw(pool, {"type", "model", "memory", "platform", "features"},
+              {std::make_shared<DictBuilder>(pool), std::make_shared<DictBuilder>(pool),
+               std::make_shared<arrow::Int32Builder>(pool), std::make_shared<DictBuilder>(pool), stringList(pool)})
+        , _offline(pool, {"licensed", "plan", "max_offline", "chargeable"},
+                   {std::make_shared<arrow::BooleanBuilder>(pool), std::make_shared<arrow::StringBuilder>(pool),
+                    std::make_shared<arrow::Int32Builder>(pool), std::make_shared<arrow::Int32Builder>(pool)})
+        , _upgradeBlocked(pool)
+    {
+    }
+
+    Status reserve(int64_t n)
+    {
+        ARROW_RETURN_NOT_OK(_id.Reserve(n));
+        ARROW_RETURN_NOT_OK(_isOnline.Reserve(n));
+        ARROW_RETURN_NOT_OK(_isSynced.Reserve(n));
+        ARROW_RETURN_NOT_OK(_reboot.Reserve(n));
+        return _upgradeBlocked.Reserve(n);
+    }
+
+    Status append(const Device &d)
+    {
+        ARROW_RETURN_NOT_OK(_id.Append(d.id()));
+        ARROW_RETURN_NOT_OK(_description.Append(d.description()));
+        ARROW_RETURN_NOT_OK(_location.Append(d.location()));
+        ARROW_RETURN_NOT_OK(_serial.Append(d.serial()));
+        ARROW_RETURN_NOT_OK(_status.Append(d.status()));
+        ARROW_RETURN_NOT_OK(_isOnline.Append(d.isOnline()));
+        ARROW_RETURN_NOT_OK(d.isSynced() ? _isSynced.Append(*d.isSynced()) : _isSynced.AppendNull());
+        ARROW_RETURN_NOT_OK(appendStrings(*_maintenance, d.maintenance()));
+
+        const Device::RunObject &run=d.run();
+        ARROW_RETURN_NOT_OK(_run.builder->Append());
+        ARROW_RETURN_NOT_OK(_run.child<DictBuilder>(0).Append(run.channel));
+        ARROW_RETURN_NOT_OK(_run.child<arrow::StringBuilder>(1).Append(run.public_addr));
+        ARROW_RETURN_NOT_OK(_run.child<arrow::StringBuilder>(2).Append(run.resolution));
+        ARROW_RETURN_NOT_OK(_run.child<arrow::TimestampBuilder>(3).Append(int64_t(run.restarted)));
+        ARROW_RETURN_NOT_OK(_run.child<DictBuilder>(4).Append(run.tag));
+        ARROW_RETURN_NOT_OK(_run.child<DictBuilder>(5).Append(run.version));
+        ARROW_RETURN_NOT_OK(_run.child<arrow::StringBuilder>(6).Append(run.pi_revision));
+        ARROW_RETURN_NOT_OK(appendStrings(_run.child<arrow::ListBuilder>(7), run.features));
+
+        if(const QJsonValue *u=d.userdata())
+            ARROW_RETURN_NOT_OK(_userdata.Append(userdataJson(*u)));
+        else
+            ARROW_RETURN_NOT_OK(_userdata.AppendNull());
+        ARROW_RETURN_NOT_OK(_reboot.Append(int8_t(d.reboot())));
+
+        if(const Device::Geo *g=d.geo())
+        {
+            ARROW_RETURN_NOT_OK(_geo.builder->Append());
+            ARROW_RETURN_NOT_OK(_geo.child<arrow::DoubleBuilder>(0).Append(g->lat));
+            ARROW_RETURN_NOT_OK(_geo.child<arrow::DoubleBuilder>(1).Append(g->lon));
+            ARROW_RETURN_NOT_OK(_geo.child<DictBuilder>(2).Append(g->source));
+        }
+        else
+            ARROW_RETURN_NOT_OK(_geo.appendNull());
+
+        if(const Device::Setup *s=d.setup())
+        {
+            ARROW_RETURN_NOT_OK(_setup.builder->Append());
+            ARROW_RETURN_NOT_OK(_setup.child<arrow::Int64Builder>(0).Append(s->id));
+            ARROW_RETURN_NOT_OK(_setup.child<arrow::StringBuilder>(1).Append(s->name));
+            ARROW_RETURN_NOT_OK(_setup.child<arrow::TimestampBuilder>(2).Append(int64_t(s->updated)));
+        }
+        else
+            ARROW_RETURN_NOT_OK(_setup.appendNull());
+
+        if(const Device::Hw *h=d.hw())
+        {
+            ARROW_RETURN_NOT_OK(_hw.builder->Append());
+            ARROW_RETURN_NOT_OK(_hw.child<DictBuilder>(0).Append(h->hw_type));
+            ARROW_RETURN_NOT_OK(_hw.child<DictBuilder>(1).Append(h->model));
+            ARROW_RETURN_NOT_OK(_hw.child<arrow::Int32Builder>(2).Append(h->memory));
+            ARROW_RETURN_NOT_OK(_hw.child<DictBuilder>(3).Append(h->platform));
+            ARROW_RETURN_NOT_OK(appendStrings(_hw.child<arrow::ListBuilder>(4), h->features));
+        }
+        else
+            ARROW_RETURN_NOT_OK(_hw.appendNull());
+
+        const Device::Offline &off=d.offline();
+        ARROW_RETURN_NOT_OK(_offline.builder->Append());
+        ARROW_RETURN_NOT_OK(_offline.child<arrow::BooleanBuilder>(0).Append(off.licensed));
+        ARROW_RETURN_NOT_OK(_offline.child<arrow::StringBuilder>(1).Append(off.plan));
+        ARROW_RETURN_NOT_OK(_offline.child<arrow::Int32Builder>(2).Append(off.max_offline));
+        ARROW_RETURN_NOT_OK(_offline.child<arrow::Int32Builder>(3).Append(off.chargeable));
+
+        return _upgradeBlocked.Append(d.upgradeBlocked());
+    }
+
+    Status finish(std::shared_ptr<arrow::Schema> &schema, arrow::ArrayVector &columns)
+    {
+        const std::vector<std::pair<const char *, arrow::ArrayBuilder *>> all={
+            {"id", &_id}, {"description", &_description}, {"location", &_location}, {"serial", &_serial},
+            {"status", &_status}, {"is_online", &_isOnline}, {"is_synced", &_isSynced},
+            {"maintenance", _maintenance.get()}, {"run", _run.builder.get()}, {"userdata", &_userdata},
+            {"reboot", &_reboot}, {"geo", _geo.builder.get()}, {"setup", _setup.builder.get()},
+            {"hw", _hw.builder.get()}, {"offline", _offline.builder.get()}, {"upgrade_blocked", &_upgradeBlocked}};
+
+        arrow::FieldVector fields;
+        for(const auto &c: all)
+        {
+            std::shared_ptr<arrow::Array> a;
+            ARROW_RETURN_NOT_OK(c.second->Finish(&a));
+            fields.push_back(arrow::field(c.first, a->type()));
+            columns.push_back(std::move(a));
+        }
+        schema=arrow::schema(fields);
+        return Status::OK();
+    }
+
+private:
+    static std::string userdataJson(const QJsonValue &v)
+    {
+        // QJsonDocument only serializes containers; wrap and strip so scalars come out as plain JSON too
+        const QByteArray wrapped=QJsonDocument(QJsonArray{v}).toJson(QJsonDocument::Compact);
+        return wrapped.mid(1, wrapped.size()-2).toStdString();
+    }
+
+    arrow::Int64Builder                 _id;
+    arrow::StringBuilder                _description;
+    arrow::StringBuilder                _location;
+    arrow::StringBuilder                _serial;
+    arrow::StringBuilder                _status;
+    arrow::BooleanBuilder               _isOnline;
+    arrow::BooleanBuilder               _isSynced;
+    std::shared_ptr<arrow::ListBuilder> _maintenance;
+    StructColumn                        _run;
+    arrow::StringBuilder                _userdata;
+    arrow::Int8Builder                  _reboot;
+    StructColumn                        _geo;
+    StructColumn                        _setup;
+    StructColumn                        _hw;
+    StructColumn                        _offline;
+    arrow::Int32Builder                 _upgradeBlocked;
+};
+
+Status writeFleet(const std::vector<Device> &devices, ArrowExporter::Format f, const std::string &path)
+{
+    arrow::MemoryPool *pool=arrow::default_memory_pool();
+    FleetColumns columns(pool);
+    ARROW_RETURN_NOT_OK(columns.reserve(int64_t(devices.size())));
+    for(const auto &d: devices)
+        ARROW_RETURN_NOT_OK(columns.append(d));
+
+    std::shared_ptr<arrow::Schema> schema;
+    arrow::ArrayVector arrays;
+    ARROW_RETURN_NOT_OK(columns.finish(schema, arrays));
+
+    ARROW_ASSIGN_OR_RAISE(auto out, arrow::io::FileOutputStream::Open(path));
+    if(f==ArrowExporter::Format::Parquet)
+    {
+#ifdef IB_HAVE_PARQUET
+        const auto table=arrow::Table::Make(schema, arrays, int64_t(devices.size()));
+        ARROW_RETURN_NOT_OK(parquet::arrow::WriteTable(*table, pool, out, 64*1024));
+#else
+        return Status::NotImplemented("built without Parquet support");
+#endif
+    }
+    else
+    {
+        const auto batch=arrow::RecordBatch::Make(schema, int64_t(devices.size()), arrays);
+        ARROW_ASSIGN_OR_RAISE(auto writer, arrow::ipc::MakeFileWriter(out, schema));
+        ARROW_RETURN_NOT_OK(writer->WriteRecordBatch(*batch));
+        ARROW_RETURN_NOT_OK(writer->Close());
+    }
+    return out->Close();
+}
+
+}
+
+#endif
+
+bool ArrowExporter::available()
+{
+#ifdef IB_HAVE_ARROW
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool ArrowExporter::available(Format f)
+{
+#ifdef IB_HAVE_PARQUET
+    return available();
+#else
+    return available() && f==Format::ArrowIpc;
+#endif
+}
+
+ArrowExporter::Format ArrowExporter::formatForPath(const std::string &path)
+{
+    static const std::string PARQUET=".parquet";
+    if(path.size()>=PARQUET.size() && path.compare(path.size()-PARQUET.size(), PARQUET.size(), PARQUET)==0)
+        return Format::Parquet;
+    return Format::ArrowIpc;
+}
+
+bool ArrowExporter::exportAll(const std::vector<Device> &devices, Format f, const std::string &path,
+                              std::string *error)
+{
+#ifdef IB_HAVE_ARROW
+    const arrow::Status st=writeFleet(devices, f, path);
+    if(!st.ok() && error!=nullptr)
+        *error=st.ToString();
+    return st.ok();
+#else
+    (void)devices;
+    (void)f;
+    (void)path;
+    if(error!=nullptr)
+        *error="built without Apache Arrow support";
+    return false;
+#endif
+}
+
+}
@@ -0,0 +1,44 @@
+#ifndef ARROWEXPORT_HPP
+#define ARROWEXPORT_HPP
+
+#include <string>
+#include <vector>
+
+#include "device.hpp"
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The ArrowExporter class
+ * Columnar export of a fleet snapshot as an Arrow IPC file (.arrow / .feather) or Parquet (.parquet).
+ *
+ * The Device model maps onto typed columns: run, geo, setup, hw and offline become struct columns (null where the
+ * API returned null), string lists become list<utf8>, timestamps are timestamp[s, UTC] and the low cardinality
+ * strings (channel, tag, version, hw type/model/platform, geo source) are dictionary encoded.  userdata is kept as
+ * its JSON text since it has no fixed schema.
+ *
+ * Needs Apache Arrow C++ (and parquet for .parquet), picked up by qmake through pkg-config as IB_HAVE_ARROW /
+ * IB_HAVE_PARQUET.  Without them available() is false and exportAll() fails with an explanatory error.
+ */
+class ArrowExporter
+{
+public:
+    enum class Format
+    {
+        ArrowIpc=0,
+        Parquet
+    };
+
+    static bool available();
+    static bool available(Format f);
+
+    //! .parquet selects Parquet, anything else the Arrow IPC file format
+    static Format formatForPath(const std::string &path);
+
+    static bool exportAll(const std::vector<Device> &devices, Format f, const std::string &path,
+                          std::string *error=nullptr);
+};
+
+}
+
+#endif // ARROWEXPORT_HPP
@@ -0,0 +1,658 @@
+#include "assetsync.hpp"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QNetworkReply>
+#include <QSaveFile>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+#include "apiclient.hpp"
+#include "jsonparser.hpp"
+
+namespace InfoBeamer {
+
+static const char MANIFEST[]=".assetsync.json";
+//! Bounded, so a reply the token bucket holds back stops reading from its connection
+static const qint64 READ_BUFFER=256*1024;
+static const int MAX_ATTEMPTS=3;
+static const int REFILL_INTERVAL_MS=20;
+static const int PROGRESS_INTERVAL_MS=100;
+
+static QJsonObject readJson(const QString &path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return QJsonObject();
+    return JsonParser::fromJson(file.readAll()).object();
+}
+
+static bool writeJson(const QString &path, const QJsonObject &obj)
+{
+    QSaveFile file(path);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+AssetSync::AssetSync(ApiClient *api, QObject *parent)
+    : QObject(parent)
+    , _api(api)
+{
+    _refill.setInterval(REFILL_INTERVAL_MS);
+    connect(&_refill, &QTimer::timeout, this, &AssetSync::refill);
+}
+
+AssetSync::~AssetSync()
+{
+    cancel();
+}
+
+QList<AssetSync::Asset> AssetSync::fromList(const QJsonObject &assetList)
+{
+    QList<Asset> assets;
+    for(const QJsonValue &v: assetList.value("assets").toArray())
+    {
+        const QJsonObject o=v.toObject();
+        Asset a;
+        a.id=o.value("id").toInteger();
+        a.filename=o.value("filename").toString();
+        a.size=o.value("size").toInteger();
+        a.md5=o.value("md5").toString().toLatin1().toLower();
+        if(a.id>0 && !a.filename.isEmpty())
+            assets.append(a);
+    }
+    return assets;
+}
+
+QString AssetSync::fileName(const Asset &asset)
+{
+    // The id prefix keeps names unique and never lets one start with a dot
+    QString name=asset.filename;
+    name.replace('/', '_').replace('\\', '_');
+    return QString("%1-%2").arg(asset.id).arg(name);
+}
+
+QString AssetSync::pathFor(const Asset &asset) const
+{
+    return QDir(_dir).filePath(fileName(asset));
+}
+
+void AssetSync::setMaxParallel(int n)
+{
+    _maxParallel=qMax(1, n);
+    pump();
+}
+
+void AssetSync::setRateLimit(qint64 bytesPerSecond)
+{
+    _rate=qMax<qint64>(0, bytesPerSecond);
+    _tokens=burst();
+    _lastRefill.start();
+    // Lets replies held back by the old limit continue
+    refill();
+}
+
+QByteArray AssetSync::md5Of(const QString &path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    QCryptographicHash md5(QCryptographicHash::Md5);
+    if(!md5.addData(&file))
+        return QByteArray();
+    return md5.result().toHex();
+}
+
+QJsonObject AssetSync::manifestEntry(const QString &path, const QByteArray &md5)
+{
+    const QFileInfo info(path);
+    return QJsonObject{
+        {"size", info.size()},
+        {"mtime", info.lastModified().toMSecsSinceEpoch()},
+        {"md5", QString::fromLatin1(md5)}};
+}
+
+AssetSync::Plan AssetSync::plan(const QList<Asset> &assets, const QString &dir, QJsonObject manifest)
+{
+    Plan p;
+    const QDir d(dir);
+
+    // Manifest entries only count while the file still has the size and mtime it was hashed with
+    QHash<QByteArray, QString> have;    //! md5 -> verified file with that content
+    for(const QString &name: manifest.keys())
+    {
+        const QJsonObject e=manifest.value(name).toObject();
+        const QFileInfo info(d.filePath(name));
+        if(!info.isFile() || info.size()!=e.value("size").toInteger()
+                || info.lastModified().toMSecsSinceEpoch()!=e.value("mtime").toInteger())
+            manifest.remove(name);
+        else
+            have.insert(e.value("md5").toString().toLatin1(), info.filePath());
+    }
+
+    for(const Asset &a: assets)
+    {
+        const QString name=fileName(a);
+        const QString path=d.filePath(name);
+        const QFileInfo info(path);
+        QByteArray md5=manifest.value(name).toObject().value("md5").toString().toLatin1();
+        if(md5.isEmpty() && info.isFile() && info.size()==a.size)
+        {
+            if(a.md5.isEmpty())
+            {
+                // Nothing to compare with; the right size has to do
+                p.upToDate++;
+                continue;
+            }
+            md5=md5Of(path);
+            if(!md5.isEmpty())
+            {
+                manifest.insert(name, manifestEntry(path, md5));
+                have.insert(md5, path);
+            }
+        }
+        if(!md5.isEmpty() && md5==a.md5)
+        {
+            p.upToDate++;
+            continue;
+        }
+
+        const auto source=a.md5.isEmpty() ? have.constEnd() : have.constFind(a.md5);
+        if(source!=have.constEnd())
+        {
+            const QString tmp=path+".copy";
+            QFile::remove(tmp);
+            if(QFile::copy(source.value(), tmp) && (!QFile::exists(path) || QFile::remove(path))
+                    && QFile::rename(tmp, path))
+            {
+                manifest.insert(name, manifestEntry(path, a.md5));
+                p.copied++;
+                continue;
+            }
+            QFile::remove(tmp);
+        }
+        p.download.append(a);
+    }
+    p.manifest=manifest;
+    return p;
+}
+
+void AssetSync::sync(const QList<Asset> &assets)
+{
+    cancel();
+    _busy=true;
+    _stats=Stats();
+    _stats.listed=quint64(assets.size());
+    if(!QDir().mkpath(_dir))
+        qDebug() << __func__ << "cannot create" << _dir;
+
+    // Hashing and copying can take a while for large files, so the directory is checked on a worker thread
+    const quint64 run=_run;
+    auto *watcher=new QFutureWatcher<Plan>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, run]{
+        watcher->deleteLater();
+        if(run==_run)
+            start(watcher->result());
+    });
+    watcher->setFuture(QtConcurrent::run(&AssetSync::plan, assets, _dir, readJson(QDir(_dir).filePath(MANIFEST))));
+}
+
+void AssetSync::start(const Plan &p)
+{
+    _manifest=p.manifest;
+    _stats.upToDate=p.upToDate;
+    _stats.copied=p.copied;
+    _bytesDone=_bytesTotal=0;
+    _filesDone=0;
+    _filesTotal=int(p.download.size());
+    for(const Asset &a: p.download)
+        _bytesTotal+=a.size;
+    for(const Asset &a: p.download)
+        open(a);
+    saveManifest();
+    emitProgress();
+    pump();
+    finishIfIdle();
+}
+
+void AssetSync::open(const Asset &asset)
+{
+    auto file=std::make_unique<File>();
+    File &f=*file;
+    f.asset=asset;
+    f.path=pathFor(asset);
+    f.part.setFileName(f.path+".part");
+    _files[asset.id]=std::move(file);
+
+    const qint64 chunk=qMin(_chunkSize, asset.size);
+    const QJsonObject sidecar=readJson(f.part.fileName()+".json");
+    const bool resume=sidecar.value("md5").toString().toLatin1()==asset.md5
+            && sidecar.value("size").toInteger()==asset.size
+            && sidecar.value("chunk").toInteger()==chunk
+            && QFileInfo(f.part.fileName()).size()==asset.size;
+
+    if(!f.part.open(QIODevice::ReadWrite) || !f.part.resize(asset.size))
+    {
+        fileFailed(f, f.part.errorString());
+        return;
+    }
+
+    for(qint64 offset=0; offset<asset.size || f.chunks.empty(); offset+=chunk)
+    {
+        Chunk c;
+        c.offset=offset;
+        c.length=qMin(chunk, asset.size-offset);
+        f.chunks.push_back(c);
+    }
+    if(resume)
+    {
+        for(const QJsonValue &v: sidecar.value("done").toArray())
+        {
+            const qint64 i=v.toInteger(-1);
+            if(i<0 || i>=qint64(f.chunks.size()) || f.chunks[size_t(i)].done)
+                continue;
+            f.chunks[size_t(i)].done=true;
+            f.bytes+=f.chunks[size_t(i)].length;
+            _stats.chunksResumed++;
+        }
+        _bytesDone+=f.bytes;
+    }
+    for(const Chunk &c: f.chunks)
+        if(!c.done)
+            f.remaining++;
+
+    if(f.remaining==0)
+        verify(f);
+    else
+        _queue.emplace_back(asset.id, -1);
+}
+
+void AssetSync::pump()
+{
+    while(!_queue.empty() && _running.size()<size_t(_maxParallel))
+    {
+        const auto job=_queue.front();
+        _queue.pop_front();
+        const auto fi=_files.find(job.first);
+        if(fi==_files.end())
+            continue;
+        File &f=*fi->second;
+
+        QNetworkReply *reply;
+        if(job.second<0)
+            reply=_api->post(_api->infoBeamerRequest(QString("asset/%1/download").arg(job.first)));
+        else
+        {
+            const Chunk &c=f.chunks[size_t(job.second)];
+            if(c.done)
+                continue;
+            QNetworkRequest req=_api->request(f.url);
+            // Byte ranges of a compressed representation would not be ranges of the file
+            req.setRawHeader("Accept-Encoding", "identity");
+            if(f.chunks.size()>1)
+                req.setRawHeader("Range", "bytes="+QByteArray::number(c.offset)+"-"
+                                 +QByteArray::number(c.offset+c.length-1));
+            reply=_api->get(req);
+            reply->setReadBufferSize(READ_BUFFER);
+        }
+        Transfer t;
+        t.id=job.first;
+        t.chunk=job.second;
+        _running.emplace(reply, t);
+        connect(reply, &QNetworkReply::readyRead, this, &AssetSync::onReadyRead);
+        connect(reply, &QNetworkReply::finished, this, &AssetSync::onFinished);
+    }
+}
+
+std::vector<QNetworkReply *> AssetSync::running() const
+{
+    std::vector<QNetworkReply *> replies;
+    replies.reserve(_running.size());
+    for(const auto &r: _running)
+        replies.push_back(r.first);
+    return replies;
+}
+
+AssetSync::Transfer AssetSync::release(QNetworkReply *reply, bool abort)
+{
+    const auto r=_running.find(reply);
+    const Transfer t=r->second;
+    _running.erase(r);
+    reply->disconnect(this);
+    if(abort)
+        reply->abort();
+    reply->deleteLater();
+    return t;
+}
+
+void AssetSync::onReadyRead()
+{
+    drain(qobject_cast<QNetworkReply *>(sender()));
+}
+
+void AssetSync::onFinished()
+{
+    QNetworkReply *reply=qobject_cast<QNetworkReply *>(sender());
+    const auto r=_running.find(reply);
+    if(r==_running.end())
+        return;
+
+    if(reply->error()!=QNetworkReply::NoError)
+    {
+        const QString error=reply->errorString();
+        const Transfer t=release(reply, false);
+        if(t.chunk<0)
+            fileFailed(*_files.at(t.id), "no download link: "+error);
+        else
+            chunkFailed(t, error);
+    }
+    else if(r->second.chunk<0)
+    {
+        if(_api->read(reply, r->second.link))
+            linkDone(reply);
+        else
+        {
+            const QString error=_api->errorString(reply);
+            fileFailed(*_files.at(release(reply, false).id), "no download link: "+error);
+        }
+    }
+    else
+        drain(reply);   // Completes the chunk once the token bucket lets the rest through
+    pump();
+    finishIfIdle();
+}
+
+void AssetSync::linkDone(QNetworkReply *reply)
+{
+    const Transfer t=release(reply, false);
+
+    File &f=*_files.at(t.id);
+    const QUrl url(JsonParser::fromJson(t.link).object().value("download_url").toString());
+    if(!url.isValid() || url.isRelative())
+    {
+        fileFailed(f, "no download link in "+QString::fromUtf8(t.link.left(200)));
+        return;
+    }
+    f.url=url;
+    // Ahead of the other files' links, so files complete one after another rather than all at the end
+    for(int i=int(f.chunks.size())-1; i>=0; i--)
+        if(!f.chunks[size_t(i)].done)
+            _queue.emplace_front(t.id, i);
+}
+
+bool AssetSync::check(QNetworkReply *reply, Transfer &t)
+{
+    t.checked=true;
+    File &f=*_files.at(t.id);
+    const Chunk &c=f.chunks[size_t(t.chunk)];
+    const int status=reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    const bool ranged=f.chunks.size()>1;
+
+    if(status==206 && ranged
+            && reply->rawHeader("Content-Range").startsWith("bytes "+QByteArray::number(c.offset)+"-"))
+        return true;
+    if(status==200 && !ranged)
+        return true;
+    if(status==200)
+    {
+        // Range was ignored and this reply carries the whole file: it becomes the file's only chunk
+        qDebug() << __func__ << f.url.host() << "does not serve ranges, fetching" << f.asset.filename << "whole";
+        abortFile(t.id, reply);
+        _queue.erase(std::remove_if(_queue.begin(), _queue.end(),
+                                    [&t](const std::pair<qint64, int> &job){return job.first==t.id;}),
+                     _queue.end());
+        _bytesDone-=f.bytes;
+        f.bytes=0;
+        Chunk whole;
+        whole.length=f.asset.size;
+        f.chunks.assign(1, whole);
+        f.remaining=1;
+        t.chunk=0;
+        saveSidecar(f);
+        return true;
+    }
+
+    const QString error=QString("unexpected reply %1 %2 to a request for bytes %3-%4")
+            .arg(status).arg(QString::fromLatin1(reply->rawHeader("Content-Range")))
+            .arg(c.offset).arg(c.offset+c.length-1);
+    chunkFailed(release(reply, true), error);
+    return false;
+}
+
+void AssetSync::drain(QNetworkReply *reply)
+{
+    const auto r=_running.find(reply);
+    if(r==_running.end())
+        return;
+    Transfer &t=r->second;
+    if(t.chunk<0)
+    {
+        _api->read(reply, t.link);
+        return;
+    }
+    if(!t.checked && !check(reply, t))
+        return;
+
+    File &f=*_files.at(t.id);
+    const Chunk &c=f.chunks[size_t(t.chunk)];
+    while(reply->bytesAvailable()>0)
+    {
+        qint64 n=reply->bytesAvailable();
+        if(_rate>0)
+        {
+            if(_tokens<=0)
+            {
+                if(!_refill.isActive())
+                    _refill.start();
+                return;
+            }
+            n=qMin(n, _tokens);
+        }
+        const QByteArray data=reply->read(n);
+        if(t.received+data.size()>c.length)
+        {
+            chunkFailed(release(reply, true), "more data than requested");
+            return;
+        }
+        if(!f.part.seek(c.offset+t.received) || f.part.write(data)!=data.size())
+        {
+            release(reply, true);
+            fileFailed(f, f.part.errorString());
+            return;
+        }
+        t.received+=data.size();
+        f.bytes+=data.size();
+        _tokens-=data.size();
+        _bytesDone+=data.size();
+        _stats.bytes+=quint64(data.size());
+    }
+    if(_progressClock.elapsed()>=PROGRESS_INTERVAL_MS)
+        emitProgress();
+    if(reply->isFinished() && reply->error()==QNetworkReply::NoError)
+        chunkDone(reply);
+}
+
+void AssetSync::chunkDone(QNetworkReply *reply)
+{
+    const Transfer t=release(reply, false);
+    File &f=*_files.at(t.id);
+    Chunk &c=f.chunks[size_t(t.chunk)];
+    if(t.received!=c.length)
+    {
+        chunkFailed(t, QString("short read, %1 of %2 bytes").arg(t.received).arg(c.length));
+        return;
+    }
+    c.done=true;
+    f.remaining--;
+    saveSidecar(f);
+    if(f.remaining==0)
+        verify(f);
+}
+
+void AssetSync::chunkFailed(const Transfer &t, const QString &error)
+{
+    File &f=*_files.at(t.id);
+    f.bytes-=t.received;
+    _bytesDone-=t.received;
+    Chunk &c=f.chunks[size_t(t.chunk)];
+    if(++c.attempts>=MAX_ATTEMPTS)
+    {
+        fileFailed(f, error);
+        return;
+    }
+    qDebug() << __func__ << f.asset.filename << "bytes" << c.offset << "retrying after:" << error;
+    _queue.emplace_back(t.id, t.chunk);
+}
+
+void AssetSync::fileFailed(File &f, const QString &error)
+{
+    const qint64 id=f.asset.id;
+    qDebug() << __func__ << f.asset.filename << error;
+    abortFile(id);
+    // The .part and its chunk record stay, the next sync resumes from them; queued chunks are skipped by pump()
+    f.part.close();
+    _bytesDone-=f.bytes;
+    _bytesTotal-=f.asset.size;
+    _filesDone++;
+    _stats.failed++;
+    _files.erase(id);
+    emit assetFailed(id, error);
+    emitProgress();
+}
+
+void AssetSync::abortFile(qint64 id, QNetworkReply *except)
+{
+    std::vector<QNetworkReply *> replies;
+    for(const auto &r: _running)
+        if(r.second.id==id && r.first!=except)
+            replies.push_back(r.first);
+    for(QNetworkReply *reply: replies)
+        release(reply, true);
+}
+
+void AssetSync::verify(File &f)
+{
+    f.part.close();
+    _verifying++;
+    const qint64 id=f.asset.id;
+    const quint64 run=_run;
+    const QString part=f.part.fileName();
+    auto *watcher=new QFutureWatcher<QByteArray>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, id, run, part]{
+        watcher->deleteLater();
+        if(run!=_run)
+            return;
+        _verifying--;
+        const auto fi=_files.find(id);
+        if(fi==_files.end())
+            return;
+        File &f=*fi->second;
+        const QByteArray md5=watcher->result();
+        if(!f.asset.md5.isEmpty() && md5!=f.asset.md5)
+        {
+            QFile::remove(part);
+            QFile::remove(part+".json");
+            fileFailed(f, QString("checksum mismatch, got %1").arg(QString::fromLatin1(md5)));
+        }
+        else if((QFile::exists(f.path) && !QFile::remove(f.path)) || !QFile::rename(part, f.path))
+            fileFailed(f, "cannot replace "+f.path);
+        else
+        {
+            QFile::remove(part+".json");
+            _manifest.insert(fileName(f.asset), manifestEntry(f.path, md5));
+            saveManifest();
+            _stats.downloaded++;
+            _filesDone++;
+            _files.erase(fi);
+            emitProgress();
+        }
+        finishIfIdle();
+    });
+    watcher->setFuture(QtConcurrent::run(&AssetSync::md5Of, part));
+}
+
+void AssetSync::saveSidecar(const File &f) const
+{
+    QJsonArray done;
+    for(size_t i=0; i<f.chunks.size(); i++)
+        if(f.chunks[i].done)
+            done.append(qint64(i));
+    const QJsonObject sidecar{
+        {"md5", QString::fromLatin1(f.asset.md5)},
+        {"size", f.asset.size},
+        {"chunk", f.chunks.front().length},
+        {"done", done}};
+    if(!writeJson(f.part.fileName()+".json", sidecar))
+        qDebug() << __func__ << "cannot write chunk record for" << f.part.fileName();
+}
+
+void AssetSync::saveManifest() const
+{
+    if(!writeJson(QDir(_dir).filePath(MANIFEST), _manifest))
+        qDebug() << __func__ << "cannot write manifest in" << _dir;
+}
+
+void AssetSync::refill()
+{
+    if(_rate>0)
+    {
+        _tokens=qMin(burst(), _tokens+_rate*_lastRefill.restart()/1000);
+        if(_tokens<=0)
+            return;
+    }
+    bool starved=false;
+    for(QNetworkReply *reply: running())
+    {
+        if(!_running.count(reply) || reply->bytesAvailable()==0)
+            continue;
+        drain(reply);
+        if(_running.count(reply) && reply->bytesAvailable()>0)
+            starved=true;
+    }
+    if(!starved)
+        _refill.stop();
+    pump();
+    finishIfIdle();
+}
+
+void AssetSync::cancel()
+{
+    _run++;
+    _queue.clear();
+    for(QNetworkReply *reply: running())
+        release(reply, true);
+    // Chunk records are written as chunks finish, so there is nothing to save here
+    _files.clear();
+    _refill.stop();
+    _verifying=0;
+    _busy=false;
+}
+
+void AssetSync::finishIfIdle()
+{
+    if(!_busy || !_queue.empty() || !_running.empty() || _verifying>0)
+        return;
+    _busy=false;
+    _files.clear();
+    _refill.stop();
+    emitProgress();
+    emit finished();
+}
+
+void AssetSync::emitProgress()
+{
+    _progressClock.start();
+    emit progress(_bytesDone, _bytesTotal, _filesDone, _filesTotal);
+}
+
+}
@@ -0,0 +1,200 @@
+#ifndef ASSETSYNC_HPP
+#define ASSETSYNC_HPP
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QTimer>
+#include <QUrl>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class QNetworkReply;
+
+namespace InfoBeamer {
+
+class ApiClient;
+
+/*!
+ * \brief The AssetSync class
+ * Mirrors the files of an asset/list into a local directory, as <id>-<filename>.
+ *
+ * Files already there with the listed md5 are skipped; a manifest (.assetsync.json) remembers size, mtime and md5 of
+ * every file it verified, so unchanged files are not hashed again on the next run.  An asset whose content is already
+ * on disk under another asset is copied locally instead of downloaded.
+ *
+ * Everything else is fetched over its download link in chunks of chunkSize() bytes with HTTP Range requests, up to
+ * maxParallel() at once, into <file>.part.  Finished chunks are recorded in <file>.part.json, so an interrupted sync
+ * resumes where it stopped.  Servers that ignore Range get a single whole-file request instead.  The result is
+ * checked against the listed md5 before it replaces the file.
+ *
+ * setRateLimit() caps the total transfer rate with a token bucket: replies read only what the bucket allows and
+ * their bounded read buffers push back on the connection, so the sender slows down instead of data piling up here.
+ */
+class AssetSync : public QObject
+{
+    Q_OBJECT
+public:
+    struct Asset
+    {
+        qint64      id=0;
+        QString     filename;
+        qint64      size=0;
+        QByteArray  md5;        //! Lower case hex, as listed
+    };
+
+    struct Stats
+    {
+        quint64 listed=0;
+        quint64 upToDate=0;         //! Already on disk with the listed checksum
+        quint64 copied=0;           //! Same content as another asset on disk, copied locally
+        quint64 downloaded=0;
+        quint64 failed=0;
+        quint64 chunksResumed=0;    //! Chunks an interrupted run had already finished
+        quint64 bytes=0;            //! Body bytes received
+    };
+
+    static const qint64 DEFAULT_CHUNK=8*1024*1024;
+    static const int    DEFAULT_PARALLEL=6;
+
+    explicit AssetSync(ApiClient *api, QObject *parent=nullptr);
+    ~AssetSync();
+
+    //! The "assets" array of an asset/list response; entries without id or filename are skipped
+    static QList<Asset> fromList(const QJsonObject &assetList);
+
+    void setDirectory(const QString &dir) {_dir=dir;}
+    const QString &directory() const {return _dir;}
+
+    //! Takes effect for files started afterwards; resuming needs the chunk size of the interrupted run
+    void setChunkSize(qint64 bytes) {_chunkSize=qMax<qint64>(64*1024, bytes);}
+    qint64 chunkSize() const {return _chunkSize;}
+
+    void setMaxParallel(int n);
+    int maxParallel() const {return _maxParallel;}
+
+    //! Bytes per second over all transfers, 0 for no limit
+    void setRateLimit(qint64 bytesPerSecond);
+    qint64 rateLimit() const {return _rate;}
+
+    //! Starts syncing \a assets into directory(); a sync still running is cancelled first
+    void sync(const QList<Asset> &assets);
+    //! Stops all transfers; .part files and their chunk records stay for the next sync
+    void cancel();
+    bool busy() const {return _busy;}
+
+    const Stats &stats() const {return _stats;}
+
+    QString pathFor(const Asset &asset) const;
+
+signals:
+    //! \a bytes counts chunks resumed from an earlier run as done
+    void progress(qint64 bytes, qint64 total, int files, int totalFiles);
+    void assetFailed(qint64 id, const QString &error);
+    void finished();
+
+private slots:
+    void onReadyRead();
+    void onFinished();
+    void refill();
+
+private:
+    struct Chunk
+    {
+        qint64  offset=0;
+        qint64  length=0;
+        bool    done=false;
+        int     attempts=0;
+    };
+
+    struct File
+    {
+        Asset               asset;
+        QString             path;
+        QUrl                url;
+        QFile               part;
+        std::vector<Chunk>  chunks;
+        int                 remaining=0;    //! Chunks not done yet
+        qint64              bytes=0;        //! Counted towards progress: done chunks and what is in flight
+    };
+
+    struct Transfer
+    {
+        qint64      id=0;
+        int         chunk=-1;       //! -1 while fetching the download link
+        qint64      received=0;
+        bool        checked=false;  //! Status and range looked at
+        QByteArray  link;           //! Body of the download link request
+    };
+
+    //! Outcome of checking the directory, worked out off the GUI thread
+    struct Plan
+    {
+        QList<Asset>    download;
+        QJsonObject     manifest;
+        quint64         upToDate=0;
+        quint64         copied=0;
+    };
+
+    static QString fileName(const Asset &asset);
+    static Plan plan(const QList<Asset> &assets, const QString &dir, QJsonObject manifest);
+    static QByteArray md5Of(const QString &path);
+    static QJsonObject manifestEntry(const QString &path, const QByteArray &md5);
+
+    void start(const Plan &p);
+    void open(const Asset &asset);
+    void pump();
+    std::vector<QNetworkReply *> running() const;
+    Transfer release(QNetworkReply *reply, bool abort);
+    void drain(QNetworkReply *reply);
+    bool check(QNetworkReply *reply, Transfer &t);
+    void linkDone(QNetworkReply *reply);
+    void chunkDone(QNetworkReply *reply);
+    void chunkFailed(const Transfer &t, const QString &error);
+    void fileFailed(File &f, const QString &error);
+    void verify(File &f);
+    void abortFile(qint64 id, QNetworkReply *except=nullptr);
+    void saveSidecar(const File &f) const;
+    void saveManifest() const;
+    void finishIfIdle();
+    void emitProgress();
+    qint64 burst() const {return qMax<qint64>(_rate/10, 16*1024);}
+
+    ApiClient                          *_api;
+    QString                             _dir;
+    qint64                              _chunkSize=DEFAULT_CHUNK;
+    int                                 _maxParallel=DEFAULT_PARALLEL;
+    bool                                _busy=false;
+    quint64                             _run=0;         //! Bumped by cancel(), so stale worker results are dropped
+    int                                 _verifying=0;
+
+    std::map<qint64, std::unique_ptr<File>> _files;
+    std::deque<std::pair<qint64, int>>  _queue;         //! (asset id, chunk), chunk -1 for the download link
+    std::unordered_map<QNetworkReply *, Transfer> _running;  //! Node based: references survive other erasures
+    QJsonObject                         _manifest;
+
+    // Token bucket
+    qint64                              _rate=0;
+    qint64                              _tokens=0;
+    QElapsedTimer                       _lastRefill;
+    QTimer                              _refill;
+
+    QElapsedTimer                       _progressClock;
+    qint64                              _bytesDone=0;
+    qint64                              _bytesTotal=0;
+    int                                 _filesDone=0;
+    int                                 _filesTotal=0;
+    Stats                               _stats;
+};
+
+}
+
+#endif // ASSETSYNC_HPP
@@ -0,0 +1,235 @@
+#include "bulkoperation.hpp"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QJsonParseError>
+#include <QNetworkReply>
+#include <QTimer>
+#include <QUrl>
+
+#include <unordered_set>
+
+#include "apiclient.hpp"
+#include "fanout.hpp"
+
+namespace InfoBeamer {
+
+BulkOperation::BulkOperation(ApiClient *api, QObject *parent)
+    : QObject(parent)
+    , _api(api)
+    , _fanOut(new FanOut(api, this))
+{
+}
+
+QString BulkOperation::actionName(Action action)
+{
+    switch(action)
+    {
+    case Action::AssignSetup:
+        return "assign setup";
+    case Action::SetUserdata:
+        return "set userdata";
+    case Action::Reboot:
+        return "reboot";
+    }
+    return QString();
+}
+
+bool BulkOperation::start(Action action, const std::vector<Device> &devices, const QString &argument, QString *error)
+{
+    if(_busy)
+    {
+        if(error)
+            *error="a bulk operation is still running";
+        return false;
+    }
+    _action=action;
+    _form.clear();
+    if(action==Action::AssignSetup)
+    {
+        bool ok=false;
+        _setupId=argument.trimmed().toInt(&ok);
+        if(!ok || _setupId<=0)
+        {
+            if(error)
+                *error=QString("not a setup id: %1").arg(argument);
+            return false;
+        }
+        _form="setup_id="+QByteArray::number(_setupId);
+    }
+    else if(action==Action::SetUserdata)
+    {
+        QJsonParseError parseError;
+        const QJsonDocument doc=QJsonDocument::fromJson(argument.toUtf8(), &parseError);
+        if(parseError.error!=QJsonParseError::NoError || !doc.isObject())
+        {
+            if(error)
+                *error=QString("userdata must be a JSON object: %1").arg(parseError.errorString());
+            return false;
+        }
+        _userdata=doc.object();
+        _form="userdata="+QUrl::toPercentEncoding(QString::fromUtf8(doc.toJson(QJsonDocument::Compact)));
+    }
+
+    _run++;
+    _results.clear();
+    _results.reserve(devices.size());
+    _settled=_failed=0;
+    _elapsedMs=0;
+    _busy=true;
+    _clock.start();
+    _fanOut->fitTo(QUrl(ApiClient::infoBeamerBase()));
+
+    // Every result exists before the first one settles, so finishing waits for all of them
+    std::unordered_set<int> seen;
+    std::vector<bool> skip;
+    for(const Device &d: devices)
+    {
+        if(!seen.insert(d.id()).second)
+            continue;
+        Result r;
+        r.device=d.id();
+        _results.push_back(r);
+        skip.push_back(alreadyApplied(d));
+    }
+    qDebug() << __func__ << actionName(action) << "on" << _results.size() << "devices";
+    for(size_t i=0; i<_results.size(); i++)
+    {
+        if(skip[i])
+            settle(i, Outcome::Skipped);
+        else
+            dispatch(i);
+    }
+    // Nothing to settle for an empty selection
+    finishIfDone();
+    return true;
+}
+
+void BulkOperation::cancel()
+{
+    if(!_busy)
+        return;
+    _run++;
+    _fanOut->cancel();
+    _busy=false;
+    _elapsedMs=_clock.elapsed();
+}
+
+bool BulkOperation::alreadyApplied(const Device &d) const
+{
+    switch(_action)
+    {
+    case Action::AssignSetup:
+        return d.setup() && d.setup()->id==_setupId;
+    case Action::SetUserdata:
+        return d.userdata() && *d.userdata()==_userdata;
+    case Action::Reboot:
+        return false;
+    }
+    return false;
+}
+
+void BulkOperation::dispatch(size_t index)
+{
+    Result &r=_results[index];
+    r.attempts++;
+    const QString path=_action==Action::Reboot ? QString("device/%1/reboot").arg(r.device)
+                                               : QString("device/%1").arg(r.device);
+    const quint64 run=_run;
+    _fanOut->enqueuePost(_api->infoBeamerRequest(path), _form,
+        [this, index, run](const QByteArray &)
+        {
+            if(run!=_run)
+                return;
+            _results[index].status=200;
+            settle(index, Outcome::Done);
+        },
+        [this, index, run](QNetworkReply *reply)
+        {
+            if(run==_run)
+                failedAttempt(index, reply);
+        });
+}
+
+void BulkOperation::failedAttempt(size_t index, QNetworkReply *reply)
+{
+    Result &r=_results[index];
+    const int status=reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    r.status=status;
+    // A body that did not decode does not undo what the server did
+    if(status>=200 && status<300)
+    {
+        settle(index, Outcome::Done);
+        return;
+    }
+    r.error=status ? QString("HTTP %1").arg(status) : reply->errorString();
+
+    if(r.attempts>=MAX_ATTEMPTS || !retryable(reply, status))
+    {
+        qDebug() << __func__ << "device" << r.device << actionName(_action) << "failed after" << r.attempts
+                 << "attempts:" << r.error;
+        settle(index, Outcome::Failed);
+        return;
+    }
+    int delay=qMin(BACKOFF_MS<<(r.attempts-1), int(MAX_BACKOFF_MS));
+    const QByteArray retryAfter=reply->rawHeader("Retry-After").trimmed();
+    if(!retryAfter.isEmpty())
+    {
+        bool seconds=false;
+        qint64 ms=retryAfter.toLongLong(&seconds)*1000;
+        if(!seconds)
+            ms=QDateTime::currentDateTimeUtc().msecsTo(QDateTime::fromString(QString::fromLatin1(retryAfter),
+                                                                               Qt::RFC2822Date));
+        if(ms>MAX_RETRY_AFTER_MS)
+        {
+            r.error+=QString(", retry after %1 s").arg(ms/1000);
+            settle(index, Outcome::Failed);
+            return;
+        }
+        delay=int(qMax<qint64>(delay, ms));
+    }
+    const quint64 run=_run;
+    QTimer::singleShot(delay, this, [this, index, run]{
+        if(run==_run)
+            dispatch(index);
+    });
+}
+
+bool BulkOperation::retryable(QNetworkReply *reply, int status) const
+{
+    if(status==429)
+        return true;
+    if(_action==Action::Reboot)
+    {
+        // Only where the request surely was not acted on; a timeout may have rebooted the device already
+        return status==503 || reply->error()==QNetworkReply::ConnectionRefusedError
+                || reply->error()==QNetworkReply::HostNotFoundError;
+    }
+    return status>=500 || status==0;
+}
+
+void BulkOperation::settle(size_t index, Outcome outcome)
+{
+    Result &r=_results[index];
+    r.outcome=outcome;
+    _settled++;
+    if(outcome==Outcome::Failed)
+        _failed++;
+    emit deviceFinished(r);
+    emit progress(_settled, _failed, int(_results.size()));
+    finishIfDone();
+}
+
+void BulkOperation::finishIfDone()
+{
+    if(!_busy || _settled<int(_results.size()))
+        return;
+    _busy=false;
+    _elapsedMs=_clock.elapsed();
+    qDebug() << __func__ << actionName(_action) << _results.size() << "devices," << _failed << "failed in"
+             << _elapsedMs << "ms";
+    emit finished();
+}
+
+}
@@ -0,0 +1,122 @@
+#ifndef BULKOPERATION_HPP
+#define BULKOPERATION_HPP
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QJsonValue>
+#include <QString>
+
+#include <vector>
+
+#include "device.hpp"
+
+class QNetworkReply;
+
+namespace InfoBeamer {
+
+class ApiClient;
+class FanOut;
+
+/*!
+ * \brief The BulkOperation class
+ * Runs one action over a selection of devices, e.g. the matches of a DeviceQuery over the polled fleet:
+ *
+ *   AssignSetup    POST device/{id} setup_id=<id>
+ *   SetUserdata    POST device/{id} userdata=<json>
+ *   Reboot         POST device/{id}/reboot
+ *
+ * Requests go through a FanOut, as many at once as the connection carries well.  Devices already in the target state
+ * (same setup, equal userdata) are skipped without a request.  Every device ends up with a Result.
+ *
+ * Failed requests are retried up to MAX_ATTEMPTS times with a doubling backoff, or after Retry-After when the server
+ * sends one.  Assigning a setup or userdata gives the same state however often it is applied, so those are retried on
+ * any 429, 5xx or network error.  A repeated reboot is a second reboot: it is only retried when the server certainly
+ * did not act on the first one (429, 503, no connection).
+ */
+class BulkOperation : public QObject
+{
+    Q_OBJECT
+public:
+    enum class Action
+    {
+        AssignSetup,
+        SetUserdata,
+        Reboot
+    };
+
+    enum class Outcome
+    {
+        Pending,
+        Done,
+        Skipped,    //! Already in the target state
+        Failed
+    };
+
+    struct Result
+    {
+        int         device=0;
+        Outcome     outcome=Outcome::Pending;
+        int         attempts=0;
+        int         status=0;       //! HTTP status of the last reply, 0 for none
+        QString     error;
+    };
+
+    static const int MAX_ATTEMPTS=4;
+    static const int BACKOFF_MS=500;
+    static const int MAX_BACKOFF_MS=10*1000;
+    //! A longer Retry-After fails the device rather than holding up the whole operation
+    static const int MAX_RETRY_AFTER_MS=60*1000;
+
+    explicit BulkOperation(ApiClient *api, QObject *parent=nullptr);
+
+    static QString actionName(Action action);
+
+    /*!
+     * \brief start
+     * Applies \a action to \a devices; \a argument is the setup id for AssignSetup and the JSON document for
+     * SetUserdata.  Returns false and sets \a error if the argument does not parse or an operation is still running.
+     */
+    bool start(Action action, const std::vector<Device> &devices, const QString &argument=QString(),
+               QString *error=nullptr);
+    //! Stops dispatching; requests already sent may still take effect, their devices stay Pending
+    void cancel();
+    bool busy() const {return _busy;}
+
+    Action action() const {return _action;}
+    const std::vector<Result> &results() const {return _results;}
+    int settled() const {return _settled;}
+    int failed() const {return _failed;}
+    qint64 elapsedMs() const {return _elapsedMs;}
+
+signals:
+    void progress(int settled, int failed, int total);
+    void deviceFinished(const InfoBeamer::BulkOperation::Result &result);
+    void finished();
+
+private:
+    bool alreadyApplied(const Device &d) const;
+    void dispatch(size_t index);
+    void failedAttempt(size_t index, QNetworkReply *reply);
+    bool retryable(QNetworkReply *reply, int status) const;
+    void settle(size_t index, Outcome outcome);
+    void finishIfDone();
+
+    ApiClient              *_api;
+    FanOut                 *_fanOut;
+    Action                  _action=Action::Reboot;
+    int                     _setupId=0;
+    QJsonValue              _userdata;
+    QByteArray              _form;          //! Request body, the same for every device
+    std::vector<Result>     _results;
+    bool                    _busy=false;
+    quint64                 _run=0;         //! Bumped by cancel(), so pending retries are dropped
+    int                     _settled=0;
+    int                     _failed=0;
+    QElapsedTimer           _clock;
+    qint64                  _elapsedMs=0;
+};
+
+}
+
+#endif // BULKOPERATION_HPP
@@ -1,7 +1,9 @@
 #include "device.hpp"
+#include "deviceexport.hpp"
 #include <QJsonObject>
 #include <QJsonValue>
 #include <QJsonArray>
+#include <QSet>
 
 #include <iostream>
 #include <typeinfo>
@@ -32,8 +34,6 @@ Device::Device(const QJsonObject &obj)
         throw DeviceException("No description in json", IBErrCode::BAD_JSON);
     if(obj["description"].type()!=String)
         throw DeviceException("description in json not String", IBErrCode::BAD_JSON);
-    qDebug() << __func__ << __FILE_NAME__ << "line" << __LINE__ << "description in json:"
-             << obj["description"].toString();
     _description=obj["description"].toString().toStdString();
 
 
@@ -42,8 +42,6 @@ Device::Device(const QJsonObject &obj)
         throw DeviceException("No location in json", IBErrCode::BAD_JSON);
     if(obj["location"].type()!=String)
         throw DeviceException("location in json not String", IBErrCode::BAD_JSON);
-    qDebug() << __func__ << __FILE_NAME__ << "line" << __LINE__ << "location in json:"
-             << obj["location"].toString();
     _location=obj["location"].toString().toStdString();
 
     //Get serial
@@ -51,8 +49,6 @@ Device::Device(const QJsonObject &obj)
         throw DeviceException("No serial in json", IBErrCode::BAD_JSON);
     if(obj["serial"].type()!=String)
         throw DeviceException("serial in json not String", IBErrCode::BAD_JSON);
-    qDebug() << __func__ << __FILE_NAME__ << "line" << __LINE__ << "serial in json:"
-             << obj["serial"].toString();
     _serial=obj["serial"].toString().toStdString();
 
     //Get status
@@ -93,20 +89,14 @@ Device::Device(const QJsonObject &obj)
 
     if(obj["status"].type()==String)
     {
-        qDebug() << __func__ << __FILE_NAME__ << "line" << __LINE__ << "status in json:"
-                 << obj["status"].toString().toStdString().c_str();
         _status=obj["status"].toString().toStdString();
     }
     else if(obj["status"].type()==Null)
     {
-        qDebug() << __func__ << __FILE_NAME__ << "line" << __LINE__ << "status in json is type Null:"
-                 << obj["status"].toString().toStdString().c_str();
         _status=obj["status"].toString().toStdString();
     }
     else
     {
-        qDebug() << __func__ << __FILE_NAME__ << "line" << __LINE__ << "status in json unexpected type:"
-                 << obj["status"].type() << obj["status"];
         throw DeviceException("status in json not String/Null", IBErrCode::BAD_JSON);
     }
 
@@ -124,17 +114,17 @@ Device::Device(const QJsonObject &obj)
 
     //Get is_synced
     if (!obj.contains("is_synced"))
-        _is_synced=nullptr;
+        _is_synced.reset();
     else
     {
         const auto &v=obj["is_synced"];
         if(v.type()!=Bool)
             throw DeviceException("is_synced in json not Bool", IBErrCode::BAD_JSON);
-        _is_synced=new bool(v.toBool());
+        _is_synced=v.toBool();
     }
 
     //Get maintenance strings (if any)
-    if(obj.contains("maintenace"))
+    if(obj.contains("maintenance"))
     {
         const auto &v=obj["maintenance"];
         if(v.type()==Array)
@@ -207,7 +197,7 @@ Device::Device(const QJsonObject &obj)
         {
             throw DeviceException("run object \"restarted\" is not Double", IBErrCode::BAD_JSON);
         }
-        _run.restarted=time_t(run["resolution"].toInteger());
+        _run.restarted=time_t(run["restarted"].toInteger());
 
         //Get tag
         if(!run.contains("tag"))
@@ -241,11 +231,26 @@ Device::Device(const QJsonObject &obj)
             throw DeviceException("run object \"pi_revision\" is not String", IBErrCode::BAD_JSON);
         }
         _run.pi_revision=run["pi_revision"].toString().toStdString();
+
+        //Get features
+        if(run.contains("features"))
+        {
+            if(run["features"].type()!=Array)
+            {
+                throw DeviceException("run object \"features\" is not Array", IBErrCode::BAD_JSON);
+            }
+            for(const auto &feature: run["features"].toArray())
+            {
+                if(feature.type()!=String)
+                    throw DeviceException("run object \"features\" entry is not String", IBErrCode::BAD_JSON);
+                _run.features.push_back(feature.toString().toStdString());
+            }
+        }
     }
 
     //Get userdata
     if(obj.contains("userdata"))
-        _userdata=new QJsonValue(obj["userdata"]);
+        _userdata=obj["userdata"];
 
     //Get reboot
     if(!obj.contains("reboot"))
@@ -277,7 +282,7 @@ Device::Device(const QJsonObject &obj)
         {
             throw DeviceException("geo object \"lat\" is not Double", IBErrCode::BAD_JSON);
         }
-        _geo=new Geo;
+        _geo.emplace();
         _geo->lat=geo["lat"].toDouble();
 
         //Get lon
@@ -298,11 +303,9 @@ Device::Device(const QJsonObject &obj)
         }
         if(geo["source"].type()!=String)
         {
-            throw DeviceException("geo object \"lon\" is not Double", IBErrCode::BAD_JSON);
+            throw DeviceException("geo object \"source\" is not String", IBErrCode::BAD_JSON);
         }
-        QString source(geo["source"].toString());
-        _geo->source=source.toStdString();
-        //_geo->source=geo["source"].toString().toStdString();
+        _geo->source=geo["source"].toString().toStdString();
     }
 
     //Get setup
@@ -318,7 +321,7 @@ Device::Device(const QJsonObject &obj)
             throw DeviceException("setup object does not contain \"id\"", IBErrCode::BAD_JSON);
         if(setup["id"].type()!=Double)
             throw DeviceException("setup object \"id\" not Double", IBErrCode::BAD_JSON);
-        _setup=new Setup;
+        _setup.emplace();
         _setup->id=setup["id"].toInteger();
 
         //Get name
@@ -341,7 +344,7 @@ Device::Device(const QJsonObject &obj)
     //Get hw
     if(obj.contains("hw") && obj["hw"].type()!=Null)
     {
-        _hw=new Hw;
+        _hw.emplace();
         const auto &h=obj["hw"];
         if(h.type()!=Object)
             throw DeviceException("json object \"hw\" is not Object", IBErrCode::BAD_JSON);
@@ -376,7 +379,7 @@ Device::Device(const QJsonObject &obj)
         {
             if(hw["memory"].type()!=Double)
                 throw DeviceException("hw object \"memory\" not Double", IBErrCode::BAD_JSON);
-            _hw->memory=time_t(hw["memory"].toInteger());
+            _hw->memory=int(hw["memory"].toInteger());
         }
 
         //Get features
@@ -400,170 +403,488 @@ Device::Device(const QJsonObject &obj)
     {
         throw DeviceException("json object does not contain \"offline\"", IBErrCode::BAD_JSON);
     }
+    {
+        const auto &o=obj["offline"];
+        if(o.type()!=Object)
+            throw DeviceException("json object \"offline\" is not Object", IBErrCode::BAD_JSON);
+        const auto &offline=o.toObject();
+        if(offline["licensed"].type()!=Bool)
+            throw DeviceException("offline object \"licensed\" not Bool", IBErrCode::BAD_JSON);
+        _offline.licensed=offline["licensed"].toBool();
+        if(offline["plan"].type()!=String && offline["plan"].type()!=Null)
+            throw DeviceException("offline object \"plan\" not String/Null", IBErrCode::BAD_JSON);
+        _offline.plan=offline["plan"].toString().toStdString();
+        if(offline["max_offline"].type()!=Double)
+            throw DeviceException("offline object \"max_offline\" not Double", IBErrCode::BAD_JSON);
+        _offline.max_offline=int(offline["max_offline"].toInteger());
+        if(offline["chargeable"].type()!=Double)
+            throw DeviceException("offline object \"chargeable\" not Double", IBErrCode::BAD_JSON);
+        _offline.chargeable=int(offline["chargeable"].toInteger());
+    }
+
+    //Get upgrade_blocked
+    if(obj.contains("upgrade_blocked"))
+    {
+        if(obj["upgrade_blocked"].type()!=Double)
+            throw DeviceException("json object \"upgrade_blocked\" is not Double", IBErrCode::BAD_JSON);
+        _upgrade_blocked=int(obj["upgrade_blocked"].toInteger());
+    }
 }
 
 
-void Device::poplulate(const QJsonObject &obj)
+static const char *typeName(QJsonValue::Type t)
+{
+    switch(t)
+    {
+    case QJsonValue::Null:   return "Null";
+    case QJsonValue::Bool:   return "Bool";
+    case QJsonValue::Double: return "Double";
+    case QJsonValue::String: return "String";
+    case QJsonValue::Array:  return "Array";
+    case QJsonValue::Object: return "Object";
+    default:                 return "Undefined";
+    }
+}
+
+namespace {
+
+/*!
+ * \brief The Lenient class
+ * Field access for the slow decode path: hands out the value when it has the expected type and records a missing
+ * field or type change otherwise, falling back to the caller's default.
+ */
+class Lenient
+{
+public:
+    Lenient(DecodeDrift &drift, const char *section) : _drift(drift), _section(section) {}
+
+    //! The value of \a key if it has type \a t (or is null and \a nullable), else Undefined
+    QJsonValue get(const QJsonObject &o, const char *key, QJsonValue::Type t, bool required=true,
+                   bool nullable=false) const
+    {
+        const auto it=o.constFind(QLatin1String(key));
+        if(it==o.constEnd())
+        {
+            if(required)
+                _drift.missingFields[path(key)]++;
+            return QJsonValue(QJsonValue::Undefined);
+        }
+        const QJsonValue v=it.value();
+        if(v.type()==t || (nullable && v.isNull()))
+            return v;
+        _drift.typeChanges[path(key)+':'+typeName(v.type())]++;
+        // Numbers sent as strings are common enough to be worth keeping
+        if(t==Double && v.isString())
+        {
+            bool ok=false;
+            const double d=v.toString().toDouble(&ok);
+            if(ok)
+                return QJsonValue(d);
+        }
+        return QJsonValue(QJsonValue::Undefined);
+    }
+
+    std::string string(const QJsonObject &o, const char *key, bool required=true) const
+    {
+        return get(o, key, String, required, true).toString().toStdString();
+    }
+    qint64 integer(const QJsonObject &o, const char *key, qint64 def=0, bool required=true) const
+    {
+        const QJsonValue v=get(o, key, Double, required);
+        return v.isDouble() ? v.toInteger(def) : def;
+    }
+    double real(const QJsonObject &o, const char *key, bool required=true) const
+    {
+        return get(o, key, Double, required).toDouble();
+    }
+    bool boolean(const QJsonObject &o, const char *key, bool required=true) const
+    {
+        return get(o, key, Bool, required).toBool();
+    }
+    std::vector<std::string> strings(const QJsonObject &o, const char *key, bool required=true) const
+    {
+        std::vector<std::string> result;
+        for(const auto &e: get(o, key, Array, required, true).toArray())
+        {
+            if(e.isString())
+                result.push_back(e.toString().toStdString());
+            else
+                _drift.typeChanges[path(key)+"[]:"+typeName(e.type())]++;
+        }
+        return result;
+    }
+    //! The object under \a key; false when it is missing, null or not an object
+    bool object(const QJsonObject &o, const char *key, QJsonObject &out, bool required=true) const
+    {
+        const QJsonValue v=get(o, key, Object, required, true);
+        out=v.toObject();
+        return v.isObject();
+    }
+
+private:
+    std::string path(const char *key) const
+    {
+        return *_section ? std::string(_section)+'.'+key : std::string(key);
+    }
+
+    DecodeDrift &_drift;
+    const char  *_section;
+};
+
+}
+
+Device::Device(const QJsonObject &obj, DecodeDrift &drift)
+{
+    const Lenient top(drift, "");
+    _id=int(top.integer(obj, "id"));
+    _description=top.string(obj, "description");
+    _location=top.string(obj, "location");
+    _serial=top.string(obj, "serial");
+    _status=top.string(obj, "status");
+    _is_onLine=top.boolean(obj, "is_online");
+    const QJsonValue synced=top.get(obj, "is_synced", Bool, false);
+    if(synced.isBool())
+        _is_synced=synced.toBool();
+    _maintenance=top.strings(obj, "maintenance", false);
+
+    QJsonObject o;
+    if(top.object(obj, "run", o, false))
+    {
+        const Lenient run(drift, "run");
+        _run.channel=run.string(o, "channel");
+        _run.public_addr=run.string(o, "public_addr");
+        _run.resolution=run.string(o, "resolution");
+        _run.restarted=time_t(run.integer(o, "restarted"));
+        _run.tag=run.string(o, "tag");
+        _run.version=run.string(o, "version");
+        _run.pi_revision=run.string(o, "pi_revision");
+        _run.features=run.strings(o, "features", false);
+    }
+
+    if(obj.contains("userdata"))
+        _userdata=obj["userdata"];
+    _reboot=time_t(top.integer(obj, "reboot"));
+
+    if(top.object(obj, "geo", o, false))
+    {
+        const Lenient geo(drift, "geo");
+        _geo.emplace();
+        _geo->lat=geo.real(o, "lat");
+        _geo->lon=geo.real(o, "lon");
+        _geo->source=geo.string(o, "source");
+    }
+    if(top.object(obj, "setup", o, false))
+    {
+        const Lenient setup(drift, "setup");
+        _setup.emplace();
+        _setup->id=int(setup.integer(o, "id"));
+        _setup->name=setup.string(o, "name");
+        _setup->updated=time_t(setup.integer(o, "updated"));
+    }
+    if(top.object(obj, "hw", o, false))
+    {
+        const Lenient hw(drift, "hw");
+        _hw.emplace();
+        _hw->hw_type=hw.string(o, "type", false);
+        _hw->model=hw.string(o, "model", false);
+        _hw->memory=int(hw.integer(o, "memory", 0, false));
+        _hw->platform=hw.string(o, "platform", false);
+        _hw->features=hw.strings(o, "features", false);
+    }
+    if(top.object(obj, "offline", o))
+    {
+        const Lenient offline(drift, "offline");
+        _offline.licensed=offline.boolean(o, "licensed");
+        _offline.plan=offline.string(o, "plan");
+        _offline.max_offline=int(offline.integer(o, "max_offline"));
+        _offline.chargeable=int(offline.integer(o, "chargeable"));
+    }
+    _upgrade_blocked=int(top.integer(obj, "upgrade_blocked", 0, false));
+}
+
+void Device::scanKeys(const QJsonObject &obj, DecodeDrift &drift)
+{
+    struct Section
+    {
+        const char          *name;
+        const QSet<QString>  keys;
+    };
+    static const QSet<QString> TOP={"id", "description", "location", "serial", "status", "is_online", "is_synced",
+                                    "maintenance", "run", "userdata", "reboot", "geo", "setup", "hw", "offline",
+                                    "upgrade_blocked"};
+    static const Section NESTED[]={
+        {"run", {"channel", "public_addr", "resolution", "restarted", "tag", "version", "boot_version",
+                 "base_version", "pi_revision", "features"}},
+        {"geo", {"lat", "lon", "source"}},
+        {"setup", {"id", "name", "updated"}},
+        {"hw", {"type", "model", "memory", "platform", "features"}},
+        {"offline", {"licensed", "plan", "max_offline", "chargeable"}}};
+
+    for(auto it=obj.constBegin(); it!=obj.constEnd(); ++it)
+        if(!TOP.contains(it.key()))
+            drift.unknownKeys[it.key().toStdString()]++;
+    for(const auto &section: NESTED)
+    {
+        const QJsonValue v=obj.value(QLatin1String(section.name));
+        if(!v.isObject())
+            continue;
+        const QJsonObject o=v.toObject();
+        for(auto it=o.constBegin(); it!=o.constEnd(); ++it)
+            if(!section.keys.contains(it.key()))
+                drift.unknownKeys[std::string(section.name)+'.'+it.key().toStdString()]++;
+    }
+}
+
+//! The slow path gets an id out of \a obj: a number, or a number sent as a string (see Lenient::get())
+static bool decodableId(const QJsonObject &obj)
+{
+    const QJsonValue id=obj["id"];
+    bool ok=id.isDouble();
+    if(id.isString())
+        id.toString().toDouble(&ok);
+    return ok;
+}
+
+Device Device::fromJson(const QJsonObject &obj, DecodeDrift *drift)
+{
+    if(drift==nullptr)
+        return Device(obj);
+    scanKeys(obj, *drift);
+    try
+    {
+        Device d(obj);
+        drift->fastPath++;
+        return d;
+    }
+    catch (const DeviceException &)
+    {
+        if(!decodableId(obj))
+        {
+            drift->dropped++;
+            throw;
+        }
+        drift->slowPath++;
+        return Device(obj, *drift);
+    }
+}
+
+std::vector<Device> Device::decode(const QJsonObject &obj, DecodeMode mode, DecodeDrift *drift)
 {
-    Device::devices.clear();
     if(!obj.contains("devices"))
         throw DeviceException("json missing key \"devices\"", IBErrCode::BAD_JSON);
     const QJsonValue &a(obj["devices"]);
     if(a.type()!=Array)
         throw DeviceException("json value \"devices\" is not an array", IBErrCode::BAD_JSON);
     const QJsonArray &da(a.toArray());
+
+    DecodeDrift local;
+    DecodeDrift &d=drift!=nullptr ? *drift : local;
+    std::vector<Device> result;
+    result.reserve(size_t(da.size()));
     for(int i=0; i<da.size(); i++)
     {
         if(da[i].type()!=Object)
         {
+            if(mode==DecodeMode::Tolerant)
+            {
+                d.dropped++;
+                continue;
+            }
             std::string msg;
             msg+="json \"devices[";
             msg+=std::to_string(i);
             msg+="]\" not QJsonObject";
             throw(DeviceException(msg, IBErrCode::BAD_JSON));
         }
-        devices.push_back(Device(da[i].toObject()));
-        std::cerr << devices.back();
+        if(mode==DecodeMode::Strict)
+        {
+            result.push_back(Device(da[i].toObject()));
+            continue;
+        }
+        try
+        {
+            result.push_back(fromJson(da[i].toObject(), &d));
+        }
+        catch (const DeviceException &)
+        {
+            // Counted as dropped; the rest of the fleet still goes through
+        }
     }
+    return result;
 }
 
-std::vector<Device> Device::devices;
-
-static inline const std::string &typeToString(const QJsonValue &v)
+void DecodeDrift::merge(const DecodeDrift &o)
 {
-    QJsonValue::Type t=v.type();
-    static std::string TYPESTRING[]={"Null",
-                                     "Bool",
-                                     "Double",
-                                     "String",
-                                     "Array",
-                                     "Object",
-                                     "Undefined",
-                                     "Illegal"};
-    size_t index =
-            (t>=Null && t<=Object)
-            ? t : t==Undefined ? Object+1 : Object+2;
-    return TYPESTRING[index];
+    fastPath+=o.fastPath;
+    slowPath+=o.slowPath;
+    dropped+=o.dropped;
+    for(const auto &k: o.unknownKeys)
+        unknownKeys[k.first]+=k.second;
+    for(const auto &k: o.typeChanges)
+        typeChanges[k.first]+=k.second;
+    for(const auto &k: o.missingFields)
+        missingFields[k.first]+=k.second;
 }
 
+std::string DecodeDrift::summary() const
+{
+    std::string s="fast "+std::to_string(fastPath)+", slow "+std::to_string(slowPath)+", dropped "
+            +std::to_string(dropped);
+    const auto list=[&s](const char *what, const std::map<std::string, uint64_t> &m)
+    {
+        if(m.empty())
+            return;
+        s+="; ";
+        s+=what;
+        s+=':';
+        for(const auto &k: m)
+            s+=' '+k.first+" ("+std::to_string(k.second)+')';
+    };
+    list("unknown", unknownKeys);
+    list("type changed", typeChanges);
+    list("missing", missingFields);
+    return s;
+}
 
-
-static inline std::ostream& operator << (std::ostream & os, const QJsonValue & v)
+Device::Fleet &Device::fleet()
 {
-    os << typeToString(v);
-    switch (v.type())
-    {
-    // Types that do not have a value to display
-    case Null:
-    case Object:
-    case Array:
-    case Undefined:
-    default:
-        break;
-        // Types that display a value
-    case Bool:
-        os << '(' << (v.toBool() ? "true" : "false") << ')';
-        break;
-    case String:
-        os << "(\"" << v.toString().toStdString() << "\")";
-        break;
-    case Double:
-    {
-        double vDbl(v.toDouble());
-        int64_t vInt(v.toDouble());
-        if(vDbl==vInt)
-            //Integer
-            os << '(' << vInt << ')';
-        else
-            os << '(' << vDbl << ')';
-    }
-    }
-    return os;
+    static Fleet f;
+    return f;
 }
 
-std::ostream& operator << (std::ostream& os, const Device &d)
+//! Heap bytes of \a s; short strings live inside the object
+static size_t heapOf(const std::string &s)
 {
-    using std::endl;
-    os << "id=" << d._id << endl
-       << "desciption=\"" << d._description << "\"" << endl
-       << "serial=\"" << d._serial << "\"" << endl
-       << "status=\"" << d._status << "\"" << endl
-       << "is " << (d._is_onLine ? "" : "not ") << "on_line" << endl
-       << "is_synced=" << (d._is_synced==nullptr ? "null" : (d._is_synced ? "true" : "false")) << endl
-       << "maintenance strings:" << endl;
-    //Maintenance strings
-    for (size_t i=0; i<d._maintenance.size(); i++)
-        os << '\t' << i <<"\t\"" << d._maintenance[i] << '\"' << endl;
-    //Run object
-    os << "run:" << endl
-       << "\tchannel=\"" << d._run.channel << '\"' << endl
-       << "\tpublic_addr=\"" << d._run.public_addr << '\"' << endl
-       << "\tresolution=\"" << d._run.resolution << '\"' << endl
-       << "\trestarted at " << ctime(&d._run.restarted)
-       << "\ttag=\"" << d._run.tag << '\"' << endl
-       << "\tversion=\"" << d._run.version << '\"' << endl
-       << "\tpi_revision=\"" << d._run.pi_revision;
-
-    //Userdata
-    if(d._userdata!=nullptr)
-        os << "userdata="
-           << *(d._userdata)
-           << endl;
-
-
-    os << "\treboot at " << ctime(&d._reboot) << endl;
-
-    //Geo data
-    if (d._geo==nullptr)
-        os << "geo is Null" << endl;
-    else
-    {
-        os << "geo:" << endl
-           << "\tlat=" << d._geo->lat
-           << ", lon=" << d._geo->lon
-           << ", source=\"" << d._geo->source
-           << "\"" << endl;
-    }
+    return s.capacity()+1>sizeof(std::string) ? s.capacity()+1 : 0;
+}
 
-    //Setup data
-    if (d._setup==nullptr)
-        os << "setup is Null" << endl;
-    else
-    {
-        os << "setup:" << endl
-           << "\tid=" << d._setup->id
-           << ", name=\"" << d._setup->name
-           << ",\" updated at " << ctime(&d._setup->updated)
-           << endl;
-    }
+static size_t heapOf(const std::vector<std::string> &v)
+{
+    size_t n=v.capacity()*sizeof(std::string);
+    for(const auto &s: v)
+        n+=heapOf(s);
+    return n;
+}
 
-    //Hw
-    if (d._hw==nullptr)
-        os << "setup is Null" <<  endl;
-    else
+//! Rough: a fixed cost per value plus the UTF-16 text of keys and strings
+static size_t heapOf(const QJsonValue &root)
+{
+    size_t n=0;
+    std::vector<QJsonValue> stack{root};
+    while(!stack.empty())
     {
-        os << "hw:" << endl
-           << "\ttype=\"" << d._hw->hw_type
-           << "\", model=\"" << d._hw->model
-           << "\", memory=" << d._hw->memory
-           << "MB, platform=\"" << d._hw->platform
-           << "\"" << endl;
-        if(!d._hw->features.empty())
+        const QJsonValue v=std::move(stack.back());
+        stack.pop_back();
+        n+=16;
+        if(v.isString())
+            n+=size_t(v.toString().size())*2;
+        else if(v.isArray())
+        {
+            for(const QJsonValue &e: v.toArray())
+                stack.push_back(e);
+        }
+        else if(v.isObject())
         {
-            os << "\features:" << endl;
-            for(const auto &f: d._hw->features)
-                os << "\t\t\"" << f << "\"" << endl;
+            const QJsonObject o=v.toObject();
+            for(auto e=o.constBegin(); e!=o.constEnd(); ++e)
+            {
+                n+=size_t(e.key().size())*2;
+                stack.push_back(e.value());
+            }
         }
     }
+    return n;
+}
 
-    //offline
-    os << "offline"
-       << "\tlicensed=" << (d._offline.licensed ? "true" : "false")
-       << ", plan=\"" << d._offline.plan << "\""
-       << ", tmax_offline=" << d._offline.max_offline << " days"
-       << ", chargeable=" << d._offline.chargeable << " days" << endl;
+size_t Device::footprint() const
+{
+    size_t n=sizeof(Device)+heapOf(_description)+heapOf(_location)+heapOf(_serial)+heapOf(_status)
+            +heapOf(_maintenance);
+    n+=heapOf(_run.channel)+heapOf(_run.public_addr)+heapOf(_run.resolution)+heapOf(_run.tag)+heapOf(_run.version)
+        +heapOf(_run.boot_version)+heapOf(_run.base_version)+heapOf(_run.pi_revision)+heapOf(_run.features);
+    if(_userdata)
+        n+=heapOf(*_userdata);
+    if(_geo)
+        n+=heapOf(_geo->source);
+    if(_setup)
+        n+=heapOf(_setup->name);
+    if(_hw)
+        n+=heapOf(_hw->hw_type)+heapOf(_hw->model)+heapOf(_hw->platform)+heapOf(_hw->features);
+    return n+heapOf(_offline.plan);
+}
 
-    os << "upgrade_blocked=" << d._upgrade_blocked << " days" << endl;
+size_t Device::footprint(const std::vector<Device> &devices)
+{
+    size_t n=(devices.capacity()-devices.size())*sizeof(Device);
+    for(const auto &d: devices)
+        n+=d.footprint();
+    return n;
+}
+
+size_t Device::publishedFootprint()
+{
+    // Retired generations are not reachable from here; they are taken to be the size of the current one
+    const size_t generations=1+fleet().retired();
+    const Fleet::ReadGuard devices=snapshot();
+    return footprint(*devices)*generations;
+}
+
+void Device::poplulate(const QJsonObject &obj)
+{
+    publish(decode(obj));
+    const Fleet::ReadGuard devices=snapshot();
+    DeviceExporter::exportAll(*devices, DeviceExporter::Format::Text, stderr);
+}
+
+bool Device::operator==(const Device &o) const
+{
+    const auto sameRun=[](const RunObject &a, const RunObject &b)
+    {
+        return a.channel==b.channel && a.public_addr==b.public_addr && a.resolution==b.resolution
+                && a.restarted==b.restarted && a.tag==b.tag && a.version==b.version
+                && a.boot_version==b.boot_version && a.base_version==b.base_version
+                && a.pi_revision==b.pi_revision && a.features==b.features;
+    };
+    const auto sameGeo=[](const Geo &a, const Geo &b)
+    {
+        return a.lat==b.lat && a.lon==b.lon && a.source==b.source;
+    };
+    const auto sameSetup=[](const Setup &a, const Setup &b)
+    {
+        return a.id==b.id && a.name==b.name && a.updated==b.updated;
+    };
+    const auto sameHw=[](const Hw &a, const Hw &b)
+    {
+        return a.hw_type==b.hw_type && a.model==b.model && a.memory==b.memory
+                && a.platform==b.platform && a.features==b.features;
+    };
+    const auto sameOffline=[](const Offline &a, const Offline &b)
+    {
+        return a.licensed==b.licensed && a.plan==b.plan && a.max_offline==b.max_offline
+                && a.chargeable==b.chargeable;
+    };
+    // Optional members are equal if both are null or both hold equal values
+    const auto same=[](const auto &a, const auto &b, const auto &eq)
+    {
+        return bool(a)==bool(b) && (!a || eq(*a, *b));
+    };
+
+    return _id==o._id && _description==o._description && _location==o._location && _serial==o._serial
+            && _status==o._status && _is_onLine==o._is_onLine && _is_synced==o._is_synced
+            && _maintenance==o._maintenance && sameRun(_run, o._run) && _userdata==o._userdata
+            && _reboot==o._reboot && same(_geo, o._geo, sameGeo) && same(_setup, o._setup, sameSetup)
+            && same(_hw, o._hw, sameHw) && sameOffline(_offline, o._offline)
+            && _upgrade_blocked==o._upgrade_blocked;
+}
+
+/*!
+ * \brief operator <<
+ * Human readable dump of one device; see DeviceExporter for bulk and machine readable output.
+ */
+std::ostream& operator << (std::ostream& os, const Device &d)
+{
+    DeviceExporter e(DeviceExporter::Format::Text, OutBuffer::streamSink(os));
+    e.write(d);
     return os;
 }
 
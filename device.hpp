@@ -1,9 +1,12 @@
 #ifndef DEVICE_HPP
 #define DEVICE_HPP
 
+#include <cstdint>
+#include <map>
 #include <string>
 #include <vector>
 #include <iostream>
+#include <optional>
 
 #include <QJsonObject>
 #include <QJsonValue>
@@ -12,6 +15,7 @@
 #include <time.h>
 
 #include "InfoBeamer_API_Types.hpp"
+#include "rcu.hpp"
 
 namespace  InfoBeamer{
 
@@ -20,6 +24,29 @@ namespace  InfoBeamer{
  *
 */
 
+/*!
+ * \brief The DecodeDrift struct
+ * What a tolerant decode ran into, keyed by dotted field path ("run.restarted").  Counts add up over devices and
+ * refreshes, so a changed API field shows up as a steadily growing count rather than as a failed refresh.
+ */
+struct DecodeDrift
+{
+    uint64_t fastPath=0;    //! Devices that matched the expected schema
+    uint64_t slowPath=0;    //! Devices that had to be decoded field by field
+    uint64_t dropped=0;     //! Entries that are not objects or have no usable id
+    std::map<std::string, uint64_t> unknownKeys;
+    std::map<std::string, uint64_t> typeChanges;    //! "path:ActualType"
+    std::map<std::string, uint64_t> missingFields;
+
+    //! Anything beyond the fast path happened
+    bool drifted() const
+    {
+        return slowPath || dropped || !unknownKeys.empty() || !typeChanges.empty() || !missingFields.empty();
+    }
+    void merge(const DecodeDrift &o);
+    std::string summary() const;
+};
+
 /*!
  * \brief The Device class
  */
@@ -28,6 +55,48 @@ class Device
 {
 public:
     static void poplulate(const QJsonObject &obj);
+
+    enum class DecodeMode
+    {
+        Strict=0,   //! Any deviation from the expected schema throws DeviceException
+        Tolerant    //! Deviating devices are decoded field by field and the deviations counted in DecodeDrift
+    };
+
+    /*!
+     * \brief decode
+     * Decodes the "devices" array of a device/list response without touching the static device list.
+     *
+     * In Tolerant mode every device first takes the strict fast path.  Only a device it rejects is decoded again on
+     * the slow path, which substitutes defaults for missing or mistyped fields instead of throwing, so one odd device
+     * or one changed field does not fail the whole refresh.  Unknown keys are counted in both cases.  Only a
+     * response without a "devices" array still throws.
+     */
+    static std::vector<Device> decode(const QJsonObject &obj, DecodeMode mode=DecodeMode::Strict,
+                                      DecodeDrift *drift=nullptr);
+
+    typedef Rcu<std::vector<Device>> Fleet;
+
+    /*!
+     * \brief snapshot
+     * Pins the current fleet generation.  Safe from any thread and lock-free; the generation stays valid while the
+     * guard lives, however many publish() calls happen meanwhile.
+     */
+    static Fleet::ReadGuard snapshot() {return fleet().read();}
+
+    //! Replaces the fleet seen by snapshot() and returns the new generation number
+    static uint64_t publish(std::vector<Device> devices) {return fleet().publish(std::move(devices));}
+
+    //! Decodes a single device object, e.g. a device/{id} response; with \a drift as in Tolerant mode
+    static Device fromJson(const QJsonObject &obj, DecodeDrift *drift=nullptr);
+
+    //! Frees published generations no reader holds any more; publish() does that too, but only when called
+    static void reclaim() {fleet().reclaim();}
+    //! Approximate bytes held by the published fleet, replaced generations still waiting for readers included
+    static size_t publishedFootprint();
+    //! Approximate heap bytes of \a devices, unused capacity included
+    static size_t footprint(const std::vector<Device> &devices);
+    //! Approximate heap bytes held by this device, itself included
+    size_t footprint() const;
     /*!
      * @brief The RunObject struct
      */
@@ -100,16 +169,38 @@ public:
         int         chargeable;  //! Number of days offline before usage for this device is free.
     };
 
+    int                             id() const {return _id;}
+    const std::string              &description() const {return _description;}
+    const std::string              &location() const {return _location;}
+    const std::string              &serial() const {return _serial;}
+    const std::string              &status() const {return _status;}
+    bool                            isOnline() const {return _is_onLine;}
+    const std::optional<bool>      &isSynced() const {return _is_synced;}
+    const std::vector<std::string> &maintenance() const {return _maintenance;}
+    const RunObject                &run() const {return _run;}
+    const QJsonValue               *userdata() const {return _userdata ? &*_userdata : nullptr;}
+    time_t                          reboot() const {return _reboot;}
+    const Geo                      *geo() const {return _geo ? &*_geo : nullptr;}
+    const Setup                    *setup() const {return _setup ? &*_setup : nullptr;}
+    const Hw                       *hw() const {return _hw ? &*_hw : nullptr;}
+    const Offline                  &offline() const {return _offline;}
+    int                             upgradeBlocked() const {return _upgrade_blocked;}
+
+    bool operator==(const Device &o) const;
+    bool operator!=(const Device &o) const {return !(*this==o);}
+
 private:
     Device(const QJsonObject& obj);
+    Device(const QJsonObject& obj, DecodeDrift &drift);     //! Slow path, never throws
+    static void scanKeys(const QJsonObject &obj, DecodeDrift &drift);
 
-    int                     _id;                //! The numerical device id.
+    int                     _id=0;              //! The numerical device id.
     std::string             _description;       //! The device description as given on the Device page.
     std::string             _location;          //! The device location as given on the Device page.
     std::string             _serial;            //! The hardware serial number of the device.
     std::string             _status;            //! An informal string showing what the device is doing at the moment.
-    bool                    _is_onLine;         //! true if the device is online and has recently contacted the info-beamer hosted service.
-    bool*                   _is_synced=nullptr; //! Is the device in sync with what is configured on info-beamer hosted?
+    bool                    _is_onLine=false;   //! true if the device is online and has recently contacted the info-beamer hosted service.
+    std::optional<bool>     _is_synced;         //! Is the device in sync with what is configured on info-beamer hosted?
 
     /*!
      * \brief _maintenance
@@ -119,29 +210,30 @@ private:
      */
     std::vector<std::string>  _maintenance;
 
-    RunObject                 _run; //! See RunObject struct, above
+    RunObject                 _run{}; //! See RunObject struct, above
 
-    QJsonValue                *_userdata=nullptr;          //! User supplied opaque data assigned to this device. You can store any data for a device here.
+    std::optional<QJsonValue> _userdata;                   //! User supplied opaque data assigned to this device. You can store any data for a device here.
 
     /*!
      * \brief _reboot
      * The maintenance hour given in an offset from 0:00 in UTC time. The device might reboot in this hour if there is an important update.
      */
-    time_t                  _reboot;
+    time_t                  _reboot=0;
 
     /*!
      * \brief _geo
      * Geolocation information about this device. Can be null if the device hasn't been seen online yet or a device location isn't available.
      */
-    Geo*                    _geo=nullptr;
-
-    Setup*                  _setup;              //! Information about the assigned setup. Is null if no setup assigned yet
-    Hw                      *_hw=nullptr;        //! Information about the hardware
-    Offline                 _offline;            //! Offline support status. Warning, these fields are still work in progress and might change.
-    int                     _upgrade_blocked;    //! Number of days this device will not by subject to automated system upgrades.
-    static std::vector<Device> devices;
-    friend std::ostream& operator << (std::ostream& os, const Device &d);
+    std::optional<Geo>      _geo;
+
+    std::optional<Setup>    _setup;              //! Information about the assigned setup. Is null if no setup assigned yet
+    std::optional<Hw>       _hw;                 //! Information about the hardware
+    Offline                 _offline{};          //! Offline support status. Warning, these fields are still work in progress and might change.
+    int                     _upgrade_blocked=0;  //! Number of days this device will not by subject to automated system upgrades.
+
+    static Fleet &fleet();
 };
+std::ostream& operator << (std::ostream& os, const Device &d);
 typedef IBException<class Device> DeviceException;
 }
 #endif // DEVICE_HPP
@@ -0,0 +1,54 @@
+#include "devicedetails.hpp"
+
+#include <QDebug>
+
+#include "apiclient.hpp"
+#include "fanout.hpp"
+#include "jsonparser.hpp"
+
+namespace InfoBeamer {
+
+DeviceDetails::DeviceDetails(ApiClient *api, QObject *parent)
+    : QObject(parent)
+    , _api(api)
+    , _fanOut(new FanOut(api, this))
+{
+    connect(_fanOut, &FanOut::progress, this, &DeviceDetails::progress);
+    connect(_fanOut, &FanOut::drained, this, &DeviceDetails::finished);
+}
+
+void DeviceDetails::refresh(const std::vector<int> &ids)
+{
+    _fanOut->fitTo(QUrl(ApiClient::infoBeamerBase()));
+    for(int id: ids)
+    {
+        _fanOut->enqueue(_api->infoBeamerRequest(QString("device/%1").arg(id)), [this, id](const QByteArray &body)
+        {
+            const QJsonObject obj=JsonParser::fromJson(body).object();
+            try
+            {
+                emit detailReady(Device::fromJson(obj, &_drift));
+            }
+            catch (const DeviceException &e)
+            {
+                qDebug() << __func__ << "device" << id << "detail not decoded:" << e.what();
+            }
+        });
+    }
+}
+
+void DeviceDetails::refreshAll(const std::vector<Device> &fleet)
+{
+    std::vector<int> ids;
+    ids.reserve(fleet.size());
+    for(const auto &d: fleet)
+        ids.push_back(d.id());
+    refresh(ids);
+}
+
+void DeviceDetails::cancel()
+{
+    _fanOut->cancel();
+}
+
+}
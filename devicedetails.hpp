@@ -0,0 +1,51 @@
+#ifndef DEVICEDETAILS_HPP
+#define DEVICEDETAILS_HPP
+
+#include <QObject>
+
+#include <vector>
+
+#include "device.hpp"
+
+namespace InfoBeamer {
+
+class ApiClient;
+class FanOut;
+
+/*!
+ * \brief The DeviceDetails class
+ * Fetches device/{id} for many devices through a FanOut and hands back each decoded Device as it arrives, ready to
+ * be merged over the record from device/list.  Parallelism follows the connection: six requests over HTTP/1.1,
+ * more once the API host has been seen speaking HTTP/2.
+ */
+class DeviceDetails : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DeviceDetails(ApiClient *api, QObject *parent=nullptr);
+
+    void refresh(const std::vector<int> &ids);
+    void refreshAll(const std::vector<Device> &fleet);
+
+    //! Drops everything queued or in flight, e.g. when the view changes
+    void cancel();
+
+    FanOut *executor() const {return _fanOut;}
+
+    //! Schema deviations seen in device/{id} responses; those are decoded tolerantly too
+    const DecodeDrift &drift() const {return _drift;}
+
+signals:
+    void detailReady(const InfoBeamer::Device &device);
+    void progress(int done, int failed, int total);
+    void finished();
+
+private:
+    ApiClient   *_api;
+    FanOut      *_fanOut;
+    DecodeDrift  _drift;
+};
+
+}
+
+#endif // DEVICEDETAILS_HPP
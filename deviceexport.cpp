@@ -0,0 +1,636 @@
+#include "deviceexport.hpp"
+
+#include <QByteArray>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <ostream>
+
+namespace InfoBeamer {
+
+OutBuffer::OutBuffer(Sink sink, size_t capacity)
+    : _sink(std::move(sink))
+    , _capacity(capacity)
+{
+    _buf.reserve(capacity);
+}
+
+OutBuffer::~OutBuffer()
+{
+    flush();
+}
+
+OutBuffer::Sink OutBuffer::fileSink(std::FILE *f)
+{
+    return [f](const char *data, size_t len){std::fwrite(data, 1, len, f);};
+}
+
+OutBuffer::Sink OutBuffer::streamSink(std::ostream &os)
+{
+    return [&os](const char *data, size_t len){os.write(data, std::streamsize(len));};
+}
+
+OutBuffer &OutBuffer::put(const char *s, size_t len)
+{
+    if(_buf.size()+len>_capacity)
+    {
+        flush();
+        if(len>=_capacity)
+        {
+            _sink(s, len);
+            return *this;
+        }
+    }
+    _buf.insert(_buf.end(), s, s+len);
+    return *this;
+}
+
+OutBuffer &OutBuffer::put(const char *s)
+{
+    return put(s, std::strlen(s));
+}
+
+OutBuffer &OutBuffer::putInt(long long v)
+{
+    char tmp[24];
+    const auto r=std::to_chars(tmp, tmp+sizeof tmp, v);
+    return put(tmp, size_t(r.ptr-tmp));
+}
+
+OutBuffer &OutBuffer::putDouble(double v)
+{
+    if(!std::isfinite(v))
+        return put("null");
+#if defined(__cpp_lib_to_chars)
+    char tmp[32];
+    const auto r=std::to_chars(tmp, tmp+sizeof tmp, v);
+    return put(tmp, size_t(r.ptr-tmp));
+#else
+    // snprintf() honours LC_NUMERIC, which QApplication sets from the environment
+    const QByteArray tmp=QByteArray::number(v, 'g', 17);
+    return put(tmp.constData(), size_t(tmp.size()));
+#endif
+}
+
+void OutBuffer::flush()
+{
+    if(!_buf.empty())
+    {
+        _sink(_buf.data(), _buf.size());
+        _buf.clear();
+    }
+}
+
+static inline void twoDigits(char *out, unsigned v)
+{
+    out[0]=char('0'+v/10);
+    out[1]=char('0'+v%10);
+}
+
+void IsoTime::format(time_t t, char *out)
+{
+    long long secs=(long long)t;
+    long long day=secs/86400;
+    long long rem=secs%86400;
+    if(rem<0)
+    {
+        rem+=86400;
+        day--;
+    }
+    if(day!=_day)
+    {
+        // Civil date from days since 1970-01-01 (H. Hinnant's algorithm)
+        const long long z=day+719468;
+        const long long era=(z>=0 ? z : z-146096)/146097;
+        const unsigned doe=unsigned(z-era*146097);
+        const unsigned yoe=(doe-doe/1460+doe/36524-doe/146096)/365;
+        const unsigned doy=doe-(365*yoe+yoe/4-yoe/100);
+        const unsigned mp=(5*doy+2)/153;
+        const unsigned d=doy-(153*mp+2)/5+1;
+        const unsigned m=mp<10 ? mp+3 : mp-9;
+        const long long y=(long long)yoe+era*400+(m<=2);
+        const unsigned yy=unsigned(y<0 ? 0 : y>9999 ? 9999 : y);
+        twoDigits(_date, yy/100);
+        twoDigits(_date+2, yy%100);
+        _date[4]='-';
+        twoDigits(_date+5, m);
+        _date[7]='-';
+        twoDigits(_date+8, d);
+        _date[10]='T';
+        _day=day;
+    }
+    std::memcpy(out, _date, 11);
+    twoDigits(out+11, unsigned(rem/3600));
+    out[13]=':';
+    twoDigits(out+14, unsigned(rem/60%60));
+    out[16]=':';
+    twoDigits(out+17, unsigned(rem%60));
+    out[19]='Z';
+}
+
+std::string IsoTime::format(time_t t)
+{
+    char buf[20];
+    format(t, buf);
+    return std::string(buf, sizeof buf);
+}
+
+DeviceExporter::DeviceExporter(Format f, OutBuffer::Sink sink)
+    : _format(f)
+    , _out(std::move(sink))
+{
+}
+
+DeviceExporter::~DeviceExporter()
+{
+    finish();
+}
+
+void DeviceExporter::finish()
+{
+    _out.flush();
+}
+
+DeviceExporter::Format DeviceExporter::formatForPath(const std::string &path)
+{
+    const auto endsWith=[&path](const char *ext)
+    {
+        const size_t n=std::strlen(ext);
+        return path.size()>=n && path.compare(path.size()-n, n, ext)==0;
+    };
+    if(endsWith(".ndjson") || endsWith(".jsonl"))
+        return Format::NDJSON;
+    if(endsWith(".csv"))
+        return Format::CSV;
+    return Format::Text;
+}
+
+void DeviceExporter::exportAll(const std::vector<Device> &devices, Format f, std::FILE *out)
+{
+    DeviceExporter e(f, OutBuffer::fileSink(out));
+    e.write(devices);
+    e.finish();
+    std::fflush(out);
+}
+
+bool DeviceExporter::exportAll(const std::vector<Device> &devices, Format f, const std::string &path)
+{
+    std::FILE *out=std::fopen(path.c_str(), "wb");
+    if(out==nullptr)
+        return false;
+    exportAll(devices, f, out);
+    const bool ok=std::ferror(out)==0;
+    return std::fclose(out)==0 && ok;
+}
+
+void DeviceExporter::write(const std::vector<Device> &devices)
+{
+    for(const auto &d: devices)
+        write(d);
+}
+
+void DeviceExporter::write(const Device &d)
+{
+    switch(_format)
+    {
+    case Format::NDJSON:
+        writeJson(d);
+        break;
+    case Format::CSV:
+        writeCsv(d);
+        break;
+    case Format::Text:
+        writeText(d);
+        break;
+    }
+}
+
+void DeviceExporter::time(time_t t)
+{
+    char buf[20];
+    _iso.format(t, buf);
+    _out.put(buf, sizeof buf);
+}
+
+void DeviceExporter::jsonString(const std::string &s)
+{
+    static const char HEX[]="0123456789abcdef";
+    _out.put('"');
+    size_t run=0;
+    for(size_t i=0; i<s.size(); i++)
+    {
+        const unsigned char c=static_cast<unsigned char>(s[i]);
+        if(c>=0x20 && c!='"' && c!='\\')
+            continue;
+        _out.put(s.data()+run, i-run);
+        run=i+1;
+        switch(c)
+        {
+        case '"': _out.put("\\\"", 2); break;
+        case '\\': _out.put("\\\\", 2); break;
+        case '\n': _out.put("\\n", 2); break;
+        case '\r': _out.put("\\r", 2); break;
+        case '\t': _out.put("\\t", 2); break;
+        default:
+        {
+            const char esc[6]={'\\', 'u', '0', '0', HEX[c>>4], HEX[c & 0x0f]};
+            _out.put(esc, sizeof esc);
+        }
+        }
+    }
+    _out.put(s.data()+run, s.size()-run);
+    _out.put('"');
+}
+
+void DeviceExporter::jsonValue(const QJsonValue &v)
+{
+    switch(v.type())
+    {
+    case QJsonValue::Bool:
+        _out.put(v.toBool() ? "true" : "false");
+        break;
+    case QJsonValue::Double:
+    {
+        // Integral values print as integers; the cast is only defined for finite values within long long's range
+        const double d=v.toDouble();
+        if(d>=-9223372036854775808.0 && d<9223372036854775808.0 && std::trunc(d)==d)
+            _out.putInt((long long)d);
+        else
+            _out.putDouble(d);
+        break;
+    }
+    case QJsonValue::String:
+        _scratch=v.toString().toStdString();
+        jsonString(_scratch);
+        break;
+    case QJsonValue::Array:
+    {
+        const QJsonArray a=v.toArray();
+        _out.put('[');
+        for(qsizetype i=0; i<a.size(); i++)
+        {
+            if(i)
+                _out.put(',');
+            jsonValue(a[i]);
+        }
+        _out.put(']');
+        break;
+    }
+    case QJsonValue::Object:
+    {
+        const QJsonObject o=v.toObject();
+        _out.put('{');
+        bool first=true;
+        for(auto it=o.constBegin(); it!=o.constEnd(); ++it)
+        {
+            if(!first)
+                _out.put(',');
+            first=false;
+            _scratch=it.key().toStdString();
+            jsonString(_scratch);
+            _out.put(':');
+            jsonValue(it.value());
+        }
+        _out.put('}');
+        break;
+    }
+    default:
+        _out.put("null", 4);
+        break;
+    }
+}
+
+void DeviceExporter::writeJson(const Device &d)
+{
+    const auto key=[this](const char *k)
+    {
+        _out.put(k);
+    };
+    const auto strings=[this](const std::vector<std::string> &v)
+    {
+        _out.put('[');
+        for(size_t i=0; i<v.size(); i++)
+        {
+            if(i)
+                _out.put(',');
+            jsonString(v[i]);
+        }
+        _out.put(']');
+    };
+
+    key("{\"id\":");
+    _out.putInt(d.id());
+    key(",\"description\":");
+    jsonString(d.description());
+    key(",\"location\":");
+    jsonString(d.location());
+    key(",\"serial\":");
+    jsonString(d.serial());
+    key(",\"status\":");
+    jsonString(d.status());
+    key(",\"is_online\":");
+    _out.put(d.isOnline() ? "true" : "false");
+    key(",\"is_synced\":");
+    _out.put(!d.isSynced() ? "null" : *d.isSynced() ? "true" : "false");
+    key(",\"maintenance\":");
+    strings(d.maintenance());
+
+    const Device::RunObject &run=d.run();
+    key(",\"run\":{\"channel\":");
+    jsonString(run.channel);
+    key(",\"public_addr\":");
+    jsonString(run.public_addr);
+    key(",\"resolution\":");
+    jsonString(run.resolution);
+    key(",\"restarted\":");
+    _out.putInt((long long)run.restarted);
+    key(",\"restarted_iso\":\"");
+    time(run.restarted);
+    key("\",\"tag\":");
+    jsonString(run.tag);
+    key(",\"version\":");
+    jsonString(run.version);
+    key(",\"pi_revision\":");
+    jsonString(run.pi_revision);
+    key(",\"features\":");
+    strings(run.features);
+    _out.put('}');
+
+    key(",\"userdata\":");
+    if(d.userdata()!=nullptr)
+        jsonValue(*d.userdata());
+    else
+        _out.put("null", 4);
+
+    key(",\"reboot\":");
+    _out.putInt((long long)d.reboot());
+
+    key(",\"geo\":");
+    if(const Device::Geo *g=d.geo())
+    {
+        key("{\"lat\":");
+        _out.putDouble(g->lat);
+        key(",\"lon\":");
+        _out.putDouble(g->lon);
+        key(",\"source\":");
+        jsonString(g->source);
+        _out.put('}');
+    }
+    else
+        _out.put("null", 4);
+
+    key(",\"setup\":");
+    if(const Device::Setup *s=d.setup())
+    {
+        key("{\"id\":");
+        _out.putInt(s->id);
+        key(",\"name\":");
+        jsonString(s->name);
+        key(",\"updated\":");
+        _out.putInt((long long)s->updated);
+        _out.put('}');
+    }
+    else
+        _out.put("null", 4);
+
+    key(",\"hw\":");
+    if(const Device::Hw *h=d.hw())
+    {
+        key("{\"type\":");
+        jsonString(h->hw_type);
+        key(",\"model\":");
+        jsonString(h->model);
+        key(",\"memory\":");
+        _out.putInt(h->memory);
+        key(",\"platform\":");
+        jsonString(h->platform);
+        key(",\"features\":");
+        strings(h->features);
+        _out.put('}');
+    }
+    else
+        _out.put("null", 4);
+
+    const Device::Offline &off=d.offline();
+    key(",\"offline\":{\"licensed\":");
+    _out.put(off.licensed ? "true" : "false");
+    key(",\"plan\":");
+    jsonString(off.plan);
+    key(",\"max_offline\":");
+    _out.putInt(off.max_offline);
+    key(",\"chargeable\":");
+    _out.putInt(off.chargeable);
+    key("},\"upgrade_blocked\":");
+    _out.putInt(d.upgradeBlocked());
+    _out.put("}\n", 2);
+}
+
+void DeviceExporter::csvField(const std::string &s)
+{
+    if(s.find_first_of(",\"\r\n")==std::string::npos)
+    {
+        _out.put(s);
+        return;
+    }
+    _out.put('"');
+    size_t run=0;
+    for(size_t i=0; i<s.size(); i++)
+    {
+        if(s[i]!='"')
+            continue;
+        _out.put(s.data()+run, i+1-run);
+        _out.put('"');
+        run=i+1;
+    }
+    _out.put(s.data()+run, s.size()-run);
+    _out.put('"');
+}
+
+void DeviceExporter::writeCsv(const Device &d)
+{
+    if(!_headerDone)
+    {
+        _out.put("id,description,location,serial,status,is_online,is_synced,maintenance,"
+                 "channel,public_addr,resolution,restarted,tag,version,pi_revision,userdata,reboot,"
+                 "geo_lat,geo_lon,geo_source,setup_id,setup_name,setup_updated,"
+                 "hw_type,hw_model,hw_memory,hw_platform,"
+                 "offline_licensed,offline_plan,offline_max_offline,offline_chargeable,upgrade_blocked\n");
+        _headerDone=true;
+    }
+    const auto joined=[this](const std::vector<std::string> &v)
+    {
+        _scratch.clear();
+        for(size_t i=0; i<v.size(); i++)
+        {
+            if(i)
+                _scratch+=';';
+            _scratch+=v[i];
+        }
+        csvField(_scratch);
+    };
+
+    _out.putInt(d.id()).put(',');
+    csvField(d.description());
+    _out.put(',');
+    csvField(d.location());
+    _out.put(',');
+    csvField(d.serial());
+    _out.put(',');
+    csvField(d.status());
+    _out.put(',').put(d.isOnline() ? "true" : "false").put(',');
+    if(d.isSynced())
+        _out.put(*d.isSynced() ? "true" : "false");
+    _out.put(',');
+    joined(d.maintenance());
+
+    const Device::RunObject &run=d.run();
+    _out.put(',');
+    csvField(run.channel);
+    _out.put(',');
+    csvField(run.public_addr);
+    _out.put(',');
+    csvField(run.resolution);
+    _out.put(',');
+    time(run.restarted);
+    _out.put(',');
+    csvField(run.tag);
+    _out.put(',');
+    csvField(run.version);
+    _out.put(',');
+    csvField(run.pi_revision);
+    _out.put(',');
+    if(d.userdata()!=nullptr)
+    {
+        // Serialize through the JSON writer into a side buffer, then quote that as one field
+        std::string json;
+        {
+            DeviceExporter inner(Format::NDJSON, [&json](const char *p, size_t n){json.append(p, n);});
+            inner.jsonValue(*d.userdata());
+        }
+        csvField(json);
+    }
+    _out.put(',').putInt((long long)d.reboot()).put(',');
+
+    if(const Device::Geo *g=d.geo())
+    {
+        _out.putDouble(g->lat).put(',').putDouble(g->lon).put(',');
+        csvField(g->source);
+    }
+    else
+        _out.put(",,");
+    _out.put(',');
+
+    if(const Device::Setup *s=d.setup())
+    {
+        _out.putInt(s->id).put(',');
+        csvField(s->name);
+        _out.put(',');
+        time(s->updated);
+    }
+    else
+        _out.put(",,");
+    _out.put(',');
+
+    if(const Device::Hw *h=d.hw())
+    {
+        csvField(h->hw_type);
+        _out.put(',');
+        csvField(h->model);
+        _out.put(',').putInt(h->memory).put(',');
+        csvField(h->platform);
+    }
+    else
+        _out.put(",,,");
+    _out.put(',');
+
+    const Device::Offline &off=d.offline();
+    _out.put(off.licensed ? "true" : "false").put(',');
+    csvField(off.plan);
+    _out.put(',').putInt(off.max_offline).put(',').putInt(off.chargeable);
+    _out.put(',').putInt(d.upgradeBlocked()).put('\n');
+}
+
+void DeviceExporter::writeText(const Device &d)
+{
+    const auto quoted=[this](const char *label, const std::string &v)
+    {
+        _out.put(label).put("=\"").put(v).put("\"\n");
+    };
+
+    _out.put("id=").putInt(d.id()).put('\n');
+    quoted("description", d.description());
+    quoted("location", d.location());
+    quoted("serial", d.serial());
+    quoted("status", d.status());
+    _out.put("is ").put(d.isOnline() ? "" : "not ").put("on_line\n");
+    _out.put("is_synced=").put(!d.isSynced() ? "null" : *d.isSynced() ? "true" : "false").put('\n');
+    _out.put("maintenance strings:\n");
+    for(size_t i=0; i<d.maintenance().size(); i++)
+        _out.put('\t').putInt((long long)i).put("\t\"").put(d.maintenance()[i]).put("\"\n");
+
+    const Device::RunObject &run=d.run();
+    _out.put("run:\n");
+    quoted("\tchannel", run.channel);
+    quoted("\tpublic_addr", run.public_addr);
+    quoted("\tresolution", run.resolution);
+    _out.put("\trestarted at ");
+    time(run.restarted);
+    _out.put('\n');
+    quoted("\ttag", run.tag);
+    quoted("\tversion", run.version);
+    quoted("\tpi_revision", run.pi_revision);
+
+    if(d.userdata()!=nullptr)
+    {
+        _out.put("userdata=");
+        jsonValue(*d.userdata());
+        _out.put('\n');
+    }
+
+    _out.put("reboot hour=").putInt((long long)d.reboot()).put(" UTC\n");
+
+    if(const Device::Geo *g=d.geo())
+    {
+        _out.put("geo:\n\tlat=").putDouble(g->lat).put(", lon=").putDouble(g->lon)
+                .put(", source=\"").put(g->source).put("\"\n");
+    }
+    else
+        _out.put("geo is Null\n");
+
+    if(const Device::Setup *s=d.setup())
+    {
+        _out.put("setup:\n\tid=").putInt(s->id).put(", name=\"").put(s->name).put("\", updated at ");
+        time(s->updated);
+        _out.put('\n');
+    }
+    else
+        _out.put("setup is Null\n");
+
+    if(const Device::Hw *h=d.hw())
+    {
+        _out.put("hw:\n\ttype=\"").put(h->hw_type).put("\", model=\"").put(h->model)
+                .put("\", memory=").putInt(h->memory).put("MB, platform=\"").put(h->platform).put("\"\n");
+        if(!h->features.empty())
+        {
+            _out.put("\tfeatures:\n");
+            for(const auto &f: h->features)
+                _out.put("\t\t\"").put(f).put("\"\n");
+        }
+    }
+    else
+        _out.put("hw is Null\n");
+
+    const Device::Offline &off=d.offline();
+    _out.put("offline\tlicensed=").put(off.licensed ? "true" : "false")
+            .put(", plan=\"").put(off.plan).put('"')
+            .put(", max_offline=").putInt(off.max_offline).put(" days")
+            .put(", chargeable=").putInt(off.chargeable).put(" days\n");
+    _out.put("upgrade_blocked=").putInt(d.upgradeBlocked()).put(" days\n");
+}
+
+}
@@ -0,0 +1,121 @@
+#ifndef DEVICEEXPORT_HPP
+#define DEVICEEXPORT_HPP
+
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "device.hpp"
+
+class QJsonValue;
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The OutBuffer class
+ * Reusable output buffer in front of a sink (file, pipe, ostream).  Formatting appends into the buffer, which is
+ * handed to the sink in large batches; nothing is flushed per line.
+ */
+class OutBuffer
+{
+public:
+    typedef std::function<void(const char *data, size_t len)> Sink;
+
+    explicit OutBuffer(Sink sink, size_t capacity=64*1024);
+    ~OutBuffer();
+    OutBuffer(const OutBuffer &)=delete;
+    OutBuffer &operator=(const OutBuffer &)=delete;
+
+    static Sink fileSink(std::FILE *f);
+    static Sink streamSink(std::ostream &os);
+
+    OutBuffer &put(char c)
+    {
+        if(_buf.size()>=_capacity)
+            flush();
+        _buf.push_back(c);
+        return *this;
+    }
+    OutBuffer &put(const char *s, size_t len);
+    OutBuffer &put(const char *s);
+    OutBuffer &put(const std::string &s) {return put(s.data(), s.size());}
+    OutBuffer &putInt(long long v);
+    //! Shortest form that reads back the same; NaN and the infinities, which have no JSON number, as null
+    OutBuffer &putDouble(double v);
+
+    void flush();
+
+private:
+    Sink                _sink;
+    size_t              _capacity;
+    std::vector<char>   _buf;
+};
+
+/*!
+ * \brief The IsoTime class
+ * ISO-8601 UTC formatter (2023-04-01T12:34:56Z) without ctime()/gmtime().  The date part only changes once a day, so
+ * it is cached in the instance and reused across calls; use one instance per thread.
+ */
+class IsoTime
+{
+public:
+    //! Writes exactly 20 characters to \a out
+    void format(time_t t, char *out);
+    std::string format(time_t t);
+
+private:
+    long long   _day=-1;
+    char        _date[11]={};
+};
+
+/*!
+ * \brief The DeviceExporter class
+ * Writes devices as NDJSON (one object per line), CSV (with a header row) or the human readable layout that
+ * operator<<(std::ostream&, const Device&) produces.
+ */
+class DeviceExporter
+{
+public:
+    enum class Format
+    {
+        NDJSON=0,
+        CSV,
+        Text
+    };
+
+    DeviceExporter(Format f, OutBuffer::Sink sink);
+    ~DeviceExporter();
+
+    void write(const Device &d);
+    void write(const std::vector<Device> &devices);
+    void finish();
+
+    //! Picks the format from a file name: .ndjson/.jsonl, .csv, anything else is Text
+    static Format formatForPath(const std::string &path);
+
+    static void exportAll(const std::vector<Device> &devices, Format f, std::FILE *out);
+    static bool exportAll(const std::vector<Device> &devices, Format f, const std::string &path);
+
+private:
+    void writeJson(const Device &d);
+    void writeCsv(const Device &d);
+    void writeText(const Device &d);
+
+    void jsonString(const std::string &s);
+    void jsonValue(const QJsonValue &v);
+    void csvField(const std::string &s);
+    void time(time_t t);
+
+    Format      _format;
+    OutBuffer   _out;
+    IsoTime     _iso;
+    bool        _headerDone=false;
+    std::string _scratch;
+};
+
+}
+
+#endif // DEVICEEXPORT_HPP
@@ -0,0 +1,162 @@
+#include "devicequery.hpp"
+
+#include <QList>
+
+#include <algorithm>
+
+namespace InfoBeamer {
+
+static bool parseBool(const QByteArray &v, bool &ok)
+{
+    ok=true;
+    if(v=="1" || v=="true" || v=="yes")
+        return true;
+    if(v=="0" || v=="false" || v=="no")
+        return false;
+    ok=false;
+    return false;
+}
+
+DeviceQuery DeviceQuery::parse(const QByteArray &query, QString *error)
+{
+    DeviceQuery q;
+    const auto fail=[&](const QByteArray &key){
+        if(error!=nullptr)
+            *error=QString("bad query parameter \"%1\"").arg(QString::fromUtf8(key));
+        return DeviceQuery();
+    };
+
+    for(const QByteArray &kv: query.split('&'))
+    {
+        if(kv.isEmpty())
+            continue;
+        const qsizetype eq=kv.indexOf('=');
+        const QByteArray key=eq<0 ? kv : kv.left(eq);
+        QByteArray raw=eq<0 ? QByteArray() : kv.mid(eq+1);
+        raw.replace('+', ' ');
+        const QByteArray value=QByteArray::fromPercentEncoding(raw);
+        bool ok=true;
+
+        if(key=="online")
+            q._online=parseBool(value, ok);
+        else if(key=="channel")
+            q._channel=value.toStdString();
+        else if(key=="status")
+            q._status=value.toStdString();
+        else if(key=="model")
+            q._model=value.toStdString();
+        else if(key=="setup")
+            q._setup=value.toInt(&ok);
+        else if(key=="q")
+            q._text=QString::fromUtf8(value);
+        else if(key=="offset")
+            q._offset=size_t(value.toULongLong(&ok));
+        else if(key=="limit")
+            q._limit=size_t(value.toULongLong(&ok));
+        else if(key=="id")
+        {
+            for(const QByteArray &id: value.split(','))
+            {
+                q._ids.push_back(id.toInt(&ok));
+                if(!ok)
+                    break;
+            }
+        }
+        else
+            ok=false;
+
+        if(!ok)
+            return fail(key);
+    }
+    std::sort(q._ids.begin(), q._ids.end());
+    return q;
+}
+
+bool DeviceQuery::matchesAll() const
+{
+    return !_online && !_channel && !_status && !_model && !_setup && _ids.empty() && _text.isEmpty()
+            && _offset==0 && !_limit;
+}
+
+bool DeviceQuery::matches(const Device &d) const
+{
+    if(_online && d.isOnline()!=*_online)
+        return false;
+    if(_channel && d.run().channel!=*_channel)
+        return false;
+    if(_status && d.status()!=*_status)
+        return false;
+    if(_model && (d.hw()==nullptr || d.hw()->model!=*_model))
+        return false;
+    if(_setup && (d.setup()==nullptr || d.setup()->id!=*_setup))
+        return false;
+    if(!_ids.empty() && !std::binary_search(_ids.begin(), _ids.end(), d.id()))
+        return false;
+    if(!_text.isEmpty())
+    {
+        const auto has=[this](const std::string &s){
+            return QString::fromStdString(s).contains(_text, Qt::CaseInsensitive);
+        };
+        if(!has(d.description()) && !has(d.location()) && !has(d.serial()))
+            return false;
+    }
+    return true;
+}
+
+std::vector<size_t> DeviceQuery::select(const std::vector<Device> &devices) const
+{
+    std::vector<size_t> result;
+    size_t skipped=0;
+    for(size_t i=0; i<devices.size(); i++)
+    {
+        if(_limit && result.size()>=*_limit)
+            break;
+        if(!matches(devices[i]))
+            continue;
+        if(skipped<_offset)
+        {
+            skipped++;
+            continue;
+        }
+        result.push_back(i);
+    }
+    return result;
+}
+
+QByteArray DeviceQuery::canonical() const
+{
+    QByteArray key;
+    const auto add=[&key](const char *name, const QByteArray &value){
+        key+=name;
+        key+='=';
+        key+=value.toPercentEncoding();
+        key+='&';
+    };
+    if(_online)
+        add("online", *_online ? "1" : "0");
+    if(_channel)
+        add("channel", QByteArray::fromStdString(*_channel));
+    if(_status)
+        add("status", QByteArray::fromStdString(*_status));
+    if(_model)
+        add("model", QByteArray::fromStdString(*_model));
+    if(_setup)
+        add("setup", QByteArray::number(*_setup));
+    if(!_ids.empty())
+    {
+        QByteArray ids;
+        for(int id: _ids)
+            ids+=QByteArray::number(id)+',';
+        ids.chop(1);
+        add("id", ids);
+    }
+    if(!_text.isEmpty())
+        add("q", _text.toUtf8());
+    if(_offset)
+        add("offset", QByteArray::number(qulonglong(_offset)));
+    if(_limit)
+        add("limit", QByteArray::number(qulonglong(*_limit)));
+    return key;
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef DEVICEQUERY_HPP
+#define DEVICEQUERY_HPP
+
+#include <QByteArray>
+#include <QString>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "device.hpp"
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The DeviceQuery class
+ * Filter over devices, built from URL query parameters:
+ *
+ *   online=true|false   channel=stable   status=Running   model=...   setup=<id>   id=1,2,3
+ *   q=<text>            matches description, location or serial, case-insensitively
+ *   offset=, limit=     paging over the matches, in fleet order
+ *
+ * All given conditions must hold.  Unknown parameters are an error rather than silently ignored.
+ */
+class DeviceQuery
+{
+public:
+    //! Parses "a=b&c=d" (percent encoded); on error returns a match-all query and sets \a error
+    static DeviceQuery parse(const QByteArray &query, QString *error=nullptr);
+
+    bool matches(const Device &d) const;
+
+    //! Indices into \a devices of the matches after offset and limit
+    std::vector<size_t> select(const std::vector<Device> &devices) const;
+
+    bool matchesAll() const;
+
+    //! Parameters in a fixed order, so equal queries give equal keys (for caching)
+    QByteArray canonical() const;
+
+private:
+    std::optional<bool>         _online;
+    std::optional<std::string>  _channel;
+    std::optional<std::string>  _status;
+    std::optional<std::string>  _model;
+    std::optional<int>          _setup;
+    std::vector<int>            _ids;
+    QString                     _text;
+    size_t                      _offset=0;
+    std::optional<size_t>       _limit;
+};
+
+}
+
+#endif // DEVICEQUERY_HPP
@@ -0,0 +1,69 @@
+#include "devicesearchdialog.hpp"
+
+#include <QElapsedTimer>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QVBoxLayout>
+
+#include "fleetpoller.hpp"
+
+namespace InfoBeamer {
+
+DeviceSearchDialog::DeviceSearchDialog(FleetPoller *poller, QWidget *parent)
+    : QDialog(parent)
+    , _poller(poller)
+    , _query(new QLineEdit(this))
+    , _results(new QListWidget(this))
+    , _status(new QLabel(this))
+{
+    setWindowTitle("Search Devices");
+    _query->setPlaceholderText("Description, location, serial or userdata");
+    _query->setClearButtonEnabled(true);
+
+    auto *layout=new QVBoxLayout(this);
+    layout->addWidget(_query);
+    layout->addWidget(_results);
+    layout->addWidget(_status);
+    resize(520, 400);
+
+    connect(_query, &QLineEdit::textChanged, this, &DeviceSearchDialog::search);
+    connect(_poller, &FleetPoller::fleetChanged, this, &DeviceSearchDialog::fleetChanged);
+    fleetChanged();
+}
+
+void DeviceSearchDialog::fleetChanged()
+{
+    // Rows are looked up through the poller's own id index, which it keeps current anyway
+    search();
+}
+
+void DeviceSearchDialog::search()
+{
+    _results->clear();
+    const QString query=_query->text();
+    if(query.trimmed().isEmpty())
+    {
+        _status->setText(QString("%1 devices indexed").arg(_poller->searchIndex().size()));
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const std::vector<int> ids=_poller->searchIndex().search(query, MAX_RESULTS);
+    const qint64 ns=timer.nsecsElapsed();
+
+    for(int id: ids)
+    {
+        const Device *d=_poller->device(id);
+        if(d==nullptr)
+            continue;
+        _results->addItem(QString("%1  %2 - %3 (%4)").arg(id)
+                          .arg(QString::fromStdString(d->description()), QString::fromStdString(d->location()),
+                               QString::fromStdString(d->serial())));
+    }
+    _status->setText(QString("%1%2 matches in %3 us")
+                     .arg(ids.size()).arg(ids.size()>=size_t(MAX_RESULTS) ? "+" : "").arg(ns/1000.0, 0, 'f', 1));
+}
+
+}
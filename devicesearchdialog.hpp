@@ -0,0 +1,41 @@
+#ifndef DEVICESEARCHDIALOG_HPP
+#define DEVICESEARCHDIALOG_HPP
+
+#include <QDialog>
+
+class QLabel;
+class QLineEdit;
+class QListWidget;
+
+namespace InfoBeamer {
+
+class FleetPoller;
+
+/*!
+ * \brief The DeviceSearchDialog class
+ * Search-as-you-type over the poller's fleet through its SearchIndex.  Every keystroke runs a query; results follow
+ * fleet refreshes while the dialog is open.
+ */
+class DeviceSearchDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    //! Results shown at most; the search stops once it has this many
+    static const int MAX_RESULTS=200;
+
+    explicit DeviceSearchDialog(FleetPoller *poller, QWidget *parent=nullptr);
+
+private slots:
+    void search();
+    void fleetChanged();
+
+private:
+    FleetPoller    *_poller;
+    QLineEdit      *_query;
+    QListWidget    *_results;
+    QLabel         *_status;
+};
+
+}
+
+#endif // DEVICESEARCHDIALOG_HPP
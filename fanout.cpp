@@ -0,0 +1,107 @@
+#include "fanout.hpp"
+
+#include <QNetworkReply>
+
+#include "apiclient.hpp"
+
+namespace InfoBeamer {
+
+FanOut::FanOut(ApiClient *api, QObject *parent)
+    : QObject(parent)
+    , _api(api)
+{
+}
+
+void FanOut::setMaxInFlight(int n)
+{
+    _maxInFlight=qMax(1, n);
+    pump();
+}
+
+void FanOut::fitTo(const QUrl &url)
+{
+    setMaxInFlight(_api->speaksHttp2(url) ? HTTP2_PARALLEL : HTTP1_PARALLEL);
+}
+
+void FanOut::enqueue(const QNetworkRequest &req, Handler onDone, Failure onFailed)
+{
+    _queue.push_back({req, std::move(onDone), std::move(onFailed), false, QByteArray()});
+    _total++;
+    pump();
+}
+
+void FanOut::enqueuePost(const QNetworkRequest &req, const QByteArray &body, Handler onDone, Failure onFailed)
+{
+    _queue.push_back({req, std::move(onDone), std::move(onFailed), true, body});
+    _total++;
+    pump();
+}
+
+void FanOut::cancel()
+{
+    _queue.clear();
+    // Take the running set first: abort() emits finished synchronously
+    const QHash<QNetworkReply *, Running> running=std::move(_running);
+    _running.clear();
+    for(auto r=running.keyBegin(); r!=running.keyEnd(); ++r)
+    {
+        (*r)->disconnect(this);
+        (*r)->abort();
+        (*r)->deleteLater();
+    }
+    _total=_done=_failed=0;
+}
+
+void FanOut::pump()
+{
+    while(!_queue.empty() && _running.size()<_maxInFlight)
+    {
+        Job job=std::move(_queue.front());
+        _queue.pop_front();
+        QNetworkReply *reply=job.post ? _api->post(job.req, job.body) : _api->get(job.req);
+        _running.insert(reply, {std::move(job.done), std::move(job.failed), QByteArray()});
+        connect(reply, &QNetworkReply::readyRead, this, &FanOut::onReadyRead);
+        connect(reply, &QNetworkReply::finished, this, &FanOut::onFinished);
+    }
+}
+
+void FanOut::onReadyRead()
+{
+    QNetworkReply *reply=qobject_cast<QNetworkReply *>(sender());
+    const auto r=_running.find(reply);
+    if(r!=_running.end())
+        _api->read(reply, r->body);
+}
+
+void FanOut::onFinished()
+{
+    QNetworkReply *reply=qobject_cast<QNetworkReply *>(sender());
+    reply->deleteLater();
+    const auto r=_running.find(reply);
+    if(r==_running.end())
+        return;
+    Running job=std::move(r.value());
+    _running.erase(r);
+
+    if(reply->error()==QNetworkReply::NoError && _api->read(reply, job.body))
+    {
+        _done++;
+        job.done(job.body);
+    }
+    else
+    {
+        _failed++;
+        if(job.failed)
+            job.failed(reply);
+    }
+    emit progress(_done, _failed, _total);
+
+    pump();
+    if(idle())
+    {
+        _total=_done=_failed=0;
+        emit drained();
+    }
+}
+
+}
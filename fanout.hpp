@@ -0,0 +1,92 @@
+#ifndef FANOUT_HPP
+#define FANOUT_HPP
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QNetworkRequest>
+#include <QUrl>
+
+#include <deque>
+#include <functional>
+
+class QNetworkReply;
+
+namespace InfoBeamer {
+
+class ApiClient;
+
+/*!
+ * \brief The FanOut class
+ * Bounded-concurrency executor for batches of GET requests.  Jobs queue up and at most maxInFlight() of them are
+ * on the wire at once; as each finishes the next one starts.  cancel() drops the queue and aborts whatever is
+ * running, and no handler of a cancelled job is called.
+ *
+ * Handlers run on the GUI thread: the done handler with the decoded body of a reply without a network error, the
+ * failure handler, if one was given, with any other reply while it is still readable (status, Retry-After, ...).
+ */
+class FanOut : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<void(const QByteArray &body)> Handler;
+    typedef std::function<void(QNetworkReply *reply)> Failure;
+
+    //! Qt opens at most six HTTP/1.1 connections per host; more parallelism only pays off over HTTP/2
+    static const int HTTP1_PARALLEL=6;
+    static const int HTTP2_PARALLEL=32;
+
+    explicit FanOut(ApiClient *api, QObject *parent=nullptr);
+
+    void setMaxInFlight(int n);
+    int maxInFlight() const {return _maxInFlight;}
+    //! HTTP2_PARALLEL once the server \a url points at has answered over HTTP/2, HTTP1_PARALLEL until then
+    void fitTo(const QUrl &url);
+
+    void enqueue(const QNetworkRequest &req, Handler onDone, Failure onFailed=Failure());
+    //! Like enqueue(), POSTing \a body
+    void enqueuePost(const QNetworkRequest &req, const QByteArray &body, Handler onDone, Failure onFailed=Failure());
+    void cancel();
+
+    int queued() const {return int(_queue.size());}
+    int inFlight() const {return _running.size();}
+    bool idle() const {return _queue.empty() && _running.isEmpty();}
+
+signals:
+    void progress(int done, int failed, int total);
+    void drained();                 //! Everything enqueued since the last drain has finished or failed
+
+private slots:
+    void onReadyRead();
+    void onFinished();
+
+private:
+    struct Job
+    {
+        QNetworkRequest req;
+        Handler         done;
+        Failure         failed;
+        bool            post=false;
+        QByteArray      body;
+    };
+    struct Running
+    {
+        Handler         done;
+        Failure         failed;
+        QByteArray      body;
+    };
+
+    void pump();
+
+    ApiClient                       *_api;
+    int                              _maxInFlight=HTTP1_PARALLEL;
+    std::deque<Job>                  _queue;
+    QHash<QNetworkReply *, Running>  _running;
+    int                              _total=0;
+    int                              _done=0;
+    int                              _failed=0;
+};
+
+}
+
+#endif // FANOUT_HPP
@@ -0,0 +1,83 @@
+#include "fleetaggregates.hpp"
+
+namespace InfoBeamer {
+
+void FleetAggregates::reset(const std::vector<Device> &devices, time_t now)
+{
+    *this=FleetAggregates();
+    for(const auto &d: devices)
+        add(d, now);
+}
+
+void FleetAggregates::apply(const FleetDiff &diff, time_t now)
+{
+    expire(now);
+    for(const auto &d: diff.removed)
+        remove(d);
+    for(const auto &c: diff.changed)
+    {
+        remove(c.first);
+        add(c.second, now);
+    }
+    for(const auto &d: diff.added)
+        add(d, now);
+}
+
+size_t FleetAggregates::restarts(time_t now)
+{
+    expire(now);
+    return _restarts.size();
+}
+
+void FleetAggregates::add(const Device &d, time_t now)
+{
+    _devices++;
+    ChannelCount &channel=_channels[d.run().channel];
+    if(d.isOnline())
+    {
+        _online++;
+        channel.online++;
+    }
+    else
+        channel.offline++;
+    if(!d.maintenance().empty())
+        _maintenance++;
+    if(d.upgradeBlocked()>0)
+        _upgradeBlocked++;
+    _versions[d.run().version]++;
+    if(d.run().restarted>=now-RESTART_WINDOW)
+        _restarts.insert(d.run().restarted);
+}
+
+void FleetAggregates::remove(const Device &d)
+{
+    _devices--;
+    const auto channel=_channels.find(d.run().channel);
+    if(d.isOnline())
+    {
+        _online--;
+        channel->second.online--;
+    }
+    else
+        channel->second.offline--;
+    if(channel->second.online+channel->second.offline==0)
+        _channels.erase(channel);
+    if(!d.maintenance().empty())
+        _maintenance--;
+    if(d.upgradeBlocked()>0)
+        _upgradeBlocked--;
+    const auto version=_versions.find(d.run().version);
+    if(--version->second==0)
+        _versions.erase(version);
+    // Already gone if it has left the window since it was added
+    const auto restart=_restarts.find(d.run().restarted);
+    if(restart!=_restarts.end())
+        _restarts.erase(restart);
+}
+
+void FleetAggregates::expire(time_t now)
+{
+    _restarts.erase(_restarts.begin(), _restarts.lower_bound(now-RESTART_WINDOW));
+}
+
+}
@@ -0,0 +1,66 @@
+#ifndef FLEETAGGREGATES_HPP
+#define FLEETAGGREGATES_HPP
+
+#include <ctime>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "device.hpp"
+#include "fleetdiff.hpp"
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The FleetAggregates class
+ * Fleet health counters and histograms kept up to date from FleetDiffs, so reading them never walks the devices.
+ * reset() does the one full pass, for the first snapshot; every later refresh costs only its added, removed and
+ * changed devices.
+ *
+ * Restarts are counted over a sliding window: restart times inside it are kept ordered and the ones that fall out
+ * are dropped when the count is read.
+ */
+class FleetAggregates
+{
+public:
+    struct ChannelCount
+    {
+        size_t online=0;
+        size_t offline=0;
+    };
+
+    static const time_t RESTART_WINDOW=60*60;
+
+    void reset(const std::vector<Device> &devices, time_t now);
+    void apply(const FleetDiff &diff, time_t now);
+
+    size_t devices() const {return _devices;}
+    size_t online() const {return _online;}
+    size_t offline() const {return _devices-_online;}
+    size_t maintenance() const {return _maintenance;}           //! Devices with any maintenance flag
+    size_t upgradeBlocked() const {return _upgradeBlocked;}
+
+    //! Devices that restarted within RESTART_WINDOW before \a now
+    size_t restarts(time_t now);
+
+    const std::map<std::string, size_t> &versions() const {return _versions;}
+    const std::map<std::string, ChannelCount> &channels() const {return _channels;}
+
+private:
+    void add(const Device &d, time_t now);
+    void remove(const Device &d);
+    void expire(time_t now);
+
+    size_t                                  _devices=0;
+    size_t                                  _online=0;
+    size_t                                  _maintenance=0;
+    size_t                                  _upgradeBlocked=0;
+    std::multiset<time_t>                   _restarts;      //! Restart times not older than the window
+    std::map<std::string, size_t>           _versions;      //! run.version -> devices
+    std::map<std::string, ChannelCount>     _channels;      //! run.channel -> devices
+};
+
+}
+
+#endif // FLEETAGGREGATES_HPP
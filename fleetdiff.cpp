@@ -0,0 +1,43 @@
+#include "fleetdiff.hpp"
+
+#include <unordered_map>
+
+namespace InfoBeamer {
+
+size_t FleetDiff::onlineFlips() const
+{
+    size_t n=0;
+    for(const auto &c: changed)
+        if(c.first.isOnline()!=c.second.isOnline())
+            n++;
+    return n;
+}
+
+FleetDiff FleetDiff::compute(const std::vector<Device> &before, const std::vector<Device> &after)
+{
+    FleetDiff diff;
+    std::unordered_map<int, const Device *> old;
+    old.reserve(before.size());
+    for(const auto &d: before)
+        old.emplace(d.id(), &d);
+
+    for(const auto &d: after)
+    {
+        const auto o=old.find(d.id());
+        if(o==old.end())
+        {
+            diff.added.push_back(d);
+            continue;
+        }
+        if(*o->second!=d)
+            diff.changed.emplace_back(*o->second, d);
+        old.erase(o);
+    }
+    // Whatever was not matched is gone; keep the old list order
+    for(const auto &d: before)
+        if(old.count(d.id()))
+            diff.removed.push_back(d);
+    return diff;
+}
+
+}
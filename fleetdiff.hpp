@@ -0,0 +1,32 @@
+#ifndef FLEETDIFF_HPP
+#define FLEETDIFF_HPP
+
+#include <utility>
+#include <vector>
+
+#include "device.hpp"
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The FleetDiff struct
+ * Difference between two device/list snapshots, matched by device id.  Only this is pushed to the UI on a refresh.
+ */
+struct FleetDiff
+{
+    std::vector<Device>                     added;
+    std::vector<Device>                     removed;
+    std::vector<std::pair<Device, Device>>  changed;    //! (before, after)
+
+    bool empty() const {return added.empty() && removed.empty() && changed.empty();}
+    size_t size() const {return added.size()+removed.size()+changed.size();}
+
+    //! Number of changed devices whose is_online flag flipped
+    size_t onlineFlips() const;
+
+    static FleetDiff compute(const std::vector<Device> &before, const std::vector<Device> &after);
+};
+
+}
+
+#endif // FLEETDIFF_HPP
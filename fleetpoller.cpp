@@ -0,0 +1,218 @@
+#include "fleetpoller.hpp"
+
+#include <QDebug>
+#include <QNetworkReply>
+
+#include "apiclient.hpp"
+#include "jsonparser.hpp"
+
+namespace InfoBeamer {
+
+static const int DEFAULT_MIN_INTERVAL_MS=5*1000;
+static const int DEFAULT_MAX_INTERVAL_MS=5*60*1000;
+static const int INITIAL_INTERVAL_MS=30*1000;
+
+FleetPoller::FleetPoller(ApiClient *api, QObject *parent)
+    : FleetPoller(api, Account::builtIn(), parent)
+{
+}
+
+FleetPoller::FleetPoller(ApiClient *api, const Account &account, QObject *parent)
+    : QObject(parent)
+    , _api(api)
+    , _account(account)
+    , _minInterval(DEFAULT_MIN_INTERVAL_MS)
+    , _maxInterval(DEFAULT_MAX_INTERVAL_MS)
+    , _interval(INITIAL_INTERVAL_MS)
+{
+    _timer.setSingleShot(true);
+    connect(&_timer, &QTimer::timeout, this, &FleetPoller::pollNow);
+}
+
+void FleetPoller::start()
+{
+    _active=true;
+    pollNow();
+}
+
+void FleetPoller::stop()
+{
+    _active=false;
+    _timer.stop();
+}
+
+void FleetPoller::setIntervalBounds(int minMs, int maxMs)
+{
+    _minInterval=qMax(1000, minMs);
+    _maxInterval=qMax(_minInterval, maxMs);
+    setInterval(qBound(_minInterval, _interval, _maxInterval));
+}
+
+void FleetPoller::setInterval(int ms)
+{
+    if(ms==_interval)
+        return;
+    _interval=ms;
+    emit intervalChanged(ms);
+}
+
+void FleetPoller::merge(const Device &device)
+{
+    const auto i=_index.find(device.id());
+    if(i==_index.end())
+        return;
+    Device &d=_snapshot[i->second];
+    if(d==device)
+        return;
+    // Only the first merge sees the list record; later ones replace a merged record
+    _listed.emplace(d.id(), d);
+    FleetDiff diff;
+    diff.changed.emplace_back(d, device);
+    d=device;
+    _aggregates.apply(diff, time(nullptr));
+    _search.apply(diff);
+    publishLater();
+    emit fleetChanged(diff);
+}
+
+const Device *FleetPoller::device(int id) const
+{
+    const auto i=_index.find(id);
+    return i==_index.end() ? nullptr : &_snapshot[i->second];
+}
+
+void FleetPoller::reindex()
+{
+    _index.clear();
+    _index.reserve(_snapshot.size());
+    for(size_t i=0; i<_snapshot.size(); i++)
+        _index.emplace(_snapshot[i].id(), i);
+}
+
+void FleetPoller::keepMerged(FleetDiff &diff)
+{
+    std::unordered_map<int, Device> listed;
+    auto out=diff.changed.begin();
+    for(auto &c: diff.changed)
+    {
+        const auto l=_listed.find(c.first.id());
+        if(l!=_listed.end() && l->second==c.second)
+        {
+            // device/list says what it said when the detail was merged: no change, the merged record stays
+            _snapshot[_index.at(c.first.id())]=std::move(c.first);
+            listed.insert(std::move(*l));
+            continue;
+        }
+        *out++=std::move(c);
+    }
+    diff.changed.erase(out, diff.changed.end());
+    // Devices the list changed or dropped are plain list records again
+    _listed.swap(listed);
+}
+
+void FleetPoller::publishLater()
+{
+    if(!_publishing || _publishPending)
+        return;
+    _publishPending=true;
+    QTimer::singleShot(0, this, [this]{
+        _publishPending=false;
+        Device::publish(_snapshot);
+    });
+}
+
+void FleetPoller::schedule()
+{
+    // The next poll is only armed once the previous one is done, so polls never overlap
+    if(_active && _reply==nullptr)
+        _timer.start(_interval);
+}
+
+void FleetPoller::pollNow()
+{
+    if(_reply!=nullptr)
+        return;
+    _timer.stop();
+    _buffer.clear();
+    _reply=_api->get(_api->infoBeamerRequest("device/list", _account));
+    connect(_reply, &QNetworkReply::readyRead, this, &FleetPoller::onReadyRead);
+    connect(_reply, &QNetworkReply::finished, this, &FleetPoller::onFinished);
+}
+
+void FleetPoller::onReadyRead()
+{
+    _api->read(_reply, _buffer);
+}
+
+void FleetPoller::fail(const QString &error)
+{
+    // Back off the same way as on a quiet fleet, whether the request or its payload failed
+    setInterval(qMin(_maxInterval, _interval*2));
+    emit pollFailed(error);
+    schedule();
+}
+
+void FleetPoller::onFinished()
+{
+    QNetworkReply *reply=_reply;
+    _reply=nullptr;
+    reply->deleteLater();
+
+    if(reply->error()!=QNetworkReply::NoError || !_api->read(reply, _buffer))
+    {
+        _buffer.clear();
+        fail(_api->errorString(reply));
+        return;
+    }
+
+    QJsonParseError err;
+    const QJsonObject json=JsonParser::fromJson(_buffer, &err).object();
+    QByteArray payload;
+    payload.swap(_buffer);
+    if(err.error!=QJsonParseError::NoError)
+    {
+        fail(err.errorString());
+        return;
+    }
+
+    std::vector<Device> fleet;
+    DecodeDrift drift;
+    try
+    {
+        fleet=Device::decode(json, Device::DecodeMode::Tolerant, &drift);
+    }
+    catch (const DeviceException &e)
+    {
+        fail(e.what());
+        return;
+    }
+    if(drift.drifted())
+        qDebug() << __func__ << _account.name << "schema drift:" << drift.summary().c_str();
+    _drift.merge(drift);
+
+    FleetDiff diff=FleetDiff::compute(_snapshot, fleet);
+    _snapshot.swap(fleet);
+    reindex();
+    if(!_listed.empty())
+        keepMerged(diff);
+    // The first diff adds every device, so this also covers the initial load
+    _aggregates.apply(diff, time(nullptr));
+    _search.apply(diff);
+    // Published before refreshed() goes out, so listeners pinning Device::snapshot() see this refresh
+    if(_publishing && !diff.empty())
+        Device::publish(_snapshot);
+
+    if(!_loaded)
+        _loaded=true;
+    else if(diff.empty())
+        setInterval(qMin(_maxInterval, _interval+_interval/2));
+    else
+        setInterval(qMax(_minInterval, _interval/2));
+
+    emit refreshed(json, payload);
+    if(!diff.empty())
+        emit fleetChanged(diff);
+    schedule();
+}
+
+}
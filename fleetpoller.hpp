@@ -0,0 +1,134 @@
+#ifndef FLEETPOLLER_HPP
+#define FLEETPOLLER_HPP
+
+#include <QObject>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QMetaType>
+#include <QTimer>
+
+#include <unordered_map>
+#include <vector>
+
+#include "account.hpp"
+#include "device.hpp"
+#include "fleetaggregates.hpp"
+#include "fleetdiff.hpp"
+#include "searchindex.hpp"
+
+class QNetworkReply;
+
+namespace InfoBeamer {
+
+class ApiClient;
+
+/*!
+ * \brief The FleetPoller class
+ * Refreshes device/list in the background.  The interval adapts to the fleet: it halves (down to the minimum)
+ * after a refresh that changed any device and grows by half (up to the maximum) after one that did not, so a
+ * flapping fleet is watched closely and a stable one costs few requests.
+ *
+ * At most one request is ever in flight; pollNow() while one is running is folded into it.  Listeners get the
+ * computed FleetDiff rather than the whole fleet.
+ *
+ * device/list is decoded in DecodeMode::Tolerant, so a device that no longer matches the expected schema is decoded
+ * field by field instead of failing the refresh; what deviated is accumulated in drift().
+ */
+class FleetPoller : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FleetPoller(ApiClient *api, QObject *parent=nullptr);
+    //! Polls the fleet of \a account instead of the built-in one
+    FleetPoller(ApiClient *api, const Account &account, QObject *parent=nullptr);
+
+    const Account &account() const {return _account;}
+
+    void start();
+    void stop();
+    bool isActive() const {return _active;}
+
+    /*!
+     * \brief pollNow
+     * Refreshes immediately, unless a refresh is already in flight, in which case its result serves this call too.
+     */
+    void pollNow();
+    bool inFlight() const {return _reply!=nullptr;}
+
+    int interval() const {return _interval;}
+    void setIntervalBounds(int minMs, int maxMs);
+
+    const std::vector<Device> &snapshot() const {return _snapshot;}
+    //! The device with \a id in snapshot(), nullptr if there is none; valid until the next refresh or merge
+    const Device *device(int id) const;
+
+    //! Health counters for snapshot(), updated from every diff
+    FleetAggregates &aggregates() {return _aggregates;}
+
+    //! Full-text index over snapshot(), updated from every diff
+    const SearchIndex &searchIndex() const {return _search;}
+
+    //! Schema deviations seen over all refreshes so far
+    const DecodeDrift &drift() const {return _drift;}
+
+    /*!
+     * \brief setPublishing
+     * Also publish every new snapshot as the global fleet generation (Device::publish()), for readers on other
+     * threads.  Merges are folded into one publication per event loop pass.
+     */
+    void setPublishing(bool on) {_publishing=on;}
+
+    /*!
+     * \brief merge
+     * Replaces the snapshot record with the id of \a device, e.g. with a fresher device/{id} result, and reports the
+     * change through fleetChanged().  Devices not in the snapshot are ignored.
+     *
+     * The merged record stands until device/list itself reports the device differently from the list record it was
+     * merged over; fields only the detail carries therefore do not show up as changes on every refresh.
+     */
+    void merge(const Device &device);
+
+signals:
+    void refreshed(const QJsonObject &json, const QByteArray &payload); //! Every successful poll, parsed and raw
+    void fleetChanged(const InfoBeamer::FleetDiff &diff); //! Only when the fleet actually changed
+    void pollFailed(const QString &error);
+    void intervalChanged(int ms);
+
+private slots:
+    void onReadyRead();
+    void onFinished();
+
+private:
+    void schedule();
+    void setInterval(int ms);
+    //! Reports a failed poll and backs off
+    void fail(const QString &error);
+    void publishLater();
+    void reindex();
+    void keepMerged(FleetDiff &diff);
+
+    ApiClient           *_api;
+    Account              _account;
+    QNetworkReply       *_reply=nullptr;
+    QByteArray           _buffer;
+    QTimer               _timer;
+    bool                 _active=false;
+    bool                 _loaded=false;      //! The first snapshot says nothing about flapping
+    bool                 _publishing=false;
+    bool                 _publishPending=false;
+    int                  _minInterval;
+    int                  _maxInterval;
+    int                  _interval;
+    std::vector<Device>  _snapshot;
+    std::unordered_map<int, size_t> _index;     //! Device id -> position in _snapshot
+    std::unordered_map<int, Device> _listed;    //! device/list record of every device merge() replaced
+    FleetAggregates      _aggregates;
+    SearchIndex          _search;
+    DecodeDrift          _drift;
+};
+
+}
+
+Q_DECLARE_METATYPE(InfoBeamer::FleetDiff)
+
+#endif // FLEETPOLLER_HPP
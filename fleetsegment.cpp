@@ -0,0 +1,303 @@
+#include "fleetsegment.hpp"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+
+#include <cstring>
+#include <string>
+
+#include "device.hpp"
+#include "fleetstore.hpp"
+
+namespace InfoBeamer {
+
+static_assert(sizeof(FleetSegment::Header)%8==0 && sizeof(FleetSegment::Record)%8==0,
+              "records must stay 8 byte aligned behind the header");
+
+static const quint32 DIRECTORY_MAGIC=0x49424644;  // "IBFD"
+
+namespace {
+
+//! Builds the records and the pool of a write() in the worker's own memory
+class Encoder
+{
+public:
+    void add(const QString &account, const Device &d)
+    {
+        FleetSegment::Record r{};
+        r.id=d.id();
+        r.upgradeBlocked=d.upgradeBlocked();
+        r.online=d.isOnline();
+        r.synced=d.isSynced() ? qint8(*d.isSynced()) : qint8(-1);
+        r.reboot=qint64(d.reboot());
+        r.restarted=qint64(d.run().restarted);
+        if(const Device::Geo *geo=d.geo())
+        {
+            r.hasGeo=1;
+            r.lat=geo->lat;
+            r.lon=geo->lon;
+        }
+        if(const Device::Setup *setup=d.setup())
+        {
+            r.setupId=setup->id;
+            r.setupName=str(setup->name);
+        }
+        if(const Device::Hw *hw=d.hw())
+        {
+            r.memory=hw->memory;
+            r.model=str(hw->model);
+        }
+        // Every device of an account carries the same name; it is pooled once per account
+        if(account!=_account)
+        {
+            _account=account;
+            _accountStr=str(account.toStdString());
+        }
+        r.account=_accountStr;
+        r.description=str(d.description());
+        r.location=str(d.location());
+        r.serial=str(d.serial());
+        r.status=str(d.status());
+        r.channel=str(d.run().channel);
+        r.publicAddr=str(d.run().public_addr);
+        r.version=str(d.run().version);
+        records.push_back(r);
+    }
+
+    quint64 bytes() const
+    {
+        return sizeof(FleetSegment::Header)+records.size()*sizeof(FleetSegment::Record)+pool.size();
+    }
+
+    std::vector<FleetSegment::Record> records;
+    std::string                       pool;
+
+private:
+    FleetSegment::Str str(const std::string &s)
+    {
+        const FleetSegment::Str ref{quint32(pool.size()), quint32(s.size())};
+        pool+=s;
+        return ref;
+    }
+
+    QString           _account;
+    FleetSegment::Str _accountStr{0, 0};
+};
+
+}
+
+FleetSegment::FleetSegment(const QString &key)
+    : _key(key)
+    , _memory(key)
+{
+}
+
+FleetSegment::~FleetSegment()
+{
+    detach();
+}
+
+bool FleetSegment::create(qint64 bytes)
+{
+    if(!_memory.create(bytes, QSharedMemory::ReadWrite))
+    {
+        // On Unix a segment outlives a crashed creator; take it over if it is large enough
+        if(_memory.error()!=QSharedMemory::AlreadyExists || !_memory.attach(QSharedMemory::ReadWrite))
+            return false;
+        if(_memory.size()<bytes)
+        {
+            qDebug() << __func__ << _key << "exists with" << _memory.size() << "bytes, need" << bytes;
+            _memory.detach();
+            return false;
+        }
+    }
+    if(!_memory.lock())
+        return false;
+    Header *h=static_cast<Header *>(_memory.data());
+    std::memset(h, 0, sizeof(Header));
+    h->version=VERSION;
+    h->capacity=quint64(_memory.size());
+    h->magic=MAGIC;
+    _memory.unlock();
+    return true;
+}
+
+bool FleetSegment::attach(QSharedMemory::AccessMode mode)
+{
+    return _memory.isAttached() || _memory.attach(mode);
+}
+
+void FleetSegment::detach()
+{
+    if(_memory.isAttached())
+        _memory.detach();
+}
+
+bool FleetSegment::write(const FleetStore &store)
+{
+    Encoder e;
+    e.records.reserve(store.size());
+    store.forEach([&e](const QString &account, const Device &d){e.add(account, d);});
+
+    if(!_memory.isAttached() || !_memory.lock())
+        return false;
+    char *base=static_cast<char *>(_memory.data());
+    Header *h=reinterpret_cast<Header *>(base);
+    h->required=e.bytes();
+    if(e.bytes()>quint64(_memory.size()))
+    {
+        _memory.unlock();
+        return false;
+    }
+    // Invalid until the header is complete again
+    h->magic=0;
+    const size_t recordBytes=e.records.size()*sizeof(Record);
+    std::memcpy(base+sizeof(Header), e.records.data(), recordBytes);
+    std::memcpy(base+sizeof(Header)+recordBytes, e.pool.data(), e.pool.size());
+    h->version=VERSION;
+    h->generation++;
+    h->capacity=quint64(_memory.size());
+    h->count=quint32(e.records.size());
+    h->stringsSize=quint32(e.pool.size());
+    h->writtenMs=QDateTime::currentMSecsSinceEpoch();
+    h->pid=QCoreApplication::applicationPid();
+    h->magic=MAGIC;
+    _memory.unlock();
+    return true;
+}
+
+quint64 FleetSegment::required()
+{
+    if(!_memory.isAttached() || !_memory.lock())
+        return 0;
+    const quint64 bytes=static_cast<const Header *>(_memory.constData())->required;
+    _memory.unlock();
+    return bytes;
+}
+
+FleetSegment::View::View(FleetSegment &segment)
+    : _segment(segment)
+{
+    if(!segment._memory.isAttached() || !segment._memory.lock())
+        return;
+    _locked=true;
+    const char *base=static_cast<const char *>(segment._memory.constData());
+    const Header *h=reinterpret_cast<const Header *>(base);
+    if(h->magic!=MAGIC || h->version!=VERSION)
+        return;
+    if(sizeof(Header)+quint64(h->count)*sizeof(Record)+h->stringsSize>quint64(segment._memory.size()))
+        return;
+    _header=h;
+    _records=reinterpret_cast<const Record *>(base+sizeof(Header));
+    _strings=reinterpret_cast<const char *>(_records+h->count);
+}
+
+FleetSegment::View::~View()
+{
+    if(_locked)
+        _segment._memory.unlock();
+}
+
+std::string_view FleetSegment::View::string(const Str &s) const
+{
+    if(!_header || quint64(s.offset)+s.size>_header->stringsSize)
+        return std::string_view();
+    return std::string_view(_strings+s.offset, s.size);
+}
+
+FleetSegmentDirectory::FleetSegmentDirectory(const QString &prefix)
+    : _prefix(prefix)
+    , _memory(prefix)
+{
+}
+
+bool FleetSegmentDirectory::create(int shards)
+{
+    if(shards<1 || shards>MAX_SHARDS)
+        return false;
+    if(!_memory.create(sizeof(Table), QSharedMemory::ReadWrite)
+            && (_memory.error()!=QSharedMemory::AlreadyExists || !_memory.attach(QSharedMemory::ReadWrite)))
+        return false;
+    if(!_memory.lock())
+        return false;
+    Table *t=static_cast<Table *>(_memory.data());
+    std::memset(t, 0, sizeof(Table));
+    t->shards=shards;
+    t->magic=DIRECTORY_MAGIC;
+    _memory.unlock();
+    return true;
+}
+
+bool FleetSegmentDirectory::attach()
+{
+    return _memory.isAttached() || _memory.attach(QSharedMemory::ReadOnly);
+}
+
+int FleetSegmentDirectory::shards()
+{
+    if(!_memory.isAttached() || !_memory.lock())
+        return 0;
+    const Table *t=static_cast<const Table *>(_memory.constData());
+    const int shards=t->magic==DIRECTORY_MAGIC ? qBound(0, int(t->shards), MAX_SHARDS) : 0;
+    _memory.unlock();
+    return shards;
+}
+
+int FleetSegmentDirectory::epoch(int shard)
+{
+    if(shard<0 || shard>=MAX_SHARDS || !_memory.isAttached() || !_memory.lock())
+        return 0;
+    const int epoch=static_cast<const Table *>(_memory.constData())->epochs[shard];
+    _memory.unlock();
+    return epoch;
+}
+
+void FleetSegmentDirectory::setEpoch(int shard, int epoch)
+{
+    if(shard<0 || shard>=MAX_SHARDS || !_memory.isAttached() || !_memory.lock())
+        return;
+    static_cast<Table *>(_memory.data())->epochs[shard]=epoch;
+    _memory.unlock();
+}
+
+QString FleetSegmentDirectory::segmentKey(const QString &prefix, int shard, int epoch)
+{
+    return QString("%1-%2-%3").arg(prefix).arg(shard).arg(epoch);
+}
+
+SharedFleetReader::SharedFleetReader(const QString &prefix)
+    : _directory(prefix)
+{
+}
+
+bool SharedFleetReader::attach()
+{
+    if(!_directory.attach())
+    {
+        _error=_directory.errorString();
+        return false;
+    }
+    refresh();
+    return true;
+}
+
+void SharedFleetReader::refresh()
+{
+    const int shards=_directory.shards();
+    _shards.resize(size_t(shards));
+    for(int i=0; i<shards; i++)
+    {
+        Shard &s=_shards[size_t(i)];
+        const int epoch=_directory.epoch(i);
+        if(s.epoch==epoch && s.segment && s.segment->isAttached())
+            continue;
+        s.epoch=epoch;
+        s.segment=std::make_unique<FleetSegment>(FleetSegmentDirectory::segmentKey(_directory.prefix(), i, epoch));
+        // Not there yet while the supervisor replaces it; tried again next time
+        if(!s.segment->attach())
+            qDebug() << __func__ << "shard" << i << ":" << s.segment->errorString();
+    }
+}
+
+}
@@ -0,0 +1,216 @@
+#ifndef FLEETSEGMENT_HPP
+#define FLEETSEGMENT_HPP
+
+#include <QSharedMemory>
+#include <QString>
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace InfoBeamer {
+
+class FleetStore;
+
+/*!
+ * \brief The FleetSegment class
+ * The devices of one poller worker in shared memory, laid out so that another process can map the segment and read
+ * it in place: a header, fixed size records and a string pool, addressed by offsets from the start of the segment
+ * rather than by pointers.
+ *
+ * The worker builds the image in its own memory and copies it in under the segment's lock, header last, so a worker
+ * dying halfway leaves a segment that reads as empty rather than garbled.  Readers hold the same lock while a View
+ * lives.
+ *
+ * A segment cannot grow.  A fleet that does not fit is not written; required() then tells how large the segment has to
+ * be, and whoever created it creates a larger one under the next epoch of the key (see FleetSegmentDirectory).
+ */
+class FleetSegment
+{
+public:
+    static const quint32 MAGIC=0x49424653;  // "IBFS"
+    static const quint32 VERSION=1;
+
+    //! A string in the pool
+    struct Str
+    {
+        quint32 offset;
+        quint32 size;
+    };
+
+    struct Record
+    {
+        qint32  id;
+        qint32  upgradeBlocked;
+        qint32  setupId;            //! 0 without a setup
+        qint32  memory;             //! Hardware memory in MB, 0 if unknown
+        qint8   online;
+        qint8   synced;             //! -1 unknown
+        qint8   hasGeo;
+        qint8   reserved;
+        qint32  reserved2;
+        qint64  reboot;
+        qint64  restarted;
+        double  lat;
+        double  lon;
+        Str     account;
+        Str     description;
+        Str     location;
+        Str     serial;
+        Str     status;
+        Str     channel;
+        Str     publicAddr;
+        Str     version;
+        Str     setupName;
+        Str     model;
+    };
+
+    struct Header
+    {
+        quint32 magic;              //! 0 while a write is under way or after it was cut short
+        quint32 version;
+        quint64 generation;         //! Bumped by every write()
+        quint64 capacity;           //! Bytes of the whole segment
+        quint64 required;           //! Bytes the last write() needed, whether it fit or not
+        quint32 count;
+        quint32 stringsSize;        //! The pool follows the records
+        qint64  writtenMs;          //! Since the epoch
+        qint64  pid;                //! Of the writer
+    };
+
+    explicit FleetSegment(const QString &key);
+    ~FleetSegment();
+
+    const QString &key() const {return _key;}
+    QString errorString() const {return _memory.errorString();}
+
+    //! Creates the segment with room for \a bytes, holding no devices; an orphan left by a crash is reused if it fits
+    bool create(qint64 bytes);
+    bool attach(QSharedMemory::AccessMode mode=QSharedMemory::ReadOnly);
+    void detach();
+    bool isAttached() const {return _memory.isAttached();}
+    qint64 capacity() const {return _memory.isAttached() ? _memory.size() : 0;}
+
+    //! Replaces the contents with every device of \a store; false if they do not fit (see required()) or on error
+    bool write(const FleetStore &store);
+    //! What the last write() needed
+    quint64 required();
+
+    /*!
+     * \brief The View class
+     * Reads the segment in place while it lives.  Strings point into the segment and are only valid meanwhile.
+     */
+    class View
+    {
+    public:
+        explicit View(FleetSegment &segment);
+        ~View();
+        View(const View &)=delete;
+        View &operator=(const View &)=delete;
+
+        //! The segment holds a complete fleet
+        bool isValid() const {return _header!=nullptr;}
+        quint64 generation() const {return _header ? _header->generation : 0;}
+        quint32 size() const {return _header ? _header->count : 0;}
+        qint64 writtenMs() const {return _header ? _header->writtenMs : 0;}
+        qint64 pid() const {return _header ? _header->pid : 0;}
+
+        const Record &at(quint32 i) const {return _records[i];}
+        //! Empty for a reference outside the pool
+        std::string_view string(const Str &s) const;
+
+    private:
+        FleetSegment    &_segment;
+        bool             _locked=false;
+        const Header    *_header=nullptr;
+        const Record    *_records=nullptr;
+        const char      *_strings=nullptr;
+    };
+
+private:
+    QString         _key;
+    QSharedMemory   _memory;
+};
+
+/*!
+ * \brief The FleetSegmentDirectory class
+ * Names the current segment of every shard.  The supervisor creates it under the bare prefix and bumps a shard's epoch
+ * when it replaces that shard's segment with a larger one; readers find the segments through it.
+ */
+class FleetSegmentDirectory
+{
+public:
+    static const int MAX_SHARDS=64;
+
+    explicit FleetSegmentDirectory(const QString &prefix);
+
+    bool create(int shards);
+    bool attach();
+    QString errorString() const {return _memory.errorString();}
+
+    int shards();
+    int epoch(int shard);
+    void setEpoch(int shard, int epoch);
+
+    //! Key of the segment of \a shard in \a epoch
+    static QString segmentKey(const QString &prefix, int shard, int epoch);
+    const QString &prefix() const {return _prefix;}
+
+private:
+    struct Table
+    {
+        quint32 magic;
+        qint32  shards;
+        qint32  epochs[MAX_SHARDS];
+    };
+
+    QString         _prefix;
+    QSharedMemory   _memory;
+};
+
+/*!
+ * \brief The SharedFleetReader class
+ * Maps the segments of every shard of a supervisor, following them when they are replaced, without copying or
+ * decoding them.
+ */
+class SharedFleetReader
+{
+public:
+    explicit SharedFleetReader(const QString &prefix);
+
+    //! Attaches the directory and every shard it names; false if there is no directory (no supervisor running)
+    bool attach();
+    QString errorString() const {return _error;}
+
+    //! Calls \a f with a View of every shard that holds a fleet; reattaches shards whose segment was replaced
+    template<typename F>
+    void forEach(F f)
+    {
+        refresh();
+        for(auto &s: _shards)
+        {
+            if(!s.segment || !s.segment->isAttached())
+                continue;
+            FleetSegment::View view(*s.segment);
+            if(view.isValid())
+                f(view);
+        }
+    }
+
+private:
+    struct Shard
+    {
+        int                            epoch=-1;
+        std::unique_ptr<FleetSegment>  segment;
+    };
+
+    void refresh();
+
+    FleetSegmentDirectory  _directory;
+    std::vector<Shard>     _shards;
+    QString                _error;
+};
+
+}
+
+#endif // FLEETSEGMENT_HPP
@@ -0,0 +1,111 @@
+#include "fleetstore.hpp"
+
+#include "fleetpoller.hpp"
+
+namespace InfoBeamer {
+
+FleetStore::FleetStore(ApiClient *api, QObject *parent)
+    : QObject(parent)
+    , _api(api)
+{
+}
+
+FleetStore::~FleetStore()
+{
+}
+
+void FleetStore::setAccounts(const std::vector<Account> &accounts)
+{
+    for(auto *p: _pollers)
+        p->deleteLater();
+    _pollers.clear();
+    _pending.clear();
+
+    for(const auto &a: accounts)
+    {
+        auto *p=new FleetPoller(_api, a, this);
+        const QString name=a.name;
+        connect(p, &FleetPoller::fleetChanged, this, [this, name](const FleetDiff &diff){
+            emit accountChanged(name, diff);
+        });
+        connect(p, &FleetPoller::refreshed, this, [this, name]{settle(name, true);});
+        connect(p, &FleetPoller::pollFailed, this, [this, name](const QString &error){
+            emit accountFailed(name, error);
+            settle(name, false);
+        });
+        _pollers.push_back(p);
+    }
+    if(_active)
+        start();
+}
+
+void FleetStore::start()
+{
+    _active=true;
+    pollAll();
+    for(auto *p: _pollers)
+        p->start();
+}
+
+void FleetStore::stop()
+{
+    _active=false;
+    for(auto *p: _pollers)
+        p->stop();
+}
+
+void FleetStore::pollAll()
+{
+    _pending.clear();
+    _roundFailed=0;
+    _round.start();
+    for(auto *p: _pollers)
+    {
+        _pending.insert(p->account().name);
+        p->pollNow();
+    }
+}
+
+void FleetStore::settle(const QString &account, bool ok)
+{
+    if(!_pending.remove(account))
+        return;
+    if(!ok)
+        _roundFailed++;
+    if(_pending.isEmpty())
+        emit roundFinished(_round.elapsed(), _roundFailed);
+}
+
+QStringList FleetStore::accountNames() const
+{
+    QStringList names;
+    for(const auto *p: _pollers)
+        names.append(p->account().name);
+    return names;
+}
+
+size_t FleetStore::size() const
+{
+    size_t n=0;
+    for(const auto *p: _pollers)
+        n+=p->snapshot().size();
+    return n;
+}
+
+const std::vector<Device> &FleetStore::devices(const QString &account) const
+{
+    static const std::vector<Device> none;
+    for(const auto *p: _pollers)
+        if(p->account().name==account)
+            return p->snapshot();
+    return none;
+}
+
+void FleetStore::forEach(const std::function<void(const QString &, const Device &)> &f) const
+{
+    for(const auto *p: _pollers)
+        for(const auto &d: p->snapshot())
+            f(p->account().name, d);
+}
+
+}
@@ -0,0 +1,75 @@
+#ifndef FLEETSTORE_HPP
+#define FLEETSTORE_HPP
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+#include <functional>
+#include <vector>
+
+#include "account.hpp"
+#include "device.hpp"
+#include "fleetdiff.hpp"
+
+namespace InfoBeamer {
+
+class ApiClient;
+class FleetPoller;
+
+/*!
+ * \brief The FleetStore class
+ * Unified view over the fleets of many accounts.  Every account gets its own FleetPoller, i.e. its own request queue
+ * and adaptive interval, and all of them share the ApiClient's connections; a refresh of every account therefore
+ * costs about the latency of the slowest account rather than the sum.  (Over HTTP/1.1 Qt caps connections per host
+ * at six, over HTTP/2 the requests are multiplexed on one connection.)
+ *
+ * Device ids are only unique within an account, so devices are always addressed together with their account name.
+ */
+class FleetStore : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FleetStore(ApiClient *api, QObject *parent=nullptr);
+    ~FleetStore();
+
+    //! Replaces the monitored accounts; pollers of the previous set are dropped
+    void setAccounts(const std::vector<Account> &accounts);
+    size_t accounts() const {return _pollers.size();}
+    //! Names of the monitored accounts, in the order given
+    QStringList accountNames() const;
+
+    void start();
+    void stop();
+    bool isActive() const {return _active;}
+
+    //! Refreshes every account at once; roundFinished() reports when the last one is done
+    void pollAll();
+
+    //! Devices over all accounts
+    size_t size() const;
+    //! Snapshot of \a account, empty if unknown
+    const std::vector<Device> &devices(const QString &account) const;
+    void forEach(const std::function<void(const QString &account, const Device &device)> &f) const;
+
+signals:
+    void accountChanged(const QString &account, const InfoBeamer::FleetDiff &diff);
+    void accountFailed(const QString &account, const QString &error);
+    void roundFinished(qint64 ms, int failed);
+
+private:
+    void settle(const QString &account, bool ok);
+
+    ApiClient                  *_api;
+    std::vector<FleetPoller *>  _pollers;
+    bool                        _active=false;
+    QSet<QString>               _pending;       //! Accounts the current pollAll() still waits for
+    int                         _roundFailed=0;
+    QElapsedTimer               _round;
+};
+
+}
+
+#endif // FLEETSTORE_HPP
@@ -0,0 +1,663 @@
+#include "githubcrawler.hpp"
+
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QNetworkReply>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <iterator>
+
+#include "apiclient.hpp"
+#include "jsonparser.hpp"
+
+namespace InfoBeamer {
+
+static const char CHECKPOINT[]="crawl.json";
+static const char EDGES[]="edges.csv";
+static const char EDGES_HEADER[]="follower_id,follower,followee_id,followee\n";
+//! 2: the visited set keeps an expanded flag where version 1 kept the top bit of the hops
+static const int CHECKPOINT_VERSION=2;
+static const int CHECKPOINT_INTERVAL_MS=30*1000;
+static const int MAX_ATTEMPTS=3;
+//! Users at maxHops are recorded too, so the set has to hold one more
+static const int MAX_HOPS=VisitedSet::MAX_HOPS-1;
+
+static QJsonObject readJson(const QString &path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return QJsonObject();
+    return JsonParser::fromJson(file.readAll()).object();
+}
+
+static bool writeJson(const QString &path, const QJsonObject &obj)
+{
+    QSaveFile file(path);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+// VisitedSet
+
+size_t VisitedSet::find(quint64 key) const
+{
+    // Fibonacci hashing; ids are dense, so the multiply is what spreads them
+    const size_t mask=_slots.size()-1;
+    size_t i=size_t((key*0x9e3779b97f4a7c15ull)>>(64-_bits));
+    while(_slots[i]!=0 && (_slots[i]&ID_MASK)!=key)
+        i=(i+1)&mask;
+    return i;
+}
+
+void VisitedSet::grow()
+{
+    std::vector<quint64> old;
+    old.swap(_slots);
+    _bits=_bits ? _bits+1 : 10;
+    _slots.assign(size_t(1)<<_bits, 0);
+    for(quint64 word: old)
+        if(word)
+            _slots[find(word&ID_MASK)]=word;
+}
+
+bool VisitedSet::insert(qint64 id, int hops)
+{
+    if((_size+1)*4>_slots.size()*3)
+        grow();
+    const quint64 key=(quint64(id)+1)&ID_MASK;
+    hops=qBound(0, hops, MAX_HOPS);
+    quint64 &slot=_slots[find(key)];
+    if(slot==0)
+        _size++;
+    else if(int((slot&~EXPANDED)>>56)<=hops)
+        return false;
+    slot=key|quint64(hops)<<56|(slot&EXPANDED);
+    return true;
+}
+
+quint64 VisitedSet::word(qint64 id) const
+{
+    return _slots.empty() ? 0 : _slots[find((quint64(id)+1)&ID_MASK)];
+}
+
+int VisitedSet::hops(qint64 id) const
+{
+    const quint64 slot=word(id);
+    return slot ? int((slot&~EXPANDED)>>56) : -1;
+}
+
+void VisitedSet::setExpanded(qint64 id)
+{
+    if(_slots.empty())
+        return;
+    quint64 &slot=_slots[find((quint64(id)+1)&ID_MASK)];
+    if(slot)
+        slot|=EXPANDED;
+}
+
+bool VisitedSet::expanded(qint64 id) const
+{
+    return word(id)&EXPANDED;
+}
+
+void VisitedSet::clear()
+{
+    _slots.clear();
+    _bits=0;
+    _size=0;
+}
+
+QByteArray VisitedSet::save() const
+{
+    QByteArray out(qsizetype(_size*sizeof(quint64)), Qt::Uninitialized);
+    char *at=out.data();
+    for(quint64 word: _slots)
+    {
+        if(!word)
+            continue;
+        qToLittleEndian(word, at);
+        at+=sizeof(quint64);
+    }
+    return out;
+}
+
+bool VisitedSet::load(const QByteArray &packed)
+{
+    clear();
+    if(packed.size()%qsizetype(sizeof(quint64)))
+        return false;
+    for(qsizetype at=0; at<packed.size(); at+=qsizetype(sizeof(quint64)))
+    {
+        const quint64 word=qFromLittleEndian<quint64>(packed.constData()+at);
+        if((word&ID_MASK)==0)
+            return false;
+        const qint64 id=qint64(word&ID_MASK)-1;
+        insert(id, int((word&~EXPANDED)>>56));
+        if(word&EXPANDED)
+            setExpanded(id);
+    }
+    return true;
+}
+
+// GitHubCrawler
+
+GitHubCrawler::GitHubCrawler(ApiClient *api, QObject *parent)
+    : QObject(parent)
+    , _api(api)
+{
+    _checkpoint.setInterval(CHECKPOINT_INTERVAL_MS);
+    connect(&_checkpoint, &QTimer::timeout, this, &GitHubCrawler::checkpoint);
+}
+
+GitHubCrawler::~GitHubCrawler()
+{
+    stop();
+}
+
+QString GitHubCrawler::path(const char *name) const
+{
+    return QDir(_dir).filePath(name);
+}
+
+QUrl GitHubCrawler::listUrl(const User &user, bool following) const
+{
+    return _api->gitHubRequest(QString("users/%1/%2?per_page=%3")
+                               .arg(user.login, following ? "following" : "followers").arg(PER_PAGE)).url();
+}
+
+QUrl GitHubCrawler::nextLink(const QByteArray &link)
+{
+    // <https://api.github.com/user/1/followers?page=2>; rel="next", <...>; rel="last"
+    static const QRegularExpression next("<([^>]*)>\\s*;\\s*rel=\"next\"");
+    const QRegularExpressionMatch m=next.match(QString::fromLatin1(link));
+    return m.hasMatch() ? QUrl(m.captured(1)) : QUrl();
+}
+
+const GitHubCrawler::Stats &GitHubCrawler::stats()
+{
+    _stats.visited=_visited.size();
+    _stats.queued=0;
+    for(const Lane &lane: _lanes)
+        _stats.queued+=lane.queue.size()+(lane.active ? 1 : 0);
+    const qint64 ms=_clock.isValid() ? _clock.elapsed() : 0;
+    _stats.usersPerSecond=ms>0 ? double(_stats.expanded-_expandedAtStart)*1000.0/double(ms) : 0.0;
+    return _stats;
+}
+
+size_t GitHubCrawler::footprint() const
+{
+    size_t n=_visited.footprint()+_lanes.capacity()*sizeof(Lane);
+    for(const Lane &lane: _lanes)
+    {
+        n+=size_t(lane.body.capacity());
+        for(const std::vector<User> *users: {&lane.followers, &lane.followees})
+        {
+            n+=users->capacity()*sizeof(User);
+            for(const User &u: *users)
+                n+=size_t(u.login.capacity())*sizeof(QChar);
+        }
+        for(const User &u: lane.queue)
+            n+=sizeof(User)+size_t(u.login.capacity())*sizeof(QChar);
+    }
+    return n;
+}
+
+void GitHubCrawler::crawl(const QString &seed, int maxHops, const QString &dir)
+{
+    stop();
+    _dir=dir;
+    _seed=seed.trimmed();
+    _maxHops=qBound(0, maxHops, MAX_HOPS);
+    _lanes.assign(size_t(_parallel), Lane());
+    _visited.clear();
+    _stats=Stats();
+    _rateReset=0;
+
+    qint64 edgesBytes=-1;
+    const QJsonObject cp=readJson(path(CHECKPOINT));
+    const bool resumed=!cp.isEmpty();
+    if(resumed && !resume(cp, edgesBytes))
+    {
+        emit failed(QString(cp.value("version").toInt()==CHECKPOINT_VERSION
+                            ? "%1 holds a checkpoint of another crawl"
+                            : "%1 holds a checkpoint of an older version, which cannot be resumed")
+                    .arg(QDir::toNativeSeparators(dir)));
+        return;
+    }
+    _edges.setFileName(path(EDGES));
+    if(!_edges.open(resumed ? QIODevice::ReadWrite : QIODevice::WriteOnly|QIODevice::Truncate)
+       || (resumed && !_edges.resize(edgesBytes)))
+    {
+        _edges.close();
+        emit failed(QString("Cannot write %1: %2").arg(_edges.fileName(), _edges.errorString()));
+        return;
+    }
+    if(resumed)
+        _edges.seek(_edges.size());
+    else
+        _edges.write(EDGES_HEADER);
+
+    _busy=true;
+    _clock.start();
+    _expandedAtStart=_stats.expanded;
+    _checkpoint.start();
+    if(resumed)
+    {
+        qDebug() << __func__ << "resuming crawl from" << _seed << ":" << _visited.size() << "visited,"
+                 << stats().queued << "queued";
+        pump();
+        finishIfIdle();
+    }
+    else
+        seed();
+}
+
+bool GitHubCrawler::resume(const QJsonObject &checkpoint, qint64 &edgesBytes)
+{
+    if(checkpoint.value("version").toInt()!=CHECKPOINT_VERSION
+       || checkpoint.value("seed").toString().compare(_seed, Qt::CaseInsensitive)!=0
+       || checkpoint.value("max_hops").toInt()!=_maxHops)
+        return false;
+    edgesBytes=checkpoint.value("edges_bytes").toInteger(-1);
+    if(edgesBytes<qint64(sizeof(EDGES_HEADER)-1) || QFileInfo(path(EDGES)).size()<edgesBytes)
+        return false;
+    if(!_visited.load(QByteArray::fromBase64(checkpoint.value("visited").toString().toLatin1())))
+        return false;
+
+    // Spread over the lanes; stealing evens out whatever this gets wrong
+    size_t lane=0;
+    for(const QJsonValue &v: checkpoint.value("frontier").toArray())
+    {
+        const QJsonArray u=v.toArray();
+        User user{u.at(0).toString(), u.at(1).toInteger(), u.at(2).toInt()};
+        if(user.login.isEmpty() || user.id<=0)
+            continue;
+        _lanes[lane++%_lanes.size()].queue.push_back(std::move(user));
+    }
+    _stats.expanded=quint64(checkpoint.value("expanded").toInteger());
+    _stats.edges=quint64(checkpoint.value("edges").toInteger());
+    _stats.failed=quint64(checkpoint.value("failed").toInteger());
+    return true;
+}
+
+void GitHubCrawler::checkpoint()
+{
+    // Nothing to resume before the seed is known
+    if(!_busy || _visited.size()==0)
+        return;
+    _edges.flush();
+    QJsonArray frontier;
+    for(const Lane &lane: _lanes)
+    {
+        // Half done users start over; their edges were not written yet
+        if(lane.active)
+            frontier.append(QJsonArray{lane.user.login, lane.user.id, lane.user.hops});
+        for(const User &u: lane.queue)
+            frontier.append(QJsonArray{u.login, u.id, u.hops});
+    }
+    const QJsonObject cp{
+        {"version", CHECKPOINT_VERSION},
+        {"seed", _seed},
+        {"max_hops", _maxHops},
+        {"edges_bytes", _edges.size()},
+        {"expanded", qint64(_stats.expanded)},
+        {"edges", qint64(_stats.edges)},
+        {"failed", qint64(_stats.failed)},
+        {"visited", QString::fromLatin1(_visited.save().toBase64())},
+        {"frontier", frontier}};
+    if(!writeJson(path(CHECKPOINT), cp))
+        qDebug() << __func__ << "cannot write" << path(CHECKPOINT);
+}
+
+void GitHubCrawler::seed()
+{
+    _seedBody.clear();
+    _seedReply=_api->get(_api->gitHubRequest(QString("users/%1").arg(_seed)));
+    _stats.requests++;
+    connect(_seedReply, &QNetworkReply::readyRead, this, &GitHubCrawler::onReadyRead);
+    connect(_seedReply, &QNetworkReply::finished, this, &GitHubCrawler::onFinished);
+}
+
+void GitHubCrawler::seedDone(QNetworkReply *reply)
+{
+    const bool ok=reply->error()==QNetworkReply::NoError && _api->read(reply, _seedBody);
+    const QJsonObject o=ok ? JsonParser::fromJson(_seedBody).object() : QJsonObject();
+    _seedBody.clear();
+    User user{o.value("login").toString(), o.value("id").toInteger(), 0};
+    if(user.login.isEmpty() || user.id<=0)
+    {
+        const QString error=rateLimited(reply) ? QString("rate limited") : _api->errorString(reply);
+        close();
+        emit failed(QString("GitHub user %1: %2").arg(_seed, error));
+        return;
+    }
+    rateLimited(reply);
+    _seed=user.login;
+    _visited.insert(user.id, 0);
+    if(_maxHops>0)
+        _lanes.front().queue.push_back(std::move(user));
+    pump();
+    finishIfIdle();
+}
+
+void GitHubCrawler::pump()
+{
+    if(!_busy)
+        return;
+    for(size_t l=0; l<_lanes.size(); l++)
+    {
+        const Lane &lane=_lanes[l];
+        if(lane.reply || (!lane.active && !take(l)))
+            continue;
+        if(!budget())
+            return;
+        issue(l);
+    }
+}
+
+bool GitHubCrawler::take(size_t l)
+{
+    Lane &lane=_lanes[l];
+    for(;;)
+    {
+        if(lane.queue.empty())
+        {
+            // Steal the newer half of the longest queue; the owner keeps working from the older end
+            size_t victim=l;
+            for(size_t v=0; v<_lanes.size(); v++)
+                if(_lanes[v].queue.size()>_lanes[victim].queue.size())
+                    victim=v;
+            std::deque<User> &from=_lanes[victim].queue;
+            if(from.empty())
+                return false;
+            const auto half=from.end()-qsizetype((from.size()+1)/2);
+            _stats.stolen+=quint64(from.end()-half);
+            lane.queue.insert(lane.queue.end(), std::make_move_iterator(half), std::make_move_iterator(from.end()));
+            from.erase(half, from.end());
+        }
+        User user=std::move(lane.queue.front());
+        lane.queue.pop_front();
+        const int hops=_visited.hops(user.id);
+        // Queued again by a still shorter path; that later entry expands it
+        if(_visited.expanded(user.id) && hops<user.hops)
+            continue;
+        lane.user=std::move(user);
+        if(hops>=0)
+            lane.user.hops=hops;
+        break;
+    }
+    // A user queued again while another lane still expands it leaves the edges to that lane
+    lane.again=_visited.expanded(lane.user.id);
+    for(const Lane &other: _lanes)
+        lane.again=lane.again || (other.active && other.user.id==lane.user.id);
+    lane.active=true;
+    lane.following=false;
+    lane.page=listUrl(lane.user, false);
+    lane.attempts=0;
+    lane.followers.clear();
+    lane.followees.clear();
+    return true;
+}
+
+void GitHubCrawler::issue(size_t l)
+{
+    Lane &lane=_lanes[l];
+    lane.body.clear();
+    lane.reply=_api->get(_api->request(lane.page));
+    _running.emplace(lane.reply, l);
+    _stats.requests++;
+    connect(lane.reply, &QNetworkReply::readyRead, this, &GitHubCrawler::onReadyRead);
+    connect(lane.reply, &QNetworkReply::finished, this, &GitHubCrawler::onFinished);
+}
+
+bool GitHubCrawler::budget()
+{
+    if(_paused)
+        return false;
+    // Requests in flight will each take one more off the remaining budget
+    if(_stats.rateRemaining<0 || _stats.rateRemaining-qint64(_running.size())>_reserve)
+        return true;
+    pause(QDateTime::fromSecsSinceEpoch(_rateReset));
+    return false;
+}
+
+bool GitHubCrawler::rateLimited(QNetworkReply *reply)
+{
+    bool ok=false;
+    const qint64 remaining=reply->rawHeader("X-RateLimit-Remaining").toLongLong(&ok);
+    if(ok)
+        _stats.rateRemaining=remaining;
+    const qint64 reset=reply->rawHeader("X-RateLimit-Reset").toLongLong(&ok);
+    if(ok)
+        _rateReset=reset;
+
+    const int status=reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if(status!=403 && status!=429)
+        return false;
+    // A 403 with budget left is about the resource, not the rate
+    const QByteArray retryAfter=reply->rawHeader("Retry-After");
+    if(retryAfter.isEmpty() && _stats.rateRemaining!=0)
+        return false;
+    pause(retryAfter.isEmpty() ? QDateTime::fromSecsSinceEpoch(_rateReset)
+                               : QDateTime::currentDateTime().addSecs(retryAfter.toLongLong()));
+    return true;
+}
+
+void GitHubCrawler::pause(const QDateTime &until)
+{
+    if(_paused || !_busy)
+        return;
+    _paused=true;
+    _stats.rateWaits++;
+    // A second past the reset, for clocks that disagree a little
+    const QDateTime at=qMax(until, QDateTime::currentDateTime()).addSecs(1);
+    qDebug() << __func__ << "rate limit reached, crawl waits until" << at.toString(Qt::ISODate);
+    emit rateLimited(at);
+    const quint64 run=_run;
+    QTimer::singleShot(int(QDateTime::currentDateTime().msecsTo(at)), this, [this, run]{
+        if(run!=_run)
+            return;
+        _paused=false;
+        // Unknown until the next reply says otherwise
+        _stats.rateRemaining=-1;
+        pump();
+    });
+}
+
+void GitHubCrawler::onReadyRead()
+{
+    QNetworkReply *reply=qobject_cast<QNetworkReply *>(sender());
+    if(reply==_seedReply)
+    {
+        _api->read(reply, _seedBody);
+        return;
+    }
+    const auto r=_running.find(reply);
+    if(r!=_running.end())
+        _api->read(reply, _lanes[r->second].body);
+}
+
+void GitHubCrawler::onFinished()
+{
+    QNetworkReply *reply=qobject_cast<QNetworkReply *>(sender());
+    reply->deleteLater();
+    if(reply==_seedReply)
+    {
+        _seedReply=nullptr;
+        seedDone(reply);
+        return;
+    }
+    const auto r=_running.find(reply);
+    if(r==_running.end())
+        return;
+    const size_t l=r->second;
+    _running.erase(r);
+    Lane &lane=_lanes[l];
+    lane.reply=nullptr;
+
+    if(rateLimited(reply))
+    {
+        // The page is fetched again after the pause
+        lane.body.clear();
+        return;
+    }
+    if(reply->error()==QNetworkReply::NoError && _api->read(reply, lane.body))
+        pageDone(l, reply->rawHeader("Link"));
+    else
+    {
+        qDebug() << __func__ << lane.user.login << ":" << _api->errorString(reply);
+        // Users deleted or renamed since they were listed answer 404
+        const int status=reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if(status==404 || ++lane.attempts>=MAX_ATTEMPTS)
+            userDone(l, false);
+    }
+    pump();
+    finishIfIdle();
+}
+
+void GitHubCrawler::addEdge(QByteArray &out, const User &follower, const User &followee)
+{
+    out+=QByteArray::number(follower.id)+','+follower.login.toUtf8()+','
+         +QByteArray::number(followee.id)+','+followee.login.toUtf8()+'\n';
+}
+
+void GitHubCrawler::pageDone(size_t l, const QByteArray &link)
+{
+    Lane &lane=_lanes[l];
+    const QJsonArray users=JsonParser::fromJson(lane.body).array();
+    lane.body.clear();
+    lane.attempts=0;
+    for(const QJsonValue &v: users)
+    {
+        const QJsonObject o=v.toObject();
+        const User other{o.value("login").toString(), o.value("id").toInteger(), lane.user.hops+1};
+        if(other.login.isEmpty() || other.id<=0)
+            continue;
+        discovered(l, other);
+        if(!lane.again)
+            (lane.following ? lane.followees : lane.followers).push_back(other);
+    }
+
+    lane.page=nextLink(link);
+    if(!lane.page.isEmpty())
+        return;
+    if(!lane.following)
+    {
+        lane.following=true;
+        lane.page=listUrl(lane.user, true);
+        return;
+    }
+    userDone(l, true);
+}
+
+void GitHubCrawler::discovered(size_t l, const User &user)
+{
+    const int before=_visited.hops(user.id);
+    if(!_visited.insert(user.id, user.hops) || user.hops>=_maxHops)
+        return;
+    // A user still waiting takes its new hops along when its turn comes.  New work is a user that was past maxHops,
+    // or one expanded (or being expanded) with fewer hops to spare than it has now.
+    bool queue=before<0 || before>=_maxHops || _visited.expanded(user.id);
+    for(const Lane &lane: _lanes)
+        queue=queue || (lane.active && lane.user.id==user.id);
+    if(queue)
+        _lanes[l].queue.push_back(user);
+}
+
+void GitHubCrawler::userDone(size_t l, bool ok)
+{
+    Lane &lane=_lanes[l];
+    if(ok && !lane.again)
+    {
+        // A user expanded already wrote the relation from its own lists
+        QByteArray edges;
+        quint64 count=0;
+        for(const User &u: lane.followers)
+            if(!_visited.expanded(u.id))
+            {
+                addEdge(edges, u, lane.user);
+                count++;
+            }
+        for(const User &u: lane.followees)
+            if(!_visited.expanded(u.id))
+            {
+                addEdge(edges, lane.user, u);
+                count++;
+            }
+        _edges.write(edges);
+        _stats.edges+=count;
+        _stats.expanded++;
+        _visited.setExpanded(lane.user.id);
+    }
+    else if(!ok)
+        _stats.failed++;
+    lane.active=false;
+    lane.page.clear();
+    lane.followers.clear();
+    lane.followees.clear();
+    emit progress();
+}
+
+void GitHubCrawler::finishIfIdle()
+{
+    if(!_busy || _seedReply)
+        return;
+    for(const Lane &lane: _lanes)
+        if(lane.active || !lane.queue.empty())
+            return;
+    const Stats &st=stats();
+    qDebug() << __func__ << "crawl from" << _seed << "done:" << st.visited << "users," << st.expanded << "expanded,"
+             << st.edges << "edges," << st.failed << "failed," << st.usersPerSecond << "users/s";
+    close();
+    emit progress();
+    emit finished();
+}
+
+void GitHubCrawler::abortAll()
+{
+    // Take the running set first: abort() emits finished synchronously
+    const std::unordered_map<QNetworkReply *, size_t> running=std::move(_running);
+    _running.clear();
+    for(const auto &r: running)
+    {
+        r.first->disconnect(this);
+        r.first->abort();
+        r.first->deleteLater();
+        _lanes[r.second].reply=nullptr;
+    }
+    if(_seedReply)
+    {
+        _seedReply->disconnect(this);
+        _seedReply->abort();
+        _seedReply->deleteLater();
+        _seedReply=nullptr;
+    }
+}
+
+void GitHubCrawler::close()
+{
+    checkpoint();
+    _edges.close();
+    _checkpoint.stop();
+    _busy=false;
+    _paused=false;
+    _run++;
+}
+
+void GitHubCrawler::stop()
+{
+    if(!_busy)
+        return;
+    abortAll();
+    close();
+}
+
+}
@@ -0,0 +1,215 @@
+#ifndef GITHUBCRAWLER_HPP
+#define GITHUBCRAWLER_HPP
+
+#include <QObject>
+#include <QByteArray>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonObject>
+#include <QString>
+#include <QTimer>
+#include <QUrl>
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+class QNetworkReply;
+
+namespace InfoBeamer {
+
+class ApiClient;
+
+/*!
+ * \brief The VisitedSet class
+ * Open addressing set of GitHub user ids, with the number of hops each was reached in and whether it was expanded.
+ * Every slot is one 64-bit word (id+1 in the low 56 bits, 0 for empty, hops in the next 7, the expanded flag on
+ * top), probed linearly and grown at 3/4 load, so a few million users take tens of MB where a QSet or QHash would
+ * need several times that.
+ */
+class VisitedSet
+{
+public:
+    static const int MAX_HOPS=127;
+
+    //! Records \a id as reached in \a hops; true if it is new or was only known further away
+    bool insert(qint64 id, int hops);
+    //! Hops \a id was reached in, -1 if it was not
+    int hops(qint64 id) const;
+    //! Marks \a id, which must have been inserted, as expanded
+    void setExpanded(qint64 id);
+    bool expanded(qint64 id) const;
+    size_t size() const {return _size;}
+    size_t footprint() const {return _slots.capacity()*sizeof(quint64);}
+    void clear();
+
+    //! The occupied slots, packed little endian, for checkpoints
+    QByteArray save() const;
+    bool load(const QByteArray &packed);
+
+private:
+    static const quint64 ID_MASK=(quint64(1)<<56)-1;
+    static const quint64 EXPANDED=quint64(1)<<63;
+
+    size_t find(quint64 key) const;
+    quint64 word(qint64 id) const;
+    void grow();
+
+    std::vector<quint64>    _slots;
+    int                     _bits=0;
+    size_t                  _size=0;
+};
+
+/*!
+ * \brief The GitHubCrawler class
+ * Walks the follower graph from a seed user, up to maxHops() hops: every user reached in fewer hops has its followers
+ * and following lists fetched (100 per page, following the Link header) and each relation written to edges.csv in the
+ * crawl directory as follower_id,follower,followee_id,followee.  A relation shows up in the following list of one user
+ * and the followers list of the other.  The lists are written when a user is done, leaving out relations to users
+ * already expanded: whichever end is done first writes it, so it is written once.
+ *
+ * Queues are not kept in hop order, so a user can be reached again by a shorter path.  One still waiting is expanded
+ * with the hops it has when its turn comes.  One already expanded only reached maxHops() minus its old hops away, so
+ * it is queued once more for the users past that; this second expansion writes no edges, the first one wrote them.
+ *
+ * Up to maxParallel() users are expanded at once.  Each of those slots works through its own queue of users it
+ * discovered and, once that runs dry, steals the newer half of the longest other queue, so no slot idles while work
+ * is waiting.  The crawl only ever issues requests while X-RateLimit-Remaining stays above reserve(), leaving that
+ * much of the hourly budget to the interactive lookups; below it, or when GitHub answers 403/429, it waits for the
+ * reset.
+ *
+ * The visited set, the queues and the size of edges.csv are checkpointed to crawl.json every half minute and when
+ * the crawl stops.  Crawling into a directory holding a checkpoint for the same seed resumes from it: edges.csv is
+ * cut back to the checkpointed size and users that were half done are expanded again.  Checkpoints of an older layout
+ * are not resumed.
+ */
+class GitHubCrawler : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats
+    {
+        quint64 visited=0;          //! Users reached
+        quint64 expanded=0;         //! Users whose lists were fetched completely
+        quint64 edges=0;
+        quint64 queued=0;           //! Users waiting for expansion
+        quint64 requests=0;
+        quint64 failed=0;           //! Users given up on
+        quint64 stolen=0;           //! Users moved between queues
+        quint64 rateWaits=0;        //! Times the crawl paused for the rate limit
+        qint64  rateRemaining=-1;   //! Last X-RateLimit-Remaining, -1 until seen
+        double  usersPerSecond=0;   //! Expanded users per second of this session
+    };
+
+    static const int DEFAULT_PARALLEL=6;
+    static const int DEFAULT_RESERVE=100;
+    static const int PER_PAGE=100;
+
+    explicit GitHubCrawler(ApiClient *api, QObject *parent=nullptr);
+    ~GitHubCrawler();
+
+    //! Takes effect with the next crawl()
+    void setMaxParallel(int n) {_parallel=qMax(1, n);}
+    int maxParallel() const {return _parallel;}
+
+    //! Rate limit requests the crawl leaves unused
+    void setReserve(int requests) {_reserve=qMax(0, requests);}
+    int reserve() const {return _reserve;}
+
+    /*!
+     * \brief crawl
+     * Starts crawling from \a seed into \a dir, or resumes the crawl checkpointed there.  A crawl still running is
+     * stopped first.
+     */
+    void crawl(const QString &seed, int maxHops, const QString &dir);
+    //! Checkpoints and stops; crawl() with the same arguments resumes
+    void stop();
+    bool busy() const {return _busy;}
+
+    int maxHops() const {return _maxHops;}
+    const Stats &stats();
+    //! Approximate heap bytes of the visited set, the queues and the edges not written yet
+    size_t footprint() const;
+
+signals:
+    void progress();
+    void rateLimited(const QDateTime &resumeAt);
+    void failed(const QString &error);
+    void finished();
+
+private slots:
+    void onReadyRead();
+    void onFinished();
+    void checkpoint();
+
+private:
+    struct User
+    {
+        QString login;
+        qint64  id=0;
+        int     hops=0;
+    };
+
+    struct Lane
+    {
+        std::deque<User>    queue;
+        bool                active=false;   //! Expanding user
+        User                user;
+        bool                again=false;    //! user was expanded before or is in another lane, which writes its edges
+        bool                following=false;//! Fetching the following list, else the followers
+        QUrl                page;           //! Next page to fetch
+        QNetworkReply      *reply=nullptr;
+        QByteArray          body;
+        int                 attempts=0;
+        std::vector<User>   followers;      //! Listed so far; written once user is done, so a resumed crawl does
+        std::vector<User>   followees;      //! not repeat them
+    };
+
+    static QUrl nextLink(const QByteArray &link);
+    static void addEdge(QByteArray &out, const User &follower, const User &followee);
+
+    bool resume(const QJsonObject &checkpoint, qint64 &edgesBytes);
+    void seed();
+    void seedDone(QNetworkReply *reply);
+    QUrl listUrl(const User &user, bool following) const;
+    void pump();
+    bool take(size_t lane);
+    void issue(size_t lane);
+    bool budget();
+    bool rateLimited(QNetworkReply *reply);
+    void pause(const QDateTime &until);
+    void pageDone(size_t lane, const QByteArray &link);
+    void userDone(size_t lane, bool ok);
+    void discovered(size_t lane, const User &user);
+    void finishIfIdle();
+    void close();
+    void abortAll();
+    QString path(const char *name) const;
+
+    ApiClient                              *_api;
+    QString                                 _dir;
+    QString                                 _seed;
+    int                                     _maxHops=0;
+    int                                     _parallel=DEFAULT_PARALLEL;
+    int                                     _reserve=DEFAULT_RESERVE;
+    bool                                    _busy=false;
+    bool                                    _paused=false;
+    quint64                                 _run=0;         //! Bumped by stop(), so stale timers do nothing
+    qint64                                  _rateReset=0;   //! X-RateLimit-Reset, seconds since the epoch
+
+    std::vector<Lane>                       _lanes;
+    std::unordered_map<QNetworkReply *, size_t> _running;   //! Reply -> lane; the seed lookup has none
+    QNetworkReply                          *_seedReply=nullptr;
+    QByteArray                              _seedBody;
+    VisitedSet                              _visited;
+    QFile                                   _edges;
+    QTimer                                  _checkpoint;
+    QElapsedTimer                           _clock;
+    quint64                                 _expandedAtStart=0;
+    Stats                                   _stats;
+};
+
+}
+
+#endif // GITHUBCRAWLER_HPP
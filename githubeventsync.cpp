@@ -0,0 +1,511 @@
+#include "githubeventsync.hpp"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QNetworkReply>
+#include <QRegularExpression>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <climits>
+
+#include "apiclient.hpp"
+#include "jsonparser.hpp"
+
+namespace InfoBeamer {
+
+static const int CACHE_VERSION=1;
+
+static QJsonObject readJson(const QString &path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return QJsonObject();
+    return JsonParser::fromJson(file.readAll()).object();
+}
+
+static qint64 eventId(const QJsonObject &event)
+{
+    // Ids are decimal strings, increasing over time
+    return event.value("id").toString().toLongLong();
+}
+
+GitHubEventSync::GitHubEventSync(ApiClient *api, QObject *parent)
+    : QObject(parent)
+    , _api(api)
+{
+    _clock.start();
+    _timer.setSingleShot(true);
+    connect(&_timer, &QTimer::timeout, this, &GitHubEventSync::schedule);
+}
+
+GitHubEventSync::~GitHubEventSync()
+{
+    const std::unordered_map<QNetworkReply *, Request> running=std::move(_running);
+    _running.clear();
+    for(const auto &r: running)
+    {
+        r.first->disconnect(this);
+        r.first->abort();
+        r.first->deleteLater();
+    }
+}
+
+int GitHubEventSync::restore()
+{
+    if(_dir.isEmpty())
+        return 0;
+    int n=0;
+    for(const QString &file: QDir(_dir).entryList({"*.json"}, QDir::Files))
+    {
+        const QString login=readJson(QDir(_dir).filePath(file)).value("login").toString();
+        if(login.isEmpty() || watching(login))
+            continue;
+        watch(login);
+        n++;
+    }
+    return n;
+}
+
+void GitHubEventSync::watch(const QString &login)
+{
+    const QString key=keyOf(login);
+    if(key.isEmpty() || _users.count(key))
+        return;
+    User &u=_users[key];
+    u.login=login.trimmed();
+    load(u);
+    schedule();
+}
+
+void GitHubEventSync::unwatch(const QString &login)
+{
+    const QString key=keyOf(login);
+    if(!_users.erase(key))
+        return;
+    abort(key);
+    _queue.erase(std::remove(_queue.begin(), _queue.end(), key), _queue.end());
+    if(!_dir.isEmpty())
+        QFile::remove(cachePath(key));
+    pump();
+}
+
+QStringList GitHubEventSync::watched() const
+{
+    QStringList logins;
+    for(const auto &u: _users)
+        logins << u.second.login;
+    return logins;
+}
+
+bool GitHubEventSync::watching(const QString &login) const
+{
+    return _users.count(keyOf(login))>0;
+}
+
+QJsonArray GitHubEventSync::repos(const QString &login) const
+{
+    QJsonArray out;
+    const auto u=_users.find(keyOf(login));
+    if(u!=_users.end())
+        for(const auto &repo: u->second.repos)
+            out.append(repo.second);
+    return out;
+}
+
+bool GitHubEventSync::synced(const QString &login) const
+{
+    const auto u=_users.find(keyOf(login));
+    return u!=_users.end() && u->second.synced;
+}
+
+QUrl GitHubEventSync::nextLink(const QByteArray &link)
+{
+    static const QRegularExpression next("<([^>]*)>\\s*;\\s*rel=\"next\"");
+    const QRegularExpressionMatch m=next.match(QString::fromLatin1(link));
+    return m.hasMatch() ? QUrl(m.captured(1)) : QUrl();
+}
+
+bool GitHubEventSync::stale(const User &u)
+{
+    return QDateTime::currentSecsSinceEpoch()-u.syncedAt>MAX_LISTING_AGE_S;
+}
+
+void GitHubEventSync::schedule()
+{
+    const qint64 now=_clock.elapsed();
+    if(now<_pausedUntilMs)
+    {
+        _timer.start(int(qMin<qint64>(_pausedUntilMs-now, INT_MAX)));
+        return;
+    }
+    qint64 next=-1;
+    for(auto &e: _users)
+    {
+        User &u=e.second;
+        if(u.active)
+            continue;
+        if(u.dueMs<=now)
+        {
+            u.active=true;
+            _queue.push_back(e.first);
+        }
+        else if(next<0 || u.dueMs<next)
+            next=u.dueMs;
+    }
+    pump();
+    if(next>=0)
+        _timer.start(int(qMin<qint64>(next-now, INT_MAX)));
+}
+
+void GitHubEventSync::pump()
+{
+    while(!_queue.empty() && int(_running.size())<_maxParallel && _clock.elapsed()>=_pausedUntilMs)
+    {
+        const auto it=_users.find(_queue.front());
+        _queue.pop_front();
+        if(it==_users.end())
+            continue;
+        User &u=it->second;
+        u.fresh=QJsonArray();
+        u.freshEtag.clear();
+        u.newest=0;
+        u.pages=0;
+        u.listing.clear();
+        QNetworkRequest req=_api->gitHubRequest(QString("users/%1/events?per_page=%2").arg(u.login).arg(PER_PAGE));
+        // A resync needs the feed's newest event as its baseline, which a 304 does not carry
+        if(u.synced && !u.resyncPending && !stale(u) && !u.etag.isEmpty())
+            req.setRawHeader("If-None-Match", u.etag);
+        _stats.polls++;
+        issue(u, Kind::Events, req);
+    }
+}
+
+void GitHubEventSync::issue(User &u, Kind kind, const QNetworkRequest &req)
+{
+    QNetworkReply *reply=_api->get(req);
+    _running.emplace(reply, Request{keyOf(u.login), kind, QByteArray()});
+    _stats.requests++;
+    connect(reply, &QNetworkReply::readyRead, this, &GitHubEventSync::onReadyRead);
+    connect(reply, &QNetworkReply::finished, this, &GitHubEventSync::onFinished);
+}
+
+void GitHubEventSync::abort(const QString &key)
+{
+    std::vector<QNetworkReply *> replies;
+    for(const auto &r: _running)
+        if(r.second.key==key)
+            replies.push_back(r.first);
+    for(QNetworkReply *reply: replies)
+    {
+        _running.erase(reply);
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+}
+
+void GitHubEventSync::onReadyRead()
+{
+    QNetworkReply *reply=qobject_cast<QNetworkReply *>(sender());
+    const auto r=_running.find(reply);
+    if(r!=_running.end())
+        _api->read(reply, r->second.body);
+}
+
+void GitHubEventSync::onFinished()
+{
+    QNetworkReply *reply=qobject_cast<QNetworkReply *>(sender());
+    reply->deleteLater();
+    const auto r=_running.find(reply);
+    if(r==_running.end())
+        return;
+    Request req=std::move(r->second);
+    _running.erase(r);
+    const auto it=_users.find(req.key);
+    if(it==_users.end())
+    {
+        pump();
+        return;
+    }
+    User &u=it->second;
+
+    if(rateLimited(reply))
+    {
+        // The poll starts over after the pause; a resync that was running stays pending
+        u.active=false;
+        u.dueMs=_pausedUntilMs;
+        schedule();
+        return;
+    }
+    const int status=reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    bool ok=false;
+    const int pollS=reply->rawHeader("X-Poll-Interval").toInt(&ok);
+    if(ok && pollS>0)
+        u.pollS=pollS;
+    if(status==304)
+    {
+        _stats.notModified++;
+        done(u, false);
+        return;
+    }
+    if(reply->error()!=QNetworkReply::NoError || !_api->read(reply, req.body))
+    {
+        qDebug() << __func__ << u.login << "poll failed:" << _api->errorString(reply);
+        emit failed(u.login, _api->errorString(reply));
+        done(u, false);
+        return;
+    }
+    _stats.bytes+=quint64(req.body.size());
+    if(req.kind==Kind::Events)
+        eventsDone(u, reply, req.body);
+    else
+        reposDone(u, reply, req.body);
+}
+
+void GitHubEventSync::eventsDone(User &u, QNetworkReply *reply, const QByteArray &body)
+{
+    u.pages++;
+    if(u.pages==1)
+        u.freshEtag=reply->rawHeader("ETag");
+    bool reached=false;
+    for(const QJsonValue &v: JsonParser::fromJson(body).array())
+    {
+        const QJsonObject event=v.toObject();
+        const qint64 id=eventId(event);
+        u.newest=qMax(u.newest, id);
+        if(id<=u.lastEvent)
+        {
+            reached=true;
+            break;
+        }
+        u.fresh.append(event);
+    }
+
+    if(!u.synced || u.resyncPending || stale(u))
+    {
+        resync(u, false);
+        return;
+    }
+    if(!reached)
+    {
+        const QUrl next=nextLink(reply->rawHeader("Link"));
+        if(next.isValid() && u.pages<MAX_EVENT_PAGES)
+        {
+            issue(u, Kind::Events, _api->request(next));
+            return;
+        }
+        // Before the first event the whole feed is new, as long as it is all there
+        if(u.lastEvent>0 || next.isValid())
+        {
+            resync(u, true);
+            return;
+        }
+    }
+
+    bool changed=false;
+    for(qsizetype i=u.fresh.size()-1; i>=0; i--)
+    {
+        const Applied a=apply(u, u.fresh.at(i).toObject());
+        if(a==Applied::Gap)
+        {
+            resync(u, true);
+            return;
+        }
+        changed|=a==Applied::Changed;
+    }
+    _stats.events+=quint64(u.fresh.size());
+    u.lastEvent=qMax(u.lastEvent, u.newest);
+    u.etag=u.freshEtag;
+    // Without a change only the position in the feed moved; it is saved along with the next change
+    done(u, changed);
+}
+
+void GitHubEventSync::reposDone(User &u, QNetworkReply *reply, const QByteArray &body)
+{
+    u.pages++;
+    for(const QJsonValue &v: JsonParser::fromJson(body).array())
+    {
+        const QJsonObject repo=v.toObject();
+        const QString name=repo.value("name").toString();
+        if(!name.isEmpty())
+            u.listing[name]=repo;
+    }
+    const QUrl next=nextLink(reply->rawHeader("Link"));
+    if(next.isValid() && u.pages<MAX_REPO_PAGES)
+    {
+        issue(u, Kind::Repos, _api->request(next));
+        return;
+    }
+    u.repos=std::move(u.listing);
+    u.listing.clear();
+    u.truncated=next.isValid();
+    if(u.truncated)
+        qDebug() << __func__ << u.login << "has more than" << u.repos.size() << "repositories, listing the first";
+    u.synced=true;
+    u.resyncPending=false;
+    u.syncedAt=QDateTime::currentSecsSinceEpoch();
+    // The feed was read before the listing, so everything up to its newest event is in there
+    u.lastEvent=qMax(u.lastEvent, u.newest);
+    u.etag=u.freshEtag;
+    done(u, true);
+}
+
+GitHubEventSync::Applied GitHubEventSync::apply(User &u, const QJsonObject &event)
+{
+    const QString type=event.value("type").toString();
+    const QJsonObject payload=event.value("payload").toObject();
+    const QString at=event.value("created_at").toString();
+    if(type=="ForkEvent")
+    {
+        // The event's repo is the one forked; the fork is the forkee
+        const QJsonObject forkee=payload.value("forkee").toObject();
+        const QString name=forkee.value("name").toString();
+        if(name.isEmpty() || forkee.value("owner").toObject().value("login").toString()
+                .compare(u.login, Qt::CaseInsensitive)!=0)
+            return Applied::Ignored;
+        u.repos[name]=forkee;
+        return Applied::Changed;
+    }
+
+    const QJsonObject repo=event.value("repo").toObject();
+    const QString fullName=repo.value("name").toString();
+    const int slash=fullName.indexOf('/');
+    if(slash<0 || fullName.left(slash).compare(u.login, Qt::CaseInsensitive)!=0)
+        return Applied::Ignored;
+    const QString name=fullName.mid(slash+1);
+    const auto known=u.repos.find(name);
+    const bool repository=payload.value("ref_type").toString()=="repository";
+
+    if((type=="CreateEvent" && repository) || type=="PublicEvent")
+    {
+        if(known!=u.repos.end())
+            return Applied::Ignored;
+        u.repos[name]=QJsonObject{
+            {"id", repo.value("id")},
+            {"name", name},
+            {"full_name", fullName},
+            {"description", payload.value("description")},
+            {"language", QJsonValue()},
+            {"stargazers_count", 0},
+            {"fork", false},
+            {"created_at", at},
+            {"pushed_at", at},
+            {"updated_at", at}};
+        return Applied::Changed;
+    }
+    if(type=="DeleteEvent" && repository)
+    {
+        if(known==u.repos.end())
+            return Applied::Ignored;
+        u.repos.erase(known);
+        return Applied::Changed;
+    }
+    if(type!="PushEvent")
+        return Applied::Ignored;
+    // A truncated listing does not hold every repository, so one it lacks is no sign of missed events
+    if(known==u.repos.end())
+        return u.truncated ? Applied::Ignored : Applied::Gap;
+    known->second.insert("pushed_at", at);
+    return Applied::Changed;
+}
+
+void GitHubEventSync::resync(User &u, bool gap)
+{
+    if(gap)
+    {
+        _stats.gaps++;
+        qDebug() << __func__ << u.login << "missed events after" << u.lastEvent << ", fetching the listing again";
+    }
+    _stats.resyncs++;
+    u.resyncPending=true;
+    u.pages=0;
+    u.listing.clear();
+    issue(u, Kind::Repos, _api->gitHubRequest(QString("users/%1/repos?per_page=%2").arg(u.login).arg(PER_PAGE)));
+}
+
+void GitHubEventSync::done(User &u, bool changed)
+{
+    u.active=false;
+    u.dueMs=_clock.elapsed()+qint64(u.pollS)*1000;
+    u.fresh=QJsonArray();
+    u.listing.clear();
+    if(changed)
+    {
+        save(u);
+        emit reposChanged(u.login, repos(u.login));
+    }
+    schedule();
+}
+
+bool GitHubEventSync::rateLimited(QNetworkReply *reply)
+{
+    const int status=reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if(status!=403 && status!=429)
+        return false;
+    bool ok=false;
+    const qint64 remaining=reply->rawHeader("X-RateLimit-Remaining").toLongLong(&ok);
+    const QByteArray retryAfter=reply->rawHeader("Retry-After");
+    // A 403 with budget left is about the resource, not the rate
+    if(retryAfter.isEmpty() && (!ok || remaining!=0))
+        return false;
+    const QDateTime until=retryAfter.isEmpty()
+            ? QDateTime::fromSecsSinceEpoch(reply->rawHeader("X-RateLimit-Reset").toLongLong())
+            : QDateTime::currentDateTime().addSecs(retryAfter.toLongLong());
+    // A second past the reset, for clocks that disagree a little
+    const QDateTime at=qMax(until, QDateTime::currentDateTime()).addSecs(1);
+    _pausedUntilMs=_clock.elapsed()+QDateTime::currentDateTime().msecsTo(at);
+    qDebug() << __func__ << "rate limit reached, event polls wait until" << at.toString(Qt::ISODate);
+    emit rateLimited(at);
+    return true;
+}
+
+QString GitHubEventSync::cachePath(const QString &key) const
+{
+    return QDir(_dir).filePath(key+".json");
+}
+
+void GitHubEventSync::load(User &u) const
+{
+    if(_dir.isEmpty())
+        return;
+    const QJsonObject cached=readJson(cachePath(keyOf(u.login)));
+    if(cached.value("version").toInt()!=CACHE_VERSION)
+        return;
+    for(const QJsonValue &v: cached.value("repos").toArray())
+    {
+        const QJsonObject repo=v.toObject();
+        u.repos[repo.value("name").toString()]=repo;
+    }
+    u.synced=true;
+    u.syncedAt=qint64(cached.value("synced_at").toDouble());
+    u.truncated=cached.value("truncated").toBool();
+    u.etag=cached.value("etag").toString().toLatin1();
+    u.lastEvent=cached.value("last_event").toString().toLongLong();
+    u.pollS=qMax(1, cached.value("poll_interval").toInt(DEFAULT_POLL_S));
+}
+
+void GitHubEventSync::save(const User &u) const
+{
+    if(_dir.isEmpty() || !QDir().mkpath(_dir))
+        return;
+    QSaveFile file(cachePath(keyOf(u.login)));
+    if(!file.open(QIODevice::WriteOnly))
+        return;
+    QJsonObject cached;
+    cached.insert("version", CACHE_VERSION);
+    cached.insert("login", u.login);
+    cached.insert("synced_at", double(u.syncedAt));
+    cached.insert("truncated", u.truncated);
+    cached.insert("etag", QString::fromLatin1(u.etag));
+    cached.insert("last_event", QString::number(u.lastEvent));
+    cached.insert("poll_interval", u.pollS);
+    cached.insert("repos", repos(u.login));
+    file.write(QJsonDocument(cached).toJson(QJsonDocument::Compact));
+    if(!file.commit())
+        qDebug() << __func__ << "cannot write" << file.fileName();
+}
+
+}
@@ -0,0 +1,182 @@
+#ifndef GITHUBEVENTSYNC_HPP
+#define GITHUBEVENTSYNC_HPP
+
+#include <QObject>
+#include <QByteArray>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QNetworkRequest>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QUrl>
+
+#include <deque>
+#include <map>
+#include <unordered_map>
+
+class QNetworkReply;
+
+namespace InfoBeamer {
+
+class ApiClient;
+
+/*!
+ * \brief The GitHubEventSync class
+ * Keeps the repository lists of watched GitHub users current from their events instead of fetching every list again.
+ *
+ * Each user's users/{login}/events is polled at the X-Poll-Interval GitHub asks for, with the ETag of the last
+ * answer; an unchanged feed costs a 304, which GitHub does not count against the rate limit.  New events (ids above
+ * the newest one applied) are applied oldest first: CreateEvent and DeleteEvent of a repository, PublicEvent and
+ * ForkEvent add or drop it, PushEvent moves its pushed_at.  Events on repositories of other owners do not touch the
+ * set.
+ *
+ * The feed holds what the user did, not what was done to their repositories: a WatchEvent is the user starring a
+ * repository, and pushes by collaborators do not show up.  Star counts and those pushes are only as current as the
+ * last listing.
+ *
+ * The feed only reaches back 300 events.  If it no longer reaches the newest event applied, or an event names one of
+ * the user's repositories the set does not hold, events were missed: the users/{login}/repos listing is fetched again
+ * (a resync), as it is for a user seen for the first time.  A listing cut off at MAX_REPO_PAGES cannot tell a missed
+ * event that way, so pushes to repositories it lacks are ignored.  Events from between the feed and the listing of a
+ * resync are applied again on the next poll, with the same result.  GitHub reports no event when a repository is
+ * deleted, so a listing older than MAX_LISTING_AGE_S is fetched again as well.
+ *
+ * The sets are kept as <login>.json in the cache directory, so a restart resumes with conditional requests.
+ */
+class GitHubEventSync : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats
+    {
+        quint64 polls=0;
+        quint64 notModified=0;      //! Polls answered with 304
+        quint64 requests=0;         //! Including event pages past the first and resync pages
+        quint64 bytes=0;            //! Decoded bodies
+        quint64 events=0;           //! Events applied
+        quint64 resyncs=0;
+        quint64 gaps=0;             //! Resyncs because events were missed
+    };
+
+    static const int PER_PAGE=100;
+    //! 300 events, the most GitHub keeps
+    static const int MAX_EVENT_PAGES=3;
+    static const int DEFAULT_POLL_S=60;
+    static const int DEFAULT_PARALLEL=6;
+    //! Bounds a resync at 5000 repositories; the set of a user with more holds the first ones only
+    static const int MAX_REPO_PAGES=50;
+    //! Repositories deleted on GitHub leave no event; a listing this old is fetched again anyway
+    static const int MAX_LISTING_AGE_S=24*3600;
+
+    explicit GitHubEventSync(ApiClient *api, QObject *parent=nullptr);
+    ~GitHubEventSync();
+
+    //! Where the sets are kept; empty keeps them in memory only
+    void setCacheDirectory(const QString &dir) {_dir=dir;}
+    //! Watches every user with a set in the cache directory; returns how many
+    int restore();
+    void setMaxParallel(int n) {_maxParallel=qMax(1, n);}
+
+    //! Starts polling \a login, from its cached set if there is one
+    void watch(const QString &login);
+    //! Stops polling \a login and drops its set, cached one included
+    void unwatch(const QString &login);
+    QStringList watched() const;
+    bool watching(const QString &login) const;
+
+    //! The user's repositories, by name; empty until the first resync
+    QJsonArray repos(const QString &login) const;
+    //! A listing has been fetched (or loaded) for \a login
+    bool synced(const QString &login) const;
+
+    const Stats &stats() const {return _stats;}
+
+signals:
+    void reposChanged(const QString &login, const QJsonArray &repos);
+    void failed(const QString &login, const QString &error);
+    void rateLimited(const QDateTime &resumeAt);
+
+private slots:
+    void onReadyRead();
+    void onFinished();
+    void schedule();
+
+private:
+    struct User
+    {
+        QString                         login;
+        std::map<QString, QJsonObject>  repos;          //! By name
+        bool                            synced=false;
+        bool                            truncated=false;        //! The listing stopped at MAX_REPO_PAGES
+        bool                            resyncPending=false;    //! Until a resync completes
+        qint64                          syncedAt=0;     //! Unix time of the last listing
+        QByteArray                      etag;           //! Of the first events page
+        qint64                          lastEvent=0;    //! Id of the newest event applied
+        int                             pollS=DEFAULT_POLL_S;
+        qint64                          dueMs=0;        //! _clock time of the next poll
+        bool                            active=false;   //! Queued or requests in flight
+
+        // The poll in progress
+        QJsonArray                      fresh;          //! Events newer than lastEvent, newest first
+        QByteArray                      freshEtag;
+        qint64                          newest=0;
+        int                             pages=0;
+        std::map<QString, QJsonObject>  listing;        //! Resync pages so far
+    };
+
+    enum class Applied
+    {
+        Ignored,
+        Changed,
+        Gap         //! Names a repository of the user the set does not hold
+    };
+
+    enum class Kind
+    {
+        Events,
+        Repos
+    };
+
+    struct Request
+    {
+        QString     key;
+        Kind        kind;
+        QByteArray  body;
+    };
+
+    static QString keyOf(const QString &login) {return login.trimmed().toLower();}
+    static QUrl nextLink(const QByteArray &link);
+    //! The listing is older than MAX_LISTING_AGE_S
+    static bool stale(const User &u);
+
+    void pump();
+    void issue(User &u, Kind kind, const QNetworkRequest &req);
+    void eventsDone(User &u, QNetworkReply *reply, const QByteArray &body);
+    void reposDone(User &u, QNetworkReply *reply, const QByteArray &body);
+    static Applied apply(User &u, const QJsonObject &event);
+    void resync(User &u, bool gap);
+    void done(User &u, bool changed);
+    void abort(const QString &key);
+    bool rateLimited(QNetworkReply *reply);
+    QString cachePath(const QString &key) const;
+    void load(User &u) const;
+    void save(const User &u) const;
+
+    ApiClient                                   *_api;
+    QString                                      _dir;
+    int                                          _maxParallel=DEFAULT_PARALLEL;
+    std::map<QString, User>                      _users;        //! By lower case login
+    std::deque<QString>                          _queue;
+    std::unordered_map<QNetworkReply *, Request> _running;
+    QTimer                                       _timer;
+    QElapsedTimer                                _clock;
+    qint64                                       _pausedUntilMs=0;
+    Stats                                        _stats;
+};
+
+}
+
+#endif // GITHUBEVENTSYNC_HPP
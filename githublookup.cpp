@@ -0,0 +1,222 @@
+#include "githublookup.hpp"
+
+#include <QDebug>
+#include <QNetworkReply>
+#include <QRegularExpression>
+#include <QUrlQuery>
+
+#include "apiclient.hpp"
+#include "jsonparser.hpp"
+
+namespace InfoBeamer {
+
+//! Bounds the pages requested at once (and the repositories shown) at 5000
+static const int MAX_PAGES=50;
+
+//! Page number of the rel="last" link of a Link header, 1 if there is none (everything fit on the first page)
+static int lastPage(const QByteArray &link)
+{
+    static const QRegularExpression last("<([^>]*)>\\s*;\\s*rel=\"last\"");
+    const QRegularExpressionMatch m=last.match(QString::fromLatin1(link));
+    if(!m.hasMatch())
+        return 1;
+    return qMax(1, QUrlQuery(QUrl(m.captured(1))).queryItemValue("page").toInt());
+}
+
+GitHubLookup::GitHubLookup(ApiClient *api, QObject *parent)
+    : QObject(parent)
+    , _api(api)
+{
+}
+
+GitHubLookup::~GitHubLookup()
+{
+    cancel();
+}
+
+void GitHubLookup::lookup(const QString &login, bool repos)
+{
+    cancel();
+    _login=login.trimmed();
+    _timings=Timings();
+    _profile=QJsonObject();
+    _lastPage=0;
+    _requested.clear();
+    _pages.clear();
+    _reposFailed=false;
+    _withRepos=repos;
+    _guess=ApiClient::gitHubAvatarGuess(_login);
+    _guessState=0;
+    _clock.start();
+
+    // Nothing here depends on anything else, so all three go out together
+    issue(Stage::Profile, _api->gitHubRequest(QString("users/%1").arg(_login)));
+    if(_withRepos)
+    {
+        _requested.insert(1);
+        issue(Stage::Repos, pageRequest(1), 1);
+    }
+    issue(Stage::AvatarGuess, _api->request(_guess));
+}
+
+void GitHubLookup::cancel()
+{
+    // Take the running set first: abort() emits finished synchronously
+    const std::unordered_map<QNetworkReply *, Request> running=std::move(_running);
+    _running.clear();
+    for(const auto &r: running)
+    {
+        r.first->disconnect(this);
+        r.first->abort();
+        r.first->deleteLater();
+    }
+}
+
+QNetworkRequest GitHubLookup::pageRequest(int page) const
+{
+    return _api->gitHubRequest(QString("users/%1/repos?per_page=%2&page=%3").arg(_login).arg(PER_PAGE).arg(page));
+}
+
+void GitHubLookup::issue(Stage stage, const QNetworkRequest &req, int page)
+{
+    QNetworkReply *reply=_api->get(req);
+    _running.emplace(reply, Request{stage, page, QByteArray()});
+    connect(reply, &QNetworkReply::readyRead, this, &GitHubLookup::onReadyRead);
+    connect(reply, &QNetworkReply::finished, this, &GitHubLookup::onFinished);
+}
+
+void GitHubLookup::requestPages(int last)
+{
+    for(int page=2; page<=qMin(last, MAX_PAGES); page++)
+        if(_requested.insert(page).second)
+            issue(Stage::Repos, pageRequest(page), page);
+}
+
+void GitHubLookup::onReadyRead()
+{
+    QNetworkReply *reply=qobject_cast<QNetworkReply *>(sender());
+    const auto r=_running.find(reply);
+    if(r!=_running.end())
+        _api->read(reply, r->second.body);
+}
+
+void GitHubLookup::onFinished()
+{
+    QNetworkReply *reply=qobject_cast<QNetworkReply *>(sender());
+    reply->deleteLater();
+    const auto r=_running.find(reply);
+    if(r==_running.end())
+        return;
+    Request req=std::move(r->second);
+    _running.erase(r);
+    const bool ok=reply->error()==QNetworkReply::NoError && _api->read(reply, req.body);
+
+    switch(req.stage)
+    {
+    case Stage::Profile:
+        if(!ok)
+        {
+            // No such user, or no answer: the rest is moot
+            const QString error=_api->errorString(reply);
+            cancel();
+            emit failed(error);
+            return;
+        }
+        profileDone(req.body);
+        break;
+    case Stage::Repos:
+        if(ok)
+            pageDone(req.page, req.body, reply->rawHeader("Link"));
+        else if(!_reposFailed)
+        {
+            _reposFailed=true;
+            emit failed(QString("Repositories of %1: %2").arg(_login, reply->errorString()));
+        }
+        break;
+    case Stage::AvatarGuess:
+        _guessState=ok ? 1 : -1;
+        if(ok)
+        {
+            _timings.avatarMs=_clock.elapsed();
+            emit avatarReady(req.body);
+        }
+        confirmAvatar();
+        break;
+    case Stage::Avatar:
+        if(ok)
+        {
+            _timings.avatarMs=_clock.elapsed();
+            emit avatarReady(req.body);
+        }
+        else
+            qDebug() << __func__ << "avatar of" << _login << ":" << reply->errorString();
+        break;
+    }
+    finishIfIdle();
+}
+
+void GitHubLookup::profileDone(const QByteArray &body)
+{
+    _profile=JsonParser::fromJson(body).object();
+    _timings.profileMs=_clock.elapsed();
+    emit profileReady(_profile);
+    // public_repos tells the page count before the first page's Link header may have
+    if(_lastPage==0 && _withRepos)
+        requestPages((_profile.value("public_repos").toInt()+PER_PAGE-1)/PER_PAGE);
+    confirmAvatar();
+}
+
+void GitHubLookup::pageDone(int page, const QByteArray &body, const QByteArray &link)
+{
+    _pages[page]=JsonParser::fromJson(body).array();
+    if(page==1)
+    {
+        _lastPage=lastPage(link);
+        requestPages(_lastPage);
+    }
+    if(_lastPage==0 || _timings.reposMs>=0)
+        return;
+    // Pages past the last one (public_repos was stale) are ignored
+    const int last=qMin(_lastPage, MAX_PAGES);
+    for(int p=1; p<=last; p++)
+        if(_pages.find(p)==_pages.end())
+            return;
+    QJsonArray repos;
+    for(int p=1; p<=last; p++)
+        for(const QJsonValue &repo: _pages[p])
+            repos.append(repo);
+    _timings.reposMs=_clock.elapsed();
+    _timings.repoPages=last;
+    emit reposReady(repos);
+}
+
+void GitHubLookup::confirmAvatar()
+{
+    // Needs both the profile and the outcome of the guess
+    if(_profile.isEmpty() || _guessState==0)
+        return;
+    const QUrl actual(_profile.value("avatar_url").toString());
+    // The guess is keyed by login; it holds if the profile is that login's and its avatar lives where we looked
+    const bool same=_profile.value("login").toString().compare(_login, Qt::CaseInsensitive)==0
+            && actual.host()==_guess.host();
+    if(_guessState==1 && same)
+    {
+        _timings.avatarGuessed=true;
+        return;
+    }
+    if(actual.isValid() && !actual.isEmpty())
+        issue(Stage::Avatar, _api->request(actual));
+}
+
+void GitHubLookup::finishIfIdle()
+{
+    if(!_running.empty())
+        return;
+    _timings.totalMs=_clock.elapsed();
+    qDebug() << __func__ << _login << "in" << _timings.totalMs << "ms: profile" << _timings.profileMs << "ms,"
+             << _timings.repoPages << "repo pages" << _timings.reposMs << "ms, avatar" << _timings.avatarMs << "ms"
+             << (_timings.avatarGuessed ? "(guessed)" : "(from profile)");
+    emit finished();
+}
+
+}
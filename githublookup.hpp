@@ -0,0 +1,116 @@
+#ifndef GITHUBLOOKUP_HPP
+#define GITHUBLOOKUP_HPP
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QNetworkRequest>
+#include <QString>
+#include <QUrl>
+
+#include <map>
+#include <set>
+#include <unordered_map>
+
+class QNetworkReply;
+
+namespace InfoBeamer {
+
+class ApiClient;
+
+/*!
+ * \brief The GitHubLookup class
+ * Fetches a GitHub user's profile, repositories and avatar with as few round trips in a row as possible.
+ *
+ * The profile, the first page of repositories and the avatar all go out at once: the avatar is fetched speculatively
+ * from ApiClient::gitHubAvatarGuess() instead of waiting for the avatar_url of the profile.  When the profile arrives
+ * it confirms the guess (same login, avatar on the host guessed) or the avatar is fetched again from avatar_url.
+ * Further repository pages are requested all together as soon as either the profile (public_repos) or the Link
+ * header of the first page tells how many there are.  Every request has its own buffer.
+ *
+ * reposReady() carries the repositories of all pages in order, so language and star counts come with them.
+ */
+class GitHubLookup : public QObject
+{
+    Q_OBJECT
+public:
+    struct Timings
+    {
+        qint64  profileMs=-1;       //! Since lookup(), -1 until done
+        qint64  reposMs=-1;
+        qint64  avatarMs=-1;
+        qint64  totalMs=-1;
+        int     repoPages=0;
+        bool    avatarGuessed=false;//! The speculative avatar was confirmed by the profile
+    };
+
+    static const int PER_PAGE=100;
+
+    explicit GitHubLookup(ApiClient *api, QObject *parent=nullptr);
+    ~GitHubLookup();
+
+    //! Starts looking up \a login, without its repositories if \a repos is false; a lookup still running is cancelled
+    void lookup(const QString &login, bool repos=true);
+    void cancel();
+    bool busy() const {return !_running.empty();}
+
+    const Timings &timings() const {return _timings;}
+
+signals:
+    void profileReady(const QJsonObject &profile);
+    void reposReady(const QJsonArray &repos);
+    //! May come twice: first from the guess, then from avatar_url if the profile did not confirm the guess
+    void avatarReady(const QByteArray &image);
+    void failed(const QString &error);
+    void finished();
+
+private slots:
+    void onReadyRead();
+    void onFinished();
+
+private:
+    enum class Stage
+    {
+        Profile,
+        Repos,
+        AvatarGuess,
+        Avatar
+    };
+
+    struct Request
+    {
+        Stage       stage;
+        int         page=0;
+        QByteArray  body;
+    };
+
+    QNetworkRequest pageRequest(int page) const;
+    void issue(Stage stage, const QNetworkRequest &req, int page=0);
+    void requestPages(int last);
+    void profileDone(const QByteArray &body);
+    void pageDone(int page, const QByteArray &body, const QByteArray &link);
+    void confirmAvatar();
+    void finishIfIdle();
+
+    ApiClient                                   *_api;
+    QString                                      _login;
+    std::unordered_map<QNetworkReply *, Request> _running;
+    QElapsedTimer                                _clock;
+    Timings                                      _timings;
+
+    QJsonObject                                  _profile;      //! Empty until it arrived
+    int                                          _lastPage=0;   //! From the first page's Link header, 0 until known
+    std::set<int>                                _requested;
+    std::map<int, QJsonArray>                    _pages;
+    bool                                         _reposFailed=false;
+    bool                                         _withRepos=true;
+
+    QUrl                                         _guess;
+    int                                          _guessState=0; //! 0 in flight, 1 fetched, -1 failed
+};
+
+}
+
+#endif // GITHUBLOOKUP_HPP
@@ -0,0 +1,31 @@
+# Build and query times of SearchIndex and RelationIndex over a synthetic fleet, see main.cpp
+QT       += core
+QT       -= gui
+
+CONFIG += c++1z console
+CONFIG -= app_bundle
+
+TARGET = indexbench
+
+INCLUDEPATH += .. ../mockserver
+
+SOURCES += \
+    ../InfoBeamer_API_Types.cpp \
+    ../device.cpp \
+    ../deviceexport.cpp \
+    ../fleetdiff.cpp \
+    ../jsonflatten.cpp \
+    ../mockserver/fixtures.cpp \
+    ../relationindex.cpp \
+    ../searchindex.cpp \
+    main.cpp
+
+HEADERS += \
+    ../InfoBeamer_API_Types.hpp \
+    ../device.hpp \
+    ../deviceexport.hpp \
+    ../fleetdiff.hpp \
+    ../jsonflatten.hpp \
+    ../mockserver/fixtures.hpp \
+    ../relationindex.hpp \
+    ../searchindex.hpp
@@ -0,0 +1,119 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+
+#include <cstdio>
+#include <vector>
+
+#include "device.hpp"
+#include "fixtures.hpp"
+#include "fleetdiff.hpp"
+#include "relationindex.hpp"
+#include "searchindex.hpp"
+
+using namespace InfoBeamer;
+
+/*!
+ * indexbench
+ * Builds SearchIndex and RelationIndex over the mock server's synthetic fleet and times building, queries and the
+ * incremental update from a refresh with churn.  Query times are the mean over --iterations runs.
+ */
+
+static QJsonObject parse(const QByteArray &json)
+{
+    return QJsonDocument::fromJson(json).object();
+}
+
+//! Mean microseconds of \a n calls of \a f
+template<class F>
+static double timeUs(int n, F f)
+{
+    QElapsedTimer t;
+    t.start();
+    for(int i=0; i<n; i++)
+        f();
+    return double(t.nsecsElapsed())/1000.0/n;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setApplicationName("indexbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Build and query times of the search and relation indexes.");
+    parser.addHelpOption();
+    const QCommandLineOption devices("devices", "Devices in the synthetic fleet.", "n", "50000");
+    const QCommandLineOption setups("setups", "Setups, one package each.", "n", "20");
+    const QCommandLineOption churn("churn", "Fraction of devices changed by the refresh.", "f", "0.05");
+    const QCommandLineOption iterations("iterations", "Runs per query.", "n", "200");
+    parser.addOptions({devices, setups, churn, iterations});
+    parser.process(a);
+
+    Mock::Fixtures::Counts counts;
+    counts.devices=qMax(1, parser.value(devices).toInt());
+    counts.setups=qMax(1, parser.value(setups).toInt());
+    counts.packages=counts.setups;
+    counts.assets=200;
+    counts.assetBytes=4*1024;
+    counts.gitHubUsers=0;
+    Mock::Fixtures fixtures(counts, 1);
+    const int n=qMax(1, parser.value(iterations).toInt());
+
+    const std::vector<Device> fleet=Device::decode(parse(fixtures.deviceList(0)), Device::DecodeMode::Tolerant);
+    std::printf("%zu devices, %d setups\n\n", fleet.size(), counts.setups);
+
+    SearchIndex search;
+    QElapsedTimer t;
+    t.start();
+    search.reset(fleet);
+    std::printf("search index: built in %.1f ms, %zu keys, %.1f MB\n", double(t.nsecsElapsed())/1e6, search.keys(),
+                double(search.footprint())/(1024*1024));
+
+    // From a single device to an eighth of the fleet; short words take the prefix lists
+    std::printf("%-24s %8s %10s\n", "query", "hits", "us");
+    for(const char *q: {"s", "sc", "berlin", "floor 3", "hamburg floor 3", "screen 4711", "screen 12345", "1000",
+                        "nowhere"})
+    {
+        std::vector<int> hits;
+        const double us=timeUs(n, [&]{hits=search.search(QString(q));});
+        std::printf("%-24s %8zu %10.1f\n", q, hits.size(), us);
+    }
+
+    RelationIndex relations;
+    t.restart();
+    relations.resetDevices(fleet);
+    relations.setPackages(parse(fixtures.packageList()));
+    relations.setAssets(parse(fixtures.assetList()));
+    for(const int id: relations.setSetups(parse(fixtures.setupList())))
+        relations.setSetup(parse(fixtures.setup(id)));
+    std::printf("\nrelation index: built in %.1f ms, %.1f MB\n", double(t.nsecsElapsed())/1e6,
+                double(relations.footprint())/(1024*1024));
+    std::printf("%-24s %8s %10s\n", "query", "devices", "us");
+    for(const int package: {500, 500+counts.packages/2})
+    {
+        RelationIndex::Ids ids;
+        const double us=timeUs(n, [&]{ids=relations.devicesOfPackage(package);});
+        std::printf("%-24s %8zu %10.1f\n", qPrintable(QString("package %1").arg(package)), ids.size(), us);
+    }
+    for(const int asset: {10000, 10001})
+    {
+        RelationIndex::Ids ids;
+        const double us=timeUs(n, [&]{ids=relations.devicesOfAsset(asset);});
+        std::printf("%-24s %8zu %10.1f\n", qPrintable(QString("asset %1").arg(asset)), ids.size(), us);
+    }
+
+    // A refresh: the poller diffs the new list against the old one and both indexes follow the diff
+    const std::vector<Device> next=Device::decode(parse(fixtures.deviceList(parser.value(churn).toDouble())),
+                                                  Device::DecodeMode::Tolerant);
+    const FleetDiff diff=FleetDiff::compute(fleet, next);
+    t.restart();
+    search.apply(diff);
+    const qint64 searchNs=t.nsecsElapsed();
+    t.restart();
+    relations.apply(diff);
+    std::printf("\nrefresh: %zu changed, search index %.1f us, relation index %.1f us\n", diff.changed.size(),
+                double(searchNs)/1000.0, double(t.nsecsElapsed())/1000.0);
+    return 0;
+}
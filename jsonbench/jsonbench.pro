@@ -0,0 +1,21 @@
+# Conformance check and throughput benchmark of the JSON parser backends, see main.cpp
+QT       += core
+QT       -= gui
+
+CONFIG += c++1z console
+CONFIG -= app_bundle
+
+TARGET = jsonbench
+
+INCLUDEPATH += .. ../mockserver
+
+SOURCES += \
+    ../jsonindex.cpp \
+    ../jsonparser.cpp \
+    ../mockserver/fixtures.cpp \
+    main.cpp
+
+HEADERS += \
+    ../jsonindex.hpp \
+    ../jsonparser.hpp \
+    ../mockserver/fixtures.hpp
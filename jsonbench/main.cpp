@@ -0,0 +1,198 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include <cstdio>
+#include <vector>
+
+#include "fixtures.hpp"
+#include "jsonindex.hpp"
+#include "jsonparser.hpp"
+
+using namespace InfoBeamer;
+
+/*!
+ * jsonbench
+ * Checks that the Indexed backend of JsonParser gives exactly what QJsonDocument gives, valid or not, for hand written
+ * edge cases and the mock server's payloads, then measures both backends on those payloads.  Exits with 1 if any
+ * document does not conform, so it can gate a change of the default backend.
+ */
+
+struct Case
+{
+    QByteArray name;
+    QByteArray json;
+};
+
+static QByteArray nested(int depth, char open, char close, const QByteArray &inner)
+{
+    QByteArray out;
+    for(int i=0; i<depth; i++)
+        out+=open=='{' ? QByteArray("{\"a\":") : QByteArray(1, open);
+    out+=inner;
+    out+=QByteArray(depth, close);
+    return out;
+}
+
+static std::vector<Case> edgeCases()
+{
+    std::vector<Case> cases={
+        // Plain documents and whitespace
+        {"empty object", "{}"},
+        {"empty array", "[]"},
+        {"whitespace", " \t\r\n[ 1 , {\"a\" : [ ] } ]\n"},
+        {"literals", "[true,false,null]"},
+        {"duplicate keys", "{\"a\":1,\"b\":2,\"a\":3}"},
+        {"byte order mark", "\xEF\xBB\xBF{\"a\":1}"},
+
+        // Numbers
+        {"integers", "[0,-0,1,-1,42,9007199254740993]"},
+        {"int64 limits", "[9223372036854775807,-9223372036854775808]"},
+        {"past int64", "[9223372036854775808,-9223372036854775809,18446744073709551616]"},
+        {"fractions", "[0.5,-1.25,3.0,1e3,1E-3,1e+2,-0.0]"},
+        {"huge exponent", "[1e400]"},
+        {"tiny exponent", "[1e-400]"},
+
+        // Escapes
+        {"simple escapes", "[\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"]"},
+        {"unicode escapes", "[\"\\u0041\\u00e9\\u20AC\\u0000\"]"},
+        {"unknown escape", "[\"\\x\\q\"]"},
+        {"escaped key", "{\"a\\nb\":1}"},
+        {"escape then text", "[\"\\u00e9t\\u00e9 \xC3\xA9t\xC3\xA9\"]"},
+
+        // Surrogates
+        {"surrogate pair", "[\"\\ud83d\\ude00\"]"},
+        {"lone high surrogate", "[\"\\ud83d\"]"},
+        {"lone low surrogate", "[\"\\ude00x\"]"},
+        {"reversed pair", "[\"\\ude00\\ud83d\"]"},
+        {"raw four byte", "[\"\xF0\x9F\x98\x80\"]"},
+
+        // Raw bytes in strings
+        {"raw control character", "[\"a\tb\x01\"]"},
+        {"two byte", "[\"gr\xC3\xBC\xC3\x9F\"]"},
+        {"overlong", "[\"\xC0\xAF\"]"},
+        {"encoded surrogate", "[\"\xED\xA0\x80\"]"},
+        {"past U+10FFFF", "[\"\xF4\x90\x80\x80\"]"},
+        {"truncated sequence", "[\"\xE2\x82\"]"},
+        {"stray continuation", "[\"\x80\"]"},
+        {"invalid in escaped string", "[\"\\n\xC3\"]"},
+
+        // Malformed documents
+        {"nothing", ""},
+        {"only whitespace", "  \n"},
+        {"top level string", "\"a\""},
+        {"top level number", "1"},
+        {"unclosed object", "{"},
+        {"unclosed array", "[1,2"},
+        {"trailing comma array", "[1,]"},
+        {"trailing comma object", "{\"a\":1,}"},
+        {"missing value", "{\"a\":}"},
+        {"missing colon", "{\"a\" 1}"},
+        {"missing comma", "[1 2]"},
+        {"key without value", "{\"a\"}"},
+        {"unquoted key", "{a:1}"},
+        {"leading zero", "[01]"},
+        {"bare minus", "[-]"},
+        {"dot without digits", "[1.]"},
+        {"exponent without digits", "[1e]"},
+        {"plus sign", "[+1]"},
+        {"short literal", "[tru]"},
+        {"long literal", "[truex]"},
+        {"wrong case literal", "[True]"},
+        {"unterminated string", "[\"abc"},
+        {"short unicode escape", "[\"\\u12\"]"},
+        {"bad unicode escape", "[\"\\u12g4\"]"},
+        {"garbage after", "[1] x"},
+        {"second document", "{}{}"},
+        {"byte order mark only", "\xEF\xBB\xBF"},
+    };
+
+    // QJsonDocument allows 1024 levels, counting the outermost
+    cases.push_back({"1024 arrays", nested(1024, '[', ']', "1")});
+    cases.push_back({"1025 arrays", nested(1025, '[', ']', "1")});
+    cases.push_back({"1024 objects", nested(1023, '{', '}', "{}")});
+    cases.push_back({"1025 objects", nested(1024, '{', '}', "{}")});
+    cases.push_back({"deep and unclosed", nested(1000, '[', ']', "1").chopped(1)});
+    return cases;
+}
+
+static std::vector<Case> fixtureCases(int devices)
+{
+    Mock::Fixtures::Counts counts;
+    counts.devices=devices;
+    counts.assets=qMax(200, devices/10);
+    counts.gitHubUsers=1000;
+    Mock::Fixtures fixtures(counts, 1);
+    const QString base("http://127.0.0.1:8080/github/");
+    return {
+        {"device/list", fixtures.deviceList(0)},
+        {"device/list churned", fixtures.deviceList(0.2)},
+        {"device/{id}", fixtures.device(1000)},
+        {"package/list", fixtures.packageList()},
+        {"setup/list", fixtures.setupList()},
+        {"asset/list", fixtures.assetList()},
+        {"account", fixtures.account()},
+        {"users/{login}", fixtures.gitHubUser("user1", base)},
+        {"users/{login}/repos", fixtures.gitHubRepos("user1", 1, 100)},
+        {"users/{login}/events", fixtures.gitHubEvents("user1", Mock::Fixtures::MAX_EVENTS, 1, 100)},
+        {"users/{login}/followers", fixtures.gitHubFollows("user1", false, 1, 100, base)},
+    };
+}
+
+static int check(const std::vector<Case> &cases)
+{
+    int failed=0;
+    for(const Case &c: cases)
+    {
+        if(JsonParser::conforms(c.json))
+            continue;
+        QJsonParseError qt;
+        QJsonDocument::fromJson(c.json, &qt);
+        std::printf("DIFFERS  %s (QJsonDocument: %s)\n", c.name.constData(),
+                    qt.error==QJsonParseError::NoError ? "valid" : qPrintable(qt.errorString()));
+        failed++;
+    }
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setApplicationName("jsonbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Conformance check and benchmark of the JSON parser backends.");
+    parser.addHelpOption();
+    const QCommandLineOption devices("devices", "Devices in the synthetic device/list.", "n", "5000");
+    const QCommandLineOption iterations("iterations", "Parses per payload and backend.", "n", "20");
+    const QCommandLineOption checkOnly("check-only", "Only check conformance.");
+    parser.addOptions({devices, iterations, checkOnly});
+    parser.process(a);
+
+    const std::vector<Case> edges=edgeCases();
+    const std::vector<Case> payloads=fixtureCases(qMax(1, parser.value(devices).toInt()));
+    const int failed=check(edges)+check(payloads);
+    std::printf("conformance: %d of %d documents differ\n", failed, int(edges.size()+payloads.size()));
+    if(parser.isSet(checkOnly))
+        return failed ? 1 : 0;
+
+    // GB/s per payload: QJsonDocument, then the Indexed backend with every index implementation this CPU has
+    const int n=qMax(1, parser.value(iterations).toInt());
+    const JsonIndex::Isa best=JsonIndex::detectIsa();
+    std::printf("\n%-26s %10s %8s", "payload", "bytes", "qt");
+    for(int isa=0; isa<=int(best); isa++)
+        std::printf(" %8s", JsonIndex::isaName(JsonIndex::Isa(isa)));
+    std::printf("\n");
+    for(const Case &c: payloads)
+    {
+        std::printf("%-26s %10lld %8.3f", c.name.constData(), qlonglong(c.json.size()),
+                    JsonParser::benchmark(c.json, JsonParser::Backend::Qt, n));
+        for(int isa=0; isa<=int(best); isa++)
+        {
+            JsonIndex::setIsa(JsonIndex::Isa(isa));
+            std::printf(" %8.3f", JsonParser::benchmark(c.json, JsonParser::Backend::Indexed, n));
+        }
+        std::printf("\n");
+    }
+    JsonIndex::setIsa(best);
+    return failed ? 1 : 0;
+}
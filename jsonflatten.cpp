@@ -0,0 +1,270 @@
+#include "jsonflatten.hpp"
+
+#include <QJsonArray>
+#include <QJsonObject>
+
+#include <utility>
+
+#include "deviceexport.hpp"
+
+namespace InfoBeamer {
+
+PathTable::PathTable()
+{
+    _nodes.emplace_back();
+}
+
+uint32_t PathTable::child(uint32_t parent, const QString &key)
+{
+    const auto c=_nodes[parent].children.constFind(key);
+    if(c!=_nodes[parent].children.constEnd())
+        return c.value();
+    const uint32_t id=uint32_t(_nodes.size());
+    Node n;
+    n.path=_nodes[parent].path.isEmpty() ? key : _nodes[parent].path+'.'+key;
+    _nodes.push_back(std::move(n));
+    _nodes[parent].children.insert(key, id);
+    return id;
+}
+
+uint32_t PathTable::element(uint32_t parent)
+{
+    if(_nodes[parent].element!=UINT32_MAX)
+        return _nodes[parent].element;
+    const uint32_t id=uint32_t(_nodes.size());
+    Node n;
+    n.path=_nodes[parent].path+"[]";
+    _nodes.push_back(std::move(n));
+    _nodes[parent].element=id;
+    return id;
+}
+
+uint32_t PathTable::intern(const QString &path)
+{
+    uint32_t id=ROOT;
+    for(const QString &part: path.split('.', Qt::SkipEmptyParts))
+    {
+        QString key=part;
+        int arrays=0;
+        while(key.endsWith("[]"))
+        {
+            key.chop(2);
+            arrays++;
+        }
+        if(!key.isEmpty())
+            id=child(id, key);
+        while(arrays-->0)
+            id=element(id);
+    }
+    // A bare "[]" is the element of a top level array
+    if(path=="[]")
+        id=element(ROOT);
+    return id;
+}
+
+void JsonFlattener::setRecordPath(const QString &path)
+{
+    _recordPath=path.isEmpty() ? _paths.element(PathTable::ROOT) : _paths.intern(path);
+}
+
+void JsonFlattener::flatten(const QJsonValue &root, FlatTable &out)
+{
+    struct Frame
+    {
+        QJsonObject object;
+        QJsonArray  array;
+        bool        isArray;
+        uint32_t    path;
+        uint32_t    record;
+        qsizetype   index;
+    };
+    std::vector<Frame> stack;
+    stack.reserve(32);
+
+    // Containers are pushed, leaves emitted right away
+    const auto visit=[&](const QJsonValue &v, uint32_t path, uint32_t record)
+    {
+        if(v.isObject())
+            stack.push_back(Frame{v.toObject(), QJsonArray(), false, path, record, 0});
+        else if(v.isArray())
+            stack.push_back(Frame{QJsonObject(), v.toArray(), true, path, record, 0});
+        else
+            out.cells.push_back(FlatTable::Cell{path, record, v});
+    };
+
+    visit(root, PathTable::ROOT, FlatTable::NO_RECORD);
+    while(!stack.empty())
+    {
+        Frame &f=stack.back();
+        if(f.isArray)
+        {
+            if(f.index>=f.array.size())
+            {
+                stack.pop_back();
+                continue;
+            }
+            const uint32_t path=_paths.element(f.path);
+            const uint32_t record=path==_recordPath ? out.records++ : f.record;
+            const QJsonValue v=f.array.at(f.index++);
+            visit(v, path, record);     // may reallocate the stack, f is not used after this
+        }
+        else
+        {
+            if(f.index>=f.object.size())
+            {
+                stack.pop_back();
+                continue;
+            }
+            const auto it=f.object.constBegin()+f.index++;
+            const uint32_t path=_paths.child(f.path, it.key());
+            const uint32_t record=f.record;
+            const QJsonValue v=it.value();
+            visit(v, path, record);
+        }
+    }
+}
+
+static void putLeaf(const QJsonValue &v, OutBuffer &out)
+{
+    switch(v.type())
+    {
+    case QJsonValue::Null:
+        out.put("Null");
+        break;
+    case QJsonValue::Bool:
+        out.put(v.toBool() ? "Bool(true)" : "Bool(false)");
+        break;
+    case QJsonValue::Double:
+        out.put("Double(").putDouble(v.toDouble()).put(')');
+        break;
+    case QJsonValue::String:
+        out.put("String(\"").put(v.toString().toStdString()).put("\")");
+        break;
+    default:
+        out.put("Undefined");
+        break;
+    }
+}
+
+void JsonFlattener::dump(const FlatTable &table, OutBuffer &out) const
+{
+    for(const auto &c: table.cells)
+    {
+        out.put(_paths.path(c.path).toStdString());
+        if(c.record!=FlatTable::NO_RECORD)
+            out.put('#').putInt(c.record);
+        out.put('=');
+        putLeaf(c.value, out);
+        out.put('\n');
+    }
+}
+
+void JsonFlattener::dump(const FlatSchema &schema, const FlatTable &table, OutBuffer &out) const
+{
+    const std::vector<std::vector<QJsonValue>> rows=schema.rows(table);
+    for(size_t r=0; r<rows.size(); r++)
+    {
+        out.put('#').putInt(qint64(r));
+        for(int col=0; col<schema.columns().size(); col++)
+        {
+            const QJsonValue &v=rows[r][size_t(col)];
+            if(v.isUndefined())
+                continue;
+            out.put(' ').put(schema.columns()[col].toStdString()).put('=');
+            if(!schema.isList(col))
+            {
+                putLeaf(v, out);
+                continue;
+            }
+            out.put('[');
+            const QJsonArray a=v.toArray();
+            for(qsizetype i=0; i<a.size(); i++)
+            {
+                if(i)
+                    out.put(", ");
+                putLeaf(a.at(i), out);
+            }
+            out.put(']');
+        }
+        out.put('\n');
+    }
+}
+
+FlatSchema::FlatSchema(PathTable &paths, const QString &recordPath, const QStringList &columns)
+    : _columns(columns)
+{
+    const QString record=recordPath.isEmpty() ? QString("[]") : recordPath;
+    for(int i=0; i<columns.size(); i++)
+    {
+        const uint32_t id=paths.intern(columns[i]);
+        if(id>=_columnOf.size())
+            _columnOf.resize(id+1, -1);
+        _columnOf[id]=i;
+        const QString below=columns[i].startsWith(record) ? columns[i].mid(record.size()) : columns[i];
+        _list.push_back(below.contains("[]"));
+    }
+}
+
+std::vector<std::vector<QJsonValue>> FlatSchema::rows(const FlatTable &table) const
+{
+    std::vector<QJsonValue> empty(size_t(_columns.size()));
+    for(size_t col=0; col<_list.size(); col++)
+        if(_list[col])
+            empty[col]=QJsonArray();
+    std::vector<std::vector<QJsonValue>> rows(table.records, empty);
+
+    // The cells of a record are contiguous, so list values are gathered per record and stored once it ends
+    std::vector<QJsonArray> lists(_list.size());
+    uint32_t current=FlatTable::NO_RECORD;
+    const auto store=[&]{
+        if(current==FlatTable::NO_RECORD)
+            return;
+        for(size_t col=0; col<lists.size(); col++)
+        {
+            if(lists[col].isEmpty())
+                continue;
+            QJsonArray a=rows[current][col].toArray();
+            if(a.isEmpty())
+                rows[current][col]=lists[col];
+            else
+            {
+                for(const QJsonValue &v: std::as_const(lists[col]))
+                    a.append(v);
+                rows[current][col]=a;
+            }
+            lists[col]=QJsonArray();
+        }
+    };
+    for(const auto &c: table.cells)
+    {
+        const int col=column(c.path);
+        if(col<0 || c.record==FlatTable::NO_RECORD)
+            continue;
+        if(c.record!=current)
+        {
+            store();
+            current=c.record;
+        }
+        if(_list[size_t(col)])
+            lists[size_t(col)].append(c.value);
+        else
+            rows[c.record][size_t(col)]=c.value;
+    }
+    store();
+    return rows;
+}
+
+QStringList FlatSchema::deviceColumns()
+{
+    return {"devices[].id", "devices[].description", "devices[].location", "devices[].serial",
+            "devices[].status", "devices[].is_online", "devices[].is_synced", "devices[].maintenance[]",
+            "devices[].run.channel", "devices[].run.public_addr", "devices[].run.resolution",
+            "devices[].run.restarted", "devices[].run.tag", "devices[].run.version", "devices[].run.pi_revision",
+            "devices[].run.features[]", "devices[].reboot", "devices[].geo.lat", "devices[].geo.lon",
+            "devices[].geo.source", "devices[].setup.id", "devices[].setup.name", "devices[].setup.updated",
+            "devices[].hw.type", "devices[].hw.model", "devices[].hw.memory", "devices[].hw.platform",
+            "devices[].hw.features[]", "devices[].offline.licensed", "devices[].offline.plan",
+            "devices[].offline.max_offline", "devices[].offline.chargeable", "devices[].upgrade_blocked"};
+}
+
+}
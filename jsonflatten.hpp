@@ -0,0 +1,177 @@
+#ifndef JSONFLATTEN_HPP
+#define JSONFLATTEN_HPP
+
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+#include <QStringList>
+
+#include <cstdint>
+#include <vector>
+
+namespace InfoBeamer {
+
+class FlatSchema;
+class OutBuffer;
+
+/*!
+ * \brief The PathTable class
+ * Interned JSON paths.  Array indices are normalized away ("devices[].run.channel"), so a path id names a column
+ * rather than a single value.  Ids are dense, the root ("") is 0.
+ */
+class PathTable
+{
+public:
+    static const uint32_t ROOT=0;
+
+    PathTable();
+
+    //! Id of member \a key of \a parent, created on first use
+    uint32_t child(uint32_t parent, const QString &key);
+    //! Id of the elements of array \a parent
+    uint32_t element(uint32_t parent);
+    //! Id of a dotted path such as "devices[].hw.model", created on first use
+    uint32_t intern(const QString &path);
+
+    const QString &path(uint32_t id) const {return _nodes[id].path;}
+    size_t size() const {return _nodes.size();}
+
+private:
+    struct Node
+    {
+        QString                   path;
+        QHash<QString, uint32_t>  children;
+        uint32_t                  element=UINT32_MAX;
+    };
+    std::vector<Node> _nodes;
+};
+
+/*!
+ * \brief The FlatTable struct
+ * Flattened leaves as (path id, record, value).  A record is one element of the flattener's record array (e.g. one
+ * device of device/list); leaves outside it have record NO_RECORD.  Values that repeat within a record (string
+ * lists) appear as several cells with the same path, in document order.
+ */
+struct FlatTable
+{
+    static const uint32_t NO_RECORD=UINT32_MAX;
+
+    struct Cell
+    {
+        uint32_t   path;
+        uint32_t   record;
+        QJsonValue value;
+    };
+
+    std::vector<Cell> cells;
+    uint32_t          records=0;
+
+    void clear() {cells.clear(); records=0;}
+};
+
+/*!
+ * \brief The JsonFlattener class
+ * Iterative (explicit stack, no recursion) walk over a JSON document that emits every leaf into a FlatTable.  Object
+ * members are visited through iterators, not keys() and operator[], and paths are interned once per distinct path,
+ * so the per-leaf cost does not grow with depth or key length.  Empty objects and arrays produce no cells.
+ */
+class JsonFlattener
+{
+public:
+    //! Elements of the array at \a path ("devices[]" or "" for a top level array) become records
+    void setRecordPath(const QString &path);
+
+    void flatten(const QJsonValue &root, FlatTable &out);
+
+    //! Writes "path#record=Type(value)" lines, the layout the old recursive dump used
+    void dump(const FlatTable &table, OutBuffer &out) const;
+    //! Writes one "#record column=Type(value) ..." line per record, \a schema's columns only, lists as [...]
+    void dump(const FlatSchema &schema, const FlatTable &table, OutBuffer &out) const;
+
+    PathTable &paths() {return _paths;}
+    const PathTable &paths() const {return _paths;}
+
+private:
+    PathTable _paths;
+    uint32_t  _recordPath=UINT32_MAX;
+};
+
+/*!
+ * \brief forEachLeaf
+ * Calls \a f(key, value) for every leaf below \a root in document order, without building paths: the walk for
+ * consumers that only care about values (search text) or the member a value sits in (asset_id references).  \a key
+ * is the member name, empty for array elements and the root.  Empty objects and arrays are not leaves.
+ */
+template<class F>
+void forEachLeaf(const QJsonValue &root, F f)
+{
+    struct Entry
+    {
+        QString    key;
+        QJsonValue value;
+    };
+    std::vector<Entry> stack{{QString(), root}};
+    while(!stack.empty())
+    {
+        Entry e=std::move(stack.back());
+        stack.pop_back();
+        // Children are pushed in reverse, so they pop in document order
+        if(e.value.isArray())
+        {
+            const QJsonArray a=e.value.toArray();
+            for(qsizetype i=a.size(); i-->0;)
+                stack.push_back(Entry{QString(), a.at(i)});
+        }
+        else if(e.value.isObject())
+        {
+            const QJsonObject o=e.value.toObject();
+            for(auto it=o.constEnd(); it!=o.constBegin();)
+            {
+                --it;
+                stack.push_back(Entry{it.key(), it.value()});
+            }
+        }
+        else
+            f(e.key, e.value);
+    }
+}
+
+/*!
+ * \brief The FlatSchema class
+ * Precompiled path to column mapping for a known document shape.  Column paths are interned up front, so mapping a
+ * cell to its column is an array lookup by path id.
+ *
+ * A column with an array below the record path ("devices[].run.features[]") is a list column: its value is always a
+ * QJsonArray, empty when the record has no such values.  Other columns hold their one value, or Undefined.
+ */
+class FlatSchema
+{
+public:
+    //! \a recordPath as given to JsonFlattener::setRecordPath(); \a columns are full paths below it
+    FlatSchema(PathTable &paths, const QString &recordPath, const QStringList &columns);
+
+    //! Column of \a path, -1 if it is not part of the schema
+    int column(uint32_t path) const {return path<_columnOf.size() ? _columnOf[path] : -1;}
+    const QStringList &columns() const {return _columns;}
+    bool isList(int column) const {return _list[size_t(column)];}
+
+    /*!
+     * \brief rows
+     * One row per record, one value per column; cells outside records and paths outside the schema are skipped.
+     */
+    std::vector<std::vector<QJsonValue>> rows(const FlatTable &table) const;
+
+    //! The device/list shape, with "devices[]" as the record path
+    static QStringList deviceColumns();
+
+private:
+    QStringList       _columns;
+    std::vector<bool> _list;        //! By column
+    std::vector<int>  _columnOf;    //! By path id
+};
+
+}
+
+#endif // JSONFLATTEN_HPP
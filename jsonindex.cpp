@@ -0,0 +1,313 @@
+#include "jsonindex.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define IB_JSON_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define IB_TARGET(t) __attribute__((target(t)))
+#else
+#define IB_TARGET(t)
+#endif
+
+namespace InfoBeamer {
+
+namespace {
+
+//! Raw character classes of one 64 byte block, bit i describing byte i
+struct BlockMasks
+{
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;
+    uint64_t ws;
+};
+
+typedef void (*Classifier)(const uint8_t *block, BlockMasks &m);
+
+inline uint64_t prefixXor(uint64_t x)
+{
+    x^=x<<1;
+    x^=x<<2;
+    x^=x<<4;
+    x^=x<<8;
+    x^=x<<16;
+    x^=x<<32;
+    return x;
+}
+
+inline unsigned trailingZeros(uint64_t x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return unsigned(i);
+#else
+    return unsigned(__builtin_ctzll(x));
+#endif
+}
+
+void classifyScalar(const uint8_t *block, BlockMasks &m)
+{
+    m={0, 0, 0, 0};
+    for(unsigned i=0; i<64; i++)
+    {
+        const uint64_t bit=uint64_t(1)<<i;
+        switch(block[i])
+        {
+        case '"':
+            m.quote|=bit;
+            break;
+        case '\\':
+            m.backslash|=bit;
+            break;
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+            m.op|=bit;
+            break;
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            m.ws|=bit;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+#ifdef IB_JSON_X86
+// '[' ']' '{' '}' differ only in bit 5, so OR-ing 0x20 folds the four brackets onto two compares.
+IB_TARGET("sse4.2")
+void classifySSE42(const uint8_t *block, BlockMasks &m)
+{
+    const __m128i quote=_mm_set1_epi8('"');
+    const __m128i backslash=_mm_set1_epi8('\\');
+    const __m128i comma=_mm_set1_epi8(',');
+    const __m128i colon=_mm_set1_epi8(':');
+    const __m128i openBrace=_mm_set1_epi8('{');
+    const __m128i closeBrace=_mm_set1_epi8('}');
+    const __m128i bit5=_mm_set1_epi8(0x20);
+    const __m128i space=_mm_set1_epi8(' ');
+    const __m128i tab=_mm_set1_epi8('\t');
+    const __m128i lf=_mm_set1_epi8('\n');
+    const __m128i cr=_mm_set1_epi8('\r');
+
+    m={0, 0, 0, 0};
+    for(unsigned i=0; i<4; i++)
+    {
+        const __m128i v=_mm_loadu_si128(reinterpret_cast<const __m128i *>(block+16*i));
+        const __m128i folded=_mm_or_si128(v, bit5);
+        const __m128i op=_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, colon)),
+                                      _mm_or_si128(_mm_cmpeq_epi8(folded, openBrace),
+                                                   _mm_cmpeq_epi8(folded, closeBrace)));
+        const __m128i ws=_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+                                      _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        const unsigned shift=16*i;
+        m.quote|=uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote))))<<shift;
+        m.backslash|=uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash))))<<shift;
+        m.op|=uint64_t(uint16_t(_mm_movemask_epi8(op)))<<shift;
+        m.ws|=uint64_t(uint16_t(_mm_movemask_epi8(ws)))<<shift;
+    }
+}
+
+IB_TARGET("avx2")
+void classifyAVX2(const uint8_t *block, BlockMasks &m)
+{
+    const __m256i quote=_mm256_set1_epi8('"');
+    const __m256i backslash=_mm256_set1_epi8('\\');
+    const __m256i comma=_mm256_set1_epi8(',');
+    const __m256i colon=_mm256_set1_epi8(':');
+    const __m256i openBrace=_mm256_set1_epi8('{');
+    const __m256i closeBrace=_mm256_set1_epi8('}');
+    const __m256i bit5=_mm256_set1_epi8(0x20);
+    const __m256i space=_mm256_set1_epi8(' ');
+    const __m256i tab=_mm256_set1_epi8('\t');
+    const __m256i lf=_mm256_set1_epi8('\n');
+    const __m256i cr=_mm256_set1_epi8('\r');
+
+    m={0, 0, 0, 0};
+    for(unsigned i=0; i<2; i++)
+    {
+        const __m256i v=_mm256_loadu_si256(reinterpret_cast<const __m256i *>(block+32*i));
+        const __m256i folded=_mm256_or_si256(v, bit5);
+        const __m256i op=_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, comma),
+                                                         _mm256_cmpeq_epi8(v, colon)),
+                                         _mm256_or_si256(_mm256_cmpeq_epi8(folded, openBrace),
+                                                         _mm256_cmpeq_epi8(folded, closeBrace)));
+        const __m256i ws=_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                                                         _mm256_cmpeq_epi8(v, tab)),
+                                         _mm256_or_si256(_mm256_cmpeq_epi8(v, lf),
+                                                         _mm256_cmpeq_epi8(v, cr)));
+        const unsigned shift=32*i;
+        m.quote|=uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote))))<<shift;
+        m.backslash|=uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash))))<<shift;
+        m.op|=uint64_t(uint32_t(_mm256_movemask_epi8(op)))<<shift;
+        m.ws|=uint64_t(uint32_t(_mm256_movemask_epi8(ws)))<<shift;
+    }
+}
+#endif
+
+Classifier classifierFor(JsonIndex::Isa isa)
+{
+    switch(isa)
+    {
+#ifdef IB_JSON_X86
+    case JsonIndex::Isa::AVX2:
+        return classifyAVX2;
+    case JsonIndex::Isa::SSE42:
+        return classifySSE42;
+#endif
+    default:
+        return classifyScalar;
+    }
+}
+
+/*!
+ * \brief escapedChars
+ * Returns a mask of the characters that are escaped, i.e. preceded by an odd length run of backslashes.
+ * Runs may straddle blocks; \a prevEndsOdd carries that state over.
+ */
+inline uint64_t escapedChars(uint64_t bs, uint64_t &prevEndsOdd)
+{
+    const uint64_t evenBits=0x5555555555555555ULL;
+    const uint64_t oddBits=~evenBits;
+    const uint64_t startEdges=bs & ~(bs<<1);
+    const uint64_t evenStartMask=evenBits ^ prevEndsOdd;
+    const uint64_t evenStarts=startEdges & evenStartMask;
+    const uint64_t oddStarts=startEdges & ~evenStartMask;
+    const uint64_t evenCarries=bs+evenStarts;
+    uint64_t oddCarries=bs+oddStarts;
+    const bool endsOdd=oddCarries<bs;
+    oddCarries|=prevEndsOdd;
+    prevEndsOdd=endsOdd ? 1 : 0;
+    const uint64_t evenCarryEnds=evenCarries & ~bs;
+    const uint64_t oddCarryEnds=oddCarries & ~bs;
+    return (evenCarryEnds & oddBits) | (oddCarryEnds & evenBits);
+}
+
+JsonIndex::Isa clampIsa(JsonIndex::Isa wanted)
+{
+    const JsonIndex::Isa best=JsonIndex::detectIsa();
+    return int(wanted)>int(best) ? best : wanted;
+}
+
+//! Function local so setIsa() from another translation unit's static initializer is not overwritten
+JsonIndex::Isa &currentIsa()
+{
+    static JsonIndex::Isa isa=JsonIndex::detectIsa();
+    return isa;
+}
+
+}
+
+JsonIndex::Isa JsonIndex::detectIsa()
+{
+#ifdef IB_JSON_X86
+#if defined(__GNUC__) || defined(__clang__)
+    if(__builtin_cpu_supports("avx2"))
+        return Isa::AVX2;
+    if(__builtin_cpu_supports("sse4.2"))
+        return Isa::SSE42;
+#elif defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    const int maxLeaf=regs[0];
+    __cpuid(regs, 1);
+    const bool sse42=(regs[2] & (1<<20))!=0;
+    if(maxLeaf>=7)
+    {
+        __cpuidex(regs, 7, 0);
+        if(regs[1] & (1<<5))
+            return Isa::AVX2;
+    }
+    if(sse42)
+        return Isa::SSE42;
+#endif
+#endif
+    return Isa::Scalar;
+}
+
+JsonIndex::Isa JsonIndex::isa()
+{
+    return currentIsa();
+}
+
+void JsonIndex::setIsa(Isa isa)
+{
+    currentIsa()=clampIsa(isa);
+}
+
+const char *JsonIndex::isaName(Isa isa)
+{
+    switch(isa)
+    {
+    case Isa::AVX2:
+        return "AVX2";
+    case Isa::SSE42:
+        return "SSE4.2";
+    default:
+        return "scalar";
+    }
+}
+
+bool JsonIndex::build(const char *data, size_t len)
+{
+    _positions.clear();
+    // Structurals are rarely denser than one in four bytes on API payloads
+    _positions.reserve(len/4+16);
+
+    const Classifier classify=classifierFor(currentIsa());
+    const uint8_t *in=reinterpret_cast<const uint8_t *>(data);
+
+    uint64_t prevEndsOdd=0;     // last block ended in an odd backslash run
+    uint64_t prevInString=0;    // all ones if the last block ended inside a string
+    uint64_t prevSeparator=1;   // last byte of the previous block was op/ws/quote (start of doc counts as one)
+
+    BlockMasks m;
+    uint8_t tail[64];
+    for(size_t base=0; base<len; base+=64)
+    {
+        const uint8_t *block=in+base;
+        if(len-base<64)
+        {
+            // Pad the final block with whitespace so it classifies as nothing
+            std::memset(tail, ' ', sizeof tail);
+            std::memcpy(tail, block, len-base);
+            block=tail;
+        }
+        classify(block, m);
+
+        const uint64_t escaped=escapedChars(m.backslash, prevEndsOdd);
+        const uint64_t quote=m.quote & ~escaped;
+        const uint64_t inString=prefixXor(quote) ^ prevInString;
+        prevInString=uint64_t(int64_t(inString)>>63);
+
+        const uint64_t separator=m.op | m.ws | quote;
+        const uint64_t follows=(separator<<1) | prevSeparator;
+        prevSeparator=separator>>63;
+
+        const uint64_t scalarStarts=~separator & ~inString & follows;
+        uint64_t structurals=(m.op & ~inString) | (quote & inString) | scalarStarts;
+
+        while(structurals)
+        {
+            _positions.push_back(uint32_t(base+trailingZeros(structurals)));
+            structurals&=structurals-1;
+        }
+    }
+    return prevInString==0;
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef JSONINDEX_HPP
+#define JSONINDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The JsonIndex class
+ * Stage one of the indexed JSON parser: a single pass over the raw document that records the byte offset of every
+ * structural character ({ } [ ] : ,), every opening string quote and the first byte of every bare scalar
+ * (numbers, true, false, null).  Characters inside strings are masked out, so the second stage can walk the
+ * document token by token without re-scanning whitespace or string bodies.
+ *
+ * The scan works on 64 byte blocks.  The character classification of a block is vectorized (SSE4.2 or AVX2 on x86,
+ * picked once at runtime from the CPU feature flags) with a portable scalar fallback; the escape and in-string
+ * bookkeeping is done on the resulting 64 bit masks and is identical for every implementation.
+ */
+class JsonIndex
+{
+public:
+    enum class Isa
+    {
+        Scalar=0,
+        SSE42,
+        AVX2
+    };
+
+    /*!
+     * \brief build
+     * Index \a len bytes at \a data.  Returns false if the document ends inside a string; structural validity is left
+     * to the second stage.  The index is only valid while \a data is.
+     */
+    bool build(const char *data, size_t len);
+
+    const std::vector<uint32_t> &positions() const {return _positions;}
+    size_t size() const {return _positions.size();}
+    uint32_t operator[](size_t i) const {return _positions[i];}
+
+    static Isa detectIsa();           //! Best implementation supported by this CPU
+    static Isa isa();                 //! Implementation used by build()
+    static void setIsa(Isa isa);      //! Force an implementation (clamped to what the CPU supports)
+    static const char *isaName(Isa isa);
+
+private:
+    std::vector<uint32_t> _positions;
+};
+
+}
+
+#endif // JSONINDEX_HPP
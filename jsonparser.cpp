@@ -0,0 +1,605 @@
+#include "jsonparser.hpp"
+#include "jsonindex.hpp"
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace InfoBeamer {
+
+namespace {
+
+//! Same nesting limit QJsonDocument applies
+const int MAX_DEPTH=1024;
+
+/*!
+ * \brief The IndexedReader class
+ * Stage two of the Indexed backend: recursive descent over the positions recorded by JsonIndex.
+ */
+class IndexedReader
+{
+public:
+    IndexedReader(const char *data, size_t len, const JsonIndex &index)
+        : _d(data), _n(len), _pos(index.positions())
+    {
+    }
+
+    QJsonDocument document()
+    {
+        if(_pos.empty())
+            return fail(QJsonParseError::IllegalValue, uint32_t(_n));
+        const char c=_d[_pos[0]];
+        if(c!='{' && c!='[')
+            return fail(QJsonParseError::IllegalValue, _pos[0]);
+        QJsonValue v=value(0);
+        if(_err!=QJsonParseError::NoError)
+            return QJsonDocument();
+        if(_i!=_pos.size())
+            return fail(QJsonParseError::GarbageAtEnd, _pos[_i]);
+        return v.isObject() ? QJsonDocument(v.toObject()) : QJsonDocument(v.toArray());
+    }
+
+    QJsonParseError::ParseError error() const {return _err;}
+    int offset() const {return _errOffset;}
+
+private:
+    QJsonDocument fail(QJsonParseError::ParseError e, uint32_t at)
+    {
+        if(_err==QJsonParseError::NoError)
+        {
+            _err=e;
+            _errOffset=int(at);
+        }
+        return QJsonDocument();
+    }
+
+    bool next(uint32_t &p)
+    {
+        if(_i>=_pos.size())
+            return false;
+        p=_pos[_i++];
+        return true;
+    }
+
+    char peek() const
+    {
+        return _i<_pos.size() ? _d[_pos[_i]] : '\0';
+    }
+
+    static bool isDelimiter(char c)
+    {
+        switch(c)
+        {
+        case ' ': case '\t': case '\n': case '\r':
+        case ',': case ':': case ']': case '}': case '[': case '{': case '"':
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    QJsonValue value(int depth)
+    {
+        uint32_t p;
+        if(!next(p))
+        {
+            fail(QJsonParseError::IllegalValue, uint32_t(_n));
+            return QJsonValue();
+        }
+        switch(_d[p])
+        {
+        case '{':
+            return object(p, depth+1);
+        case '[':
+            return array(p, depth+1);
+        case '"':
+            return string(p);
+        case 't':
+            return literal(p, "true", QJsonValue(true));
+        case 'f':
+            return literal(p, "false", QJsonValue(false));
+        case 'n':
+            return literal(p, "null", QJsonValue(QJsonValue::Null));
+        default:
+            return number(p);
+        }
+    }
+
+    QJsonValue object(uint32_t start, int depth)
+    {
+        QJsonObject obj;
+        if(depth>MAX_DEPTH)
+        {
+            fail(QJsonParseError::DeepNesting, start);
+            return obj;
+        }
+        if(peek()=='}')
+        {
+            _i++;
+            return obj;
+        }
+        uint32_t p=start;
+        for(;;)
+        {
+            if(!next(p) || _d[p]!='"')
+            {
+                fail(QJsonParseError::UnterminatedObject, p);
+                return obj;
+            }
+            const QString key=string(p).toString();
+            if(_err!=QJsonParseError::NoError)
+                return obj;
+            if(!next(p) || _d[p]!=':')
+            {
+                fail(QJsonParseError::MissingNameSeparator, p);
+                return obj;
+            }
+            QJsonValue v=value(depth);
+            if(_err!=QJsonParseError::NoError)
+                return obj;
+            obj.insert(key, v);
+            if(!next(p))
+            {
+                fail(QJsonParseError::UnterminatedObject, uint32_t(_n));
+                return obj;
+            }
+            if(_d[p]=='}')
+                return obj;
+            if(_d[p]!=',')
+            {
+                fail(QJsonParseError::MissingValueSeparator, p);
+                return obj;
+            }
+        }
+    }
+
+    QJsonValue array(uint32_t start, int depth)
+    {
+        QJsonArray arr;
+        if(depth>MAX_DEPTH)
+        {
+            fail(QJsonParseError::DeepNesting, start);
+            return arr;
+        }
+        if(peek()==']')
+        {
+            _i++;
+            return arr;
+        }
+        uint32_t p=start;
+        for(;;)
+        {
+            QJsonValue v=value(depth);
+            if(_err!=QJsonParseError::NoError)
+                return arr;
+            arr.append(v);
+            if(!next(p))
+            {
+                fail(QJsonParseError::UnterminatedArray, uint32_t(_n));
+                return arr;
+            }
+            if(_d[p]==']')
+                return arr;
+            if(_d[p]!=',')
+            {
+                fail(QJsonParseError::MissingValueSeparator, p);
+                return arr;
+            }
+        }
+    }
+
+    QJsonValue literal(uint32_t p, const char *word, const QJsonValue &v)
+    {
+        const size_t len=std::strlen(word);
+        if(_n-p<len || std::memcmp(_d+p, word, len)!=0 || (p+len<_n && !isDelimiter(_d[p+len])))
+        {
+            fail(QJsonParseError::IllegalValue, p);
+            return QJsonValue();
+        }
+        return v;
+    }
+
+    static int hexDigit(char c)
+    {
+        if(c>='0' && c<='9')
+            return c-'0';
+        if(c>='a' && c<='f')
+            return c-'a'+10;
+        if(c>='A' && c<='F')
+            return c-'A'+10;
+        return -1;
+    }
+
+    bool hex4(size_t at, char16_t &out)
+    {
+        if(_n-at<4)
+            return false;
+        int v=0;
+        for(size_t k=0; k<4; k++)
+        {
+            const int h=hexDigit(_d[at+k]);
+            if(h<0)
+                return false;
+            v=(v<<4) | h;
+        }
+        out=char16_t(v);
+        return true;
+    }
+
+    /*!
+     * \brief validUtf8
+     * The check QJsonDocument applies to string bytes: well-formed UTF-8 without overlong forms, encoded surrogates or
+     * code points past U+10FFFF.  QString::fromUtf8() would quietly substitute U+FFFD instead.
+     */
+    static bool validUtf8(const char *data, size_t len)
+    {
+        const uchar *p=reinterpret_cast<const uchar *>(data);
+        const uchar *end=p+len;
+        while(p<end)
+        {
+            const uchar b=*p++;
+            if(b<0x80)
+                continue;
+            int more;
+            uchar lo=0x80, hi=0xBF;
+            if(b>=0xC2 && b<=0xDF)
+                more=1;
+            else if(b>=0xE0 && b<=0xEF)
+            {
+                more=2;
+                if(b==0xE0)
+                    lo=0xA0;
+                else if(b==0xED)
+                    hi=0x9F;
+            }
+            else if(b>=0xF0 && b<=0xF4)
+            {
+                more=3;
+                if(b==0xF0)
+                    lo=0x90;
+                else if(b==0xF4)
+                    hi=0x8F;
+            }
+            else
+                return false;
+            if(end-p<more || *p<lo || *p>hi)
+                return false;
+            for(int k=1; k<more; k++)
+                if(p[k]<0x80 || p[k]>0xBF)
+                    return false;
+            p+=more;
+        }
+        return true;
+    }
+
+    bool appendUtf8(QString &s, size_t from, size_t to)
+    {
+        if(!validUtf8(_d+from, to-from))
+        {
+            fail(QJsonParseError::IllegalUTF8String, uint32_t(from));
+            return false;
+        }
+        s+=QString::fromUtf8(_d+from, qsizetype(to-from));
+        return true;
+    }
+
+    QJsonValue string(uint32_t quote)
+    {
+        // Fast path: no escapes, one UTF-8 conversion, validated only if there are bytes past ASCII
+        size_t end=quote+1;
+        uchar bits=0;
+        while(end<_n && _d[end]!='"' && _d[end]!='\\')
+            bits|=uchar(_d[end++]);
+        if(end<_n && _d[end]=='"')
+        {
+            if(bits>=0x80 && !validUtf8(_d+quote+1, end-quote-1))
+            {
+                fail(QJsonParseError::IllegalUTF8String, quote+1);
+                return QJsonValue();
+            }
+            return QString::fromUtf8(_d+quote+1, qsizetype(end-quote-1));
+        }
+
+        QString s;
+        size_t run=quote+1;
+        size_t at=end;
+        for(;;)
+        {
+            if(at>=_n)
+            {
+                fail(QJsonParseError::UnterminatedString, quote);
+                return QJsonValue();
+            }
+            const char c=_d[at];
+            if(c=='"')
+            {
+                if(!appendUtf8(s, run, at))
+                    return QJsonValue();
+                return s;
+            }
+            if(c!='\\')
+            {
+                at++;
+                continue;
+            }
+            if(!appendUtf8(s, run, at))
+                return QJsonValue();
+            if(++at>=_n)
+                continue;
+            switch(_d[at])
+            {
+            case '"': s+=QChar('"'); break;
+            case '\\': s+=QChar('\\'); break;
+            case '/': s+=QChar('/'); break;
+            case 'b': s+=QChar('\b'); break;
+            case 'f': s+=QChar('\f'); break;
+            case 'n': s+=QChar('\n'); break;
+            case 'r': s+=QChar('\r'); break;
+            case 't': s+=QChar('\t'); break;
+            case 'u':
+            {
+                char16_t u;
+                if(!hex4(at+1, u))
+                {
+                    fail(QJsonParseError::IllegalEscapeSequence, uint32_t(at));
+                    return QJsonValue();
+                }
+                s+=QChar(u);
+                at+=4;
+                break;
+            }
+            default:
+                // QJsonDocument takes an unknown escape as the byte itself
+                s+=QChar(uchar(_d[at]));
+                break;
+            }
+            run=++at;
+        }
+    }
+
+    QJsonValue number(uint32_t p)
+    {
+        size_t at=p;
+        bool integral=true;
+        if(at<_n && _d[at]=='-')
+            at++;
+        if(at>=_n || _d[at]<'0' || _d[at]>'9')
+        {
+            fail(QJsonParseError::IllegalValue, p);
+            return QJsonValue();
+        }
+        if(_d[at]=='0')
+            at++;
+        else
+            while(at<_n && _d[at]>='0' && _d[at]<='9')
+                at++;
+        if(at<_n && _d[at]=='.')
+        {
+            integral=false;
+            const size_t digits=++at;
+            while(at<_n && _d[at]>='0' && _d[at]<='9')
+                at++;
+            if(at==digits)
+            {
+                fail(QJsonParseError::IllegalNumber, p);
+                return QJsonValue();
+            }
+        }
+        if(at<_n && (_d[at]=='e' || _d[at]=='E'))
+        {
+            integral=false;
+            at++;
+            if(at<_n && (_d[at]=='+' || _d[at]=='-'))
+                at++;
+            const size_t digits=at;
+            while(at<_n && _d[at]>='0' && _d[at]<='9')
+                at++;
+            if(at==digits)
+            {
+                fail(QJsonParseError::IllegalNumber, p);
+                return QJsonValue();
+            }
+        }
+        if(at<_n && !isDelimiter(_d[at]))
+        {
+            fail(QJsonParseError::IllegalNumber, p);
+            return QJsonValue();
+        }
+        if(at>=_n)
+        {
+            fail(QJsonParseError::TerminationByNumber, p);
+            return QJsonValue();
+        }
+
+        if(integral)
+        {
+            // Same rule as QJsonDocument: integers that fit stay exact
+            const bool negative=_d[p]=='-';
+            uint64_t v=0;
+            bool overflow=false;
+            for(size_t k=negative ? p+1 : p; k<at; k++)
+            {
+                const uint64_t digit=uint64_t(_d[k]-'0');
+                if(v>(std::numeric_limits<uint64_t>::max()-digit)/10)
+                {
+                    overflow=true;
+                    break;
+                }
+                v=v*10+digit;
+            }
+            const uint64_t limit=negative ? uint64_t(std::numeric_limits<qint64>::max())+1
+                                          : uint64_t(std::numeric_limits<qint64>::max());
+            if(!overflow && v<=limit)
+                return QJsonValue(negative ? qint64(0-v) : qint64(v));
+        }
+        // QByteArray::toDouble() is locale independent, unlike strtod()
+        bool ok=false;
+        const double d=QByteArray::fromRawData(_d+p, qsizetype(at-p)).toDouble(&ok);
+        if(!ok)
+        {
+            fail(QJsonParseError::IllegalNumber, p);
+            return QJsonValue();
+        }
+        return QJsonValue(d);
+    }
+
+    const char *_d;
+    size_t _n;
+    const std::vector<uint32_t> &_pos;
+    size_t _i=0;
+    QJsonParseError::ParseError _err=QJsonParseError::NoError;
+    int _errOffset=0;
+};
+
+struct StatCounters
+{
+    std::atomic<uint64_t> documents{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> nanoseconds{0};
+    std::atomic<uint64_t> lastBytes{0};
+    std::atomic<uint64_t> lastNanoseconds{0};
+};
+
+StatCounters s_stats;
+
+JsonParser::Backend backendFromEnv()
+{
+    const char *isa=std::getenv("IB_JSON_ISA");
+    if(isa!=nullptr)
+    {
+        if(std::strcmp(isa, "scalar")==0)
+            JsonIndex::setIsa(JsonIndex::Isa::Scalar);
+        else if(std::strcmp(isa, "sse4.2")==0)
+            JsonIndex::setIsa(JsonIndex::Isa::SSE42);
+        else if(std::strcmp(isa, "avx2")==0)
+            JsonIndex::setIsa(JsonIndex::Isa::AVX2);
+    }
+    const char *b=std::getenv("IB_JSON_BACKEND");
+    if(b!=nullptr && std::strcmp(b, "indexed")==0)
+        return JsonParser::Backend::Indexed;
+    return JsonParser::Backend::Qt;
+}
+
+std::atomic<JsonParser::Backend> s_backend{backendFromEnv()};
+
+}
+
+QJsonDocument JsonParser::parse(const QByteArray &json, Backend b, QJsonParseError *error)
+{
+    if(b==Backend::Qt)
+        return QJsonDocument::fromJson(json, error);
+
+    // QJsonDocument skips a UTF-8 byte order mark
+    const char *data=json.constData();
+    size_t len=size_t(json.size());
+    int skipped=0;
+    if(len>3 && std::memcmp(data, "\xEF\xBB\xBF", 3)==0)
+        skipped=3;
+    data+=skipped;
+    len-=size_t(skipped);
+
+    JsonIndex index;
+    const bool closed=index.build(data, len);
+    IndexedReader reader(data, len, index);
+    QJsonDocument doc;
+    QJsonParseError::ParseError err;
+    int offset;
+    if(!closed)
+    {
+        err=QJsonParseError::UnterminatedString;
+        offset=int(json.size());
+    }
+    else
+    {
+        doc=reader.document();
+        err=reader.error();
+        offset=reader.offset()+skipped;
+    }
+    if(error!=nullptr)
+    {
+        error->error=err;
+        error->offset=err==QJsonParseError::NoError ? 0 : offset;
+    }
+    return doc;
+}
+
+QJsonDocument JsonParser::fromJson(const QByteArray &json, QJsonParseError *error)
+{
+    const auto start=std::chrono::steady_clock::now();
+    QJsonDocument doc=parse(json, s_backend.load(std::memory_order_relaxed), error);
+    const uint64_t ns=uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now()-start).count());
+
+    s_stats.documents.fetch_add(1, std::memory_order_relaxed);
+    s_stats.bytes.fetch_add(uint64_t(json.size()), std::memory_order_relaxed);
+    s_stats.nanoseconds.fetch_add(ns, std::memory_order_relaxed);
+    s_stats.lastBytes.store(uint64_t(json.size()), std::memory_order_relaxed);
+    s_stats.lastNanoseconds.store(ns, std::memory_order_relaxed);
+    return doc;
+}
+
+void JsonParser::setBackend(Backend b)
+{
+    s_backend.store(b);
+}
+
+JsonParser::Backend JsonParser::backend()
+{
+    return s_backend.load();
+}
+
+const char *JsonParser::backendName(Backend b)
+{
+    return b==Backend::Qt ? "qt" : JsonIndex::isaName(JsonIndex::isa());
+}
+
+JsonParser::Stats JsonParser::stats()
+{
+    Stats s;
+    s.documents=s_stats.documents.load(std::memory_order_relaxed);
+    s.bytes=s_stats.bytes.load(std::memory_order_relaxed);
+    s.nanoseconds=s_stats.nanoseconds.load(std::memory_order_relaxed);
+    s.lastBytes=s_stats.lastBytes.load(std::memory_order_relaxed);
+    s.lastNanoseconds=s_stats.lastNanoseconds.load(std::memory_order_relaxed);
+    return s;
+}
+
+void JsonParser::resetStats()
+{
+    s_stats.documents=0;
+    s_stats.bytes=0;
+    s_stats.nanoseconds=0;
+    s_stats.lastBytes=0;
+    s_stats.lastNanoseconds=0;
+}
+
+double JsonParser::benchmark(const QByteArray &json, Backend b, int iterations)
+{
+    if(iterations<1 || json.isEmpty())
+        return 0.0;
+    const auto start=std::chrono::steady_clock::now();
+    for(int i=0; i<iterations; i++)
+        parse(json, b, nullptr);
+    const double ns=double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now()-start).count());
+    return ns>0 ? double(json.size())*iterations/ns : 0.0;
+}
+
+bool JsonParser::conforms(const QByteArray &json)
+{
+    QJsonParseError qtErr, ixErr;
+    const QJsonDocument qt=parse(json, Backend::Qt, &qtErr);
+    const QJsonDocument ix=parse(json, Backend::Indexed, &ixErr);
+    if((qtErr.error==QJsonParseError::NoError)!=(ixErr.error==QJsonParseError::NoError))
+        return false;
+    return qt==ix;
+}
+
+}
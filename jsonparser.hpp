@@ -0,0 +1,76 @@
+#ifndef JSONPARSER_HPP
+#define JSONPARSER_HPP
+
+#include <cstdint>
+
+#include <QByteArray>
+#include <QJsonDocument>
+#include <QJsonParseError>
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The JsonParser class
+ * Drop-in replacement for QJsonDocument::fromJson() with a selectable backend.
+ *
+ * The Qt backend forwards to QJsonDocument.  The Indexed backend first builds a JsonIndex (vectorized structural scan)
+ * and then walks the recorded token positions to build the QJsonDocument the typed decoders consume.
+ *
+ * The backend defaults to Qt; the Indexed one is opt-in with the IB_JSON_BACKEND environment variable ("qt" or
+ * "indexed") or setBackend() until jsonbench shows it ahead on the API's payloads.  IB_JSON_ISA ("scalar", "sse4.2",
+ * "avx2") caps the index implementation.
+ */
+class JsonParser
+{
+public:
+    enum class Backend
+    {
+        Qt=0,
+        Indexed
+    };
+
+    /*!
+     * \brief The Stats struct
+     * Running totals over every fromJson() call, plus the figures of the most recent one.
+     */
+    struct Stats
+    {
+        uint64_t documents=0;
+        uint64_t bytes=0;
+        uint64_t nanoseconds=0;
+        uint64_t lastBytes=0;
+        uint64_t lastNanoseconds=0;
+
+        double gbPerSecond() const {return nanoseconds ? double(bytes)/double(nanoseconds) : 0.0;}
+        double lastGbPerSecond() const {return lastNanoseconds ? double(lastBytes)/double(lastNanoseconds) : 0.0;}
+    };
+
+    static QJsonDocument fromJson(const QByteArray &json, QJsonParseError *error=nullptr);
+
+    static void setBackend(Backend b);
+    static Backend backend();
+    static const char *backendName(Backend b);
+
+    static Stats stats();
+    static void resetStats();
+
+    /*!
+     * \brief benchmark
+     * Parses \a json \a iterations times with backend \a b and returns the throughput in GB/s.  Does not touch stats().
+     */
+    static double benchmark(const QByteArray &json, Backend b, int iterations=10);
+
+    /*!
+     * \brief conforms
+     * Returns true if the Indexed backend produces exactly what QJsonDocument produces for \a json, including
+     * agreeing on whether it is valid at all.
+     */
+    static bool conforms(const QByteArray &json);
+
+private:
+    static QJsonDocument parse(const QByteArray &json, Backend b, QJsonParseError *error);
+};
+
+}
+
+#endif // JSONPARSER_HPP
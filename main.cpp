@@ -1,8 +1,22 @@
 #include "mainwindow.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QHostAddress>
 #include <QTextStream>
 #include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <cstring>
+
+#include "apiclient.hpp"
+#include "fleetpoller.hpp"
+#include "fleetsegment.hpp"
+#include "startuptrace.hpp"
+#include "statusserver.hpp"
+#include "supervisor.hpp"
+
 //QString readTextFile(QString stylesheet){
 //    QFile file{stylesheet};
 //    if(file.open(QFile::ReadOnly | QFile::Text)){
@@ -11,9 +25,153 @@
 //    }
 //    return "";
 //}
+
+static const quint16 DEFAULT_STATUS_PORT=8081;
+
+static QString segmentString(const InfoBeamer::FleetSegment::View &view, const InfoBeamer::FleetSegment::Str &s)
+{
+    const std::string_view v=view.string(s);
+    return QString::fromUtf8(v.data(), qsizetype(v.size()));
+}
+
+/*!
+ * \brief exportShared
+ * Writes the devices in the segments of a running supervisor to stdout as NDJSON, read in place.
+ */
+static int exportShared(const QString &prefix)
+{
+    InfoBeamer::SharedFleetReader reader(prefix);
+    if(!reader.attach())
+    {
+        qCritical() << "no supervisor fleet at" << prefix << reader.errorString();
+        return 1;
+    }
+    QFile out;
+    if(!out.open(stdout, QIODevice::WriteOnly))
+        return 1;
+    reader.forEach([&out](const InfoBeamer::FleetSegment::View &view){
+        for(quint32 i=0; i<view.size(); i++)
+        {
+            const InfoBeamer::FleetSegment::Record &r=view.at(i);
+            QJsonObject device{{"account", segmentString(view, r.account)}, {"id", r.id},
+                               {"description", segmentString(view, r.description)},
+                               {"location", segmentString(view, r.location)},
+                               {"serial", segmentString(view, r.serial)}, {"status", segmentString(view, r.status)},
+                               {"is_online", bool(r.online)}, {"version", segmentString(view, r.version)},
+                               {"channel", segmentString(view, r.channel)},
+                               {"public_addr", segmentString(view, r.publicAddr)},
+                               {"restarted", r.restarted}, {"reboot", r.reboot},
+                               {"upgrade_blocked", r.upgradeBlocked}};
+            if(r.synced>=0)
+                device.insert("is_synced", bool(r.synced));
+            if(r.hasGeo)
+                device.insert("geo", QJsonObject{{"lat", r.lat}, {"lon", r.lon}});
+            if(r.setupId)
+                device.insert("setup", QJsonObject{{"id", r.setupId}, {"name", segmentString(view, r.setupName)}});
+            if(r.memory)
+                device.insert("hw", QJsonObject{{"model", segmentString(view, r.model)}, {"memory", r.memory}});
+            out.write(QJsonDocument(device).toJson(QJsonDocument::Compact));
+            out.write("\n");
+        }
+    });
+    return 0;
+}
+
+/*!
+ * \brief headless
+ * Runs without any window: polls the fleet and serves it through the StatusServer, or, with --supervise, polls the
+ * accounts in worker processes into shared memory (see Supervisor).
+ */
+static int headless(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setOrganizationName("InfoBeamer");
+    a.setApplicationName("GitHub_API");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Polls the info-beamer fleet and serves it over HTTP.");
+    parser.addHelpOption();
+    const QCommandLineOption headlessOption("headless", "Run without GUI.");
+    const QCommandLineOption port("status-port", "Port for the status endpoint.", "port",
+                                  qEnvironmentVariable("IB_STATUS_PORT", QString::number(DEFAULT_STATUS_PORT)));
+    const QCommandLineOption bind("status-bind", "Address for the status endpoint.", "address", "127.0.0.1");
+    const QCommandLineOption supervise("supervise", "Poll the accounts in worker processes, into shared memory.");
+    const QCommandLineOption workers("workers", "Worker processes for --supervise.", "count",
+                                     QString::number(QThread::idealThreadCount()));
+    const QCommandLineOption prefix("segment-prefix", "Shared memory key prefix of the fleet segments.", "prefix",
+                                    InfoBeamer::Supervisor::defaultPrefix());
+    const QCommandLineOption segmentMb("segment-mb", "Initial size of every fleet segment.", "MB",
+                                       QString::number(InfoBeamer::Supervisor::DEFAULT_SEGMENT_BYTES/(1024*1024)));
+    const QCommandLineOption exportSharedOption("export-shared", "Write the supervisor's fleet to stdout as NDJSON.");
+    const QCommandLineOption worker("worker", "Internal: run as worker of a supervisor.", "shard");
+    const QCommandLineOption shards("shards", "Internal: worker count of the supervisor.", "count", "1");
+    const QCommandLineOption segment("segment", "Internal: key of the worker's fleet segment.", "key");
+    parser.addOptions({headlessOption, port, bind, supervise, workers, prefix, segmentMb, exportSharedOption, worker,
+                       shards, segment});
+    parser.process(a);
+
+    if(parser.isSet(exportSharedOption))
+        return exportShared(parser.value(prefix));
+    if(parser.isSet(supervise))
+    {
+        InfoBeamer::Supervisor supervisor(parser.value(prefix), parser.value(workers).toInt());
+        supervisor.setSegmentBytes(qMax<qint64>(1, parser.value(segmentMb).toLongLong())*1024*1024);
+        QString error;
+        if(!supervisor.start(&error))
+        {
+            qCritical() << error;
+            return 1;
+        }
+        qInfo() << supervisor.workers() << "workers polling into" << parser.value(prefix);
+        return a.exec();
+    }
+    if(parser.isSet(worker))
+    {
+        InfoBeamer::ApiClient api;
+        api.warmUp();
+        InfoBeamer::ShardWorker shard(&api, parser.value(worker).toInt(), parser.value(shards).toInt(),
+                                      parser.value(segment));
+        QString error;
+        if(!shard.start(&error))
+        {
+            qCritical() << error;
+            return 1;
+        }
+        return a.exec();
+    }
+
+    InfoBeamer::ApiClient api;
+    api.warmUp();
+    InfoBeamer::FleetPoller poller(&api);
+    poller.setPublishing(true);
+    InfoBeamer::StatusServer server(&api);
+    server.setPoller(&poller);
+    if(!server.listen(QHostAddress(parser.value(bind)), quint16(parser.value(port).toUInt())))
+    {
+        qCritical() << "cannot listen on" << parser.value(bind) << parser.value(port) << server.errorString();
+        return 1;
+    }
+    qInfo() << "status endpoint on" << server.serverAddress().toString() << server.serverPort();
+    poller.start();
+    return a.exec();
+}
+
 int main(int argc, char *argv[])
 {
+    InfoBeamer::StartupTrace::start();
+    // As QCommandLineParser reads them: --worker 3 and --worker=3 alike, nothing after --
+    for(int i=1; i<argc && std::strcmp(argv[i], "--")!=0; i++)
+        for(const char *mode: {"--headless", "--supervise", "--worker", "--export-shared"})
+        {
+            const size_t n=std::strlen(mode);
+            if(std::strncmp(argv[i], mode, n)==0 && (argv[i][n]==0 || argv[i][n]=='='))
+                return headless(argc, argv);
+        }
+
     QApplication a(argc, argv);
+    a.setOrganizationName("InfoBeamer");
+    a.setApplicationName("GitHub_API");
+    InfoBeamer::StartupTrace::mark("application");
 //    QString css = readTextFile(":/resources/styles.css");
 //    if(css.length() >  0)
 //        a.setStyleSheet(css);
@@ -3,14 +3,38 @@
 
 #include <QInputDialog>
 #include <QMessageBox>
+#include <QMenu>
+#include <QFile>
+#include <QHostAddress>
+#include <QFileDialog>
+#include <QStatusBar>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QElapsedTimer>
+#include <QStandardPaths>
+#include <QTimer>
 #include <QDebug>
 
+#include <algorithm>
+#include <climits>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 #include "InfoBeamerParams.hpp"
 
+#include "account.hpp"
 #include "device.hpp"
+#include "arrowexport.hpp"
+#include "deviceexport.hpp"
+#include "devicequery.hpp"
+#include "devicesearchdialog.hpp"
+#include "fleetstore.hpp"
+#include "startuptrace.hpp"
+#include "statusserver.hpp"
+#include "jsonflatten.hpp"
+#include "jsonparser.hpp"
 
 using namespace InfoBeamer;
 
@@ -18,12 +42,420 @@ MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
 {
+    // Only what the first paint needs; initialize() does the rest once the event loop runs
     ui->setupUi(this);
-    netManager = new QNetworkAccessManager(this);
-    netReply = nullptr;
-    repoReply = nullptr;
     img = new QPixmap();
-    setFixedSize(606,469);
+    restoreLastState();
+    setFixedSize(606,469+statusBar()->sizeHint().height());
+    // The buttons use what initialize() creates
+    enableButtons(false);
+    StartupTrace::mark("window");
+    // event() starts initialize() after the first paint; a window started minimized or hidden may never get one
+    QTimer::singleShot(INIT_FALLBACK_MS, this, &MainWindow::initialize);
+}
+
+bool MainWindow::event(QEvent *e)
+{
+    const bool handled = QMainWindow::event(e);
+    if(e->type() == QEvent::Paint && !painted){
+        painted = true;
+        StartupTrace::mark("first paint");
+        qInfo() << StartupTrace::report();
+        // Queued, so the painted frame reaches the screen before the setup blocks the event loop
+        QTimer::singleShot(0, this, &MainWindow::initialize);
+    }
+    return handled;
+}
+
+void MainWindow::initialize()
+{
+    if(initialized)
+        return;
+    initialized = true;
+
+    api = new ApiClient(this);
+    api->warmUp();
+    poller = new FleetPoller(api, this);
+    poller->setPublishing(true);
+    connect(poller, &FleetPoller::refreshed, this, &MainWindow::fleetRefreshed);
+    connect(poller, &FleetPoller::fleetChanged, this, &MainWindow::fleetChanged);
+    connect(poller, &FleetPoller::pollFailed, this, &MainWindow::fleetPollFailed);
+
+    QMenu *fleetMenu = ui->menuBar->addMenu("Fleet");
+    QAction *autoRefresh = fleetMenu->addAction("Auto Refresh");
+    autoRefresh->setCheckable(true);
+    connect(autoRefresh, &QAction::toggled, this, [this](bool on){
+        if(on)
+            poller->start();
+        else
+            poller->stop();
+    });
+
+    // Local status endpoint for other tools, only when asked for
+    status = nullptr;
+    if(qEnvironmentVariableIsSet("IB_STATUS_PORT")){
+        status = new StatusServer(api, this);
+        status->setPoller(poller);
+        if(!status->listen(QHostAddress::LocalHost, quint16(qEnvironmentVariableIntValue("IB_STATUS_PORT"))))
+            qDebug() << "Error : status endpoint:" << status->errorString();
+    }
+
+    // Further accounts, if an accounts file is present
+    store = new FleetStore(api, this);
+    const QString accountsFile = Account::configPath();
+    if(QFile::exists(accountsFile)){
+        try {
+            store->setAccounts(Account::load(accountsFile));
+        } catch (const AccountException &e) {
+            qDebug() << "Error : " << e.what();
+        }
+    }
+    QAction *allAccounts = fleetMenu->addAction(QString("Monitor All Accounts (%1)").arg(store->accounts()));
+    allAccounts->setCheckable(true);
+    allAccounts->setEnabled(store->accounts()>0);
+    connect(allAccounts, &QAction::toggled, this, [this](bool on){
+        if(on)
+            store->start();
+        else
+            store->stop();
+    });
+    connect(store, &FleetStore::roundFinished, this, [this](qint64 ms, int failed){
+        statusBar()->showMessage(QString("%1 accounts, %2 devices, refreshed in %3 ms, %4 failed")
+                                 .arg(store->accounts()).arg(store->size()).arg(ms).arg(failed));
+    });
+    connect(store, &FleetStore::accountChanged, this, [](const QString &account, const FleetDiff &diff){
+        qDebug() << "account" << account << ":" << diff.added.size() << "added" << diff.removed.size() << "removed"
+                 << diff.changed.size() << "changed";
+    });
+    connect(store, &FleetStore::accountFailed, this, [](const QString &account, const QString &error){
+        qDebug() << "account" << account << "refresh failed:" << error;
+    });
+    if(status)
+        status->setStore(store);
+
+    details = new DeviceDetails(api, this);
+    connect(details, &DeviceDetails::detailReady, poller, &FleetPoller::merge);
+    connect(details, &DeviceDetails::progress, this, [this](int done, int failed, int total){
+        statusBar()->showMessage(QString("Device details: %1 of %2 fetched, %3 failed").arg(done).arg(total).arg(failed));
+    });
+    QAction *refreshDetails = fleetMenu->addAction("Refresh All Details");
+    connect(refreshDetails, &QAction::triggered, this, [this]{
+        details->cancel();
+        details->refreshAll(poller->snapshot());
+    });
+    QAction *searchDevices = fleetMenu->addAction("Search Devices...");
+    searchDevices->setShortcut(QKeySequence::Find);
+    connect(searchDevices, &QAction::triggered, this, [this]{
+        auto *dialog = new DeviceSearchDialog(poller, this);
+        dialog->setAttribute(Qt::WA_DeleteOnClose);
+        dialog->show();
+    });
+    // Setup, userdata or reboot for every device a filter selects; the fleet is refreshed afterwards to show the result
+    bulk = new BulkOperation(api, this);
+    connect(bulk, &BulkOperation::progress, this, [this](int settled, int failed, int total){
+        statusBar()->showMessage(QString("Bulk %1: %2 of %3 devices, %4 failed")
+                                 .arg(BulkOperation::actionName(bulk->action())).arg(settled).arg(total).arg(failed));
+    });
+    connect(bulk, &BulkOperation::finished, this, [this]{
+        int done = 0, skipped = 0;
+        QStringList failures;
+        for(const BulkOperation::Result &r : bulk->results()){
+            if(r.outcome == BulkOperation::Outcome::Done)
+                done++;
+            else if(r.outcome == BulkOperation::Outcome::Skipped)
+                skipped++;
+            else if(r.outcome == BulkOperation::Outcome::Failed && failures.size() < 20)
+                failures << QString("%1: %2 (%3 attempts)").arg(r.device).arg(r.error).arg(r.attempts);
+        }
+        const QString summary = QString("Bulk %1: %2 done, %3 already applied, %4 failed in %5 ms")
+                                .arg(BulkOperation::actionName(bulk->action())).arg(done).arg(skipped)
+                                .arg(bulk->failed()).arg(bulk->elapsedMs());
+        statusBar()->showMessage(summary);
+        if(!failures.isEmpty())
+            QMessageBox::warning(this, "Bulk Operation", summary+"\n\n"+failures.join("\n"));
+        poller->pollNow();
+    });
+    QAction *bulkAction = fleetMenu->addAction("Bulk Operation...");
+    connect(bulkAction, &QAction::triggered, this, [this]{
+        if(bulk->busy()){
+            if(QMessageBox::question(this, "Bulk Operation", "A bulk operation is running. Cancel it?") == QMessageBox::Yes)
+                bulk->cancel();
+            return;
+        }
+        bool ok = false;
+        const QString filter = QInputDialog::getText(this, "Bulk Operation",
+                                                     "Devices (e.g. channel=testing&online=true, empty for all)",
+                                                     QLineEdit::Normal, QString(), &ok);
+        if(!ok)
+            return;
+        QString error;
+        const DeviceQuery query = DeviceQuery::parse(filter.trimmed().toUtf8(), &error);
+        if(!error.isEmpty()){
+            QMessageBox::warning(this, "Bulk Operation", error);
+            return;
+        }
+        std::vector<Device> selection;
+        for(size_t i : query.select(poller->snapshot()))
+            selection.push_back(poller->snapshot()[i]);
+        if(selection.empty()){
+            QMessageBox::information(this, "Bulk Operation", "No device matches.");
+            return;
+        }
+        const QStringList actions{"Assign Setup", "Set Userdata", "Reboot"};
+        const QString chosen = QInputDialog::getItem(this, "Bulk Operation", QString("Action for %1 devices")
+                                                     .arg(selection.size()), actions, 0, false, &ok);
+        if(!ok)
+            return;
+        const auto action = BulkOperation::Action(actions.indexOf(chosen));
+        QString argument;
+        if(action == BulkOperation::Action::AssignSetup){
+            const int setup = QInputDialog::getInt(this, "Bulk Operation", "Setup id", 0, 1, INT_MAX, 1, &ok);
+            argument = QString::number(setup);
+        }else if(action == BulkOperation::Action::SetUserdata){
+            argument = QInputDialog::getMultiLineText(this, "Bulk Operation", "Userdata (JSON object)", "{}", &ok);
+        }
+        if(!ok)
+            return;
+        if(QMessageBox::question(this, "Bulk Operation", QString("%1 on %2 devices?").arg(chosen).arg(selection.size()))
+                != QMessageBox::Yes)
+            return;
+        if(!bulk->start(action, selection, argument, &error))
+            QMessageBox::warning(this, "Bulk Operation", error);
+    });
+    // Which devices a change to a setup, package or asset reaches; the setups and assets buttons feed the index
+    setupFetch = new FanOut(api, this);
+    QAction *impact = fleetMenu->addAction("Impact of Change...");
+    connect(impact, &QAction::triggered, this, [this]{
+        bool ok = false;
+        const QString kind = QInputDialog::getItem(this, "Impact of Change", "Changed entity",
+                                                   {"Package", "Setup", "Asset"}, 0, false, &ok);
+        if(!ok)
+            return;
+        const int id = QInputDialog::getInt(this, "Impact of Change", kind+" id", 0, 0, INT_MAX, 1, &ok);
+        if(!ok)
+            return;
+        QElapsedTimer timer;
+        timer.start();
+        RelationIndex::Ids devices, setups;
+        QString name;
+        if(kind == "Package"){
+            devices = relations.devicesOfPackage(id);
+            setups = relations.setupsOfPackage(id);
+            name = relations.packageName(id);
+        }else if(kind == "Asset"){
+            devices = relations.devicesOfAsset(id);
+            setups = relations.setupsOfAsset(id);
+            name = relations.assetName(id);
+        }else{
+            devices = relations.devicesOfSetup(id);
+            setups = {id};
+            name = relations.setupName(id);
+        }
+        const qint64 us = timer.nsecsElapsed()/1000;
+        QStringList shown;
+        for(size_t i = 0; i < devices.size() && i < 50; i++)
+            shown << QString::number(devices[i]);
+        if(devices.size() > 50)
+            shown << "...";
+        QMessageBox::information(this, "Impact of Change",
+                                 QString("%1 %2 %3 reaches %4 devices through %5 setups (%6 us)\n\n%7")
+                                 .arg(kind).arg(id).arg(name.isEmpty() ? QString() : "("+name+")")
+                                 .arg(devices.size()).arg(setups.size()).arg(us).arg(shown.join(", ")));
+    });
+    QAction *exportFleet = fleetMenu->addAction("Export Fleet...");
+    connect(exportFleet, &QAction::triggered, this, [this]{
+        QString filters = "NDJSON (*.ndjson);;CSV (*.csv);;Text (*.txt)";
+        if(ArrowExporter::available())
+            filters += ";;Arrow IPC (*.arrow)";
+        if(ArrowExporter::available(ArrowExporter::Format::Parquet))
+            filters += ";;Parquet (*.parquet)";
+        const QString path = QFileDialog::getSaveFileName(this, "Export Fleet", QString(), filters);
+        if(path.isEmpty())
+            return;
+        const std::string file = path.toStdString();
+        if(path.endsWith(".arrow") || path.endsWith(".feather") || path.endsWith(".parquet"))
+        {
+            std::string error;
+            if(!ArrowExporter::exportAll(poller->snapshot(), ArrowExporter::formatForPath(file), file, &error))
+                QMessageBox::warning(this,"Error",QString("Could not write %1: %2").arg(path, QString::fromStdString(error)));
+            return;
+        }
+        if(!DeviceExporter::exportAll(poller->snapshot(), DeviceExporter::formatForPath(file), file))
+            QMessageBox::warning(this,"Error",QString("Could not write %1").arg(path));
+    });
+
+    // Asset mirror; IB_ASSET_RATE caps it in KB/s
+    assetSync = new AssetSync(api, this);
+    assetSync->setRateLimit(qint64(qEnvironmentVariableIntValue("IB_ASSET_RATE"))*1024);
+    connect(assetSync, &AssetSync::progress, this, [this](qint64 bytes, qint64 total, int files, int totalFiles){
+        statusBar()->showMessage(QString("Asset sync: %1 of %2 files, %3 of %4 MB")
+                                 .arg(files).arg(totalFiles).arg(bytes/(1024*1024)).arg(total/(1024*1024)));
+    });
+    connect(assetSync, &AssetSync::assetFailed, this, [](qint64 id, const QString &error){
+        qDebug() << "Error : asset" << id << ":" << error;
+    });
+    connect(assetSync, &AssetSync::finished, this, [this]{
+        const AssetSync::Stats &st = assetSync->stats();
+        statusBar()->showMessage(QString("Asset sync done: %1 downloaded, %2 up to date, %3 copied, %4 failed, "
+                                         "%5 chunks resumed")
+                                 .arg(st.downloaded).arg(st.upToDate).arg(st.copied).arg(st.failed)
+                                 .arg(st.chunksResumed));
+    });
+    QAction *syncAssets = fleetMenu->addAction("Sync Assets...");
+    connect(syncAssets, &QAction::triggered, this, [this]{
+        const QString dir = QFileDialog::getExistingDirectory(this, "Sync Assets To", assetSync->directory());
+        if(dir.isEmpty())
+            return;
+        assetSync->setDirectory(dir);
+        QNetworkReply *reply = api->get(api->infoBeamerRequest("asset/list"));
+        auto body = std::make_shared<QByteArray>();
+        connect(reply, &QNetworkReply::readyRead, this, [this, reply, body]{api->read(reply, *body);});
+        connect(reply, &QNetworkReply::finished, this, [this, reply, body]{
+            reply->deleteLater();
+            if(reply->error() != QNetworkReply::NoError || !api->read(reply, *body)){
+                QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(api->errorString(reply)));
+                return;
+            }
+            assetSync->sync(AssetSync::fromList(JsonParser::fromJson(*body).object()));
+        });
+    });
+
+    // Follower graph crawl; a directory holding a checkpoint of the same crawl resumes it
+    crawler = new GitHubCrawler(api, this);
+    connect(crawler, &GitHubCrawler::progress, this, [this]{
+        const GitHubCrawler::Stats &st = crawler->stats();
+        statusBar()->showMessage(QString("Crawl: %1 users, %2 expanded, %3 queued, %4 edges, %5 users/s")
+                                 .arg(st.visited).arg(st.expanded).arg(st.queued).arg(st.edges)
+                                 .arg(st.usersPerSecond, 0, 'f', 1));
+    });
+    connect(crawler, &GitHubCrawler::rateLimited, this, [this](const QDateTime &resumeAt){
+        statusBar()->showMessage(QString("Crawl: rate limit reached, waiting until %1")
+                                 .arg(resumeAt.toString("HH:mm:ss")));
+    });
+    connect(crawler, &GitHubCrawler::failed, this, [this](const QString &error){
+        QMessageBox::warning(this,"Error",QString("Crawl[Error] : %1").arg(error));
+    });
+    QMenu *gitHubMenu = ui->menuBar->addMenu("GitHub");
+    QAction *crawl = gitHubMenu->addAction("Crawl Follower Graph...");
+    connect(crawl, &QAction::triggered, this, [this]{
+        const QString seed = QInputDialog::getText(this, "Crawl Follower Graph", "Seed GitHub username",
+                                                   QLineEdit::Normal, ui->usernameLabel->text());
+        if(seed.trimmed().isEmpty())
+            return;
+        bool ok = false;
+        const int hops = QInputDialog::getInt(this, "Crawl Follower Graph", "Hops from the seed", 2, 1, 10, 1, &ok);
+        if(!ok)
+            return;
+        const QString dir = QFileDialog::getExistingDirectory(this, "Crawl Into");
+        if(!dir.isEmpty())
+            crawler->crawl(seed, hops, dir);
+    });
+    QAction *stopCrawl = gitHubMenu->addAction("Stop Crawl");
+    connect(stopCrawl, &QAction::triggered, crawler, &GitHubCrawler::stop);
+
+    // Profile, repositories and avatar of a GitHub user, fetched side by side
+    lookup = new GitHubLookup(api, this);
+    connect(lookup, &GitHubLookup::profileReady, this, &MainWindow::showProfile);
+    connect(lookup, &GitHubLookup::profileReady, this, &MainWindow::firstData);
+    connect(lookup, &GitHubLookup::reposReady, this, &MainWindow::showRepos);
+    connect(lookup, &GitHubLookup::avatarReady, this, &MainWindow::showAvatar);
+    connect(lookup, &GitHubLookup::failed, this, &MainWindow::lookupFailed);
+
+    // Repository lists of watched users, kept current from their events; a watched user's list is shown from there
+    eventSync = new GitHubEventSync(api, this);
+    eventSync->setCacheDirectory(QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("events"));
+    connect(eventSync, &GitHubEventSync::reposChanged, this, [this](const QString &login, const QJsonArray &repos){
+        if(login.compare(ui->usernameLabel->text(), Qt::CaseInsensitive) == 0)
+            showRepos(repos);
+    });
+    connect(eventSync, &GitHubEventSync::failed, this, [](const QString &login, const QString &error){
+        qDebug() << "Error : events of" << login << ":" << error;
+    });
+    QAction *watchUser = gitHubMenu->addAction("Watch User...");
+    connect(watchUser, &QAction::triggered, this, [this]{
+        const QString login = QInputDialog::getText(this, "Watch User", "GitHub username to keep current",
+                                                    QLineEdit::Normal, ui->usernameLabel->text());
+        if(!login.trimmed().isEmpty())
+            eventSync->watch(login);
+    });
+    QAction *unwatchUser = gitHubMenu->addAction("Stop Watching User...");
+    connect(unwatchUser, &QAction::triggered, this, [this]{
+        const QStringList logins = eventSync->watched();
+        if(logins.isEmpty())
+            return;
+        bool ok = false;
+        const QString login = QInputDialog::getItem(this, "Stop Watching User", "GitHub username", logins, 0, false, &ok);
+        if(ok)
+            eventSync->unwatch(login);
+    });
+    QAction *watchedUsers = gitHubMenu->addAction("Watched Users...");
+    connect(watchedUsers, &QAction::triggered, this, [this]{
+        const GitHubEventSync::Stats &st = eventSync->stats();
+        QMessageBox::information(this, "Watched Users",
+                                 QString("%1\n\n%2 polls, %3 not modified, %4 requests, %5 KB, %6 events applied, "
+                                         "%7 resyncs (%8 after missed events)")
+                                 .arg(eventSync->watched().join(", ")).arg(st.polls).arg(st.notModified)
+                                 .arg(st.requests).arg(st.bytes/1024).arg(st.events).arg(st.resyncs).arg(st.gaps));
+    });
+    qDebug() << "watching" << eventSync->restore() << "GitHub users";
+
+    // Memory accounting; IB_MEMORY_BUDGET sets budgets, e.g. "total=256M,json=32M"
+    memory = new MemoryAccounting(this);
+    QString budgetError;
+    if(!memory->setBudgets(qEnvironmentVariable("IB_MEMORY_BUDGET"), &budgetError))
+        qDebug() << "Error : " << budgetError;
+    memory->track("buffers", [this]{
+        qint64 bytes = 0;
+        for(const QByteArray *body : std::as_const(bodies))
+            bytes += body->capacity();
+        return bytes;
+    });
+    memory->track("json", [this]{
+        qint64 bytes = 0;
+        for(qint64 b : std::as_const(retainedJson))
+            bytes += b;
+        return bytes;
+    }, [this]{
+        for(QJsonObject *json : {&deviceJson, &packageJson, &setupJson, &assetJson, &acctJason})
+            *json = QJsonObject();
+        retainedJson.clear();
+    });
+    memory->track("fleet", [this]{
+        return qint64(Device::footprint(poller->snapshot())+Device::publishedFootprint());
+    }, []{Device::reclaim();});
+    memory->track("search", [this]{return qint64(poller->searchIndex().footprint());});
+    memory->track("relations", [this]{return qint64(relations.footprint());});
+    // The decoded avatar can go, the label shows a scaled copy and the state is saved from avatarData
+    memory->track("images", [this]{
+        const QPixmap shown = ui->picLabel->pixmap();
+        return (qint64(img->width())*img->height()*img->depth()+qint64(shown.width())*shown.height()*shown.depth())/8
+                + avatarData.capacity();
+    }, [this]{*img = QPixmap();});
+    memory->track("crawl", [this]{return qint64(crawler->footprint());});
+    if(status){
+        memory->track("status", [this]{return status->footprint();}, [this]{status->releaseCache();});
+        status->setMemory(memory);
+    }
+    connect(memory, &MemoryAccounting::evicted, this, [this](const QString &name, qint64 freed){
+        statusBar()->showMessage(QString("Memory budget: released %1 KB of %2").arg(freed/1024).arg(name));
+    });
+    QAction *memoryUsage = fleetMenu->addAction("Memory Usage...");
+    connect(memoryUsage, &QAction::triggered, this, [this]{
+        QMessageBox::information(this, "Memory Usage", memory->report());
+    });
+    enableButtons(true);
+    StartupTrace::mark("initialized");
+
+    // Refresh what the cached state shows; the connections warmed up above serve it
+    if(!ui->usernameLabel->text().isEmpty())
+        lookUpUser(ui->usernameLabel->text());
+}
+
+void MainWindow::enableButtons(bool on)
+{
+    for(QPushButton *button : {ui->usernameButton, ui->devicesButton, ui->packagesButton, ui->setupsButton,
+                               ui->assetsButton, ui->acctInfoButton})
+        button->setEnabled(on);
 }
 
 void MainWindow::clearValues()
@@ -37,365 +469,343 @@ void MainWindow::clearValues()
     ui->followerBox->setValue(0);
     ui->followingBox->setValue(0);
     ui->typeLabel->clear();
-    dataBuffer.clear();
 }
 
 
 MainWindow::~MainWindow()
 {
+    saveLastState();
     delete ui;
 }
 
-static QByteArray const authHeader()
+static QString lastStatePath()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("laststate.json");
+}
+
+void MainWindow::restoreLastState()
+{
+    QFile file(lastStatePath());
+    if(!file.open(QIODevice::ReadOnly))
+        return;
+    const QJsonObject state = QJsonDocument::fromJson(file.readAll()).object();
+    if(state.value("version").toInt() != LAST_STATE_VERSION)
+        return;
+    showProfile(state.value("profile").toObject());
+    for(const QJsonValue &repo : state.value("repos").toArray())
+        ui->repoList->addItem(repo.toString());
+    ui->repoBox->setValue(ui->repoList->count());
+    const QByteArray avatar = QByteArray::fromBase64(state.value("avatar").toString().toLatin1());
+    if(!avatar.isEmpty())
+        showAvatar(avatar);
+    statusBar()->showMessage(state.value("status").toString());
+}
+
+void MainWindow::saveLastState()
 {
-    QString concatenated = ":";
-    concatenated += API_KEY.c_str();
-    QByteArray data = concatenated.toLocal8Bit().toBase64();
-    QString headerData = "Basic " + data;
-    return headerData.toLocal8Bit();
+    QJsonObject profile{{"login", ui->usernameLabel->text()}, {"name", ui->nameLabel->text()},
+                        {"bio", ui->bioEdit->toPlainText()}, {"followers", ui->followerBox->value()},
+                        {"following", ui->followingBox->value()}, {"type", ui->typeLabel->text()}};
+    QJsonArray repos;
+    for(int i = 0; i < ui->repoList->count(); ++i)
+        repos.append(ui->repoList->item(i)->text());
+    const QJsonObject state{{"version", LAST_STATE_VERSION}, {"profile", profile}, {"repos", repos},
+                            {"avatar", QString::fromLatin1(avatarData.toBase64())},
+                            {"status", statusBar()->currentMessage()}};
+
+    QDir().mkpath(QFileInfo(lastStatePath()).path());
+    QSaveFile file(lastStatePath());
+    if(!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(state).toJson(QJsonDocument::Compact)) < 0
+            || !file.commit())
+        qDebug() << "Error : cannot save" << lastStatePath() << file.errorString();
 }
 
-const QByteArray AUTHHEADERVAL=authHeader();
+void MainWindow::fetch(const QString &path, void (MainWindow::*finished)(QNetworkReply *, QByteArray &))
+{
+    // Every request has its own reply and body, so one still running when another is asked for is not cut short
+    QNetworkReply *reply = api->get(api->infoBeamerRequest(path));
+    auto body = std::make_shared<QByteArray>();
+    bodies.insert(body.get());
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply, body]{api->read(reply, *body);});
+    connect(reply, &QNetworkReply::finished, this, [this, reply, body, finished]{
+        reply->deleteLater();
+        bodies.remove(body.get());
+        (this->*finished)(reply, *body);
+    });
+}
 
-void addBasicAuth(QNetworkRequest &req)
+void MainWindow::fetchSetupConfigs(const RelationIndex::Ids &setups)
 {
-    req.setRawHeader("Authorization", AUTHHEADERVAL);
+    setupFetch->fitTo(QUrl(ApiClient::infoBeamerBase()));
+    for(int id : setups)
+        setupFetch->enqueue(api->infoBeamerRequest(QString("setup/%1").arg(id)), [this](const QByteArray &body){
+            relations.setSetup(JsonParser::fromJson(body).object());
+        });
 }
 
+void MainWindow::firstData()
+{
+    if(StartupTrace::mark("first data"))
+        qInfo() << StartupTrace::report();
+}
 
 void MainWindow::on_usernameButton_clicked()
 {
     auto username = QInputDialog::getText(this,"Github Username","Enter your GitHub Username");
     if(!username.isEmpty()){
         clearValues();
-        QNetworkRequest req{QUrl(QString("https://api.github.com/users/%1").arg(username))};
-        QNetworkRequest repoReq{QUrl(QString("https://api.github.com/users/%1/repos").arg(username))};
-        netReply = netManager->get(req);
-        connect(netReply,&QNetworkReply::readyRead,this,&MainWindow::readData);
-        connect(netReply,&QNetworkReply::finished,this,&MainWindow::finishReading);
-        repoReply = netManager->get(repoReq);
-        connect(repoReply,&QNetworkReply::readyRead,this,&MainWindow::readDataForRepo);
-        connect(repoReply,&QNetworkReply::finished,this,&MainWindow::finishedGettingRepos);
+        lookUpUser(username);
     }
 }
 
-void MainWindow::readData()
+void MainWindow::lookUpUser(const QString &login)
 {
-    dataBuffer.append(netReply->readAll());
+    // A watched user's repositories are current already; only profile and avatar are fetched
+    const bool watched = eventSync->synced(login);
+    lookup->lookup(login, !watched);
+    if(watched)
+        showRepos(eventSync->repos(login));
 }
 
-void MainWindow::readDataForRepo()
+void MainWindow::showProfile(const QJsonObject &userJsonInfo)
 {
-    dataBuffer.append(repoReply->readAll());
+    //SET USERNAME
+    QString login = userJsonInfo.value("login").toString();
+    ui->usernameLabel->setText(login);
+
+    // SET DISPLAY NAME
+    QString name = userJsonInfo.value("name").toString();
+    ui->nameLabel->setText(name);
+
+    //SET BIO
+    auto bio = userJsonInfo.value("bio").toString();
+    ui->bioEdit->setText(bio);
+
+    //SET FOLLOWER AND FOLLOWING COUNT
+    auto follower = userJsonInfo.value("followers").toInt();
+    auto following = userJsonInfo.value("following").toInt();
+    ui->followerBox->setValue(follower);
+    ui->followingBox->setValue(following);
+
+    //SET ACCOUNT TYPE
+    QString type = userJsonInfo.value("type").toString();
+    ui->typeLabel->setText(type);
 }
 
-void MainWindow::finishedGettingRepos()
+void MainWindow::showRepos(const QJsonArray &repoInfo)
 {
-    if(repoReply->error() != QNetworkReply::NoError){
-        qDebug() << "Error Getting List of Repo: " << netReply->errorString();
-        QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(netReply->errorString()));
-    }else{
-        QJsonArray repoInfo = QJsonDocument::fromJson(dataBuffer).array();
-        ui->repoBox->setValue(repoInfo.size());
-        for(int i{0}; i < ui->repoBox->value(); ++i){
-            auto repo = repoInfo.at(i).toObject();
-            //            if(repo.value("name") == QJsonValue::Undefined){
-            //                qDebug() << "No Repo associated with Account!";
-            //                QMessageBox::information(this,"No Repo","No Repository associated with current account!");
-            //                return;
-            //            }
-            QString repoName = repo.value("name").toString();
-            ui->repoList->addItem(repoName);
-        }
+    ui->repoList->clear();
+    ui->repoBox->setValue(repoInfo.size());
+    int stars = 0;
+    QHash<QString, int> languages;
+    for(const QJsonValue &value : repoInfo){
+        const QJsonObject repo = value.toObject();
+        ui->repoList->addItem(repo.value("name").toString());
+        stars += repo.value("stargazers_count").toInt();
+        const QString language = repo.value("language").toString();
+        if(!language.isEmpty())
+            languages[language]++;
     }
+    QList<QPair<int, QString>> ranked;
+    for(auto l = languages.constBegin(); l != languages.constEnd(); ++l)
+        ranked.append({l.value(), l.key()});
+    std::sort(ranked.begin(), ranked.end(), [](const QPair<int, QString> &a, const QPair<int, QString> &b){
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    });
+    QStringList top;
+    for(int i = 0; i < ranked.size() && i < 3; i++)
+        top << QString("%1 (%2)").arg(ranked[i].second).arg(ranked[i].first);
+    statusBar()->showMessage(QString("%1 repositories, %2 stars%3").arg(repoInfo.size()).arg(stars)
+                             .arg(top.isEmpty() ? QString() : ", mostly "+top.join(", ")));
 }
 
-void MainWindow::finishReading()
+void MainWindow::showAvatar(const QByteArray &imageData)
 {
-    if(netReply->error() != QNetworkReply::NoError){
-        qDebug() << "Error : " << netReply->errorString();
-        QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(netReply->errorString()));
-    }else{
-
-        //CONVERT THE DATA FROM A JSON DOC TO A JSON OBJECT
-        QJsonObject userJsonInfo = QJsonDocument::fromJson(dataBuffer).object();
-
-        //SET USERNAME
-        QString login = userJsonInfo.value("login").toString();
-        ui->usernameLabel->setText(login);
-
-        // SET DISPLAY NAME
-        QString name = userJsonInfo.value("name").toString();
-        ui->nameLabel->setText(name);
-
-        //SET BIO
-        auto bio = userJsonInfo.value("bio").toString();
-        ui->bioEdit->setText(bio);
-
-        //SET FOLLOWER AND FOLLOWING COUNT
-        auto follower = userJsonInfo.value("followers").toInt();
-        auto following = userJsonInfo.value("following").toInt();
-        ui->followerBox->setValue(follower);
-        ui->followingBox->setValue(following);
-
-        //SET ACCOUNT TYPE
-        QString type = userJsonInfo.value("type").toString();
-        ui->typeLabel->setText(type);
-
-        //SET PICTURE
-        auto picLink = userJsonInfo.value("avatar_url").toString();
-        QNetworkRequest link{QUrl(picLink)};
-        netReply = netManager->get(link);
-        connect(netReply,&QNetworkReply::finished,this,&MainWindow::setUserImage);
-        dataBuffer.clear();
-    }
+    avatarData = imageData;
+    img->loadFromData(imageData);
+    QPixmap temp = img->scaled(ui->picLabel->size());
+    ui->picLabel->setPixmap(temp);
 }
 
-static void printJsonValue(const QJsonValue &value, QString path);
-static void printJsonArray(const QJsonArray &array, QString prevPath);
-static void printJsonObject(const QJsonObject &obj, QString prevPath="")
+void MainWindow::lookupFailed(const QString &error)
 {
-    for (const auto &k: obj.keys())
-    {
-        QString path(prevPath);
-        if(path.size()>0)
-            path+='.';
-        path+=k;
-        const QJsonValue &value=obj[k];
-        switch (value.type())
-        {
-        //Leaf nodes
-        case QJsonValue::Null:
-        case QJsonValue::Bool:
-        case QJsonValue::Double:
-        case QJsonValue::String:
-        case QJsonValue::Undefined:
-        default:
-            printJsonValue(value, path);
-            break;
-
-        case QJsonValue::Array:
-            printJsonArray(value.toArray(), path);
-            break;
-
-        case QJsonValue::Object:
-            printJsonObject(value.toObject(), path);
-            break;
-        }
-    }
-}
-
-//Process leaf nodes
-static void printJsonValue(const QJsonValue &value, QString path)
-{
-    std::cerr << path.toStdString() << "=";
-    switch (value.type())
-    {
-    //Leaf nodes
-    case QJsonValue::Null:
-        std::cerr << "Null";
-        break;
-    case QJsonValue::Bool:
-        std::cerr << "Bool(" << (value.toBool() ? "true)" : "false)") << ")";
-        break;
-    case QJsonValue::Type::Double:
-        std::cerr << "Double(" << value.toDouble()<< ")";
-        break;
-    case QJsonValue::Type::String:
-        std::cerr << "String(\"" << value.toString().toStdString() << "\")";
-        break;
-    case QJsonValue::Type::Undefined:
-        std::cerr << "Undefined";
-        break;
-
-    case QJsonValue::Type::Array:
-    case QJsonValue::Type::Object:
-        std::cerr << "Program Error!!!!  " << __func__ << " called with aggregate QJsonValue";
-
-    default:
-        std::cerr << "Bad Value!!!! Not a QJsonValue enumerated type";
-        printJsonArray(value.toArray(), path);
-        break;
-    }
-
-    std::cerr << std::endl;
+    qDebug() << "Error : " << error;
+    QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(error));
 }
 
-static void printJsonArray(const QJsonArray &array, QString prevPath)
+/*!
+ * \brief printJsonObject
+ * Dumps every leaf of \a obj to stderr, one "path#record=Type(value)" line each.  List responses wrap their records
+ * in one top level array ({"devices": [...]}); its elements are numbered as records.  With \a columns (full paths,
+ * see FlatSchema) a list is printed as one line per record instead, holding those columns only.
+ */
+static void printJsonObject(const QJsonObject &obj, const QStringList &columns = QStringList())
 {
-    for(int i=0; i<array.size(); i++)
-    {
-        QString path(prevPath);
-        path+="[";
-        path+=std::to_string(i).c_str();
-        path+="]";
-        const QJsonValue &value(array[i]);
-        switch (value.type())
-        {
-        case QJsonValue::Object:
-            printJsonObject(value.toObject(), path);
-            break;
-        case QJsonValue::Array:
-            printJsonArray(value.toArray(), path);
-            break;
-        default:
-            printJsonValue(value, path);
-        }
+    JsonFlattener flattener;
+    QString recordPath;
+    if(obj.size()==1 && obj.constBegin().value().isArray()){
+        recordPath = obj.constBegin().key()+"[]";
+        flattener.setRecordPath(recordPath);
     }
+    FlatTable table;
+    flattener.flatten(obj, table);
+    OutBuffer out(OutBuffer::fileSink(stderr));
+    if(!recordPath.isEmpty() && !columns.isEmpty())
+        flattener.dump(FlatSchema(flattener.paths(), recordPath, columns), table, out);
+    else
+        flattener.dump(table, out);
 }
 
-void MainWindow::finishReadingDevices()
+void MainWindow::finishReadingPackages(QNetworkReply *reply, QByteArray &body)
 {
-    if(netReply->error() != QNetworkReply::NoError){
-        qDebug() << "Error : " << netReply->errorString();
-        QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(netReply->errorString()));
+    if(reply->error() != QNetworkReply::NoError || !api->read(reply, body)){
+        qDebug() << "Error : " << api->errorString(reply);
+        QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(api->errorString(reply)));
     }else{
 
         //CONVERT THE DATA FROM A JSON DOC TO A JSON OBJECT
-        deviceJson = QJsonDocument::fromJson(dataBuffer).object();
+        retain(packageJson, JsonParser::fromJson(body).object(), body.size());
+        firstData();
         qDebug() << __func__;
-        qDebug() << deviceJson;
-        printJsonObject(deviceJson);
-        try
-        {
-            Device::poplulate(deviceJson);
-        }
-        catch (const DeviceException &e)
-        {
-            qDebug() << __func__
-                     << __FILE_NAME__
-                     << (QString("line ")+std::to_string(__LINE__).c_str())+": "
-                     << "Device::populate failed:"
-                     << e.what();
-        }
+        qDebug() << packageJson;
+        printJsonObject(packageJson);
+        relations.setPackages(packageJson);
     }
 }
 
-void MainWindow::finishReadingPackages()
+void MainWindow::finishReadingSetups(QNetworkReply *reply, QByteArray &body)
 {
-    if(netReply->error() != QNetworkReply::NoError){
-        qDebug() << "Error : " << netReply->errorString();
-        QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(netReply->errorString()));
+    if(reply->error() != QNetworkReply::NoError || !api->read(reply, body)){
+        qDebug() << "Error : " << api->errorString(reply);
+        QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(api->errorString(reply)));
     }else{
 
         //CONVERT THE DATA FROM A JSON DOC TO A JSON OBJECT
-        deviceJson = QJsonDocument::fromJson(dataBuffer).object();
+        retain(setupJson, JsonParser::fromJson(body).object(), body.size());
+        firstData();
         qDebug() << __func__;
-        qDebug() << deviceJson;
-        printJsonObject(deviceJson);
+        qDebug() << setupJson;
+        printJsonObject(setupJson);
+        fetchSetupConfigs(relations.setSetups(setupJson));
     }
 }
 
-void MainWindow::finishReadingSetups()
+void MainWindow::finishReadingAssets(QNetworkReply *reply, QByteArray &body)
 {
-    if(netReply->error() != QNetworkReply::NoError){
-        qDebug() << "Error : " << netReply->errorString();
-        QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(netReply->errorString()));
+    if(reply->error() != QNetworkReply::NoError || !api->read(reply, body)){
+        qDebug() << "Error : " << api->errorString(reply);
+        QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(api->errorString(reply)));
     }else{
 
         //CONVERT THE DATA FROM A JSON DOC TO A JSON OBJECT
-        deviceJson = QJsonDocument::fromJson(dataBuffer).object();
+        retain(assetJson, JsonParser::fromJson(body).object(), body.size());
+        firstData();
         qDebug() << __func__;
-        qDebug() << deviceJson;
-        printJsonObject(deviceJson);
+        qDebug() << assetJson;
+        printJsonObject(assetJson);
+        relations.setAssets(assetJson);
     }
 }
 
-void MainWindow::finishReadingAssets()
+void MainWindow::finishReadingAccount(QNetworkReply *reply, QByteArray &body)
 {
-    if(netReply->error() != QNetworkReply::NoError){
-        qDebug() << "Error : " << netReply->errorString();
-        QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(netReply->errorString()));
+    if(reply->error() != QNetworkReply::NoError || !api->read(reply, body)){
+        qDebug() << "Error : " << api->errorString(reply);
+        QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(api->errorString(reply)));
     }else{
 
         //CONVERT THE DATA FROM A JSON DOC TO A JSON OBJECT
-        deviceJson = QJsonDocument::fromJson(dataBuffer).object();
+        retain(acctJason, JsonParser::fromJson(body).object(), body.size());
+        firstData();
         qDebug() << __func__;
-        qDebug() << deviceJson;
-        printJsonObject(deviceJson);
+        qDebug() << acctJason;
+        printJsonObject(acctJason);
     }
 }
 
-void MainWindow::finishReadingAccount()
+void MainWindow::on_actionAbout_Qt_triggered()
 {
-    if(netReply->error() != QNetworkReply::NoError){
-        qDebug() << "Error : " << netReply->errorString();
-        QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(netReply->errorString()));
-    }else{
+    QMessageBox::aboutQt(this,"About Qt");
+}
 
-        //CONVERT THE DATA FROM A JSON DOC TO A JSON OBJECT
-        deviceJson = QJsonDocument::fromJson(dataBuffer).object();
-        qDebug() << __func__;
-        qDebug() << deviceJson;
-        printJsonObject(deviceJson);
-    }
+
+void MainWindow::on_devicesButton_clicked()
+{
+    // Goes through the poller so a click never overlaps a background refresh.
+    // Detail fetches for the list on screen are stale once a new list is asked for.
+    details->cancel();
+    dumpNextRefresh = true;
+    poller->pollNow();
 }
 
-void MainWindow::setUserImage()
+void MainWindow::fleetRefreshed(const QJsonObject &json, const QByteArray &payload)
 {
-    qDebug() << "Pixmap stuff starts";
-    img->loadFromData(netReply->readAll());
-    QPixmap temp = img->scaled(ui->picLabel->size());
-    ui->picLabel->setPixmap(temp);
-    qDebug() << "Pixmap end";
+    firstData();
+    retain(deviceJson, json, payload.size());
+    if(!dumpNextRefresh)
+        return;
+    dumpNextRefresh = false;
+
+    qDebug() << __func__;
+    qDebug() << deviceJson;
+    printJsonObject(deviceJson, FlatSchema::deviceColumns());
+    // The poller has decoded and published this refresh already
+    const Device::Fleet::ReadGuard fleet = Device::snapshot();
+    DeviceExporter::exportAll(*fleet, DeviceExporter::Format::Text, stderr);
 }
 
-void MainWindow::on_actionAbout_Qt_triggered()
+void MainWindow::fleetChanged(const FleetDiff &diff)
 {
-    QMessageBox::aboutQt(this,"About Qt");
+    relations.apply(diff);
+    FleetAggregates &agg = poller->aggregates();
+    statusBar()->showMessage(QString("Fleet: %1 devices, %2 online, %3 need maintenance, %4 upgrade blocked, "
+                                     "%5 restarted in the last hour; %6 changed (%7 on/offline), next refresh in %8s")
+                             .arg(agg.devices())
+                             .arg(agg.online())
+                             .arg(agg.maintenance())
+                             .arg(agg.upgradeBlocked())
+                             .arg(agg.restarts(time(nullptr)))
+                             .arg(diff.size())
+                             .arg(diff.onlineFlips())
+                             .arg(poller->interval()/1000));
 }
 
+void MainWindow::fleetPollFailed(const QString &error)
+{
+    qDebug() << "Error : " << error;
+    statusBar()->showMessage(QString("Fleet refresh failed: %1").arg(error));
+    if(dumpNextRefresh){
+        dumpNextRefresh = false;
+        QMessageBox::warning(this,"Error",QString("Request[Error] : %1").arg(error));
+    }
+}
 
-void MainWindow::on_devicesButton_clicked()
+void MainWindow::retain(QJsonObject &slot, const QJsonObject &json, qint64 bytes)
 {
-    QNetworkRequest req{QUrl(API_URL+"device/list")};
-    addBasicAuth(req);
-    dataBuffer.clear();
-    netReply = netManager->get(req);
-    connect(netReply,&QNetworkReply::readyRead,this,&MainWindow::readData);
-    connect(netReply,&QNetworkReply::finished,this,&MainWindow::finishReadingDevices);
+    slot = json;
+    retainedJson.insert(&slot, json.isEmpty() ? 0 : bytes);
 }
 
 void MainWindow::on_packagesButton_clicked()
 {
-    QNetworkRequest req{QUrl(API_URL+"package/list")};
-    addBasicAuth(req);
-    dataBuffer.clear();
-    netReply = netManager->get(req);
-    connect(netReply,&QNetworkReply::readyRead,this,&MainWindow::readData);
-    connect(netReply,&QNetworkReply::finished,this,&MainWindow::finishReadingDevices);
+    fetch("package/list", &MainWindow::finishReadingPackages);
 }
 
 
 
 void MainWindow::on_setupsButton_clicked()
 {
-    QNetworkRequest req{QUrl(API_URL+"setup/list")};
-    addBasicAuth(req);
-    dataBuffer.clear();
-    netReply = netManager->get(req);
-    connect(netReply,&QNetworkReply::readyRead,this,&MainWindow::readData);
-    connect(netReply,&QNetworkReply::finished,this,&MainWindow::finishReadingDevices);
+    fetch("setup/list", &MainWindow::finishReadingSetups);
 }
 
 
 void MainWindow::on_assetsButton_clicked()
 {
-    QNetworkRequest req{QUrl(API_URL+"asset/list")};
-    addBasicAuth(req);
-    dataBuffer.clear();
-    netReply = netManager->get(req);
-    connect(netReply,&QNetworkReply::readyRead,this,&MainWindow::readData);
-    connect(netReply,&QNetworkReply::finished,this,&MainWindow::finishReadingDevices);
+    fetch("asset/list", &MainWindow::finishReadingAssets);
 }
 
 
 void MainWindow::on_acctInfoButton_clicked()
 {
-    QNetworkRequest req{QUrl(API_URL+"account")};
-    addBasicAuth(req);
-    dataBuffer.clear();
-    netReply = netManager->get(req);
-    connect(netReply,&QNetworkReply::readyRead,this,&MainWindow::readData);
-    connect(netReply,&QNetworkReply::finished,this,&MainWindow::finishReadingDevices);
+    fetch("account", &MainWindow::finishReadingAccount);
 }
@@ -7,11 +7,26 @@
 #include <QNetworkReply>
 #include <QByteArray>
 #include <QPixmap>
+#include <QSet>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonValue>
 #include <QJsonArray>
 
+#include "apiclient.hpp"
+#include "assetsync.hpp"
+#include "bulkoperation.hpp"
+#include "devicedetails.hpp"
+#include "fanout.hpp"
+#include "fleetpoller.hpp"
+#include "fleetstore.hpp"
+#include "githubcrawler.hpp"
+#include "githubeventsync.hpp"
+#include "githublookup.hpp"
+#include "memoryaccounting.hpp"
+#include "relationindex.hpp"
+#include "statusserver.hpp"
+
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
@@ -25,19 +40,21 @@ public:
     void clearValues();
     ~MainWindow();
 
+protected:
+    bool event(QEvent *e) override;
+
 private slots:
+    //! Everything the first paint does not need: network, polling, menus, accounting; runs once, after that paint
+    void initialize();
     void on_usernameButton_clicked();
-    void readData();
-    void readDataForRepo();
-    void finishedGettingRepos();
-    void finishReading();
-    void finishReadingDevices();
-    void finishReadingPackages();
-    void finishReadingSetups();
-    void finishReadingAssets();
-    void finishReadingAccount();
-    void setUserImage();
+    void showProfile(const QJsonObject &userJsonInfo);
+    void showRepos(const QJsonArray &repoInfo);
+    void showAvatar(const QByteArray &imageData);
+    void lookupFailed(const QString &error);
     void on_actionAbout_Qt_triggered();
+    void fleetRefreshed(const QJsonObject &json, const QByteArray &payload);
+    void fleetChanged(const InfoBeamer::FleetDiff &diff);
+    void fleetPollFailed(const QString &error);
 
 
     void on_devicesButton_clicked();
@@ -50,11 +67,50 @@ private slots:
     void on_acctInfoButton_clicked();
 
 private:
+    //! Stores \a json in \a slot and accounts it at the \a bytes it was parsed from
+    void retain(QJsonObject &slot, const QJsonObject &json, qint64 bytes);
+    //! The GitHub user shown when the window was last closed, so the first paint has something to show
+    void restoreLastState();
+    void saveLastState();
+    //! Looks up \a login; the repositories of a watched user come from eventSync
+    void lookUpUser(const QString &login);
+    //! GETs \a path from the info-beamer API and hands the reply and its body to \a finished
+    void fetch(const QString &path, void (MainWindow::*finished)(QNetworkReply *, QByteArray &));
+    void finishReadingPackages(QNetworkReply *reply, QByteArray &body);
+    void finishReadingSetups(QNetworkReply *reply, QByteArray &body);
+    void finishReadingAssets(QNetworkReply *reply, QByteArray &body);
+    void finishReadingAccount(QNetworkReply *reply, QByteArray &body);
+    //! Fetches setup/{id} of \a setups for the asset references in their config
+    void fetchSetupConfigs(const InfoBeamer::RelationIndex::Ids &setups);
+    //! Marks the first response on screen in the StartupTrace
+    void firstData();
+    //! The buttons that need initialize() to have run
+    void enableButtons(bool on);
+
+    static const int LAST_STATE_VERSION = 1;
+    //! initialize() runs after this long even if the window was never painted
+    static const int INIT_FALLBACK_MS = 1000;
+
     Ui::MainWindow *ui;
-    QNetworkAccessManager *netManager;
-    QNetworkReply *netReply;
-    QNetworkReply *repoReply;
-    QByteArray dataBuffer;
+    InfoBeamer::ApiClient *api = nullptr;
+    InfoBeamer::FleetPoller *poller = nullptr;
+    InfoBeamer::StatusServer *status = nullptr;  //! Only with IB_STATUS_PORT set
+    InfoBeamer::FleetStore *store = nullptr;     //! Fleets of the accounts in Account::configPath()
+    InfoBeamer::DeviceDetails *details = nullptr;
+    InfoBeamer::AssetSync *assetSync = nullptr;
+    InfoBeamer::BulkOperation *bulk = nullptr;
+    InfoBeamer::GitHubCrawler *crawler = nullptr;
+    InfoBeamer::GitHubLookup *lookup = nullptr;
+    InfoBeamer::GitHubEventSync *eventSync = nullptr;  //! Repositories of watched users
+    InfoBeamer::MemoryAccounting *memory = nullptr;
+    InfoBeamer::FanOut *setupFetch = nullptr;    //! setup/{id} for fetchSetupConfigs()
+    InfoBeamer::RelationIndex relations;         //! Devices, setups, packages and assets linked up
+    bool initialized = false;       //! initialize() has run; the buttons stay disabled until then
+    bool painted = false;           //! The first paint has been traced
+    bool dumpNextRefresh=false;     //! The next fleet refresh was asked for with the Devices button
+    QSet<const QByteArray *> bodies;   //! Of the fetch() requests in flight
     QPixmap *img;
+    QByteArray avatarData;  //! As downloaded, for saveLastState() once img has been evicted
     QJsonObject deviceJson, packageJson, setupJson, assetJson, acctJason;
+    QHash<const QJsonObject *, qint64> retainedJson;  //! Payload bytes the objects above were parsed from
 };
@@ -0,0 +1,183 @@
+#include "memoryaccounting.hpp"
+
+#include <QDebug>
+#include <QFile>
+#include <QStringList>
+
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+namespace InfoBeamer {
+
+static QString megabytes(qint64 bytes)
+{
+    return QString::number(double(bytes)/(1024.0*1024.0), 'f', 1)+" MB";
+}
+
+MemoryAccounting::MemoryAccounting(QObject *parent)
+    : QObject(parent)
+{
+    _timer.setInterval(CHECK_INTERVAL_MS);
+    connect(&_timer, &QTimer::timeout, this, &MemoryAccounting::enforce);
+    _timer.start();
+}
+
+void MemoryAccounting::track(const QString &name, Probe probe, Evictor evict)
+{
+    _subsystems.push_back({name, std::move(probe), std::move(evict)});
+}
+
+void MemoryAccounting::setBudget(const QString &name, qint64 bytes)
+{
+    if(bytes>0)
+        _budgets.insert(name, bytes);
+    else
+        _budgets.remove(name);
+}
+
+qint64 MemoryAccounting::parseSize(const QString &size)
+{
+    QString s=size.trimmed().toUpper();
+    qint64 unit=1;
+    if(s.endsWith('K'))
+        unit=1024;
+    else if(s.endsWith('M'))
+        unit=1024*1024;
+    else if(s.endsWith('G'))
+        unit=qint64(1024)*1024*1024;
+    if(unit>1)
+        s.chop(1);
+    bool ok=false;
+    const qint64 n=s.toLongLong(&ok);
+    return ok && n>=0 ? n*unit : -1;
+}
+
+bool MemoryAccounting::setBudgets(const QString &spec, QString *error)
+{
+    QHash<QString, qint64> budgets;
+    for(const QString &entry: spec.split(',', Qt::SkipEmptyParts))
+    {
+        const qsizetype eq=entry.indexOf('=');
+        const QString name=entry.left(eq).trimmed();
+        const qint64 bytes=eq>0 ? parseSize(entry.mid(eq+1)) : -1;
+        if(name.isEmpty() || bytes<0)
+        {
+            if(error)
+                *error=QString("bad memory budget \"%1\"").arg(entry.trimmed());
+            return false;
+        }
+        budgets.insert(name, bytes);
+    }
+    for(auto b=budgets.constBegin(); b!=budgets.constEnd(); ++b)
+    {
+        if(b.key()=="total")
+            setTotalBudget(b.value());
+        else
+            setBudget(b.key(), b.value());
+    }
+    return true;
+}
+
+QList<MemoryAccounting::Usage> MemoryAccounting::usage() const
+{
+    QList<Usage> out;
+    for(const Subsystem &s: _subsystems)
+        out.append({s.name, s.probe(), _budgets.value(s.name, 0), bool(s.evict), s.evictions, s.freed});
+    return out;
+}
+
+qint64 MemoryAccounting::residentBytes()
+{
+#ifdef Q_OS_LINUX
+    // statm: size resident shared ..., in pages
+    QFile statm("/proc/self/statm");
+    if(!statm.open(QIODevice::ReadOnly))
+        return -1;
+    const QList<QByteArray> fields=statm.readAll().split(' ');
+    bool ok=false;
+    const qint64 pages=fields.value(1).toLongLong(&ok);
+    return ok ? pages*sysconf(_SC_PAGESIZE) : -1;
+#else
+    return -1;
+#endif
+}
+
+QString MemoryAccounting::report() const
+{
+    QStringList lines;
+    qint64 total=0;
+    for(const Usage &u: usage())
+    {
+        total+=u.bytes;
+        QString line=QString("%1: %2").arg(u.name, megabytes(u.bytes));
+        if(u.budget>0)
+            line+=QString(" of %1").arg(megabytes(u.budget));
+        if(u.evictions>0)
+            line+=QString(", %1 evictions freed %2").arg(u.evictions).arg(megabytes(u.freed));
+        lines << line;
+    }
+    QString sum=QString("tracked: %1").arg(megabytes(total));
+    if(_totalBudget>0)
+        sum+=QString(" of %1").arg(megabytes(_totalBudget));
+    lines << sum;
+    const qint64 rss=residentBytes();
+    if(rss>=0)
+        lines << QString("resident: %1").arg(megabytes(rss));
+    return lines.join('\n');
+}
+
+qint64 MemoryAccounting::evict(Subsystem &s)
+{
+    const qint64 before=s.probe();
+    s.evict();
+    const qint64 freed=qMax<qint64>(0, before-s.probe());
+    s.evictions++;
+    s.freed+=freed;
+    qDebug() << __func__ << s.name << "released" << freed << "of" << before << "bytes";
+    emit evicted(s.name, freed);
+    return freed;
+}
+
+void MemoryAccounting::enforce()
+{
+    std::vector<qint64> bytes(_subsystems.size());
+    qint64 total=0;
+    for(size_t i=0; i<_subsystems.size(); i++)
+    {
+        Subsystem &s=_subsystems[i];
+        bytes[i]=s.probe();
+        const qint64 budget=_budgets.value(s.name, 0);
+        if(budget>0 && bytes[i]>budget && s.evict)
+            bytes[i]-=evict(s);
+        total+=bytes[i];
+    }
+    if(_totalBudget<=0 || total<=_totalBudget)
+    {
+        if(_over)
+            qDebug() << __func__ << "tracked memory" << total << "is within the budget again";
+        _over=false;
+        return;
+    }
+
+    // Largest first, so as few subsystems as possible lose their caches
+    std::vector<size_t> order(_subsystems.size());
+    for(size_t i=0; i<order.size(); i++)
+        order[i]=i;
+    std::sort(order.begin(), order.end(), [&bytes](size_t a, size_t b){return bytes[a]>bytes[b];});
+    for(size_t i: order)
+    {
+        if(total<=_totalBudget)
+            break;
+        if(_subsystems[i].evict && bytes[i]>0)
+            total-=evict(_subsystems[i]);
+    }
+    // Logged once, not on every check while it lasts
+    if(total>_totalBudget && !_over)
+        qDebug() << __func__ << "tracked memory" << total << "stays over the budget of" << _totalBudget << "bytes";
+    _over=total>_totalBudget;
+}
+
+}
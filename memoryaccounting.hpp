@@ -0,0 +1,98 @@
+#ifndef MEMORYACCOUNTING_HPP
+#define MEMORYACCOUNTING_HPP
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QTimer>
+
+#include <functional>
+#include <vector>
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The MemoryAccounting class
+ * Per-subsystem memory accounting with budgets.  Subsystems register a probe that reports the bytes they hold and,
+ * if they have anything they can rebuild or do without (caches, retained documents, idle buffers), an evictor that
+ * lets go of it.  Qt containers cannot be given a counting allocator, so the probes estimate from sizes and
+ * capacities; they are meant to show which subsystem grows, not to add up to the resident set size, which is reported
+ * next to them for comparison.
+ *
+ * enforce() runs every CHECK_INTERVAL_MS.  A subsystem over its own budget is evicted; if the tracked total is over
+ * the total budget, evictable subsystems are evicted largest first until it is not.
+ */
+class MemoryAccounting : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<qint64()> Probe;
+    typedef std::function<void()> Evictor;
+
+    struct Usage
+    {
+        QString name;
+        qint64  bytes=0;
+        qint64  budget=0;       //! 0 for none
+        bool    evictable=false;
+        quint64 evictions=0;
+        qint64  freed=0;        //! Bytes released by evictions so far
+    };
+
+    static const int CHECK_INTERVAL_MS=10*1000;
+
+    explicit MemoryAccounting(QObject *parent=nullptr);
+
+    //! Accounts \a name with \a probe; \a evict, if given, drops what the subsystem can rebuild or do without
+    void track(const QString &name, Probe probe, Evictor evict=Evictor());
+
+    //! 0 removes the budget; \a name need not be tracked yet
+    void setBudget(const QString &name, qint64 bytes);
+    void setTotalBudget(qint64 bytes) {_totalBudget=qMax<qint64>(0, bytes);}
+    qint64 totalBudget() const {return _totalBudget;}
+
+    /*!
+     * \brief setBudgets
+     * Sets budgets from "name=size,..." (IB_MEMORY_BUDGET), sizes in bytes or with a K, M or G suffix; "total" sets
+     * the total budget.  Nothing is changed if \a spec does not parse.
+     */
+    bool setBudgets(const QString &spec, QString *error=nullptr);
+    //! "64M" -> 67108864; -1 if \a size does not parse
+    static qint64 parseSize(const QString &size);
+
+    //! Probes every subsystem, in registration order
+    QList<Usage> usage() const;
+    //! Resident set size of the process, -1 where it cannot be read
+    static qint64 residentBytes();
+    //! One line per subsystem, for the UI and the log
+    QString report() const;
+
+public slots:
+    void enforce();
+
+signals:
+    void evicted(const QString &name, qint64 freed);
+
+private:
+    struct Subsystem
+    {
+        QString name;
+        Probe   probe;
+        Evictor evict;
+        quint64 evictions=0;
+        qint64  freed=0;
+    };
+
+    qint64 evict(Subsystem &s);
+
+    std::vector<Subsystem>  _subsystems;
+    QHash<QString, qint64>  _budgets;       //! May name subsystems not tracked yet
+    qint64                  _totalBudget=0;
+    bool                    _over=false;    //! The last enforce() left the total over its budget
+    QTimer                  _timer;
+};
+
+}
+
+#endif // MEMORYACCOUNTING_HPP
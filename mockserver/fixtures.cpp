@@ -0,0 +1,443 @@
+#include "fixtures.hpp"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QHash>
+#include <QJsonDocument>
+
+#include <algorithm>
+
+namespace InfoBeamer {
+namespace Mock {
+
+//! Fixed clock so the bodies do not depend on when the server was started
+static const qint64 EPOCH=1700000000;
+static const int FIRST_DEVICE_ID=1000;
+static const qint64 FIRST_GITHUB_ID=20000000;
+static const qint64 FIRST_EVENT_ID=30000000000;
+//! Mean number of users each user follows
+static const int MEAN_FOLLOWING=20;
+
+static const char *const CHANNELS[]={"stable", "testing", "bleeding"};
+static const char *const MODELS[]={"Raspberry Pi 4 Model B", "Raspberry Pi 3 Model B+", "Raspberry Pi Zero 2 W",
+                                   "Compute Module 4"};
+static const char *const PLATFORMS[]={"pi4", "pi3", "pi3", "pi4"};
+static const int MEMORY[]={4096, 1024, 512, 2048};
+static const char *const STATUSES[]={"Running", "Running", "Running", "Downloading", "Booting", "Offline"};
+static const char *const CITIES[]={"Berlin", "Hamburg", "Munich", "Vienna", "Zurich", "Amsterdam", "London", "Paris"};
+static const char *const LANGUAGES[]={"C++", "C", "Python", "Lua", "Go", "Rust", "JavaScript", "Shell"};
+
+template<class T, size_t N>
+static constexpr size_t count(T (&)[N]) {return N;}
+
+static QByteArray compact(const QJsonObject &o)
+{
+    return QJsonDocument(o).toJson(QJsonDocument::Compact);
+}
+
+Fixtures::Fixtures(const Counts &counts, quint32 seed)
+    : _counts(counts)
+    , _rng(seed)
+{
+    _devices.reserve(size_t(counts.devices));
+    for(int i=0; i<counts.devices; i++)
+        _devices.push_back(makeDevice(i));
+
+    QJsonArray packages;
+    for(int i=0; i<counts.packages; i++)
+    {
+        packages.append(QJsonObject{
+            {"id", 500+i},
+            {"name", QString("Package %1").arg(i)},
+            {"description", QString("Synthetic package number %1").arg(i)},
+            {"source", QString("https://github.com/example/package-%1").arg(i)},
+            {"package_type", i%4==0 ? "service" : "module"},
+            {"created", EPOCH-86400*(i+1)},
+            {"updated", EPOCH-3600*i}});
+    }
+    _packageList=compact({{"packages", packages}});
+
+    QJsonArray setups;
+    for(int i=0; i<counts.setups; i++)
+    {
+        const int package=counts.packages ? 500+i%counts.packages : 0;
+        setups.append(QJsonObject{
+            {"id", 200+i},
+            {"name", QString("Setup %1").arg(i)},
+            {"package", QJsonObject{{"id", package}, {"name", QString("Package %1").arg(package-500)}}},
+            {"created", EPOCH-86400*(i+1)},
+            {"updated", EPOCH-600*i},
+            {"userdata", QJsonObject{}}});
+    }
+    _setupList=compact({{"setups", setups}});
+    // Details carry the config, with asset references like those of the real setup/{id}
+    for(int i=0; i<counts.setups; i++)
+    {
+        QJsonObject setup=setups.at(i).toObject();
+        QJsonArray playlist;
+        for(int k=1; k<=3 && counts.assets; k++)
+            playlist.append(QJsonObject{{"file", QJsonObject{{"asset_id", 10000+(i*7+k)%counts.assets},
+                                                             {"type", "image"}}},
+                                        {"duration", 10}});
+        setup.insert("config", QJsonObject{{"", QJsonObject{
+            {"background", counts.assets ? QJsonValue(QJsonObject{{"asset_id", 10000+i%counts.assets}}) : QJsonValue()},
+            {"playlist", playlist}}}});
+        _setups.insert(200+i, compact(setup));
+    }
+
+    QJsonArray assets;
+    std::uniform_int_distribution<qint64> size(qMin<qint64>(4*1024, counts.assetBytes), counts.assetBytes);
+    for(int i=0; i<counts.assets; i++)
+    {
+        const bool video=i%5==0;
+        const qint64 id=10000+i;
+        const qint64 bytes=size(_rng);
+        // The listed checksum is that of the content served under /files/, so downloads can be verified
+        QCryptographicHash md5(QCryptographicHash::Md5);
+        for(qint64 offset=0; offset<bytes; offset+=1024*1024)
+            md5.addData(assetContent(id, offset, qMin<qint64>(1024*1024, bytes-offset)));
+        _assetSizes.insert(id, bytes);
+        assets.append(QJsonObject{
+            {"id", id},
+            {"filename", QString(video ? "clip-%1.mp4" : "image-%1.jpg").arg(i)},
+            {"filetype", video ? "video" : "image"},
+            {"size", bytes},
+            {"md5", QString::fromLatin1(md5.result().toHex())},
+            {"uploaded", EPOCH-60*i},
+            {"userdata", QJsonObject{}}});
+    }
+    _assetList=compact({{"assets", assets}});
+
+    _account=compact({
+        {"email", "mock@example.com"},
+        {"username", "mock"},
+        {"balance", 42.5},
+        {"usage", QJsonObject{{"devices", counts.devices}, {"storage", qint64(counts.assets)*1024*1024}}}});
+
+    makeFollowGraph();
+}
+
+void Fixtures::makeFollowGraph()
+{
+    const int n=qMax(0, _counts.gitHubUsers);
+    _following.assign(size_t(n), std::vector<int>());
+    _followers.assign(size_t(n), std::vector<int>());
+    std::uniform_int_distribution<int> degree(0, 2*MEAN_FOLLOWING);
+    std::uniform_real_distribution<double> pick(0.0, 1.0);
+    for(int i=0; i<n; i++)
+    {
+        std::vector<int> &out=_following[size_t(i)];
+        const int d=qMin(degree(_rng), n-1);
+        // Squaring skews popularity towards the low numbers, as real follower counts are skewed
+        while(int(out.size())<d)
+        {
+            const double u=pick(_rng);
+            const int j=qMin(n-1, int(u*u*n));
+            if(j!=i && std::find(out.begin(), out.end(), j)==out.end())
+                out.push_back(j);
+        }
+        std::sort(out.begin(), out.end());
+        for(int j: out)
+            _followers[size_t(j)].push_back(i);
+    }
+}
+
+int Fixtures::gitHubNode(const QString &login) const
+{
+    const int n=int(_following.size());
+    if(n==0)
+        return -1;
+    bool ok=false;
+    const int i=login.startsWith("user") ? login.mid(4).toInt(&ok) : -1;
+    return ok && i>=0 && i<n && login==QString("user%1").arg(i) ? i : int(qHash(login)%uint(n));
+}
+
+QByteArray Fixtures::assetContent(qint64 id, qint64 offset, qint64 length)
+{
+    // splitmix64 of (id, word index), so a slice does not depend on anything before it
+    auto word=[id](quint64 w) {
+        quint64 z=(quint64(id)<<40)+w+0x9e3779b97f4a7c15ull;
+        z=(z^(z>>30))*0xbf58476d1ce4e5b9ull;
+        z=(z^(z>>27))*0x94d049bb133111ebull;
+        return z^(z>>31);
+    };
+    QByteArray out(length, Qt::Uninitialized);
+    quint64 w=word(quint64(offset)/8);
+    for(qint64 i=0; i<length; i++)
+    {
+        const quint64 pos=quint64(offset+i);
+        if(pos%8==0)
+            w=word(pos/8);
+        out[i]=char(w>>(8*(pos%8)));
+    }
+    return out;
+}
+
+QJsonObject Fixtures::makeDevice(int i)
+{
+    std::uniform_real_distribution<double> lat(45.0, 55.0), lon(0.0, 15.0);
+    const size_t hw=size_t(_rng())%count(MODELS);
+    const size_t channel=size_t(_rng())%count(CHANNELS);
+    const bool online=_rng()%10!=0;
+    const int setup=_counts.setups ? 200+int(_rng()%quint32(_counts.setups)) : 0;
+
+    QJsonObject geo;
+    if(i%7!=0)
+        geo={{"lat", lat(_rng)}, {"lon", lon(_rng)}, {"source", i%2 ? "wifi" : "ip"}};
+
+    return QJsonObject{
+        {"id", FIRST_DEVICE_ID+i},
+        {"description", QString("Screen %1").arg(i)},
+        {"location", QString("%1, floor %2").arg(CITIES[size_t(i)%count(CITIES)]).arg(i%5)},
+        {"serial", QString("%1").arg(0x10000000u+quint32(i)*7919u, 8, 16, QChar('0'))},
+        {"status", online ? STATUSES[size_t(_rng())%count(STATUSES)] : "Offline"},
+        {"is_online", online},
+        {"is_synced", _rng()%4!=0},
+        {"maintenance", i%50==0 ? QJsonArray{"sd_card"} : QJsonArray{}},
+        {"run", QJsonObject{
+             {"channel", CHANNELS[channel]},
+             {"public_addr", QString("198.51.100.%1").arg(i%250+1)},
+             {"resolution", i%3 ? "1920x1080" : "3840x2160"},
+             {"restarted", EPOCH-qint64(_rng()%(86400*30))},
+             {"tag", QString("%1").arg(14-int(channel))},
+             {"version", QString("%1.%2").arg(14-int(channel)).arg(_rng()%20)},
+             {"pi_revision", "c03112"},
+             {"features", QJsonArray{"hevc", "4k"}}}},
+        {"userdata", QJsonObject{{"index", i}}},
+        {"reboot", int(_rng()%24)},
+        {"geo", geo.isEmpty() ? QJsonValue() : QJsonValue(geo)},
+        {"setup", setup ? QJsonValue(QJsonObject{{"id", setup}, {"name", QString("Setup %1").arg(setup-200)},
+                                                  {"updated", EPOCH-600*(setup-200)}}) : QJsonValue()},
+        {"hw", QJsonObject{
+             {"type", "pi"},
+             {"model", MODELS[hw]},
+             {"memory", MEMORY[hw]},
+             {"platform", PLATFORMS[hw]},
+             {"features", QJsonArray{"gpio", "hdmi"}}}},
+        {"offline", QJsonObject{{"licensed", i%20==0}, {"plan", i%20==0 ? "basic" : ""},
+                                {"max_offline", 14}, {"chargeable", 3}}},
+        {"upgrade_blocked", 0}};
+}
+
+void Fixtures::churn(double fraction)
+{
+    if(_devices.empty() || fraction<=0)
+        return;
+    const size_t n=std::max<size_t>(1, size_t(fraction*double(_devices.size())));
+    for(size_t k=0; k<n; k++)
+    {
+        QJsonObject &d=_devices[size_t(_rng())%_devices.size()];
+        const bool online=!d["is_online"].toBool();
+        d["is_online"]=online;
+        d["status"]=online ? "Running" : "Offline";
+    }
+    _deviceListDirty=true;
+}
+
+QByteArray Fixtures::deviceList(double churnFraction)
+{
+    churn(churnFraction);
+    if(_deviceListDirty)
+    {
+        QJsonArray devices;
+        for(const auto &d: _devices)
+            devices.append(d);
+        _deviceList=compact({{"devices", devices}});
+        _deviceListDirty=false;
+    }
+    return _deviceList;
+}
+
+QByteArray Fixtures::devicePage(double churnFraction, int page, int perPage)
+{
+    if(page==1)
+        churn(churnFraction);
+    QJsonArray devices;
+    const size_t first=size_t(page-1)*size_t(perPage);
+    for(size_t i=first; i<first+size_t(perPage) && i<_devices.size(); i++)
+        devices.append(_devices[i]);
+    return compact({{"devices", devices}});
+}
+
+QByteArray Fixtures::device(qint64 id) const
+{
+    const qint64 i=id-FIRST_DEVICE_ID;
+    if(i<0 || i>=qint64(_devices.size()))
+        return QByteArray();
+    return compact(_devices[size_t(i)]);
+}
+
+bool Fixtures::updateDevice(qint64 id, const QHash<QByteArray, QByteArray> &form)
+{
+    const qint64 i=id-FIRST_DEVICE_ID;
+    if(i<0 || i>=qint64(_devices.size()))
+        return false;
+    QJsonObject &d=_devices[size_t(i)];
+    if(form.contains("setup_id"))
+    {
+        const QJsonObject setup=QJsonDocument::fromJson(_setups.value(form.value("setup_id").toLongLong())).object();
+        if(setup.isEmpty())
+            return false;
+        d["setup"]=QJsonObject{{"id", setup["id"]}, {"name", setup["name"]}, {"updated", setup["updated"]}};
+    }
+    if(form.contains("userdata"))
+    {
+        const QJsonDocument userdata=QJsonDocument::fromJson(form.value("userdata"));
+        if(!userdata.isObject())
+            return false;
+        d["userdata"]=userdata.object();
+    }
+    _deviceListDirty=true;
+    return true;
+}
+
+QByteArray Fixtures::gitHubUser(const QString &login, const QString &base, int events) const
+{
+    const uint h=qHash(login);
+    const int node=gitHubNode(login);
+    const bool member=node>=0 && login==QString("user%1").arg(node);
+    return compact({
+        {"login", login},
+        {"id", member ? FIRST_GITHUB_ID+node : qint64(h%10000000)},
+        {"name", QString("Mock %1").arg(login)},
+        {"bio", "Synthetic profile served by the mock API server"},
+        {"type", "User"},
+        {"followers", gitHubFollowCount(login, false)},
+        {"following", gitHubFollowCount(login, true)},
+        {"public_repos", repoCount(events)},
+        {"avatar_url", base+"avatars/"+login+".png"},
+        {"repos_url", base+"github/users/"+login+"/repos"}});
+}
+
+//! Event k of a user happens a minute after event k-1
+static QString eventTime(int k)
+{
+    return QDateTime::fromSecsSinceEpoch(EPOCH+qint64(k)*60, Qt::UTC).toString(Qt::ISODate);
+}
+
+QByteArray Fixtures::gitHubRepos(const QString &login, int page, int perPage, int events) const
+{
+    // What the events did to the listed repositories: the last push
+    std::vector<int> pushed(size_t(_counts.repos), -1);
+    for(int k=0; k<events; k++)
+        if(eventKind(k)==2)
+            pushed[size_t(eventRepo(k))]=k;
+
+    QJsonArray repos;
+    const int first=(page-1)*perPage;
+    const int total=repoCount(events);
+    for(int i=first; i<first+perPage && i<total; i++)
+    {
+        if(i>=_counts.repos)
+        {
+            // The j-th repository created by an event
+            const int j=i-_counts.repos;
+            const int k=_counts.repos ? j*10 : j;
+            repos.append(QJsonObject{
+                {"id", 950000+k},
+                {"name", QString("new-%1").arg(k)},
+                {"full_name", QString("%1/new-%2").arg(login).arg(k)},
+                {"language", QJsonValue()},
+                {"stargazers_count", 0},
+                {"fork", false},
+                {"created_at", eventTime(k)},
+                {"pushed_at", eventTime(k)},
+                {"updated_at", eventTime(k)}});
+            continue;
+        }
+        repos.append(QJsonObject{
+            {"id", 900000+i},
+            {"name", QString("repo-%1").arg(i)},
+            {"full_name", QString("%1/repo-%2").arg(login).arg(i)},
+            {"language", LANGUAGES[size_t(i)%count(LANGUAGES)]},
+            {"stargazers_count", (i*37)%1000},
+            {"fork", i%6==0},
+            {"pushed_at", pushed[size_t(i)]<0 ? QString("2023-11-14T22:13:20Z") : eventTime(pushed[size_t(i)])},
+            {"updated_at", "2023-11-14T22:13:20Z"}});
+    }
+    return QJsonDocument(repos).toJson(QJsonDocument::Compact);
+}
+
+QByteArray Fixtures::gitHubEvents(const QString &login, int events, int page, int perPage) const
+{
+    QJsonArray out;
+    const int oldest=qMax(0, events-MAX_EVENTS);
+    const QJsonObject actor{{"id", qint64(qHash(login)%10000000)}, {"login", login}};
+    for(int k=events-1-(page-1)*perPage, n=0; k>=oldest && n<perPage; k--, n++)
+    {
+        QString repo;
+        QString owner=login;
+        qint64 repoId;
+        QJsonObject payload;
+        switch(eventKind(k))
+        {
+        case 0:
+            repo=QString("new-%1").arg(k);
+            repoId=950000+k;
+            payload={{"ref", QJsonValue()}, {"ref_type", "repository"}, {"master_branch", "main"},
+                     {"description", QJsonValue()}, {"pusher_type", "user"}};
+            break;
+        case 1:
+            // The user stars someone else's repository, which leaves their own as they are
+            owner="mock-stars";
+            repo=QString("repo-%1").arg(eventRepo(k));
+            repoId=990000+eventRepo(k);
+            payload={{"action", "started"}};
+            break;
+        default:
+            repo=QString("repo-%1").arg(eventRepo(k));
+            repoId=900000+eventRepo(k);
+            payload={{"push_id", 7000000+k}, {"size", 1}, {"ref", "refs/heads/main"},
+                     {"head", QString::number(qHash(login)^uint(k), 16)}};
+            break;
+        }
+        static const char *const TYPES[]={"CreateEvent", "WatchEvent", "PushEvent"};
+        out.append(QJsonObject{
+            {"id", QString::number(FIRST_EVENT_ID+k)},
+            {"type", TYPES[eventKind(k)]},
+            {"actor", actor},
+            {"repo", QJsonObject{{"id", repoId}, {"name", owner+"/"+repo}}},
+            {"payload", payload},
+            {"public", true},
+            {"created_at", eventTime(k)}});
+    }
+    return QJsonDocument(out).toJson(QJsonDocument::Compact);
+}
+
+int Fixtures::gitHubFollowCount(const QString &login, bool following) const
+{
+    const int node=gitHubNode(login);
+    return node<0 ? 0 : int((following ? _following : _followers)[size_t(node)].size());
+}
+
+QByteArray Fixtures::gitHubFollows(const QString &login, bool following, int page, int perPage,
+                                   const QString &base) const
+{
+    QJsonArray users;
+    const int node=gitHubNode(login);
+    if(node>=0)
+    {
+        const std::vector<int> &list=(following ? _following : _followers)[size_t(node)];
+        const size_t first=size_t(page-1)*size_t(perPage);
+        for(size_t k=first; k<first+size_t(perPage) && k<list.size(); k++)
+        {
+            const QString other=QString("user%1").arg(list[k]);
+            users.append(QJsonObject{
+                {"login", other},
+                {"id", FIRST_GITHUB_ID+list[k]},
+                {"type", "User"},
+                {"avatar_url", base+"avatars/"+other+".png"}});
+        }
+    }
+    return QJsonDocument(users).toJson(QJsonDocument::Compact);
+}
+
+const QByteArray &Fixtures::avatar()
+{
+    static const QByteArray png=QByteArray::fromBase64(
+        "iVBORw0KGgoAAAANSUhEUgAAAAEAAAABCAYAAAAfFcSJAAAADUlEQVR42mNk+M9QDwADhgGAWjR9awAAAABJRU5ErkJggg==");
+    return png;
+}
+
+}
+}
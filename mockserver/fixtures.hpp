@@ -0,0 +1,115 @@
+#ifndef FIXTURES_HPP
+#define FIXTURES_HPP
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+
+#include <random>
+#include <vector>
+
+namespace InfoBeamer {
+namespace Mock {
+
+/*!
+ * \brief The Fixtures class
+ * Deterministic synthetic API data: the same seed and counts always give the same bodies, so runs are comparable.
+ * Objects carry every field the client decodes (see Device), with realistic value spread.
+ */
+class Fixtures
+{
+public:
+    struct Counts
+    {
+        int devices=100;
+        int packages=20;
+        int setups=10;
+        int assets=200;
+        qint64 assetBytes=4*1024*1024;  //! Largest asset file
+        int repos=30;
+        int gitHubUsers=10000;          //! Users in the follower graph, user0 .. user<n-1>
+    };
+
+    Fixtures(const Counts &counts, quint32 seed);
+
+    //! {"devices":[...]}; with \a churn>0 that fraction of devices changes state first, as a live fleet would
+    QByteArray deviceList(double churn);
+    //! One page (1-based) of deviceList(); churn is applied when page 1 is asked for, i.e. once per walk
+    QByteArray devicePage(double churn, int page, int perPage);
+    int deviceCount() const {return int(_devices.size());}
+    //! A single device object, empty if \a id is unknown
+    QByteArray device(qint64 id) const;
+    /*!
+     * Applies a POST device/{id} form (setup_id=, userdata=, already decoded) to device \a id, as the next device/list
+     * shows.  Returns false for an unknown device or setup or userdata that is not a JSON object.
+     */
+    bool updateDevice(qint64 id, const QHash<QByteArray, QByteArray> &form);
+    const QByteArray &packageList() const {return _packageList;}
+    const QByteArray &setupList() const {return _setupList;}
+    //! setup/{id}: the listed setup plus a config referencing a few assets, empty if \a id is unknown
+    QByteArray setup(qint64 id) const {return _setups.value(id);}
+    const QByteArray &assetList() const {return _assetList;}
+    //! Size of the file of asset \a id, -1 if there is no such asset
+    qint64 assetSize(qint64 id) const {return _assetSizes.value(id, -1);}
+    //! \a length bytes of the file of asset \a id from \a offset; any slice can be produced on its own
+    static QByteArray assetContent(qint64 id, qint64 offset, qint64 length);
+    const QByteArray &account() const {return _account;}
+
+    /*!
+     * GitHub keeps the latest this many events of a user.  Everything below that takes \a events, the number of
+     * events the user has had so far, so repositories and events agree at any point of the feed.
+     */
+    static const int MAX_EVENTS=300;
+
+    //! GitHub users/{login}; \a base is the URL the mock is reachable at, for avatar_url and repos_url
+    QByteArray gitHubUser(const QString &login, const QString &base, int events=0) const;
+    //! One page (1-based) of GitHub users/{login}/repos
+    QByteArray gitHubRepos(const QString &login, int page, int perPage, int events=0) const;
+    int repoCount(int events=0) const {return _counts.repos+created(events);}
+    /*!
+     * One page (1-based) of GitHub users/{login}/events, newest first.  Event k (0-based) creates repository new-<k>
+     * every tenth time, stars a repository of another owner every tenth time and pushes to one of the user's otherwise.
+     */
+    QByteArray gitHubEvents(const QString &login, int events, int page, int perPage) const;
+    /*!
+     * One page (1-based) of GitHub users/{login}/following, or followers.  Logins outside the synthetic population
+     * take the place of one of its users, so any seed has a graph around it.
+     */
+    QByteArray gitHubFollows(const QString &login, bool following, int page, int perPage, const QString &base) const;
+    int gitHubFollowCount(const QString &login, bool following) const;
+
+    //! A valid 1x1 PNG
+    static const QByteArray &avatar();
+
+private:
+    QJsonObject makeDevice(int i);
+    //! Repositories created by the first \a events events
+    int created(int events) const {return _counts.repos ? (events+9)/10 : events;}
+    //! 0 create, 1 star, 2 push
+    int eventKind(int k) const {return !_counts.repos || k%10==0 ? 0 : k%10==5 ? 1 : 2;}
+    int eventRepo(int k) const {return (k/10+k%10)%_counts.repos;}
+    void makeFollowGraph();
+    int gitHubNode(const QString &login) const;
+    void churn(double fraction);
+
+    Counts                   _counts;
+    std::mt19937             _rng;
+    std::vector<QJsonObject> _devices;
+    QByteArray               _deviceList;
+    bool                     _deviceListDirty=true;
+    QByteArray               _packageList;
+    QByteArray               _setupList;
+    QHash<qint64, QByteArray> _setups;
+    QByteArray               _assetList;
+    QHash<qint64, qint64>    _assetSizes;
+    QByteArray               _account;
+    std::vector<std::vector<int>> _following;   //! By node, sorted
+    std::vector<std::vector<int>> _followers;
+};
+
+}
+}
+
+#endif // FIXTURES_HPP
@@ -0,0 +1,92 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QHostAddress>
+
+#include "mockserver.hpp"
+
+using namespace InfoBeamer::Mock;
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setApplicationName("mockserver");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Synthetic info-beamer and GitHub API for offline load tests.\n"
+                                     "Run the client with IB_API_URL=http://<host>:<port>/api/v1/ and "
+                                     "IB_GITHUB_URL=http://<host>:<port>/github/ (https and IB_CA_CERTS=<cert> "
+                                     "with --tls-cert).");
+    parser.addHelpOption();
+    const QCommandLineOption port("port", "Port to listen on.", "port", "8080");
+    const QCommandLineOption bind("bind", "Address to listen on.", "address", "127.0.0.1");
+    const QCommandLineOption devices("devices", "Devices in device/list.", "n", "100");
+    const QCommandLineOption packages("packages", "Packages in package/list.", "n", "20");
+    const QCommandLineOption setups("setups", "Setups in setup/list.", "n", "10");
+    const QCommandLineOption assets("assets", "Assets in asset/list.", "n", "200");
+    const QCommandLineOption assetBytes("asset-bytes", "Largest asset file.", "bytes", "4194304");
+    const QCommandLineOption repos("repos", "Repositories per GitHub user.", "n", "30");
+    const QCommandLineOption gitHubUsers("github-users", "Users in the GitHub follower graph.", "n", "10000");
+    const QCommandLineOption perPage("per-page", "Default GitHub page size.", "n", "30");
+    const QCommandLineOption latency("latency", "Delay before each response.", "ms", "0");
+    const QCommandLineOption jitter("jitter", "Random extra delay, up to this much.", "ms", "0");
+    const QCommandLineOption chunk("chunk", "Send bodies chunked in pieces of this size, 0 to disable.", "bytes", "0");
+    const QCommandLineOption chunkDelay("chunk-delay", "Pause between chunks.", "ms", "0");
+    const QCommandLineOption rateLimit("rate-limit", "Requests allowed per window, 0 for unlimited.", "n", "0");
+    const QCommandLineOption rateWindow("rate-window", "Rate limit window.", "s", "3600");
+    const QCommandLineOption churn("churn", "Fraction of devices changing state per device/list.", "f", "0");
+    const QCommandLineOption failRate("fail-rate", "Fraction of device POSTs answered with 503.", "f", "0");
+    const QCommandLineOption eventRate("event-rate", "New GitHub events per user and minute.", "n", "0");
+    const QCommandLineOption pollInterval("poll-interval", "X-Poll-Interval of the GitHub events feed.", "s", "60");
+    const QCommandLineOption seed("seed", "Seed for the synthetic data.", "n", "1");
+    const QCommandLineOption tlsCert("tls-cert", "Serve HTTPS with this PEM certificate (chain).", "file");
+    const QCommandLineOption tlsKey("tls-key", "PEM private key of --tls-cert.", "file");
+    const QCommandLineOption deflate("deflate", "Compress responses when the client accepts deflate.");
+    const QCommandLineOption verbose("verbose", "Log every request.");
+    parser.addOptions({port, bind, devices, packages, setups, assets, assetBytes, repos, gitHubUsers, perPage, latency,
+                       jitter, chunk, chunkDelay, rateLimit, rateWindow, churn, failRate, eventRate, pollInterval, seed,
+                       tlsCert, tlsKey, deflate, verbose});
+    parser.process(a);
+
+    MockServer::Options o;
+    o.counts.devices=parser.value(devices).toInt();
+    o.counts.packages=parser.value(packages).toInt();
+    o.counts.setups=parser.value(setups).toInt();
+    o.counts.assets=parser.value(assets).toInt();
+    o.counts.assetBytes=qMax<qint64>(1, parser.value(assetBytes).toLongLong());
+    o.counts.repos=parser.value(repos).toInt();
+    o.counts.gitHubUsers=parser.value(gitHubUsers).toInt();
+    o.perPage=qMax(1, parser.value(perPage).toInt());
+    o.latencyMs=parser.value(latency).toInt();
+    o.jitterMs=parser.value(jitter).toInt();
+    o.chunkBytes=parser.value(chunk).toInt();
+    o.chunkDelayMs=parser.value(chunkDelay).toInt();
+    o.rateLimit=parser.value(rateLimit).toInt();
+    o.rateWindowS=qMax(1, parser.value(rateWindow).toInt());
+    o.churn=parser.value(churn).toDouble();
+    o.failRate=qBound(0.0, parser.value(failRate).toDouble(), 1.0);
+    o.eventsPerMinute=qMax(0.0, parser.value(eventRate).toDouble());
+    o.pollIntervalS=qMax(1, parser.value(pollInterval).toInt());
+    o.seed=parser.value(seed).toUInt();
+    o.deflate=parser.isSet(deflate);
+    o.verbose=parser.isSet(verbose);
+
+    MockServer server(o);
+    if(parser.isSet(tlsCert))
+    {
+        QString error;
+        if(!server.enableTls(parser.value(tlsCert), parser.value(parser.isSet(tlsKey) ? tlsKey : tlsCert), &error))
+        {
+            qCritical() << "cannot enable TLS:" << error;
+            return 1;
+        }
+    }
+    if(!server.listen(QHostAddress(parser.value(bind)), quint16(parser.value(port).toUInt())))
+    {
+        qCritical() << "cannot listen on" << parser.value(bind) << parser.value(port) << server.errorString();
+        return 1;
+    }
+    qInfo() << "mock API listening on" << server.scheme() << server.serverAddress().toString() << server.serverPort()
+            << "with" << o.counts.devices << "devices";
+    return a.exec();
+}
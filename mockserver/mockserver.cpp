@@ -0,0 +1,526 @@
+#include "mockserver.hpp"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QPointer>
+#include <QSslCertificate>
+#include <QSslKey>
+#include <QSslSocket>
+#include <QStringList>
+#include <QTimer>
+
+namespace InfoBeamer {
+namespace Mock {
+
+//! Requests whose head does not fit are answered with 400 and the connection is dropped
+static const qsizetype MAX_HEAD=64*1024;
+//! Bodies smaller than this are not worth compressing
+static const qsizetype MIN_DEFLATE=256;
+
+static const char INFOBEAMER_PREFIX[]="/api/v1/";
+static const char GITHUB_PREFIX[]="/github/";
+static const char AVATAR_PREFIX[]="/avatars/";
+static const char FILES_PREFIX[]="/files/";
+
+static QByteArray reason(int status)
+{
+    switch(status)
+    {
+    case 200: return "OK";
+    case 206: return "Partial Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 416: return "Range Not Satisfiable";
+    case 429: return "Too Many Requests";
+    case 503: return "Service Unavailable";
+    default:  return "Unknown";
+    }
+}
+
+MockServer::MockServer(const Options &options, QObject *parent)
+    : QTcpServer(parent)
+    , _options(options)
+    , _fixtures(options.counts, options.seed)
+    , _rng(options.seed)
+{
+    _window.start();
+    _started.start();
+}
+
+bool MockServer::enableTls(const QString &certificateFile, const QString &keyFile, QString *error)
+{
+    const QList<QSslCertificate> chain=QSslCertificate::fromPath(certificateFile);
+    QFile file(keyFile);
+    if(chain.isEmpty() || !file.open(QIODevice::ReadOnly))
+    {
+        if(error)
+            *error=QString("cannot read %1").arg(chain.isEmpty() ? certificateFile : keyFile);
+        return false;
+    }
+    const QByteArray pem=file.readAll();
+    QSslKey key(pem, QSsl::Rsa);
+    if(key.isNull())
+        key=QSslKey(pem, QSsl::Ec);
+    if(key.isNull())
+    {
+        if(error)
+            *error=QString("no RSA or EC private key in %1").arg(keyFile);
+        return false;
+    }
+    _tls=QSslConfiguration::defaultConfiguration();
+    _tls.setLocalCertificateChain(chain);
+    _tls.setPrivateKey(key);
+    _tls.setPeerVerifyMode(QSslSocket::VerifyNone);
+    _tls.setAllowedNextProtocols({QSslConfiguration::NextProtocolHttp1_1});
+    return true;
+}
+
+void MockServer::incomingConnection(qintptr socketDescriptor)
+{
+    QSslSocket *ssl=tls() ? new QSslSocket(this) : nullptr;
+    QTcpSocket *socket=ssl ? ssl : new QTcpSocket(this);
+    if(!socket->setSocketDescriptor(socketDescriptor))
+    {
+        delete socket;
+        return;
+    }
+    _stats.connections++;
+    _connections.insert(socket, Connection());
+    // A QSslSocket only signals readyRead for decrypted bytes
+    connect(socket, &QTcpSocket::readyRead, this, [this, socket]{readRequests(socket);});
+    connect(socket, &QTcpSocket::disconnected, this, [this, socket]{
+        _connections.remove(socket);
+        socket->deleteLater();
+    });
+    if(ssl)
+    {
+        connect(ssl, &QSslSocket::encrypted, this, [this]{_stats.handshakes++;});
+        connect(ssl, &QSslSocket::sslErrors, this, [this, ssl](const QList<QSslError> &errors){
+            if(_options.verbose)
+                qDebug() << __func__ << "TLS handshake failed:" << errors;
+            ssl->disconnectFromHost();
+        });
+        ssl->setSslConfiguration(_tls);
+        ssl->startServerEncryption();
+    }
+}
+
+bool MockServer::parse(QByteArray &in, Request &req, bool &complete)
+{
+    complete=false;
+    const qsizetype end=in.indexOf("\r\n\r\n");
+    if(end<0)
+        return in.size()<=MAX_HEAD;
+
+    const QList<QByteArray> lines=in.left(end).split('\n');
+    const QList<QByteArray> start=lines.first().trimmed().split(' ');
+    if(start.size()!=3 || !start[2].startsWith("HTTP/1."))
+        return false;
+    req.method=start[0];
+    const qsizetype q=start[1].indexOf('?');
+    req.path=q<0 ? start[1] : start[1].left(q);
+    if(q>=0)
+    {
+        for(const QByteArray &kv: start[1].mid(q+1).split('&'))
+        {
+            const qsizetype eq=kv.indexOf('=');
+            req.query.insert(eq<0 ? kv : kv.left(eq), eq<0 ? QByteArray() : kv.mid(eq+1));
+        }
+    }
+    for(qsizetype i=1; i<lines.size(); i++)
+    {
+        const qsizetype colon=lines[i].indexOf(':');
+        if(colon>0)
+            req.headers.insert(lines[i].left(colon).trimmed().toLower(), lines[i].mid(colon+1).trimmed());
+    }
+
+    const qsizetype length=req.headers.value("content-length", "0").toLongLong();
+    if(in.size()<end+4+length)
+        return true;
+    req.body=in.mid(end+4, length);
+    in.remove(0, end+4+length);
+    complete=true;
+    return true;
+}
+
+void MockServer::readRequests(QTcpSocket *socket)
+{
+    for(;;)
+    {
+        auto c=_connections.find(socket);
+        if(c==_connections.end())
+            return;
+        c->in+=socket->readAll();
+        if(c->busy)
+            return;
+
+        Request req;
+        bool complete;
+        if(!parse(c->in, req, complete))
+        {
+            Response res;
+            res.status=400;
+            res.body="{\"error\":\"bad request\"}";
+            send(socket, res, false);
+            return;
+        }
+        if(!complete)
+            return;
+
+        _stats.requests++;
+        const bool keepAlive=req.headers.value("connection").toLower()!="close";
+        Response res=route(req);
+        if(_options.deflate && res.body.size()>=MIN_DEFLATE && req.headers.value("accept-encoding").contains("deflate"))
+        {
+            // qCompress() prefixes the zlib stream with the uncompressed length
+            res.body=qCompress(res.body).mid(4);
+            res.headers.append({"Content-Encoding", "deflate"});
+        }
+        if(_options.verbose)
+            qDebug() << req.method << req.path << res.status << res.body.size() << "bytes";
+        send(socket, res, keepAlive);
+    }
+}
+
+bool MockServer::rateLimited(Response &res)
+{
+    if(_options.rateLimit<=0)
+        return false;
+    const qint64 windowMs=qint64(_options.rateWindowS)*1000;
+    if(_window.elapsed()>=windowMs)
+    {
+        _window.restart();
+        _windowUsed=0;
+    }
+    _windowUsed++;
+    const qint64 reset=QDateTime::currentSecsSinceEpoch()+(windowMs-_window.elapsed())/1000;
+    res.headers.append({"X-RateLimit-Limit", QByteArray::number(_options.rateLimit)});
+    res.headers.append({"X-RateLimit-Remaining", QByteArray::number(qMax(0, _options.rateLimit-_windowUsed))});
+    res.headers.append({"X-RateLimit-Reset", QByteArray::number(reset)});
+    if(_windowUsed<=_options.rateLimit)
+        return false;
+    _stats.limited++;
+    res.headers.append({"Retry-After", QByteArray::number(qMax<qint64>(1, (windowMs-_window.elapsed())/1000))});
+    res.body="{\"message\":\"API rate limit exceeded\"}";
+    return true;
+}
+
+MockServer::Response MockServer::route(const Request &req)
+{
+    Response res;
+    res.headers.append({"Content-Type", "application/json; charset=utf-8"});
+    const QByteArray &path=req.path;
+
+    if(path.startsWith(AVATAR_PREFIX))
+    {
+        res.headers.first().second="image/png";
+        res.body=Fixtures::avatar();
+        return res;
+    }
+    if(path.startsWith(FILES_PREFIX))
+    {
+        file(req, path.mid(sizeof(FILES_PREFIX)-1).toLongLong(), res);
+        return res;
+    }
+    if(path.startsWith(GITHUB_PREFIX))
+    {
+        if(rateLimited(res))
+        {
+            res.status=403;
+            return res;
+        }
+        gitHub(req, path.mid(sizeof(GITHUB_PREFIX)-1), res);
+        return res;
+    }
+    if(path.startsWith(INFOBEAMER_PREFIX))
+    {
+        if(rateLimited(res))
+        {
+            res.status=429;
+            return res;
+        }
+        const QByteArray call=path.mid(sizeof(INFOBEAMER_PREFIX)-1);
+        if(call=="device/list")
+            deviceList(req, res);
+        else if(call=="package/list")
+            res.body=_fixtures.packageList();
+        else if(call=="setup/list")
+            res.body=_fixtures.setupList();
+        else if(call=="asset/list")
+            res.body=_fixtures.assetList();
+        else if(call=="account")
+            res.body=_fixtures.account();
+        else if(call.startsWith("setup/"))
+            res.body=_fixtures.setup(call.mid(6).toLongLong());
+        else if(call.startsWith("asset/") && call.endsWith("/download"))
+        {
+            // Hands out a link to the file, like the signed CDN links of the real API
+            const qint64 id=call.split('/').value(1).toLongLong();
+            if(_fixtures.assetSize(id)>=0)
+                res.body="{\"download_url\":\""+scheme()+"://"+req.headers.value("host", "localhost")+FILES_PREFIX
+                        +QByteArray::number(id)+"\"}";
+        }
+        else if(call.startsWith("device/"))
+            device(req, call, res);
+        if(!res.body.isEmpty())
+            return res;
+    }
+    res.status=404;
+    res.body="{\"error\":\"not found\"}";
+    return res;
+}
+
+void MockServer::gitHub(const Request &req, const QByteArray &path, Response &res)
+{
+    const QList<QByteArray> parts=path.split('/');
+    if(parts.value(0)!="users" || parts.value(1).isEmpty() || parts.size()>3)
+    {
+        res.status=404;
+        res.body="{\"message\":\"Not Found\"}";
+        return;
+    }
+    const QString login=QString::fromUtf8(parts[1]);
+    const QString base=QString::fromUtf8(scheme()+"://"+req.headers.value("host", "localhost")+"/");
+    const int events=eventCount(login);
+    if(parts.size()==2)
+    {
+        res.body=_fixtures.gitHubUser(login, base, events);
+        return;
+    }
+    const QByteArray list=parts[2];
+    if(list!="repos" && list!="followers" && list!="following" && list!="events")
+    {
+        res.status=404;
+        res.body="{\"message\":\"Not Found\"}";
+        return;
+    }
+
+    const int perPage=qBound(1, req.query.value("per_page", QByteArray::number(_options.perPage)).toInt(), 100);
+    const int count=list=="repos" ? _fixtures.repoCount(events)
+                  : list=="events" ? qMin(events, int(Fixtures::MAX_EVENTS))
+                                   : _fixtures.gitHubFollowCount(login, list=="following");
+    const int pages=qMax(1, (count+perPage-1)/perPage);
+    const int page=qBound(1, req.query.value("page", "1").toInt(), pages+1);
+    if(list=="events")
+    {
+        // A page changes whenever a new event shifts the feed; unchanged pages are answered with 304
+        const quint64 version=qHash(QString("%1 %2 %3 %4").arg(login).arg(events).arg(page).arg(perPage));
+        const QByteArray etag="\""+QByteArray::number(version, 16)+"\"";
+        res.headers.append({"ETag", etag});
+        res.headers.append({"X-Poll-Interval", QByteArray::number(_options.pollIntervalS)});
+        if(req.headers.value("if-none-match")==etag)
+        {
+            // Conditional requests that come back unchanged do not count against the rate limit
+            _windowUsed=qMax(0, _windowUsed-1);
+            res.status=304;
+            return;
+        }
+        res.body=_fixtures.gitHubEvents(login, events, page, perPage);
+    }
+    else
+        res.body=list=="repos" ? _fixtures.gitHubRepos(login, page, perPage, events)
+                               : _fixtures.gitHubFollows(login, list=="following", page, perPage, base);
+
+    auto link=[&](int p, const char *rel) {
+        return QString("<%1github/users/%2/%3?page=%4&per_page=%5>; rel=\"%6\"")
+            .arg(base, login, QString::fromLatin1(list)).arg(p).arg(perPage).arg(rel);
+    };
+    QStringList links;
+    if(page<pages)
+        links << link(page+1, "next") << link(pages, "last");
+    if(page>1)
+        links << link(1, "first") << link(page-1, "prev");
+    if(!links.isEmpty())
+        res.headers.append({"Link", links.join(", ").toUtf8()});
+}
+
+void MockServer::deviceList(const Request &req, Response &res)
+{
+    // The real device/list is one document; paging only when the client asks for it
+    if(!req.query.contains("per_page") && !req.query.contains("page"))
+    {
+        res.body=_fixtures.deviceList(_options.churn);
+        return;
+    }
+    const int perPage=qBound(1, req.query.value("per_page", "100").toInt(), 1000);
+    const int count=_fixtures.deviceCount();
+    const int pages=qMax(1, (count+perPage-1)/perPage);
+    const int page=qBound(1, req.query.value("page", "1").toInt(), pages+1);
+    res.body=_fixtures.devicePage(_options.churn, page, perPage);
+    res.headers.append({"X-Total-Count", QByteArray::number(count)});
+
+    const QByteArray base=scheme()+"://"+req.headers.value("host", "localhost")+INFOBEAMER_PREFIX;
+    auto link=[&](int p, const char *rel) {
+        return "<"+base+"device/list?page="+QByteArray::number(p)+"&per_page="+QByteArray::number(perPage)
+                +">; rel=\""+rel+"\"";
+    };
+    QList<QByteArray> links;
+    if(page<pages)
+        links << link(page+1, "next") << link(pages, "last");
+    if(page>1)
+        links << link(1, "first") << link(page-1, "prev");
+    if(!links.isEmpty())
+        res.headers.append({"Link", links.join(", ")});
+}
+
+int MockServer::eventCount(const QString &login) const
+{
+    // A few events before the server started, so every feed has a history
+    const int before=int(qHash(login)%40)+5;
+    return before+int(double(_started.elapsed())*_options.eventsPerMinute/60000.0);
+}
+
+void MockServer::device(const Request &req, const QByteArray &call, Response &res)
+{
+    // device/{id} and the per-device actions (device/{id}/reboot, ...) under it
+    const QList<QByteArray> parts=call.split('/');
+    bool ok=false;
+    const qint64 id=parts.value(1).toLongLong(&ok);
+    res.body=ok ? _fixtures.device(id) : QByteArray();
+    if(res.body.isEmpty() || req.method!="POST")
+        return;
+    if(_options.failRate>0 && std::uniform_real_distribution<double>(0, 1)(_rng)<_options.failRate)
+    {
+        _stats.failed++;
+        res.status=503;
+        res.body="{\"error\":\"service unavailable\"}";
+        return;
+    }
+    if(parts.size()>2)
+    {
+        if(parts[2]=="reboot")
+            _stats.reboots++;
+        res.body="{\"ok\":true}";
+        return;
+    }
+    QHash<QByteArray, QByteArray> form;
+    for(const QByteArray &kv: req.body.split('&'))
+    {
+        const qsizetype eq=kv.indexOf('=');
+        if(eq>0)
+            form.insert(kv.left(eq), QByteArray::fromPercentEncoding(QByteArray(kv.mid(eq+1)).replace('+', ' ')));
+    }
+    if(!_fixtures.updateDevice(id, form))
+    {
+        res.status=400;
+        res.body="{\"error\":\"invalid update\"}";
+        return;
+    }
+    _stats.updates++;
+    res.body="{\"ok\":true}";
+}
+
+void MockServer::file(const Request &req, qint64 id, Response &res)
+{
+    const qint64 size=_fixtures.assetSize(id);
+    if(size<0)
+    {
+        res.status=404;
+        res.body="{\"error\":\"not found\"}";
+        return;
+    }
+    res.headers.first().second="application/octet-stream";
+    res.headers.append({"Accept-Ranges", "bytes"});
+
+    // Single ranges only ("bytes=first-last", "bytes=first-"), which is all downloaders send
+    qint64 first=0, last=size-1;
+    const QByteArray range=req.headers.value("range");
+    if(!range.isEmpty())
+    {
+        const QList<QByteArray> bounds=range.mid(range.indexOf('=')+1).split('-');
+        bool ok=range.startsWith("bytes=") && bounds.size()==2;
+        if(ok)
+            first=bounds[0].toLongLong(&ok);
+        if(ok && !bounds[1].isEmpty())
+            last=qMin(size-1, bounds[1].toLongLong(&ok));
+        if(!ok || first>last)
+        {
+            res.status=416;
+            res.headers.append({"Content-Range", "bytes */"+QByteArray::number(size)});
+            return;
+        }
+        res.status=206;
+        res.headers.append({"Content-Range", "bytes "+QByteArray::number(first)+"-"+QByteArray::number(last)+"/"
+                                             +QByteArray::number(size)});
+    }
+    res.body=Fixtures::assetContent(id, first, last-first+1);
+}
+
+void MockServer::send(QTcpSocket *socket, Response res, bool keepAlive)
+{
+    _connections[socket].busy=true;
+    _stats.bodyBytes+=quint64(res.body.size());
+
+    const bool chunked=_options.chunkBytes>0 && !res.body.isEmpty();
+    QByteArray head="HTTP/1.1 "+QByteArray::number(res.status)+" "+reason(res.status)+"\r\n";
+    for(const auto &h: res.headers)
+        head+=h.first+": "+h.second+"\r\n";
+    if(chunked)
+        head+="Transfer-Encoding: chunked\r\n";
+    else
+        head+="Content-Length: "+QByteArray::number(res.body.size())+"\r\n";
+    head+=keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+    QPointer<QTcpSocket> guard(socket);
+    auto write=[this, guard, head, body=res.body, chunked, keepAlive]{
+        if(!guard)
+            return;
+        guard->write(head);
+        if(chunked)
+            sendChunks(guard, body, 0, keepAlive);
+        else
+        {
+            guard->write(body);
+            done(guard, keepAlive);
+        }
+    };
+
+    const int delay=_options.latencyMs+(_options.jitterMs>0 ? int(_rng()%quint32(_options.jitterMs+1)) : 0);
+    if(delay>0)
+        QTimer::singleShot(delay, socket, write);
+    else
+        write();
+}
+
+void MockServer::sendChunks(QTcpSocket *socket, QByteArray body, qsizetype offset, bool keepAlive)
+{
+    const qsizetype n=qMin<qsizetype>(_options.chunkBytes, body.size()-offset);
+    socket->write(QByteArray::number(qulonglong(n), 16)+"\r\n");
+    socket->write(body.constData()+offset, n);
+    socket->write("\r\n");
+    offset+=n;
+    if(offset>=body.size())
+    {
+        socket->write("0\r\n\r\n");
+        done(socket, keepAlive);
+        return;
+    }
+    QPointer<QTcpSocket> guard(socket);
+    QTimer::singleShot(_options.chunkDelayMs, socket, [this, guard, body, offset, keepAlive]{
+        if(guard)
+            sendChunks(guard, body, offset, keepAlive);
+    });
+}
+
+void MockServer::done(QTcpSocket *socket, bool keepAlive)
+{
+    auto c=_connections.find(socket);
+    if(c==_connections.end())
+        return;
+    if(!keepAlive)
+    {
+        socket->disconnectFromHost();
+        return;
+    }
+    const bool pending=c->busy && !c->in.isEmpty();
+    c->busy=false;
+    // Pipelined requests that arrived while this one was delayed
+    if(pending || socket->bytesAvailable()>0)
+        QTimer::singleShot(0, socket, [this, socket]{readRequests(socket);});
+}
+
+}
+}
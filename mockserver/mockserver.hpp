@@ -0,0 +1,143 @@
+#ifndef MOCKSERVER_HPP
+#define MOCKSERVER_HPP
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QSslConfiguration>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QPair>
+
+#include <random>
+
+#include "fixtures.hpp"
+
+namespace InfoBeamer {
+namespace Mock {
+
+/*!
+ * \brief The MockServer class
+ * Minimal HTTP/1.1 server standing in for info-beamer.com and api.github.com.  Routes:
+ *
+ *  /api/v1/device/list, device/{id}, package/list, setup/list, setup/{id}, asset/list, account
+ *                                                                                     (info-beamer, any method)
+ *  /api/v1/device/list?page=&per_page=                               (device/list in pages, Link and X-Total-Count)
+ *  POST /api/v1/device/{id} (setup_id=, userdata=), POST /api/v1/device/{id}/reboot  (device updates)
+ *  /github/users/{login}, /github/users/{login}/repos?page=&per_page=                  (GitHub, Link pagination)
+ *  /github/users/{login}/followers, /github/users/{login}/following                    (GitHub, same paging)
+ *  /github/users/{login}/events                                   (GitHub, same paging, ETag and X-Poll-Interval)
+ *  /avatars/{login}.png
+ *  /api/v1/asset/{id}/download -> /files/{id}                                         (asset files, Range requests)
+ *
+ * so the client is pointed at it with IB_API_URL=http://host:port/api/v1/ and IB_GITHUB_URL=http://host:port/github/.
+ * Responses can be delayed, trickled out in chunks and deflate compressed; a fixed window rate limit answers with
+ * X-RateLimit-* headers and 403 (GitHub) / 429 (info-beamer) once it is used up.  Keep-alive and pipelining are
+ * supported; requests on one connection are answered in order.  A fraction of the device POSTs can be made to fail
+ * with 503, to exercise client retries.
+ *
+ * With enableTls() every connection is HTTPS (HTTP/1.1 only), which puts the client's warm-up and handshake counting
+ * against a real TLS handshake.  Qt gives each server side socket an SSL context of its own, and with it its own
+ * session ticket key, so tickets the mock hands out are never accepted on a later connection: resumption can only be
+ * seen against the real hosts.
+ */
+class MockServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    struct Options
+    {
+        Fixtures::Counts counts;
+        quint32 seed=1;
+        int     latencyMs=0;        //! Delay before the response head is sent
+        int     jitterMs=0;         //! Extra random delay, 0..jitterMs
+        int     chunkBytes=0;       //! >0 sends the body with chunked transfer encoding in pieces of this size
+        int     chunkDelayMs=0;     //! Pause between chunks
+        int     perPage=30;         //! Default GitHub page size, as on github.com
+        int     rateLimit=0;        //! Requests per window, 0 for no limit
+        int     rateWindowS=3600;
+        double  churn=0;            //! Fraction of devices changing state per device/list
+        double  failRate=0;         //! Fraction of device POSTs answered with 503 instead
+        double  eventsPerMinute=0;  //! New GitHub events per user and minute
+        int     pollIntervalS=60;   //! X-Poll-Interval of the events feed
+        bool    deflate=false;      //! Compress bodies when the client accepts deflate
+        bool    verbose=false;
+    };
+
+    struct Stats
+    {
+        quint64 connections=0;
+        quint64 handshakes=0;       //! TLS handshakes completed
+        quint64 requests=0;
+        quint64 limited=0;
+        quint64 updates=0;          //! Device POSTs applied
+        quint64 reboots=0;
+        quint64 failed=0;           //! Device POSTs failed on purpose (failRate)
+        quint64 bodyBytes=0;
+    };
+
+    explicit MockServer(const Options &options, QObject *parent=nullptr);
+
+    //! Serves HTTPS with the PEM certificate chain and private key in the given files
+    bool enableTls(const QString &certificateFile, const QString &keyFile, QString *error=nullptr);
+    bool tls() const {return !_tls.isNull();}
+    QByteArray scheme() const {return tls() ? "https" : "http";}
+
+    const Stats &stats() const {return _stats;}
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private:
+    struct Request
+    {
+        QByteArray method;
+        QByteArray path;
+        QHash<QByteArray, QByteArray> query;
+        QHash<QByteArray, QByteArray> headers;     //! Lower case names
+        QByteArray body;
+    };
+
+    struct Response
+    {
+        int status=200;
+        QList<QPair<QByteArray, QByteArray>> headers;
+        QByteArray body;
+    };
+
+    struct Connection
+    {
+        QByteArray in;
+        bool       busy=false;   //! A response is being delayed or trickled out
+    };
+
+    void readRequests(QTcpSocket *socket);
+    static bool parse(QByteArray &in, Request &req, bool &complete);
+    Response route(const Request &req);
+    void gitHub(const Request &req, const QByteArray &path, Response &res);
+    void device(const Request &req, const QByteArray &call, Response &res);
+    //! device/list, in pages when ?page= or ?per_page= is given
+    void deviceList(const Request &req, Response &res);
+    void file(const Request &req, qint64 id, Response &res);
+    //! Events \a login has had so far
+    int eventCount(const QString &login) const;
+    bool rateLimited(Response &res);
+    void send(QTcpSocket *socket, Response res, bool keepAlive);
+    void sendChunks(QTcpSocket *socket, QByteArray body, qsizetype offset, bool keepAlive);
+    void done(QTcpSocket *socket, bool keepAlive);
+
+    Options                          _options;
+    QSslConfiguration                _tls;       //! Null for plain HTTP
+    Fixtures                         _fixtures;
+    std::mt19937                     _rng;
+    QHash<QTcpSocket *, Connection>  _connections;
+    QElapsedTimer                    _started;
+    QElapsedTimer                    _window;
+    int                              _windowUsed=0;
+    Stats                            _stats;
+};
+
+}
+}
+
+#endif // MOCKSERVER_HPP
@@ -0,0 +1,17 @@
+# Mock info-beamer / GitHub API server for offline load tests, see mockserver.hpp
+QT       += core network
+QT       -= gui
+
+CONFIG += c++1z console
+CONFIG -= app_bundle
+
+TARGET = mockserver
+
+SOURCES += \
+    fixtures.cpp \
+    main.cpp \
+    mockserver.cpp
+
+HEADERS += \
+    fixtures.hpp \
+    mockserver.hpp
@@ -0,0 +1,171 @@
+#ifndef RCU_HPP
+#define RCU_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The Rcu class
+ * Read-copy-update holder for an immutable value that is replaced as a whole, e.g. a fleet snapshot.
+ *
+ * Writers build a new value and publish() it; the pointer swap is atomic, so a reader sees either the old or the new
+ * generation, never a half built one.  Readers pin the current generation with read() and hold it for as long as
+ * the ReadGuard lives.  Pinning takes no lock and touches only the reader's own slot, so readers on many threads do
+ * not contend with each other or with the writer.
+ *
+ * Reclamation is epoch based.  Pins are counted per slot and per epoch parity.  A replaced generation is retired
+ * with the epoch it was replaced in and is freed once the epoch has moved on twice, which can only happen after
+ * every reader that could have seen it has let go.  publish() never waits for readers: if a reader holds on, the old
+ * generation simply stays retired until a later publish() or reclaim() finds it free.
+ */
+template<class T>
+class Rcu
+{
+    struct Node
+    {
+        T        value;
+        uint64_t generation;
+    };
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint32_t> pins[2]={{0}, {0}};
+    };
+
+    static const unsigned SLOTS=64;
+
+public:
+    class ReadGuard
+    {
+    public:
+        ReadGuard(ReadGuard &&o) noexcept : _node(o._node), _pin(o._pin) {o._pin=nullptr;}
+        ReadGuard(const ReadGuard &)=delete;
+        ReadGuard &operator=(const ReadGuard &)=delete;
+        ~ReadGuard() {if(_pin!=nullptr) _pin->fetch_sub(1, std::memory_order_release);}
+
+        const T &operator*() const {return _node->value;}
+        const T *operator->() const {return &_node->value;}
+        const T *get() const {return &_node->value;}
+        uint64_t generation() const {return _node->generation;}
+
+    private:
+        friend class Rcu;
+        ReadGuard(const Node *n, std::atomic<uint32_t> *pin) : _node(n), _pin(pin) {}
+
+        const Node             *_node;
+        std::atomic<uint32_t>  *_pin;
+    };
+
+    explicit Rcu(T initial=T()) : _current(new Node{std::move(initial), 0}) {}
+    ~Rcu()
+    {
+        // Readers must be gone by now
+        for(const auto &r: _retired)
+            delete r.first;
+        delete _current.load();
+    }
+    Rcu(const Rcu &)=delete;
+    Rcu &operator=(const Rcu &)=delete;
+
+    //! Pins the current generation, lock-free
+    ReadGuard read() const
+    {
+        Slot &slot=_slots[threadIndex()%SLOTS];
+        for(;;)
+        {
+            const uint64_t e=_epoch.load();
+            std::atomic<uint32_t> &pin=slot.pins[e & 1];
+            pin.fetch_add(1);
+            // The writer may have flipped the epoch between the load and the pin; then the pin may already have
+            // been checked, so step back and pin again under the new epoch
+            if(_epoch.load()==e)
+                return ReadGuard(_current.load(), &pin);
+            pin.fetch_sub(1);
+        }
+    }
+
+    /*!
+     * \brief publish
+     * Makes \a value the current generation and returns its number.  Writers are serialized among themselves;
+     * readers are not blocked.
+     */
+    uint64_t publish(T value)
+    {
+        std::lock_guard<std::mutex> lock(_writer);
+        const uint64_t generation=_current.load()->generation+1;
+        Node *old=_current.exchange(new Node{std::move(value), generation});
+        _retired.emplace_back(old, _epoch.load());
+        collect();
+        return generation;
+    }
+
+    //! Frees retired generations that no reader can still hold
+    void reclaim()
+    {
+        std::lock_guard<std::mutex> lock(_writer);
+        collect();
+    }
+
+    uint64_t generation() const {return _current.load()->generation;}
+
+    //! Replaced generations still waiting for readers
+    size_t retired() const
+    {
+        std::lock_guard<std::mutex> lock(_writer);
+        return _retired.size();
+    }
+
+private:
+    static unsigned threadIndex()
+    {
+        static std::atomic<unsigned> next{0};
+        static thread_local const unsigned index=next.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    //! Advances the epoch if the readers of the previous one are gone; true if it did
+    bool advance()
+    {
+        const uint64_t e=_epoch.load();
+        const unsigned previous=unsigned((e+1) & 1);
+        for(const auto &s: _slots)
+            if(s.pins[previous].load()!=0)
+                return false;
+        _epoch.store(e+1);
+        return true;
+    }
+
+    void collect()
+    {
+        if(_retired.empty())
+            return;
+        // Two flips at most are needed for everything retired so far
+        if(advance())
+            advance();
+        const uint64_t e=_epoch.load();
+        size_t kept=0;
+        for(auto &r: _retired)
+        {
+            if(r.second+2<=e)
+                delete r.first;
+            else
+                _retired[kept++]=r;
+        }
+        _retired.resize(kept);
+    }
+
+    std::atomic<Node *>                      _current;
+    std::atomic<uint64_t>                    _epoch{0};
+    mutable Slot                             _slots[SLOTS];
+    mutable std::mutex                       _writer;
+    std::vector<std::pair<Node *, uint64_t>> _retired;      //! (generation, epoch it was replaced in)
+};
+
+}
+
+#endif // RCU_HPP
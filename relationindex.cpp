@@ -0,0 +1,318 @@
+#include "relationindex.hpp"
+
+#include <QJsonArray>
+
+#include <algorithm>
+#include <iterator>
+
+#include "jsonflatten.hpp"
+
+namespace InfoBeamer {
+
+static int setupIdOf(const Device &d)
+{
+    return d.setup() ? d.setup()->id : 0;
+}
+
+template<typename Map>
+static size_t hashFootprint(const Map &map, size_t valueBytes)
+{
+    // Hash nodes hold the value and a next pointer; buckets are one pointer each
+    return map.size()*(valueBytes+sizeof(void *))+map.bucket_count()*sizeof(void *);
+}
+
+void RelationIndex::resetDevices(const std::vector<Device> &devices)
+{
+    _deviceSetup.clear();
+    _setupDevices.clear();
+    for(const Device &d: devices)
+        assign(d.id(), setupIdOf(d));
+}
+
+void RelationIndex::apply(const FleetDiff &diff)
+{
+    for(const Device &d: diff.removed)
+        assign(d.id(), 0);
+    for(const Device &d: diff.added)
+        assign(d.id(), setupIdOf(d));
+    for(const auto &c: diff.changed)
+        if(setupIdOf(c.first)!=setupIdOf(c.second))
+            assign(c.second.id(), setupIdOf(c.second));
+}
+
+RelationIndex::Ids RelationIndex::setSetups(const QJsonObject &setupList)
+{
+    Ids listed, stale;
+    for(const QJsonValue &v: setupList.value("setups").toArray())
+    {
+        const QJsonObject setup=v.toObject();
+        const int id=setup.value("id").toInt();
+        if(!id)
+            continue;
+        listed.push_back(id);
+        setSetup(setup);
+        if(setup.contains("config"))
+            continue;
+        const auto seen=_configSeen.find(id);
+        if(seen==_configSeen.end() || seen->second!=qint64(setup.value("updated").toDouble()))
+            stale.push_back(id);
+    }
+    std::sort(listed.begin(), listed.end());
+    Ids gone;
+    for(const auto &s: _setupPackage)
+        if(!std::binary_search(listed.begin(), listed.end(), s.first))
+            gone.push_back(s.first);
+    for(int id: gone)
+        removeSetup(id);
+    std::sort(stale.begin(), stale.end());
+    return stale;
+}
+
+void RelationIndex::setSetup(const QJsonObject &setup)
+{
+    const int id=setup.value("id").toInt();
+    if(!id)
+        return;
+    _setupNames[id]=setup.value("name").toString();
+    const QJsonValue package=setup.value("package");
+    const int packageId=package.isObject() ? package.toObject().value("id").toInt() : package.toInt();
+    if(package.isObject() && package.toObject().contains("name") && packageId)
+        _packageNames.emplace(packageId, package.toObject().value("name").toString());
+    relink(id, packageId);
+    if(setup.contains("config"))
+    {
+        relinkAssets(id, assetRefs(setup.value("config")));
+        _configSeen[id]=qint64(setup.value("updated").toDouble());
+    }
+}
+
+void RelationIndex::setPackages(const QJsonObject &packageList)
+{
+    _packageNames.clear();
+    for(const QJsonValue &v: packageList.value("packages").toArray())
+    {
+        const QJsonObject package=v.toObject();
+        if(const int id=package.value("id").toInt())
+            _packageNames[id]=package.value("name").toString();
+    }
+}
+
+void RelationIndex::setAssets(const QJsonObject &assetList)
+{
+    _assetNames.clear();
+    for(const QJsonValue &v: assetList.value("assets").toArray())
+    {
+        const QJsonObject asset=v.toObject();
+        if(const int id=asset.value("id").toInt())
+            _assetNames[id]=asset.value("filename").toString();
+    }
+}
+
+RelationIndex::Ids RelationIndex::devicesOfSetup(int setup) const
+{
+    return get(_setupDevices, setup);
+}
+
+RelationIndex::Ids RelationIndex::devicesOfPackage(int package) const
+{
+    return gather(_setupDevices, get(_packageSetups, package));
+}
+
+RelationIndex::Ids RelationIndex::devicesOfAsset(int asset) const
+{
+    return gather(_setupDevices, get(_assetSetups, asset));
+}
+
+int RelationIndex::setupOfDevice(int device) const
+{
+    const auto it=_deviceSetup.find(device);
+    return it==_deviceSetup.end() ? 0 : it->second;
+}
+
+int RelationIndex::packageOfSetup(int setup) const
+{
+    const auto it=_setupPackage.find(setup);
+    return it==_setupPackage.end() ? 0 : it->second;
+}
+
+static QString nameIn(const std::unordered_map<int, QString> &names, int id)
+{
+    const auto it=names.find(id);
+    return it==names.end() ? QString() : it->second;
+}
+
+QString RelationIndex::setupName(int id) const
+{
+    return nameIn(_setupNames, id);
+}
+
+QString RelationIndex::packageName(int id) const
+{
+    return nameIn(_packageNames, id);
+}
+
+QString RelationIndex::assetName(int id) const
+{
+    return nameIn(_assetNames, id);
+}
+
+size_t RelationIndex::footprint(const Adjacency &adj)
+{
+    size_t n=hashFootprint(adj, sizeof(Adjacency::value_type));
+    for(const auto &a: adj)
+        n+=a.second.capacity()*sizeof(int);
+    return n;
+}
+
+size_t RelationIndex::footprint() const
+{
+    size_t n=hashFootprint(_deviceSetup, sizeof(std::pair<const int, int>))
+            +hashFootprint(_setupPackage, sizeof(std::pair<const int, int>))
+            +hashFootprint(_configSeen, sizeof(std::pair<const int, qint64>))
+            +footprint(_setupDevices)+footprint(_packageSetups)+footprint(_setupAssets)+footprint(_assetSetups);
+    for(const auto *names: {&_setupNames, &_packageNames, &_assetNames})
+    {
+        n+=hashFootprint(*names, sizeof(std::pair<const int, QString>));
+        for(const auto &name: *names)
+            n+=size_t(name.second.capacity())*sizeof(QChar);
+    }
+    return n;
+}
+
+const RelationIndex::Ids &RelationIndex::get(const Adjacency &adj, int key)
+{
+    static const Ids none;
+    const auto it=adj.find(key);
+    return it==adj.end() ? none : it->second;
+}
+
+void RelationIndex::link(Adjacency &adj, int from, int to)
+{
+    Ids &ids=adj[from];
+    const auto at=std::lower_bound(ids.begin(), ids.end(), to);
+    if(at==ids.end() || *at!=to)
+        ids.insert(at, to);
+}
+
+void RelationIndex::unlink(Adjacency &adj, int from, int to)
+{
+    const auto it=adj.find(from);
+    if(it==adj.end())
+        return;
+    Ids &ids=it->second;
+    const auto at=std::lower_bound(ids.begin(), ids.end(), to);
+    if(at!=ids.end() && *at==to)
+        ids.erase(at);
+    if(ids.empty())
+        adj.erase(it);
+}
+
+RelationIndex::Ids RelationIndex::gather(const Adjacency &adj, const Ids &keys)
+{
+    if(keys.size()==1)
+        return get(adj, keys.front());
+    // k-way merge of the sorted lists, smallest head first
+    typedef std::pair<const int *, const int *> Range;
+    auto later=[](const Range &a, const Range &b){return *a.first>*b.first;};
+    std::vector<Range> heads;
+    size_t total=0;
+    for(int key: keys)
+    {
+        const Ids &ids=get(adj, key);
+        if(ids.empty())
+            continue;
+        heads.emplace_back(ids.data(), ids.data()+ids.size());
+        total+=ids.size();
+    }
+    std::make_heap(heads.begin(), heads.end(), later);
+    Ids out;
+    out.reserve(total);
+    while(!heads.empty())
+    {
+        std::pop_heap(heads.begin(), heads.end(), later);
+        Range &r=heads.back();
+        if(out.empty() || out.back()!=*r.first)
+            out.push_back(*r.first);
+        if(++r.first==r.second)
+            heads.pop_back();
+        else
+            std::push_heap(heads.begin(), heads.end(), later);
+    }
+    return out;
+}
+
+RelationIndex::Ids RelationIndex::assetRefs(const QJsonValue &config)
+{
+    Ids ids;
+    forEachLeaf(config, [&ids](const QString &key, const QJsonValue &v){
+        if(key=="asset_id" && v.isDouble())
+            ids.push_back(v.toInt());
+    });
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+void RelationIndex::assign(int device, int setup)
+{
+    const auto it=_deviceSetup.find(device);
+    const int before=it==_deviceSetup.end() ? 0 : it->second;
+    if(before==setup)
+        return;
+    if(before)
+    {
+        unlink(_setupDevices, before, device);
+        _deviceSetup.erase(it);
+    }
+    if(setup)
+    {
+        _deviceSetup.emplace(device, setup);
+        link(_setupDevices, setup, device);
+    }
+}
+
+void RelationIndex::relink(int setup, int package)
+{
+    const auto it=_setupPackage.find(setup);
+    if(it!=_setupPackage.end())
+    {
+        if(it->second==package)
+            return;
+        if(it->second)
+            unlink(_packageSetups, it->second, setup);
+        it->second=package;
+    }
+    else
+        _setupPackage.emplace(setup, package);
+    if(package)
+        link(_packageSetups, package, setup);
+}
+
+void RelationIndex::relinkAssets(int setup, const Ids &assets)
+{
+    const Ids before=get(_setupAssets, setup);
+    if(before==assets)
+        return;
+    Ids dropped, added;
+    std::set_difference(before.begin(), before.end(), assets.begin(), assets.end(), std::back_inserter(dropped));
+    std::set_difference(assets.begin(), assets.end(), before.begin(), before.end(), std::back_inserter(added));
+    for(int asset: dropped)
+        unlink(_assetSetups, asset, setup);
+    for(int asset: added)
+        link(_assetSetups, asset, setup);
+    if(assets.empty())
+        _setupAssets.erase(setup);
+    else
+        _setupAssets[setup]=assets;
+}
+
+void RelationIndex::removeSetup(int setup)
+{
+    relink(setup, 0);
+    relinkAssets(setup, Ids());
+    _setupPackage.erase(setup);
+    _configSeen.erase(setup);
+    _setupNames.erase(setup);
+}
+
+}
@@ -0,0 +1,99 @@
+#ifndef RELATIONINDEX_HPP
+#define RELATIONINDEX_HPP
+
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+
+#include <unordered_map>
+#include <vector>
+
+#include "device.hpp"
+#include "fleetdiff.hpp"
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The RelationIndex class
+ * Which devices run which setup, which package a setup is built from and which assets its configuration uses, in
+ * id-keyed adjacency lists kept both ways.  Impact queries ("which devices does a new version of package 503 reach?")
+ * are then a few lookups and a merge of sorted lists instead of a cross-reference of three dumps.
+ *
+ * Devices come in as FleetDiffs, like SearchIndex; only a changed setup assignment touches the index.  Setups come in
+ * as setup/list responses or setup/{id} details and are compared with what is indexed, so a refresh in which one setup
+ * changed relinks only that setup.  The asset references of a setup are the asset_id values anywhere in its "config",
+ * which setup/list leaves out: setSetups() returns the setups whose config has to be fetched for that.
+ *
+ * Package and asset lists only supply names; links to ids not listed (yet) are kept all the same.
+ */
+class RelationIndex
+{
+public:
+    //! Sorted, without duplicates
+    typedef std::vector<int> Ids;
+
+    void resetDevices(const std::vector<Device> &devices);
+    void apply(const FleetDiff &diff);
+
+    /*!
+     * \brief setSetups
+     * Indexes a setup/list response; setups it no longer lists are dropped.  Returns the setups that are new or were
+     * updated since their config was last seen and whose config the list does not carry, for setSetup() to be given
+     * their setup/{id} response.
+     */
+    Ids setSetups(const QJsonObject &setupList);
+    //! Indexes one setup object, e.g. a setup/{id} response with its config
+    void setSetup(const QJsonObject &setup);
+    void setPackages(const QJsonObject &packageList);
+    void setAssets(const QJsonObject &assetList);
+
+    Ids devicesOfSetup(int setup) const;
+    Ids devicesOfPackage(int package) const;
+    Ids devicesOfAsset(int asset) const;
+    Ids setupsOfPackage(int package) const {return get(_packageSetups, package);}
+    Ids setupsOfAsset(int asset) const {return get(_assetSetups, asset);}
+    Ids assetsOfDevice(int device) const {return get(_setupAssets, setupOfDevice(device));}
+    //! 0 for none
+    int setupOfDevice(int device) const;
+    int packageOfSetup(int setup) const;
+
+    QString setupName(int id) const;
+    QString packageName(int id) const;
+    QString assetName(int id) const;
+
+    size_t setups() const {return _setupPackage.size();}
+    size_t devices() const {return _deviceSetup.size();}
+    //! Approximate heap bytes held by the index
+    size_t footprint() const;
+
+private:
+    typedef std::unordered_map<int, Ids> Adjacency;
+
+    static const Ids &get(const Adjacency &adj, int key);
+    static void link(Adjacency &adj, int from, int to);
+    static void unlink(Adjacency &adj, int from, int to);
+    //! Union of the lists of \a keys in \a adj
+    static Ids gather(const Adjacency &adj, const Ids &keys);
+    static Ids assetRefs(const QJsonValue &config);
+    static size_t footprint(const Adjacency &adj);
+
+    void assign(int device, int setup);
+    void relink(int setup, int package);
+    void relinkAssets(int setup, const Ids &assets);
+    void removeSetup(int setup);
+
+    std::unordered_map<int, int>        _deviceSetup;
+    Adjacency                           _setupDevices;
+    std::unordered_map<int, int>        _setupPackage;
+    Adjacency                           _packageSetups;
+    Adjacency                           _setupAssets;
+    Adjacency                           _assetSetups;
+    std::unordered_map<int, qint64>     _configSeen;    //! Setup -> "updated" of the config indexed
+    std::unordered_map<int, QString>    _setupNames;
+    std::unordered_map<int, QString>    _packageNames;
+    std::unordered_map<int, QString>    _assetNames;
+};
+
+}
+
+#endif // RELATIONINDEX_HPP
@@ -0,0 +1,264 @@
+#include "searchindex.hpp"
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
+
+#include <algorithm>
+#include <functional>
+
+#include "jsonflatten.hpp"
+
+namespace InfoBeamer {
+
+// Key layout: kind in bits 48+, then up to three UTF-16 units
+static const uint64_t PREFIX1=uint64_t(1)<<48;
+static const uint64_t PREFIX2=uint64_t(2)<<48;
+static const uint64_t TRIGRAM=uint64_t(3)<<48;
+
+static uint64_t prefixKey(const QChar *w, qsizetype len)
+{
+    return len==1 ? PREFIX1|w[0].unicode() : PREFIX2|uint64_t(w[0].unicode())<<16|w[1].unicode();
+}
+
+static uint64_t trigramKey(const QChar *w)
+{
+    return TRIGRAM|uint64_t(w[0].unicode())<<32|uint64_t(w[1].unicode())<<16|w[2].unicode();
+}
+
+//! Calls \a f(start, length) for every run of letters and digits in \a text
+template<class F>
+static void forEachWord(const QString &text, F f)
+{
+    const QChar *s=text.unicode();
+    const qsizetype n=text.size();
+    qsizetype i=0;
+    while(i<n)
+    {
+        if(!s[i].isLetterOrNumber())
+        {
+            i++;
+            continue;
+        }
+        qsizetype end=i+1;
+        while(end<n && s[end].isLetterOrNumber())
+            end++;
+        f(s+i, end-i);
+        i=end;
+    }
+}
+
+static bool sameText(const Device &a, const Device &b)
+{
+    if(a.description()!=b.description() || a.location()!=b.location() || a.serial()!=b.serial())
+        return false;
+    const QJsonValue *ua=a.userdata(), *ub=b.userdata();
+    return ua==nullptr || ub==nullptr ? ua==ub : *ua==*ub;
+}
+
+QString SearchIndex::text(const Device &d)
+{
+    QString t=QString::fromStdString(d.description());
+    t+='\n';
+    t+=QString::fromStdString(d.location());
+    t+='\n';
+    t+=QString::fromStdString(d.serial());
+    if(const QJsonValue *userdata=d.userdata())
+    {
+        // Leaves only; keys are schema, not content
+        forEachLeaf(*userdata, [&t](const QString &, const QJsonValue &v){
+            if(v.isString())
+            {
+                t+='\n';
+                t+=v.toString();
+            }
+            else if(v.isDouble())
+            {
+                t+='\n';
+                t+=QString::number(v.toDouble(), 'g', 15);
+            }
+        });
+    }
+    return t.toCaseFolded();
+}
+
+void SearchIndex::keysOf(const QString &text, std::vector<Key> &out)
+{
+    out.clear();
+    forEachWord(text, [&out](const QChar *w, qsizetype len){
+        out.push_back(prefixKey(w, 1));
+        if(len>=2)
+            out.push_back(prefixKey(w, 2));
+        for(qsizetype i=0; i+2<len; i++)
+            out.push_back(trigramKey(w+i));
+    });
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+const std::vector<uint32_t> *SearchIndex::postings(Key key) const
+{
+    const auto p=_postings.find(key);
+    return p==_postings.end() ? nullptr : &p->second;
+}
+
+void SearchIndex::reset(const std::vector<Device> &devices)
+{
+    _docs.clear();
+    _free.clear();
+    _slotOf.clear();
+    _postings.clear();
+    _docs.reserve(devices.size());
+    _slotOf.reserve(devices.size());
+    for(const auto &d: devices)
+        add(d);
+}
+
+void SearchIndex::apply(const FleetDiff &diff)
+{
+    for(const auto &d: diff.removed)
+        remove(d.id());
+    for(const auto &c: diff.changed)
+        if(!sameText(c.first, c.second))
+            add(c.second);
+    for(const auto &d: diff.added)
+        add(d);
+}
+
+void SearchIndex::add(const Device &d)
+{
+    remove(d.id());
+    uint32_t slot;
+    if(!_free.empty())
+    {
+        slot=_free.back();
+        _free.pop_back();
+    }
+    else
+    {
+        slot=uint32_t(_docs.size());
+        _docs.emplace_back();
+    }
+    Doc &doc=_docs[slot];
+    doc.id=d.id();
+    doc.text=text(d);
+    _slotOf[d.id()]=slot;
+
+    keysOf(doc.text, _scratch);
+    for(Key k: _scratch)
+    {
+        std::vector<uint32_t> &list=_postings[k];
+        // New slots are the largest ones unless a freed slot was reused
+        if(list.empty() || list.back()<slot)
+            list.push_back(slot);
+        else
+            list.insert(std::lower_bound(list.begin(), list.end(), slot), slot);
+    }
+}
+
+void SearchIndex::remove(int id)
+{
+    const auto s=_slotOf.find(id);
+    if(s==_slotOf.end())
+        return;
+    const uint32_t slot=s->second;
+    _slotOf.erase(s);
+
+    Doc &doc=_docs[slot];
+    keysOf(doc.text, _scratch);
+    for(Key k: _scratch)
+    {
+        const auto p=_postings.find(k);
+        if(p==_postings.end())
+            continue;
+        std::vector<uint32_t> &list=p->second;
+        const auto at=std::lower_bound(list.begin(), list.end(), slot);
+        if(at!=list.end() && *at==slot)
+            list.erase(at);
+        if(list.empty())
+            _postings.erase(p);
+    }
+    doc.text.clear();
+    _free.push_back(slot);
+}
+
+size_t SearchIndex::footprint() const
+{
+    size_t n=_docs.capacity()*sizeof(Doc)+_free.capacity()*sizeof(uint32_t)+_scratch.capacity()*sizeof(Key);
+    for(const Doc &d: _docs)
+        n+=size_t(d.text.capacity())*sizeof(QChar);
+    // Hash nodes hold the value and a next pointer; buckets are one pointer each
+    n+=_slotOf.size()*(sizeof(std::pair<const int, uint32_t>)+sizeof(void *))+_slotOf.bucket_count()*sizeof(void *);
+    n+=_postings.bucket_count()*sizeof(void *);
+    for(const auto &p: _postings)
+        n+=sizeof(p)+sizeof(void *)+p.second.capacity()*sizeof(uint32_t);
+    return n;
+}
+
+std::vector<int> SearchIndex::search(const QString &query, size_t limit) const
+{
+    std::vector<int> ids;
+    std::vector<const std::vector<uint32_t> *> lists;
+    std::vector<QString> confirm;   //! Words whose trigrams could come from different places
+    bool missing=false;
+    const QString q=query.toCaseFolded();
+    forEachWord(q, [&](const QChar *w, qsizetype len){
+        if(missing)
+            return;
+        if(len<3)
+        {
+            const auto *list=postings(prefixKey(w, len));
+            missing=list==nullptr;
+            lists.push_back(list);
+            return;
+        }
+        for(qsizetype i=0; i+2<len && !missing; i++)
+        {
+            const auto *list=postings(trigramKey(w+i));
+            missing=list==nullptr;
+            lists.push_back(list);
+        }
+        if(len>3)
+            confirm.emplace_back(w, len);
+    });
+    if(missing || lists.empty() || limit==0)
+        return ids;
+
+    // Shortest list first; equal lists end up next to each other for unique()
+    std::sort(lists.begin(), lists.end(), [](const auto *a, const auto *b){
+        return a->size()!=b->size() ? a->size()<b->size() : std::less<const void *>()(a, b);
+    });
+    lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+    // Candidates come in ascending order, so every other list is only ever searched forward from where the last
+    // candidate left it, galloping to bound the step
+    std::vector<size_t> at(lists.size(), 0);
+    for(uint32_t slot: *lists.front())
+    {
+        bool match=true;
+        for(size_t l=1; l<lists.size() && match; l++)
+        {
+            const std::vector<uint32_t> &list=*lists[l];
+            size_t lo=at[l], step=1;
+            while(lo+step<list.size() && list[lo+step]<slot)
+            {
+                lo+=step;
+                step*=2;
+            }
+            const auto first=list.begin()+qsizetype(lo);
+            const auto last=list.begin()+qsizetype(qMin(lo+step+1, list.size()));
+            at[l]=size_t(std::lower_bound(first, last, slot)-list.begin());
+            match=at[l]<list.size() && list[at[l]]==slot;
+        }
+        const Doc &doc=_docs[slot];
+        for(size_t w=0; w<confirm.size() && match; w++)
+            match=doc.text.contains(confirm[w]);
+        if(!match)
+            continue;
+        ids.push_back(doc.id);
+        if(ids.size()>=limit)
+            break;
+    }
+    return ids;
+}
+
+}
@@ -0,0 +1,67 @@
+#ifndef SEARCHINDEX_HPP
+#define SEARCHINDEX_HPP
+
+#include <QString>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "device.hpp"
+#include "fleetdiff.hpp"
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The SearchIndex class
+ * Inverted index over the description, location, serial and userdata values (every string and number leaf) of the
+ * devices, kept up to date from FleetDiffs like FleetAggregates.  Changes that leave those fields alone, which is
+ * nearly every change, cost nothing.
+ *
+ * Text is case folded and split into words (runs of letters and digits).  Every trigram inside a word gets a
+ * posting list, and so do the first one and two characters of every word.  A query matches devices containing all
+ * of its words: a word of three or more characters anywhere in a word of the device (trigram lists intersected,
+ * candidates confirmed against the stored text), a shorter one as the start of a word (prefix list), which is what
+ * the first keystrokes of search-as-you-type mean.
+ */
+class SearchIndex
+{
+public:
+    void reset(const std::vector<Device> &devices);
+    void apply(const FleetDiff &diff);
+
+    //! Ids of the matching devices, at most \a limit of them, in no particular order
+    std::vector<int> search(const QString &query, size_t limit=SIZE_MAX) const;
+
+    size_t size() const {return _slotOf.size();}
+    size_t keys() const {return _postings.size();}
+    //! Approximate heap bytes held by the index
+    size_t footprint() const;
+
+    //! The case folded text indexed for \a d, fields separated by newlines
+    static QString text(const Device &d);
+
+private:
+    typedef uint64_t Key;
+
+    struct Doc
+    {
+        int     id=0;
+        QString text;
+    };
+
+    void add(const Device &d);
+    void remove(int id);
+    static void keysOf(const QString &text, std::vector<Key> &out);
+    const std::vector<uint32_t> *postings(Key key) const;
+
+    std::vector<Doc>                                _docs;      //! By slot
+    std::vector<uint32_t>                           _free;      //! Slots of removed devices, reused first
+    std::unordered_map<int, uint32_t>               _slotOf;    //! Device id -> slot
+    std::unordered_map<Key, std::vector<uint32_t>>  _postings;  //! Sorted slots per key
+    std::vector<Key>                                _scratch;
+};
+
+}
+
+#endif // SEARCHINDEX_HPP
@@ -0,0 +1,67 @@
+#include "startuptrace.hpp"
+
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace InfoBeamer {
+
+static const char FIRST_PAINT[]="first paint";
+
+static QElapsedTimer &launchClock()
+{
+    static QElapsedTimer timer;
+    return timer;
+}
+
+//! In the order reached; a handful at most
+static std::vector<std::pair<const char *, qint64>> &milestones()
+{
+    static std::vector<std::pair<const char *, qint64>> reached;
+    return reached;
+}
+
+void StartupTrace::start()
+{
+    launchClock().start();
+    milestones().clear();
+}
+
+bool StartupTrace::mark(const char *milestone)
+{
+    if(!launchClock().isValid() || elapsed(milestone)>=0)
+        return false;
+    milestones().emplace_back(milestone, launchClock().elapsed());
+    return true;
+}
+
+qint64 StartupTrace::elapsed(const char *milestone)
+{
+    for(const auto &m: milestones())
+        if(std::strcmp(m.first, milestone)==0)
+            return m.second;
+    return -1;
+}
+
+qint64 StartupTrace::budgetMs()
+{
+    static const qint64 budget=qMax(0, qEnvironmentVariableIntValue("IB_STARTUP_BUDGET"));
+    return budget;
+}
+
+QString StartupTrace::report()
+{
+    QStringList parts;
+    for(const auto &m: milestones())
+        parts << QString("%1 %2 ms").arg(QString::fromLatin1(m.first)).arg(m.second);
+    QString out="startup: "+parts.join(", ");
+    const qint64 paint=elapsed(FIRST_PAINT);
+    if(budgetMs()>0 && paint>budgetMs())
+        out+=QString(" (first paint over the budget of %1 ms)").arg(budgetMs());
+    return out;
+}
+
+}
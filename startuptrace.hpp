@@ -0,0 +1,34 @@
+#ifndef STARTUPTRACE_HPP
+#define STARTUPTRACE_HPP
+
+#include <QString>
+#include <QtGlobal>
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The StartupTrace class
+ * Milestones of a launch, timed from start() at the top of main().  The window marks "first paint" once it has been
+ * drawn and "first data" once the first response is on screen.
+ *
+ * IB_STARTUP_BUDGET sets a cold-start budget in milliseconds for the first paint; report() says when it was missed.
+ */
+class StartupTrace
+{
+public:
+    static void start();
+
+    //! Records \a milestone the first time only; false if it was recorded before
+    static bool mark(const char *milestone);
+    //! Milliseconds from start() to \a milestone, -1 if it was not reached
+    static qint64 elapsed(const char *milestone);
+
+    //! 0 for none
+    static qint64 budgetMs();
+    //! "startup: window 41 ms, first paint 88 ms, ..."
+    static QString report();
+};
+
+}
+
+#endif // STARTUPTRACE_HPP
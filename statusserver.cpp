@@ -0,0 +1,425 @@
+#include "statusserver.hpp"
+
+#include <QDebug>
+#include <QTcpSocket>
+
+#include "apiclient.hpp"
+#include "deviceexport.hpp"
+#include "devicequery.hpp"
+#include "fleetpoller.hpp"
+#include "fleetstore.hpp"
+#include "jsonparser.hpp"
+#include "memoryaccounting.hpp"
+
+namespace InfoBeamer {
+
+static const qsizetype MAX_HEAD=16*1024;
+//! Distinct filtered bodies kept per generation before the cache starts over
+static const int MAX_CACHED_BODIES=256;
+
+static QByteArray reason(int status)
+{
+    switch(status)
+    {
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    default:  return "Unknown";
+    }
+}
+
+static QByteArray escapeLabel(const std::string &v)
+{
+    QByteArray out;
+    for(const char c: v)
+    {
+        if(c=='\\' || c=='"')
+            out+='\\';
+        if(c=='\n')
+            out+="\\n";
+        else
+            out+=c;
+    }
+    return out;
+}
+
+/*!
+ * \brief The Metric struct
+ * Appends one Prometheus metric family.
+ */
+struct Metric
+{
+    QByteArray &out;
+
+    Metric(QByteArray &o, const char *name, const char *type, const char *help) : out(o)
+    {
+        out+=QByteArray("# HELP ")+name+' '+help+"\n# TYPE "+name+' '+type+'\n';
+    }
+    Metric &sample(const char *name, double v, const QByteArray &labels=QByteArray())
+    {
+        out+=name;
+        if(!labels.isEmpty())
+            out+='{'+labels+'}';
+        out+=' '+QByteArray::number(v, 'g', 15)+'\n';
+        return *this;
+    }
+};
+
+StatusServer::StatusServer(ApiClient *api, QObject *parent)
+    : QTcpServer(parent)
+    , _api(api)
+{
+}
+
+void StatusServer::setPoller(FleetPoller *poller)
+{
+    _poller=poller;
+    connect(poller, &FleetPoller::pollFailed, this, [this]{_pollFailures++;});
+}
+
+void StatusServer::setStore(FleetStore *store)
+{
+    _store=store;
+    connect(store, &FleetStore::accountFailed, this, [this](const QString &account){_accountFailures[account]++;});
+}
+
+void StatusServer::incomingConnection(qintptr socketDescriptor)
+{
+    auto *socket=new QTcpSocket(this);
+    if(!socket->setSocketDescriptor(socketDescriptor))
+    {
+        delete socket;
+        return;
+    }
+    connect(socket, &QTcpSocket::readyRead, this, [this, socket]{readRequests(socket);});
+    connect(socket, &QTcpSocket::disconnected, this, [this, socket]{
+        _in.remove(socket);
+        socket->deleteLater();
+    });
+}
+
+void StatusServer::readRequests(QTcpSocket *socket)
+{
+    QByteArray &in=_in[socket];
+    in+=socket->readAll();
+    for(;;)
+    {
+        const qsizetype end=in.indexOf("\r\n\r\n");
+        if(end<0)
+        {
+            if(in.size()>MAX_HEAD)
+            {
+                _in.remove(socket);
+                socket->abort();
+            }
+            return;
+        }
+        const QList<QByteArray> lines=in.left(end).split('\n');
+        in.remove(0, end+4);
+
+        const QList<QByteArray> start=lines.first().trimmed().split(' ');
+        QByteArray ifNoneMatch;
+        bool keepAlive=start.value(2)=="HTTP/1.1";
+        for(qsizetype i=1; i<lines.size(); i++)
+        {
+            const qsizetype colon=lines[i].indexOf(':');
+            const QByteArray name=lines[i].left(colon).trimmed().toLower();
+            const QByteArray value=lines[i].mid(colon+1).trimmed();
+            if(name=="if-none-match")
+                ifNoneMatch=value;
+            else if(name=="connection")
+                keepAlive=value.toLower()!="close";
+        }
+
+        _stats.requests++;
+        const QByteArray method=start.value(0);
+        const Response res=start.size()==3 ? handle(method, start[1], ifNoneMatch) : Response{400, "text/plain", "", ""};
+        QByteArray head="HTTP/1.1 "+QByteArray::number(res.status)+' '+reason(res.status)+"\r\n";
+        head+="Content-Type: "+res.contentType+"\r\n";
+        head+="Content-Length: "+QByteArray::number(res.body.size())+"\r\n";
+        if(!res.etag.isEmpty())
+            head+="ETag: "+res.etag+"\r\n";
+        head+="Cache-Control: no-cache\r\n";
+        head+=keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+        socket->write(head);
+        if(method!="HEAD")
+            socket->write(res.body);
+        if(!keepAlive)
+        {
+            socket->disconnectFromHost();
+            return;
+        }
+    }
+}
+
+StatusServer::Response StatusServer::handle(const QByteArray &method, const QByteArray &target,
+                                            const QByteArray &ifNoneMatch)
+{
+    if(method!="GET" && method!="HEAD")
+        return Response{405, "text/plain", "GET or HEAD only\n", ""};
+
+    const qsizetype q=target.indexOf('?');
+    const QByteArray path=q<0 ? target : target.left(q);
+    const QByteArray query=q<0 ? QByteArray() : target.mid(q+1);
+
+    refresh();
+    if(path=="/healthz")
+        return Response{200, "text/plain", "ok\n", ""};
+    if(path=="/metrics")
+        return Response{200, "text/plain; version=0.0.4", metrics(), ""};
+    if(path!="/devices" && path!="/devices.ndjson")
+        return Response{404, "text/plain", "not found\n", ""};
+
+    Response res=devices(query, path.endsWith(".ndjson"));
+    if(res.status==200 && !ifNoneMatch.isEmpty() && ifNoneMatch==res.etag)
+    {
+        _stats.notModified++;
+        res.status=304;
+        res.body.clear();
+    }
+    return res;
+}
+
+StatusServer::Response StatusServer::devices(const QByteArray &query, bool ndjson)
+{
+    QString error;
+    const DeviceQuery filter=DeviceQuery::parse(query, &error);
+    if(!error.isEmpty())
+        return Response{400, "text/plain", error.toUtf8()+'\n', ""};
+
+    const QByteArray key=(ndjson ? "n?" : "j?")+filter.canonical();
+    Response res;
+    res.contentType=ndjson ? "application/x-ndjson" : "application/json";
+    res.etag='"'+QByteArray::number(qulonglong(_generation))+'-'+QByteArray::number(qHash(key), 16)+'"';
+
+    const auto cached=_bodies.constFind(key);
+    if(cached!=_bodies.constEnd())
+    {
+        _stats.cacheHits++;
+        res.body=cached.value();
+        return res;
+    }
+
+    if(ndjson && filter.matchesAll())
+        res.body=_ndjson;
+    else
+    {
+        std::vector<size_t> rows;
+        if(filter.matchesAll())
+        {
+            rows.resize(_devices.size());
+            for(size_t i=0; i<rows.size(); i++)
+                rows[i]=i;
+        }
+        else
+            rows=filter.select(_devices);
+
+        qsizetype size=2;
+        for(const size_t r: rows)
+            size+=_lineStart[r+1]-_lineStart[r];
+        res.body.reserve(size);
+        if(!ndjson)
+            res.body+='[';
+        for(const size_t r: rows)
+        {
+            const qsizetype len=_lineStart[r+1]-_lineStart[r];
+            if(ndjson)
+                res.body.append(_ndjson.constData()+_lineStart[r], len);
+            else
+            {
+                // Lines end in '\n', which becomes the separator
+                res.body.append(_ndjson.constData()+_lineStart[r], len-1);
+                res.body+=',';
+            }
+        }
+        if(!ndjson)
+        {
+            if(rows.empty())
+                res.body+=']';
+            else
+                res.body.back()=']';
+        }
+    }
+
+    if(_bodies.size()>=MAX_CACHED_BODIES)
+        _bodies.clear();
+    _bodies.insert(key, res.body);
+    return res;
+}
+
+qint64 StatusServer::footprint() const
+{
+    qint64 n=qint64(Device::footprint(_devices))+_ndjson.capacity()+qint64(_lineStart.capacity()*sizeof(qsizetype));
+    for(auto b=_bodies.constBegin(); b!=_bodies.constEnd(); ++b)
+        n+=b.key().capacity()+b.value().capacity();
+    return n;
+}
+
+void StatusServer::releaseCache()
+{
+    _devices=std::vector<Device>();
+    _ndjson=QByteArray();
+    _lineStart.assign(1, 0);
+    _lineStart.shrink_to_fit();
+    _bodies.clear();
+    _bodies.squeeze();
+    _generation=UINT64_MAX;
+}
+
+void StatusServer::refresh()
+{
+    {
+        const Device::Fleet::ReadGuard fleet=Device::snapshot();
+        if(fleet.generation()==_generation)
+            return;
+        _generation=fleet.generation();
+        // A private copy, so no generation stays pinned between requests
+        _devices=*fleet;
+    }
+    _stats.rebuilds++;
+    _bodies.clear();
+
+    _ndjson.clear();
+    {
+        DeviceExporter e(DeviceExporter::Format::NDJSON, [this](const char *data, size_t len){
+            _ndjson.append(data, qsizetype(len));
+        });
+        e.write(_devices);
+        e.finish();
+    }
+    // Strings are escaped, so every raw newline ends a device
+    _lineStart.assign(1, 0);
+    for(qsizetype i=0; i<_ndjson.size(); i++)
+        if(_ndjson[i]=='\n')
+            _lineStart.push_back(i+1);
+    if(_lineStart.size()!=_devices.size()+1)
+    {
+        qDebug() << __func__ << "NDJSON has" << _lineStart.size()-1 << "lines for" << _devices.size() << "devices";
+        _devices.clear();
+        _ndjson.clear();
+        _lineStart.assign(1, 0);
+    }
+
+    // Without a poller there are no diffs to follow, so the counters are rebuilt with the cache
+    if(_poller==nullptr)
+        _aggregates.reset(_devices, time(nullptr));
+}
+
+QByteArray StatusServer::metrics()
+{
+    QByteArray out;
+    FleetAggregates &agg=_poller!=nullptr ? _poller->aggregates() : _aggregates;
+    const time_t now=time(nullptr);
+    Metric(out, "infobeamer_devices", "gauge", "Devices in the fleet.")
+        .sample("infobeamer_devices", double(agg.devices()));
+    Metric(out, "infobeamer_devices_online", "gauge", "Devices currently online.")
+        .sample("infobeamer_devices_online", double(agg.online()));
+    Metric(out, "infobeamer_devices_maintenance", "gauge", "Devices with a maintenance flag set.")
+        .sample("infobeamer_devices_maintenance", double(agg.maintenance()));
+    Metric(out, "infobeamer_devices_upgrade_blocked", "gauge", "Devices whose OS upgrade is blocked.")
+        .sample("infobeamer_devices_upgrade_blocked", double(agg.upgradeBlocked()));
+    Metric(out, "infobeamer_devices_restarted_recently", "gauge", "Devices that restarted within the last hour.")
+        .sample("infobeamer_devices_restarted_recently", double(agg.restarts(now)));
+    Metric per(out, "infobeamer_channel_devices", "gauge", "Devices per release channel and state.");
+    for(const auto &c: agg.channels())
+    {
+        const QByteArray channel=escapeLabel(c.first);
+        per.sample("infobeamer_channel_devices", double(c.second.online), "channel=\""+channel+"\",online=\"true\"");
+        per.sample("infobeamer_channel_devices", double(c.second.offline), "channel=\""+channel+"\",online=\"false\"");
+    }
+    Metric version(out, "infobeamer_version_devices", "gauge", "Devices per running OS version.");
+    for(const auto &v: agg.versions())
+        version.sample("infobeamer_version_devices", double(v.second), "version=\""+escapeLabel(v.first)+"\"");
+    Metric(out, "infobeamer_fleet_generation", "gauge", "Number of the published fleet generation.")
+        .sample("infobeamer_fleet_generation", double(_generation));
+
+    const ApiClient::Stats &api=_api->stats();
+    Metric(out, "infobeamer_api_requests_total", "counter", "API requests issued.")
+        .sample("infobeamer_api_requests_total", double(api.requests));
+    Metric(out, "infobeamer_api_first_latency_ms", "gauge", "Latency of the first API reply.")
+        .sample("infobeamer_api_first_latency_ms", double(api.firstLatencyMs));
+    Metric(out, "infobeamer_api_latency_ms", "gauge", "Mean latency of the API replies after the first.")
+        .sample("infobeamer_api_latency_ms", api.steadyLatencyMs());
+    Metric(out, "infobeamer_api_wire_bytes_total", "counter", "Response bytes received.")
+        .sample("infobeamer_api_wire_bytes_total", double(api.wireBytes));
+    Metric(out, "infobeamer_api_decoded_bytes_total", "counter", "Response bytes after decompression.")
+        .sample("infobeamer_api_decoded_bytes_total", double(api.decodedBytes));
+
+    const JsonParser::Stats parse=JsonParser::stats();
+    Metric(out, "infobeamer_parse_seconds_total", "counter", "Time spent parsing JSON.")
+        .sample("infobeamer_parse_seconds_total", double(parse.nanoseconds)/1e9);
+    Metric(out, "infobeamer_parse_bytes_total", "counter", "JSON bytes parsed.")
+        .sample("infobeamer_parse_bytes_total", double(parse.bytes));
+    Metric(out, "infobeamer_parse_last_seconds", "gauge", "Time the most recent parse took.")
+        .sample("infobeamer_parse_last_seconds", double(parse.lastNanoseconds)/1e9);
+
+    if(_poller!=nullptr)
+    {
+        Metric(out, "infobeamer_refresh_interval_seconds", "gauge", "Current fleet refresh interval.")
+            .sample("infobeamer_refresh_interval_seconds", _poller->interval()/1000.0);
+        Metric(out, "infobeamer_refresh_failures_total", "counter", "Failed fleet refreshes.")
+            .sample("infobeamer_refresh_failures_total", double(_pollFailures));
+
+        const DecodeDrift &drift=_poller->drift();
+        const auto total=[](const std::map<std::string, uint64_t> &m){
+            double n=0;
+            for(const auto &e: m)
+                n+=double(e.second);
+            return n;
+        };
+        Metric(out, "infobeamer_decode_devices_total", "counter", "Devices decoded, by decode path.")
+            .sample("infobeamer_decode_devices_total", double(drift.fastPath), "path=\"fast\"")
+            .sample("infobeamer_decode_devices_total", double(drift.slowPath), "path=\"slow\"")
+            .sample("infobeamer_decode_devices_total", double(drift.dropped), "path=\"dropped\"");
+        Metric(out, "infobeamer_decode_drift_total", "counter", "Schema deviations seen while decoding, by kind.")
+            .sample("infobeamer_decode_drift_total", total(drift.unknownKeys), "kind=\"unknown_key\"")
+            .sample("infobeamer_decode_drift_total", total(drift.typeChanges), "kind=\"type_change\"")
+            .sample("infobeamer_decode_drift_total", total(drift.missingFields), "kind=\"missing_field\"");
+    }
+
+    if(_store!=nullptr && _store->accounts()>0)
+    {
+        const QStringList accounts=_store->accountNames();
+        Metric devices(out, "infobeamer_account_devices", "gauge", "Devices per monitored account.");
+        for(const QString &a: accounts)
+            devices.sample("infobeamer_account_devices", double(_store->devices(a).size()),
+                           "account=\""+escapeLabel(a.toStdString())+"\"");
+        Metric failures(out, "infobeamer_account_refresh_failures_total", "counter",
+                        "Failed refreshes per monitored account.");
+        for(const QString &a: accounts)
+            failures.sample("infobeamer_account_refresh_failures_total", double(_accountFailures.value(a)),
+                            "account=\""+escapeLabel(a.toStdString())+"\"");
+    }
+
+    if(_memory!=nullptr)
+    {
+        const QList<MemoryAccounting::Usage> usage=_memory->usage();
+        Metric bytes(out, "infobeamer_memory_bytes", "gauge", "Approximate memory held, by subsystem.");
+        for(const MemoryAccounting::Usage &u: usage)
+            bytes.sample("infobeamer_memory_bytes", double(u.bytes), "subsystem=\""+u.name.toUtf8()+"\"");
+        Metric budget(out, "infobeamer_memory_budget_bytes", "gauge", "Memory budget, by subsystem; 0 for none.");
+        for(const MemoryAccounting::Usage &u: usage)
+            budget.sample("infobeamer_memory_budget_bytes", double(u.budget), "subsystem=\""+u.name.toUtf8()+"\"");
+        budget.sample("infobeamer_memory_budget_bytes", double(_memory->totalBudget()), "subsystem=\"total\"");
+        Metric evictions(out, "infobeamer_memory_evictions_total", "counter", "Evictions, by subsystem.");
+        for(const MemoryAccounting::Usage &u: usage)
+            evictions.sample("infobeamer_memory_evictions_total", double(u.evictions),
+                             "subsystem=\""+u.name.toUtf8()+"\"");
+        const qint64 rss=MemoryAccounting::residentBytes();
+        if(rss>=0)
+            Metric(out, "infobeamer_memory_resident_bytes", "gauge", "Resident set size of the process.")
+                .sample("infobeamer_memory_resident_bytes", double(rss));
+    }
+
+    Metric(out, "infobeamer_status_requests_total", "counter", "Requests served by this endpoint.")
+        .sample("infobeamer_status_requests_total", double(_stats.requests));
+    Metric(out, "infobeamer_status_cache_hits_total", "counter", "Device bodies served from the cache.")
+        .sample("infobeamer_status_cache_hits_total", double(_stats.cacheHits));
+    Metric(out, "infobeamer_status_rebuilds_total", "counter", "Times the fleet was serialized.")
+        .sample("infobeamer_status_rebuilds_total", double(_stats.rebuilds));
+    return out;
+}
+
+}
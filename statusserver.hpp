@@ -0,0 +1,102 @@
+#ifndef STATUSSERVER_HPP
+#define STATUSSERVER_HPP
+
+#include <QTcpServer>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+
+#include <cstdint>
+#include <vector>
+
+#include "device.hpp"
+#include "fleetaggregates.hpp"
+
+class QTcpSocket;
+
+namespace InfoBeamer {
+
+class ApiClient;
+class FleetPoller;
+class FleetStore;
+class MemoryAccounting;
+
+/*!
+ * \brief The StatusServer class
+ * Small embedded HTTP/1.1 server exposing the published fleet (Device::snapshot()) to other tools:
+ *
+ *  GET /devices          JSON array           GET /devices.ndjson   one device per line
+ *  GET /metrics          Prometheus text      GET /healthz
+ *
+ * /devices takes DeviceQuery parameters.  Nothing is serialized per request: when the fleet generation changes the
+ * whole fleet is serialized once into an NDJSON buffer with per-device line offsets, and every response, filtered
+ * or not, is assembled from slices of it.  Assembled bodies are cached per query until the next generation, and
+ * ETag / If-None-Match lets scrapers skip unchanged bodies altogether.
+ */
+class StatusServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    struct Stats
+    {
+        quint64 requests=0;
+        quint64 notModified=0;
+        quint64 rebuilds=0;     //! Times the fleet was serialized
+        quint64 cacheHits=0;
+    };
+
+    explicit StatusServer(ApiClient *api, QObject *parent=nullptr);
+
+    //! For refresh interval, failure and decode metrics, and the fleet counters it maintains; optional
+    void setPoller(FleetPoller *poller);
+    //! For device and failure metrics per monitored account; optional
+    void setStore(FleetStore *store);
+    //! For memory metrics; optional
+    void setMemory(MemoryAccounting *memory) {_memory=memory;}
+
+    //! Approximate bytes held by the serialized fleet and the cached bodies
+    qint64 footprint() const;
+    //! Drops the serialized fleet and the cached bodies; the next request rebuilds them
+    void releaseCache();
+
+    const Stats &stats() const {return _stats;}
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private:
+    struct Response
+    {
+        int        status=200;
+        QByteArray contentType="application/json";
+        QByteArray body;
+        QByteArray etag;
+    };
+
+    void readRequests(QTcpSocket *socket);
+    Response handle(const QByteArray &method, const QByteArray &target, const QByteArray &ifNoneMatch);
+    Response devices(const QByteArray &query, bool ndjson);
+    QByteArray metrics();
+    void refresh();
+
+    ApiClient                  *_api;
+    FleetPoller                *_poller=nullptr;
+    MemoryAccounting           *_memory=nullptr;
+    quint64                     _pollFailures=0;
+    FleetStore                 *_store=nullptr;
+    QHash<QString, quint64>     _accountFailures;
+    QHash<QTcpSocket *, QByteArray> _in;
+
+    // Cache for one fleet generation
+    uint64_t                    _generation=UINT64_MAX;
+    std::vector<Device>         _devices;
+    QByteArray                  _ndjson;        //! Whole fleet, one line per device
+    std::vector<qsizetype>      _lineStart;     //! Offsets into _ndjson, one past the end last
+    FleetAggregates             _aggregates;    //! Only used without a poller
+    QHash<QByteArray, QByteArray> _bodies;      //! Assembled bodies by format and canonical query
+    Stats                       _stats;
+};
+
+}
+
+#endif // STATUSSERVER_HPP
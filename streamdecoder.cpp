@@ -0,0 +1,236 @@
+#include "streamdecoder.hpp"
+
+#include <zlib.h>
+
+#ifdef IB_HAVE_BROTLI
+#include <brotli/decode.h>
+#endif
+#ifdef IB_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace InfoBeamer {
+
+//! Output is decoded in steps of at least this many bytes directly into the caller's buffer
+static const size_t MIN_OUT_STEP=64*1024;
+
+struct StreamDecoder::State
+{
+    bool     fed=false;     //! Any input at all
+    bool     ended=false;   //! The stream is at its end (zlib, zstd)
+    z_stream z;
+    bool     zInit=false;
+#ifdef IB_HAVE_BROTLI
+    BrotliDecoderState *br=nullptr;
+#endif
+#ifdef IB_HAVE_ZSTD
+    ZSTD_DStream *zs=nullptr;
+#endif
+};
+
+static inline size_t outStep(size_t inLen)
+{
+    // JSON typically inflates 10-20x, so size the step to the input to avoid many small resizes
+    return inLen*8>MIN_OUT_STEP ? inLen*8 : MIN_OUT_STEP;
+}
+
+StreamDecoder::StreamDecoder(Encoding e)
+    : _encoding(e)
+    , _state(new State)
+{
+    switch(e)
+    {
+    case Encoding::Identity:
+    case Encoding::Gzip:
+    case Encoding::Deflate:
+        // zlib is set up on the first chunk, once a deflate stream can be told apart from raw deflate
+        break;
+#ifdef IB_HAVE_BROTLI
+    case Encoding::Brotli:
+        _state->br=BrotliDecoderCreateInstance(nullptr, nullptr, nullptr);
+        _failed=_state->br==nullptr;
+        break;
+#endif
+#ifdef IB_HAVE_ZSTD
+    case Encoding::Zstd:
+        _state->zs=ZSTD_createDStream();
+        _failed=_state->zs==nullptr || ZSTD_isError(ZSTD_initDStream(_state->zs));
+        break;
+#endif
+    default:
+        _failed=true;
+        break;
+    }
+}
+
+StreamDecoder::~StreamDecoder()
+{
+    if(_state->zInit)
+        inflateEnd(&_state->z);
+#ifdef IB_HAVE_BROTLI
+    if(_state->br!=nullptr)
+        BrotliDecoderDestroyInstance(_state->br);
+#endif
+#ifdef IB_HAVE_ZSTD
+    if(_state->zs!=nullptr)
+        ZSTD_freeDStream(_state->zs);
+#endif
+}
+
+StreamDecoder::Encoding StreamDecoder::fromHeader(const QByteArray &contentEncoding)
+{
+    const QByteArray e=contentEncoding.trimmed().toLower();
+    if(e.isEmpty() || e=="identity")
+        return Encoding::Identity;
+    if(e=="gzip" || e=="x-gzip")
+        return Encoding::Gzip;
+    if(e=="deflate")
+        return Encoding::Deflate;
+#ifdef IB_HAVE_BROTLI
+    if(e=="br")
+        return Encoding::Brotli;
+#endif
+#ifdef IB_HAVE_ZSTD
+    if(e=="zstd")
+        return Encoding::Zstd;
+#endif
+    return Encoding::Unsupported;
+}
+
+QByteArray StreamDecoder::acceptEncoding()
+{
+    QByteArray v;
+#ifdef IB_HAVE_ZSTD
+    v+="zstd, ";
+#endif
+#ifdef IB_HAVE_BROTLI
+    v+="br, ";
+#endif
+    v+="gzip, deflate";
+    return v;
+}
+
+bool StreamDecoder::feed(const char *data, size_t len, QByteArray &out)
+{
+    if(_failed)
+        return false;
+    if(len==0)
+        return true;
+    _state->fed=true;
+
+    if(_encoding==Encoding::Identity)
+    {
+        out.append(data, qsizetype(len));
+        return true;
+    }
+
+    const size_t step=outStep(len);
+
+    if(_encoding==Encoding::Gzip || _encoding==Encoding::Deflate)
+    {
+        z_stream &z=_state->z;
+        if(!_state->zInit)
+        {
+            z=z_stream();
+            // 15+32 auto-detects gzip and zlib headers.  Some servers send "deflate" without the zlib wrapper.
+            int windowBits=15+32;
+            if(_encoding==Encoding::Deflate && len>=2)
+            {
+                const unsigned cmf=uchar(data[0]);
+                const unsigned flg=uchar(data[1]);
+                if((cmf & 0x0f)!=8 || (cmf*256+flg)%31!=0)
+                    windowBits=-15;
+            }
+            if(inflateInit2(&z, windowBits)!=Z_OK)
+                return !(_failed=true);
+            _state->zInit=true;
+        }
+        z.next_in=reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        z.avail_in=uInt(len);
+        do
+        {
+            const qsizetype old=out.size();
+            out.resize(old+qsizetype(step));
+            z.next_out=reinterpret_cast<Bytef *>(out.data()+old);
+            z.avail_out=uInt(step);
+            const int r=inflate(&z, Z_NO_FLUSH);
+            out.resize(old+qsizetype(step-z.avail_out));
+            if(r==Z_STREAM_END)
+            {
+                _state->ended=true;
+                // Concatenated gzip members are legal
+                if(z.avail_in==0 || inflateReset(&z)!=Z_OK)
+                    break;
+                _state->ended=false;
+                continue;
+            }
+            if(r==Z_BUF_ERROR)
+                break;
+            if(r!=Z_OK)
+                return !(_failed=true);
+        } while(z.avail_in>0 || z.avail_out==0);
+        return true;
+    }
+
+#ifdef IB_HAVE_BROTLI
+    if(_encoding==Encoding::Brotli)
+    {
+        size_t availIn=len;
+        const uint8_t *nextIn=reinterpret_cast<const uint8_t *>(data);
+        for(;;)
+        {
+            const qsizetype old=out.size();
+            out.resize(old+qsizetype(step));
+            size_t availOut=step;
+            uint8_t *nextOut=reinterpret_cast<uint8_t *>(out.data()+old);
+            const BrotliDecoderResult r=BrotliDecoderDecompressStream(_state->br, &availIn, &nextIn,
+                                                                      &availOut, &nextOut, nullptr);
+            out.resize(old+qsizetype(step-availOut));
+            if(r==BROTLI_DECODER_RESULT_ERROR)
+                return !(_failed=true);
+            if(r!=BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT)
+                return true;
+        }
+    }
+#endif
+
+#ifdef IB_HAVE_ZSTD
+    if(_encoding==Encoding::Zstd)
+    {
+        ZSTD_inBuffer in={data, len, 0};
+        for(;;)
+        {
+            const qsizetype old=out.size();
+            out.resize(old+qsizetype(step));
+            ZSTD_outBuffer o={out.data()+old, step, 0};
+            const size_t r=ZSTD_decompressStream(_state->zs, &o, &in);
+            out.resize(old+qsizetype(o.pos));
+            if(ZSTD_isError(r))
+                return !(_failed=true);
+            // 0 once a frame is decoded and flushed completely
+            _state->ended=r==0;
+            if(in.pos==in.size && o.pos<o.size)
+                return true;
+        }
+    }
+#endif
+
+    return !(_failed=true);
+}
+
+bool StreamDecoder::finish()
+{
+    if(_failed)
+        return false;
+    // An empty body is taken as it is; servers label bodyless answers with the encoding as well
+    if(_encoding==Encoding::Identity || !_state->fed)
+        return true;
+    bool complete=_state->ended;
+#ifdef IB_HAVE_BROTLI
+    if(_encoding==Encoding::Brotli)
+        complete=BrotliDecoderIsFinished(_state->br);
+#endif
+    return complete || !(_failed=true);
+}
+
+}
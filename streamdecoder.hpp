@@ -0,0 +1,70 @@
+#ifndef STREAMDECODER_HPP
+#define STREAMDECODER_HPP
+
+#include <cstddef>
+#include <memory>
+
+#include <QByteArray>
+
+namespace InfoBeamer {
+
+/*!
+ * \brief The StreamDecoder class
+ * Incremental Content-Encoding decoder.  Each chunk handed to feed() is decoded straight onto the end of the
+ * caller's buffer, so a compressed body is never held in memory as a whole, only the decoded bytes the parser needs.
+ *
+ * gzip and deflate are always available (zlib).  Brotli and zstd are compiled in when qmake finds the libraries
+ * (IB_HAVE_BROTLI / IB_HAVE_ZSTD) and only advertised in acceptEncoding() if they are.
+ */
+class StreamDecoder
+{
+public:
+    enum class Encoding
+    {
+        Identity=0,
+        Gzip,
+        Deflate,
+        Brotli,
+        Zstd,
+        Unsupported
+    };
+
+    explicit StreamDecoder(Encoding e);
+    ~StreamDecoder();
+    StreamDecoder(const StreamDecoder &)=delete;
+    StreamDecoder &operator=(const StreamDecoder &)=delete;
+
+    /*!
+     * \brief feed
+     * Decodes \a len bytes at \a data and appends the result to \a out.  Returns false on corrupt input; the decoder
+     * is unusable afterwards.
+     */
+    bool feed(const char *data, size_t len, QByteArray &out);
+    bool feed(const QByteArray &chunk, QByteArray &out) {return feed(chunk.constData(), size_t(chunk.size()), out);}
+
+    /*!
+     * \brief finish
+     * To be called once the input is complete.  Returns false, and fails the decoder, if the compressed stream stopped
+     * short of its end (Z_STREAM_END, or the brotli / zstd equivalent): the body was cut off.
+     */
+    bool finish();
+
+    Encoding encoding() const {return _encoding;}
+    bool failed() const {return _failed;}
+
+    static Encoding fromHeader(const QByteArray &contentEncoding);
+
+    //! Value for the Accept-Encoding request header, best codec first
+    static QByteArray acceptEncoding();
+
+private:
+    struct State;
+
+    Encoding               _encoding;
+    bool                   _failed=false;
+    std::unique_ptr<State> _state;
+};
+
+}
+
+#endif // STREAMDECODER_HPP
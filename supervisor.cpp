@@ -0,0 +1,222 @@
+#include "supervisor.hpp"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+
+#ifdef Q_OS_LINUX
+#include <signal.h>
+#include <sys/prctl.h>
+#endif
+
+namespace InfoBeamer {
+
+//! How long stop() waits for a worker to exit before it kills it
+static const int TERMINATE_TIMEOUT_MS=3000;
+
+Supervisor::Supervisor(const QString &prefix, int workers, QObject *parent)
+    : QObject(parent)
+    , _prefix(prefix)
+    , _directory(prefix)
+    , _workers(size_t(qBound(1, workers, int(FleetSegmentDirectory::MAX_SHARDS))))
+{
+}
+
+Supervisor::~Supervisor()
+{
+    stop();
+}
+
+bool Supervisor::start(QString *error)
+{
+    _stopping=false;
+    if(!_directory.create(workers()))
+    {
+        if(error)
+            *error=QString("cannot create %1: %2").arg(_prefix, _directory.errorString());
+        return false;
+    }
+    for(int shard=0; shard<workers(); shard++)
+    {
+        QString why;
+        if(!createSegment(shard, 0, _segmentBytes, &why))
+        {
+            if(error)
+                *error=QString("cannot create the segment of shard %1: %2").arg(shard).arg(why);
+            return false;
+        }
+    }
+    for(int shard=0; shard<workers(); shard++)
+        launch(shard);
+    return true;
+}
+
+void Supervisor::stop()
+{
+    _stopping=true;
+    for(Worker &w: _workers)
+    {
+        if(!w.process)
+            continue;
+        w.process->disconnect(this);
+        w.process->terminate();
+        if(!w.process->waitForFinished(TERMINATE_TIMEOUT_MS))
+            w.process->kill();
+        w.process->deleteLater();
+        w.process=nullptr;
+    }
+}
+
+bool Supervisor::createSegment(int shard, int epoch, qint64 bytes, QString *error)
+{
+    Worker &w=_workers[size_t(shard)];
+    auto segment=std::make_unique<FleetSegment>(FleetSegmentDirectory::segmentKey(_prefix, shard, epoch));
+    const bool ok=segment->create(bytes);
+    if(!ok && error)
+        *error=segment->errorString();
+    if(ok || !w.segment)
+    {
+        w.segment=std::move(segment);
+        w.epoch=epoch;
+    }
+    if(ok)
+        _directory.setEpoch(shard, epoch);
+    return ok;
+}
+
+void Supervisor::launch(int shard)
+{
+    Worker &w=_workers[size_t(shard)];
+    auto *p=new QProcess(this);
+    p->setProcessChannelMode(QProcess::ForwardedChannels);
+    p->setProgram(QCoreApplication::applicationFilePath());
+    p->setArguments({"--worker", QString::number(shard), "--shards", QString::number(workers()),
+                     "--segment", w.segment->key()});
+    connect(p, &QProcess::started, this, [this, p, shard]{emit workerStarted(shard, p->processId());});
+    connect(p, &QProcess::finished, this, [this, shard](int exitCode, QProcess::ExitStatus status){
+        exited(shard, exitCode, status);
+    });
+    connect(p, &QProcess::errorOccurred, this, [this, shard](QProcess::ProcessError e){
+        // finished() does not follow a failed start
+        if(e==QProcess::FailedToStart)
+            exited(shard, -1, QProcess::CrashExit);
+    });
+    w.process=p;
+    w.up.start();
+    p->start();
+}
+
+void Supervisor::exited(int shard, int exitCode, QProcess::ExitStatus status)
+{
+    Worker &w=_workers[size_t(shard)];
+    if(w.process)
+    {
+        w.process->deleteLater();
+        w.process=nullptr;
+    }
+    if(_stopping)
+        return;
+    const bool crashed=status==QProcess::CrashExit;
+    emit workerExited(shard, exitCode, crashed);
+
+    if(!crashed && exitCode==EXIT_RESIZE)
+    {
+        const qint64 bytes=qMax<qint64>(w.segment->capacity(), qint64(w.segment->required()))*2;
+        qDebug() << __func__ << "shard" << shard << "outgrew" << w.segment->capacity() << "bytes, moving to" << bytes;
+        QString why;
+        if(createSegment(shard, w.epoch+1, bytes, &why))
+        {
+            launch(shard);
+            return;
+        }
+        // Restarting on the segment it outgrew would only have it exit with EXIT_RESIZE again
+        const QString error=QString("shard %1 needs a %2 MB segment and none could be created (%3); its accounts "
+                                    "are not polled until the supervisor is restarted with more shared memory")
+                .arg(shard).arg((bytes+1024*1024-1)/(1024*1024)).arg(why);
+        qCritical() << __func__ << error;
+        emit workerFailed(shard, error);
+        return;
+    }
+
+    if(w.up.isValid() && w.up.elapsed()>=STABLE_MS)
+        w.backoffMs=MIN_BACKOFF_MS;
+    qDebug() << __func__ << "shard" << shard << (crashed ? "crashed" : "exited with") << exitCode
+             << ", restarting in" << w.backoffMs << "ms";
+    w.restarts++;
+    QTimer::singleShot(w.backoffMs, this, [this, shard]{
+        if(!_stopping && !_workers[size_t(shard)].process)
+            launch(shard);
+    });
+    w.backoffMs=qMin(w.backoffMs*2, int(MAX_BACKOFF_MS));
+}
+
+ShardWorker::ShardWorker(ApiClient *api, int shard, int shards, const QString &segmentKey, QObject *parent)
+    : QObject(parent)
+    , _store(api)
+    , _segment(segmentKey)
+    , _shard(shard)
+    , _shards(shards)
+{
+    _publish.setSingleShot(true);
+    _publish.setInterval(PUBLISH_DELAY_MS);
+    connect(&_publish, &QTimer::timeout, this, &ShardWorker::publish);
+    connect(&_store, &FleetStore::accountChanged, this, [this]{_publish.start();});
+    connect(&_store, &FleetStore::accountFailed, this, [](const QString &account, const QString &error){
+        qDebug() << "account" << account << "refresh failed:" << error;
+    });
+}
+
+std::vector<Account> ShardWorker::share(const std::vector<Account> &accounts, int shard, int shards)
+{
+    std::vector<Account> mine;
+    for(size_t i=size_t(shard); i<accounts.size(); i+=size_t(qMax(1, shards)))
+        mine.push_back(accounts[i]);
+    return mine;
+}
+
+bool ShardWorker::start(QString *error)
+{
+#ifdef Q_OS_LINUX
+    // Not to outlive a supervisor that was killed
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+    if(!_segment.attach(QSharedMemory::ReadWrite))
+    {
+        if(error)
+            *error=QString("cannot attach %1: %2").arg(_segment.key(), _segment.errorString());
+        return false;
+    }
+    std::vector<Account> accounts{Account::builtIn()};
+    const QString accountsFile=Account::configPath();
+    if(QFile::exists(accountsFile))
+    {
+        try {
+            accounts=Account::load(accountsFile);
+        } catch (const AccountException &e) {
+            if(error)
+                *error=e.what();
+            return false;
+        }
+    }
+    _store.setAccounts(share(accounts, _shard, _shards));
+    qDebug() << __func__ << "shard" << _shard << "of" << _shards << "polls" << _store.accounts() << "accounts";
+    publish();
+    _store.start();
+    return true;
+}
+
+void ShardWorker::publish()
+{
+    if(_segment.write(_store))
+        return;
+    if(_segment.required()>quint64(_segment.capacity()))
+    {
+        qDebug() << __func__ << "shard" << _shard << "needs" << _segment.required() << "bytes, the segment has"
+                 << _segment.capacity();
+        QCoreApplication::exit(Supervisor::EXIT_RESIZE);
+        return;
+    }
+    qDebug() << __func__ << "cannot write" << _segment.key() << ":" << _segment.errorString();
+}
+
+}
@@ -0,0 +1,120 @@
+#ifndef SUPERVISOR_HPP
+#define SUPERVISOR_HPP
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QProcess>
+#include <QString>
+#include <QTimer>
+
+#include <memory>
+#include <vector>
+
+#include "account.hpp"
+#include "fleetsegment.hpp"
+#include "fleetstore.hpp"
+
+namespace InfoBeamer {
+
+class ApiClient;
+
+/*!
+ * \brief The Supervisor class
+ * Polls the accounts of Account::configPath() in several worker processes instead of one event loop: worker n of N
+ * polls every N-th account (ShardWorker) and writes its devices to its own FleetSegment, which the supervisor creates
+ * and names in a FleetSegmentDirectory under the prefix.  Any one process can then read the whole fleet in place
+ * through a SharedFleetReader.
+ *
+ * Workers run this same executable with --worker.  One that crashes or exits is started again after a backoff that
+ * doubles up to MAX_BACKOFF_MS and starts over once a worker stays up for STABLE_MS; the other workers and their
+ * segments are not affected.  A worker whose fleet outgrew its segment exits with EXIT_RESIZE and is started right
+ * away on a segment twice the size it needed.  If that segment cannot be created the worker is not started again,
+ * since it would only outgrow the old one once more; workerFailed() reports it.
+ */
+class Supervisor : public QObject
+{
+    Q_OBJECT
+public:
+    static const int EXIT_RESIZE=3;
+    static const int MIN_BACKOFF_MS=1000;
+    static const int MAX_BACKOFF_MS=60*1000;
+    static const int STABLE_MS=60*1000;
+    static const qint64 DEFAULT_SEGMENT_BYTES=16*1024*1024;
+
+    static QString defaultPrefix() {return "infobeamer-fleet";}
+
+    Supervisor(const QString &prefix, int workers, QObject *parent=nullptr);
+    ~Supervisor();
+
+    void setSegmentBytes(qint64 bytes) {_segmentBytes=bytes;}
+
+    //! Creates the directory and the segments and starts every worker
+    bool start(QString *error=nullptr);
+    //! Terminates the workers; their segments go away with the supervisor
+    void stop();
+
+    int workers() const {return int(_workers.size());}
+    int restarts(int shard) const {return _workers[size_t(shard)].restarts;}
+
+signals:
+    void workerStarted(int shard, qint64 pid);
+    void workerExited(int shard, int exitCode, bool crashed);
+    //! \a shard is not started again, see EXIT_RESIZE
+    void workerFailed(int shard, const QString &error);
+
+private:
+    struct Worker
+    {
+        QProcess                       *process=nullptr;
+        std::unique_ptr<FleetSegment>   segment;
+        int                             epoch=0;
+        int                             restarts=0;
+        int                             backoffMs=MIN_BACKOFF_MS;
+        QElapsedTimer                   up;
+    };
+
+    bool createSegment(int shard, int epoch, qint64 bytes, QString *error=nullptr);
+    void launch(int shard);
+    void exited(int shard, int exitCode, QProcess::ExitStatus status);
+
+    QString                 _prefix;
+    FleetSegmentDirectory   _directory;
+    std::vector<Worker>     _workers;
+    qint64                  _segmentBytes=DEFAULT_SEGMENT_BYTES;
+    bool                    _stopping=false;
+};
+
+/*!
+ * \brief The ShardWorker class
+ * The poller in a worker process: polls its share of the accounts with a FleetStore and writes the devices to its
+ * segment after every change.
+ */
+class ShardWorker : public QObject
+{
+    Q_OBJECT
+public:
+    //! Changes within this many ms are written together
+    static const int PUBLISH_DELAY_MS=200;
+
+    ShardWorker(ApiClient *api, int shard, int shards, const QString &segmentKey, QObject *parent=nullptr);
+
+    //! Attaches the segment, loads the accounts and starts polling
+    bool start(QString *error=nullptr);
+
+    //! Accounts \a shard of \a shards polls: every shards-th one, starting at \a shard
+    static std::vector<Account> share(const std::vector<Account> &accounts, int shard, int shards);
+
+private slots:
+    void publish();
+
+private:
+    FleetStore      _store;
+    FleetSegment    _segment;
+    QTimer          _publish;
+    int             _shard;
+    int             _shards;
+};
+
+}
+
+#endif // SUPERVISOR_HPP